@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Benchmarks.h"
+#include "../Tools/KDForest.h"
+#include "../Tools/Matcher.h"
+#include "../Tools/ThreadPool.h"
+
+using namespace std;
+
+/**
+ * Build queries as noisy copies of train descriptors so every query has a meaningful nearest neighbour
+ *
+ * @param train Indexed descriptors
+ * @param count Number of queries
+ * @param rng Random source
+ * @param query Receives the queries
+ * @return void
+ */
+static void buildQueries(const DescriptorSet &train, int count, mt19937 &rng, DescriptorSet &query) {
+    uniform_int_distribution<int> pick(0, (int) train.size() - 1);
+    normal_distribution<float> noise(0.0f, 0.02f);
+    float d[DescriptorSet::DESCRIPTOR_SIZE];
+
+    for (int n = 0; n < count; n++) {
+        const float *source = train.getDescriptor(pick(rng));
+
+        for (int k = 0; k < DescriptorSet::DESCRIPTOR_SIZE; k++) {
+            float v = source[k] + noise(rng);
+            d[k] = (v > 0) ? v : 0;
+        }
+
+        query.add((float) n, (float) n, 1.0f, d);
+    }
+}
+
+/**
+ * Fraction of the exact two nearest neighbours that the approximate search also returned
+ *
+ * @param exact Exact neighbours
+ * @param approximate Approximate neighbours
+ * @return double
+ */
+static double recallAtTwo(const vector<TopTwoMatch> &exact, const vector<TopTwoMatch> &approximate) {
+    double found = 0;
+    double total = 0;
+
+    for (size_t q = 0; q < exact.size(); q++) {
+        int truth[2] = {exact[q].bestIndex, exact[q].secondIndex};
+        for (int t = 0; t < 2; t++) {
+            if (truth[t] < 0) {
+                continue;
+            }
+            total++;
+            if (approximate[q].bestIndex == truth[t] || approximate[q].secondIndex == truth[t]) {
+                found++;
+            }
+        }
+    }
+
+    return (total > 0) ? found / total : 1.0;
+}
+
+/**
+ * Fraction of queries whose approximate nearest neighbour is the exact one
+ *
+ * @param exact Exact neighbours
+ * @param approximate Approximate neighbours
+ * @return double
+ */
+static double recallAtOne(const vector<TopTwoMatch> &exact, const vector<TopTwoMatch> &approximate) {
+    double found = 0;
+
+    for (size_t q = 0; q < exact.size(); q++) {
+        found += (approximate[q].bestIndex == exact[q].bestIndex) ? 1 : 0;
+    }
+
+    return exact.empty() ? 1.0 : found / exact.size();
+}
+
+/**
+ * Sweep k-d forest tree counts and check budgets against the exact blocked matcher, single threaded
+ *
+ * @param argc Remaining argument count
+ * @param argv [train] [queries]
+ * @return int
+ */
+int runAnnBenchmark(int argc, char **argv) {
+    int trainCount = (argc > 0) ? atoi(argv[0]) : 20000;
+    int queryCount = (argc > 1) ? atoi(argv[1]) : 2000;
+    const int TREES[] = {1, 4, 8};
+    const int CHECKS[] = {32, 64, 128, 256, 512, 1024, 2048};
+    mt19937 rng(498);
+    DescriptorSet train, query;
+    ThreadPool pool(1);
+
+    buildRandomDescriptors(trainCount, rng, nullptr, train);
+    buildQueries(train, queryCount, rng, query);
+
+    Matcher exactMatcher = Matcher(4.0f, 1.0f, false, &pool);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<TopTwoMatch> exact = exactMatcher.nearestNeighbours(query, train);
+    double exactMs = elapsedMilliseconds(start);
+
+    printf("%-8s %-8s %10s %12s %10s %10s %10s\n", "trees", "checks", "build ms", "queries/s", "recall@1", "recall@2",
+           "speedup");
+    printf("%-8s %-8s %10s %12.0f %10.4f %10.4f %10.2f\n", "exact", "-", "-", queryCount / (exactMs / 1000.0), 1.0, 1.0,
+           1.0);
+
+    for (int trees : TREES) {
+        KDForest index = KDForest(trees);
+        start = chrono::steady_clock::now();
+        index.build(train);
+        double buildMs = elapsedMilliseconds(start);
+
+        for (int checks : CHECKS) {
+            index.setMaxChecks(checks);
+            start = chrono::steady_clock::now();
+            vector<TopTwoMatch> approximate = index.search(query, &pool);
+            double ms = elapsedMilliseconds(start);
+
+            printf("%-8d %-8d %10.1f %12.0f %10.4f %10.4f %10.2f\n", trees, checks, buildMs,
+                   queryCount / (ms / 1000.0), recallAtOne(exact, approximate), recallAtTwo(exact, approximate),
+                   exactMs / ms);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../FeatureMatching/FeatureDetector_498.h"
+#include "../Tools/Profiler.h"
+#include "../Tools/ScratchArena.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Detect and describe one image repeatedly, as a batch of jobs would
+ *
+ * @param file Image to process
+ * @param repeats Number of jobs
+ * @return double Milliseconds taken
+ */
+static double detectRepeatedly(const string &file, int repeats) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int r = 0; r < repeats; r++) {
+        ScratchArena::Scope job;
+        FeatureDetector_498 fd = FeatureDetector_498(file);
+        fd.setMode(FeatureDetector_498::TILED);
+        fd.setOctaves(3);
+        fd.detectFeatures();
+        fd.describeFeatures();
+    }
+
+    return elapsedMilliseconds(start);
+}
+
+/**
+ * Detection with scratch planes and vectors taken from the per-thread arenas against one heap allocation per request,
+ * reporting allocations per second and peak memory. The peak resident set size is process wide and never falls, so
+ * the heap run goes first and the arena run can only show it unchanged or higher.
+ *
+ * @param argc Remaining argument count
+ * @param argv [image] [repeats]
+ * @return int 0
+ */
+int runArenaBenchmark(int argc, char **argv) {
+    string file = (argc > 0) ? argv[0] : "images/rainier/Rainier1.png";
+    int repeats = (argc > 1) ? max(atoi(argv[1]), 1) : 10;
+    const bool ENABLED[] = {false, true};
+
+    // Warm up with the arenas off, a warm arena keeps its merged block and would already count in the heap run's RSS
+    Profiler::setEnabled(true);
+    ScratchArena::setEnabled(false);
+    detectRepeatedly(file, 1);
+
+    printf("%-7s %10s %12s %12s %14s %12s %12s\n", "scratch", "ms", "requests", "heap allocs", "heap allocs/s",
+           "arena MiB", "peak RSS MiB");
+    for (bool enabled : ENABLED) {
+        ScratchArena::setEnabled(enabled);
+        Profiler::reset();
+
+        double ms = detectRepeatedly(file, repeats);
+        long long requests = Profiler::counter("arena.requests").getTotal();
+        long long allocations = Profiler::counter("arena.heap_allocations").getTotal();
+
+        printf("%-7s %10.2f %12lld %12lld %14.0f %12.2f %12.2f\n", enabled ? "arena" : "heap", ms, requests,
+               allocations, allocations / (max(ms, 1e-3) / 1000.0),
+               Profiler::peak("arena.peak_bytes").getValue() / (1024.0 * 1024.0),
+               Profiler::peakResidentBytes() / (1024.0 * 1024.0));
+    }
+
+    ScratchArena::setEnabled(true);
+    Profiler::setEnabled(false);
+    return 0;
+}
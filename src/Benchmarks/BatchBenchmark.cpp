@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "../ImageStitching/BatchPipeline.h"
+
+using namespace std;
+
+/**
+ * Run a manifest once with every job going through all stages before the next starts, and once with the stages
+ * pipelined, and print the wall time and per-stage busy time of both
+ *
+ * @param argc Remaining argument count
+ * @param argv [manifest]
+ * @return int
+ */
+int runBatchBenchmark(int argc, char **argv) {
+    string manifest = (argc >= 1) ? argv[0] : "images/manifest.txt";
+    vector<BatchPipeline::Job> jobs;
+    string error;
+
+    if (!BatchPipeline::readManifest(manifest, jobs, error)) {
+        printf("%s\n", error.c_str());
+        return 1;
+    }
+
+    printf("%-12s %10s %8s", "mode", "wall ms", "failed");
+    for (const char *stage : {"decode", "detect", "match", "composite", "encode"}) {
+        printf(" %12s", stage);
+    }
+    printf("\n");
+
+    for (bool pipelined : {false, true}) {
+        BatchPipeline pipeline = BatchPipeline();
+        pipeline.setPipelined(pipelined);
+
+        // The JSON lines are kept out of the table
+        ostringstream log;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        int failed = pipeline.run(jobs, log);
+        double wall = elapsedMilliseconds(start);
+
+        printf("%-12s %10.1f %8d", pipelined ? "pipelined" : "sequential", wall, failed);
+        for (const BatchPipeline::StageStats &stage : pipeline.getStats()) {
+            printf(" %12.1f", stage.milliseconds);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
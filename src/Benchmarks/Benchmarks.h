@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include "../FeatureMatching/SIFT/SIFTDescriptor.h"
+#include "../FeatureMatching/DescriptorSet.h"
+
+int runMatcherBenchmark(int argc, char **argv);
+int runAnnBenchmark(int argc, char **argv);
+int runRansacBenchmark(int argc, char **argv);
+int runRefineBenchmark(int argc, char **argv);
+int runWarpBenchmark(int argc, char **argv);
+int runBlendBenchmark(int argc, char **argv);
+int runHarrisBenchmark(int argc, char **argv);
+int runDetectBenchmark(int argc, char **argv);
+int runSuppressionBenchmark(int argc, char **argv);
+int runPyramidBenchmark(int argc, char **argv);
+int runDescriptorBenchmark(int argc, char **argv);
+int runBinaryBenchmark(int argc, char **argv);
+int runStreamBenchmark(int argc, char **argv);
+int runBatchBenchmark(int argc, char **argv);
+int runSuiteBenchmark(int argc, char **argv);
+int runArenaBenchmark(int argc, char **argv);
+void buildRandomDescriptors(int count, std::mt19937 &rng, std::vector<SIFTDescriptor> *legacy, DescriptorSet &set);
+void buildCorrespondences(int count, double inlierRatio, std::mt19937 &rng, std::vector<float> &src,
+                          std::vector<float> &dst, std::vector<float> *quality = nullptr);
+
+/**
+ * Milliseconds elapsed since start
+ *
+ * @param start Time point taken with std::chrono::steady_clock::now()
+ * @return double
+ */
+inline double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Benchmarks.h"
+#include "../FeatureMatching/FeatureDetector_498.h"
+#include "../ImageStitching/RansacEngine.h"
+#include "../Tools/Matcher.h"
+
+using namespace std;
+
+/**
+ * Describe one image pair with a descriptor type, match it and count the homography inliers among the matches
+ *
+ * @param name Label of the pair
+ * @param detector1 Detector of the first image, features already detected
+ * @param detector2 Detector of the second image, features already detected
+ * @param type Descriptor to describe with
+ * @return void
+ */
+static void comparePair(const string &name, FeatureDetector_498 &detector1, FeatureDetector_498 &detector2,
+                        DescriptorSet::Type type) {
+    // Panorama's matching settings
+    const float DISTANCE_THRESHOLD = 1.0f;
+    const float RATIO_THRESHOLD = 0.36f;
+    const float INLIER_THRESHOLD = 15.0f;
+    Matcher matcher = Matcher(DISTANCE_THRESHOLD, RATIO_THRESHOLD, true);
+
+    detector1.setDescriptorType(type);
+    detector2.setDescriptorType(type);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    DescriptorSet f1 = detector1.describeFeatures();
+    DescriptorSet f2 = detector2.describeFeatures();
+    double describeMs = elapsedMilliseconds(start);
+
+    start = chrono::steady_clock::now();
+    vector<Match> matches = matcher.match(f1, f2);
+    double matchMs = elapsedMilliseconds(start);
+
+    int count = (int) matches.size();
+    int inliers = 0;
+    if (count >= 4) {
+        vector<float> src(2 * count), dst(2 * count);
+        for (int m = 0; m < count; m++) {
+            src[2 * m] = f1.getCol(matches[m].getIndex1());
+            src[2 * m + 1] = f1.getRow(matches[m].getIndex1());
+            dst[2 * m] = f2.getCol(matches[m].getIndex2());
+            dst[2 * m + 1] = f2.getRow(matches[m].getIndex2());
+        }
+
+        vector<int> order = Matcher::qualityOrder(matches);
+        RansacEngine engine = RansacEngine(INLIER_THRESHOLD, 2000);
+        engine.setSampling(RansacEngine::PROSAC);
+        double H[9];
+        inliers = max(engine.estimate(src.data(), dst.data(), count, H, order.data()), 0);
+    }
+
+    printf("%-12s %-8s %10zu %12.2f %10.2f %8d %8d %8.1f%%\n", name.c_str(),
+           type == DescriptorSet::BRIEF ? "brief" : "sift", f1.size() + f2.size(), describeMs, matchMs, count, inliers,
+           100.0 * inliers / (count > 0 ? count : 1));
+}
+
+/**
+ * Histogram descriptors with SSD matching against steered BRIEF with Hamming matching on the bundled image pairs. Both
+ * describe the same keypoints; match quality is the share of matches consistent with the RANSAC homography.
+ *
+ * @param argc Remaining argument count
+ * @param argv [image1 image2]
+ * @return int
+ */
+int runBinaryBenchmark(int argc, char **argv) {
+    vector<pair<string, string> > pairs;
+    if (argc >= 2) {
+        pairs.push_back(make_pair(string(argv[0]), string(argv[1])));
+    }
+    else {
+        pairs.push_back(make_pair(string("images/rainier/Rainier1.png"), string("images/rainier/Rainier2.png")));
+        pairs.push_back(make_pair(string("images/yosemite/Yosemite1.jpg"), string("images/yosemite/Yosemite2.jpg")));
+        pairs.push_back(make_pair(string("images/graf/img1.ppm"), string("images/graf/img2.ppm")));
+    }
+
+    printf("%-12s %-8s %10s %12s %10s %8s %8s %9s\n", "pair", "type", "keypoints", "describe ms", "match ms",
+           "matches", "inliers", "inlier %");
+
+    for (const pair<string, string> &files : pairs) {
+        FeatureDetector_498 detector1 = FeatureDetector_498(files.first);
+        FeatureDetector_498 detector2 = FeatureDetector_498(files.second);
+        detector1.detectFeatures();
+        detector2.detectFeatures();
+
+        string name = files.first.substr(files.first.find_last_of('/') + 1);
+        comparePair(name, detector1, detector2, DescriptorSet::SIFT);
+        comparePair(name, detector1, detector2, DescriptorSet::BRIEF);
+    }
+
+    return 0;
+}
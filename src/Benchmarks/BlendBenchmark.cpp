@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/Blender.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Largest per-channel difference between a multi-band blend made tile by tile and the same blend made as one tile. The
+ * overlap is wider and taller than a tile and starts at an odd column, so the seam crosses tile borders.
+ *
+ * @param bands Pyramid levels
+ * @return int Largest difference in gray levels
+ */
+static int tilingDifference(int bands) {
+    const int SIZE = 1500, OVERLAP = 1100, OFFSET = 401;
+    Mat first = Mat(SIZE, SIZE, CV_8UC3), second = Mat(SIZE, SIZE, CV_8UC3);
+    Mat frameMask = Mat(SIZE, SIZE, CV_8U, Scalar(255));
+    Mat outputs[2];
+
+    randu(first, Scalar::all(0), Scalar::all(255));
+    randu(second, Scalar::all(0), Scalar::all(255));
+
+    for (int untiled = 0; untiled < 2; untiled++) {
+        Blender blender = Blender(Blender::MULTIBAND, bands);
+        Mat canvas = Mat::zeros(SIZE, OFFSET + 2 * SIZE - OVERLAP, CV_8UC3);
+        Mat canvasMask = Mat::zeros(canvas.size(), CV_8U);
+
+        if (untiled) {
+            blender.setTileSize(canvas.cols);
+        }
+        first.copyTo(canvas(Rect(OFFSET, 0, SIZE, SIZE)));
+        canvasMask(Rect(OFFSET, 0, SIZE, SIZE)).setTo(Scalar(255));
+        blender.blend(canvas, canvasMask, second, frameMask, Point(OFFSET + SIZE - OVERLAP, 0));
+        outputs[untiled] = canvas;
+    }
+
+    return (int) norm(outputs[0], outputs[1], NORM_INF);
+}
+
+/**
+ * Blend two overlapping synthetic frames with feathering and with every multi-band depth, reporting wall time, the
+ * peak float working set against a whole-canvas float buffer, and the per-band cost of each multi-band run. Then check
+ * that tiling does not change a multi-band blend; the result is 1 if any depth differs by more than rounding.
+ *
+ * @param argc Remaining argument count
+ * @param argv [width] [height] [overlap]
+ * @return int
+ */
+int runBlendBenchmark(int argc, char **argv) {
+    int width = (argc > 0) ? atoi(argv[0]) : 2000;
+    int height = (argc > 1) ? atoi(argv[1]) : 1500;
+    int overlapWidth = (argc > 2) ? atoi(argv[2]) : width / 4;
+    const int MAX_BANDS = 7;
+    int canvasWidth = 2 * width - overlapWidth;
+    Mat first = Mat(height, width, CV_8UC3), second = Mat(height, width, CV_8UC3);
+    Mat frameMask = Mat(height, width, CV_8U, Scalar(255));
+    double canvasFloatMB = (double) canvasWidth * height * 3 * sizeof(float) / (1024.0 * 1024.0);
+
+    randu(first, Scalar::all(0), Scalar::all(255));
+    randu(second, Scalar::all(0), Scalar::all(255));
+
+    printf("canvas %dx%d, overlap %dx%d, whole-canvas float buffer %.1f MB\n\n", canvasWidth, height, overlapWidth,
+           height, canvasFloatMB);
+    printf("%-10s %6s %10s %10s\n", "mode", "bands", "ms", "peak MB");
+
+    for (int bands = 0; bands <= MAX_BANDS; bands++) {
+        Blender blender = (bands == 0) ? Blender(Blender::FEATHER) : Blender(Blender::MULTIBAND, bands);
+        Mat canvas = Mat::zeros(height, canvasWidth, CV_8UC3);
+        Mat canvasMask = Mat::zeros(height, canvasWidth, CV_8U);
+
+        first.copyTo(canvas(Rect(0, 0, width, height)));
+        canvasMask(Rect(0, 0, width, height)).setTo(Scalar(255));
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        blender.blend(canvas, canvasMask, second, frameMask, Point(width - overlapWidth, 0));
+        double ms = elapsedMilliseconds(start);
+
+        printf("%-10s %6d %10.2f %10.2f\n", (bands == 0) ? "feather" : "multiband", bands, ms,
+               blender.getPeakBytes() / (1024.0 * 1024.0));
+
+        if (bands > 0) {
+            for (const Blender::BandStats &s : blender.getStats()) {
+                printf("%17s level %d: %10lld px %10.2f ms %10.2f MB per tile\n", "", s.level, s.pixels,
+                       s.milliseconds, s.bytes / (1024.0 * 1024.0));
+            }
+        }
+    }
+
+    int mismatches = 0;
+    printf("\n%-10s %6s %10s\n", "tiling", "bands", "max diff");
+    for (int bands = 1; bands <= MAX_BANDS; bands++) {
+        int difference = tilingDifference(bands);
+        mismatches += (difference > 1) ? 1 : 0;
+        printf("%-10s %6d %10d\n", (difference > 1) ? "MISMATCH" : "ok", bands, difference);
+    }
+
+    return (mismatches > 0) ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "Benchmarks.h"
+#include "../FeatureMatching/SIFT/DescriptorBuilder.h"
+
+using namespace std;
+
+/**
+ * Per-object SIFTDescriptor histograms against one DescriptorBuilder batch over the same synthetic derivative windows,
+ * plus the worst error of the polynomial atan2
+ *
+ * @param argc Remaining argument count
+ * @param argv [descriptors]
+ * @return int
+ */
+int runDescriptorBenchmark(int argc, char **argv) {
+    const int WINDOW = DescriptorBuilder::WINDOW_SIZE;
+    const int PIXELS = DescriptorBuilder::WINDOW_PIXELS;
+    const int CELL = DescriptorBuilder::CELL_SIZE;
+    const int ANGLE_SAMPLES = 1000000;
+    int count = (argc > 0) ? atoi(argv[0]) : 20000;
+    mt19937 rng(498);
+    uniform_real_distribution<float> angle(0.0f, 2.0f * (float) M_PI);
+    uniform_real_distribution<float> magnitude(0.0f, 0.3f);
+    normal_distribution<float> noise(0.0f, 0.05f);
+    vector<float> windowsX((size_t) count * PIXELS);
+    vector<float> windowsY((size_t) count * PIXELS);
+
+    // One dominant orientation per cell plus noise, as in buildRandomDescriptors
+    for (int n = 0; n < count; n++) {
+        float *x = windowsX.data() + (size_t) n * PIXELS;
+        float *y = windowsY.data() + (size_t) n * PIXELS;
+
+        for (int ci = 0; ci < WINDOW; ci += CELL) {
+            for (int cj = 0; cj < WINDOW; cj += CELL) {
+                float theta = angle(rng);
+                float m = magnitude(rng);
+
+                for (int i = ci; i < ci + CELL; i++) {
+                    for (int j = cj; j < cj + CELL; j++) {
+                        x[i * WINDOW + j] = m * cos(theta) + noise(rng);
+                        y[i * WINDOW + j] = m * sin(theta) + noise(rng);
+                    }
+                }
+            }
+        }
+    }
+
+    // Baseline: one SIFTDescriptor per keypoint, normalized by DescriptorSet::add
+    DescriptorSet legacy;
+    legacy.reserve(count);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int n = 0; n < count; n++) {
+        SIFTDescriptor d = SIFTDescriptor(n, n);
+        d.generateHistograms(reinterpret_cast<const float (*)[WINDOW]>(windowsX.data() + (size_t) n * PIXELS),
+                             reinterpret_cast<const float (*)[WINDOW]>(windowsY.data() + (size_t) n * PIXELS));
+        legacy.add((float) n, (float) n, 1.0f, d.getBins());
+    }
+    double baseline = elapsedMilliseconds(start);
+
+    vector<float> batch((size_t) count * DescriptorBuilder::DESCRIPTOR_SIZE);
+    start = chrono::steady_clock::now();
+    DescriptorBuilder::build(windowsX.data(), windowsY.data(), count, batch.data());
+    double batched = elapsedMilliseconds(start);
+
+    // Worst angle error over the whole circle, radii spread over the range of Harris derivatives
+    double worst = 0;
+    for (int s = 0; s < ANGLE_SAMPLES; s++) {
+        float theta = angle(rng);
+        float m = magnitude(rng) + 1e-3f;
+        float x = m * cos(theta);
+        float y = m * sin(theta);
+        double exact = atan2((double) y, (double) x);
+        double error = fabs(DescriptorBuilder::polarAngle(y, x) - ((exact < 0) ? exact + 2 * M_PI : exact));
+        worst = max(worst, min(error, 2 * M_PI - error));
+    }
+
+    printf("%-18s %12s %16s %9s\n", "path", "ms", "descriptors/s", "speedup");
+    printf("%-18s %12.2f %16.0f %9.2f\n", "SIFTDescriptor", baseline, count / (baseline / 1000.0), 1.0);
+    printf("%-18s %12.2f %16.0f %9.2f\n", "DescriptorBuilder", batched, count / (batched / 1000.0),
+           baseline / batched);
+    printf("polynomial atan2 worst error: %.2e rad\n", worst);
+
+    return 0;
+}
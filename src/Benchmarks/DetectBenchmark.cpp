@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../FeatureMatching/FeatureDetector_498.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Detect and describe one image in one of the detector's modes
+ *
+ * @param file Image to process
+ * @param mode Detection mode
+ * @param marked Receives the image with interest points circled
+ * @param descriptors Receives the descriptors
+ * @return double Milliseconds taken
+ */
+static double detect(const string &file, FeatureDetector_498::Mode mode, Mat &marked, DescriptorSet &descriptors) {
+    FeatureDetector_498 fd = FeatureDetector_498(file);
+    fd.setMode(mode);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    marked = fd.detectFeatures();
+    descriptors = fd.describeFeatures();
+    return elapsedMilliseconds(start);
+}
+
+/**
+ * Whether two detections produced the same marked image and the same descriptors in the same order
+ *
+ * @return bool
+ */
+static bool identical(const Mat &imageA, const DescriptorSet &a, const Mat &imageB, const DescriptorSet &b) {
+    size_t count = a.size();
+
+    return count == b.size() && norm(imageA, imageB, NORM_INF) == 0 &&
+           memcmp(a.getRows(), b.getRows(), count * sizeof(float)) == 0 &&
+           memcmp(a.getCols(), b.getCols(), count * sizeof(float)) == 0 &&
+           memcmp(a.getResponses(), b.getResponses(), count * sizeof(float)) == 0 &&
+           memcmp(a.getDescriptors(), b.getDescriptors(), count * DescriptorSet::DESCRIPTOR_SIZE * sizeof(float)) == 0;
+}
+
+/**
+ * Whole-image detection against the tiled and low-memory modes, reporting time and whether they produce the same
+ * output
+ *
+ * @param argc Remaining argument count
+ * @param argv [image]
+ * @return int 0 when every mode agrees with the whole-image path
+ */
+int runDetectBenchmark(int argc, char **argv) {
+    const int REPEATS = 3;
+    const char *NAMES[] = {"whole", "tiled", "low-mem"};
+    string file = (argc > 0) ? argv[0] : "images/rainier/Rainier1.png";
+    Mat marked[3];
+    DescriptorSet descriptors[3];
+    double ms[3] = {1e30, 1e30, 1e30};
+    bool agree = true;
+
+    for (int r = 0; r < REPEATS; r++) {
+        for (int m = 0; m < 3; m++) {
+            ms[m] = min(ms[m], detect(file, (FeatureDetector_498::Mode) m, marked[m], descriptors[m]));
+        }
+    }
+
+    double pixels = (double) marked[0].total();
+
+    printf("%-8s %10s %14s %10s %10s %10s\n", "mode", "ms", "Mpixels/s", "features", "speedup", "output");
+    for (int m = 0; m < 3; m++) {
+        bool same = identical(marked[0], descriptors[0], marked[m], descriptors[m]);
+        agree = agree && same;
+
+        printf("%-8s %10.2f %14.1f %10zu %10.2f %10s\n", NAMES[m], ms[m], pixels / (ms[m] * 1000.0),
+               descriptors[m].size(), ms[0] / ms[m], same ? "identical" : "DIFFERS");
+    }
+
+    return agree ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../FeatureMatching/HarrisKernel.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * The multi-pass response HarrisKernel replaced: two filter2D calls, a product pass, three GaussianBlurs and a
+ * response pass, all through at<float>
+ *
+ * @param gray CV_32F image
+ * @param threshold Responses at or below this become 0
+ * @return Mat
+ */
+static Mat legacyHarris(const Mat &gray, float threshold) {
+    float sobelFilter[] = {
+            1.0/6, 0, -1.0/6,
+            2.0/6, 0, -2.0/6,
+            1.0/6, 0, -1.0/6
+    };
+    Mat s_v = Mat(3, 3, CV_32F, sobelFilter);
+    Mat s_h = s_v.t();
+    Mat Ix, Iy;
+
+    filter2D(gray, Ix, -1, s_h);
+    filter2D(gray, Iy, -1, s_v);
+
+    Mat Ixx = Mat::zeros(Ix.size(), CV_32F);
+    Mat Iyy = Mat::zeros(Iy.size(), CV_32F);
+    Mat Ixy = Mat::zeros(Ix.size(), CV_32F);
+    Mat corners = Mat::zeros(gray.size(), CV_32F);
+
+    for (int i = 0; i < gray.rows; i++) {
+        for (int j = 0; j < gray.cols; j++) {
+            float x = Ix.at<float>(i, j);
+            float y = Iy.at<float>(i, j);
+            Ixx.at<float>(i, j) = x * x;
+            Iyy.at<float>(i, j) = y * y;
+            Ixy.at<float>(i, j) = x * y;
+        }
+    }
+
+    GaussianBlur(Ixx, Ixx, Size(3, 3), 1);
+    GaussianBlur(Iyy, Iyy, Size(3, 3), 1);
+    GaussianBlur(Ixy, Ixy, Size(3, 3), 1);
+
+    for (int i = 0; i < gray.rows; i++) {
+        for (int j = 0; j < gray.cols; j++) {
+            float a = Ixx.at<float>(i, j);
+            float b = Ixy.at<float>(i, j);
+            float d = Iyy.at<float>(i, j);
+            float strength = (a + d == 0) ? 0 : (a * d - b * b) / (a + d);
+
+            if (strength > threshold) {
+                corners.at<float>(i, j) = strength;
+            }
+        }
+    }
+
+    return corners;
+}
+
+/**
+ * Multi-pass Harris against the fused kernel on an image file or a synthetic frame, reporting time and the largest
+ * response difference
+ *
+ * @param argc Remaining argument count
+ * @param argv [image] or [width] [height]
+ * @return int
+ */
+int runHarrisBenchmark(int argc, char **argv) {
+    const float THRESHOLD = 0.008f;
+    const int REPEATS = 5;
+    Mat gray;
+
+    if (argc == 1) {
+        cvtColor(imread(argv[0], IMREAD_COLOR), gray, COLOR_BGR2GRAY);
+    }
+    else {
+        int width = (argc > 0) ? atoi(argv[0]) : 4000;
+        int height = (argc > 1) ? atoi(argv[1]) : 3000;
+        gray = Mat(height, width, CV_8U);
+        randu(gray, Scalar::all(0), Scalar::all(255));
+        GaussianBlur(gray, gray, Size(5, 5), 1.5);
+    }
+    gray.convertTo(gray, CV_32F, 1. / 255);
+
+    Mat reference, fused, Ix, Iy;
+    double legacyMs = 1e30, fusedMs = 1e30;
+
+    for (int r = 0; r < REPEATS; r++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        reference = legacyHarris(gray, THRESHOLD);
+        legacyMs = min(legacyMs, elapsedMilliseconds(start));
+
+        start = chrono::steady_clock::now();
+        HarrisKernel::compute(gray, THRESHOLD, fused, &Ix, &Iy);
+        fusedMs = min(fusedMs, elapsedMilliseconds(start));
+    }
+
+    double difference = norm(reference, fused, NORM_INF);
+    double peak = norm(reference, NORM_INF);
+    double pixels = (double) gray.total();
+
+    printf("%-8s %10s %14s\n", "path", "ms", "Mpixels/s");
+    printf("%-8s %10.2f %14.1f\n", "legacy", legacyMs, pixels / (legacyMs * 1000.0));
+    printf("%-8s %10.2f %14.1f\n", "fused", fusedMs, pixels / (fusedMs * 1000.0));
+    printf("\nlargest response difference %g (largest response %g)\n", difference, peak);
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "Benchmarks.h"
+#include "../Tools/DistanceKernels.h"
+
+using namespace std;
+
+/**
+ * Compare the per-pair SIFTDescriptor::SSD path against the blocked kernels on every supported instruction set
+ *
+ * @param argc Remaining argument count
+ * @param argv [queries] [train]
+ * @return int
+ */
+int runMatcherBenchmark(int argc, char **argv) {
+    int queryCount = (argc > 0) ? atoi(argv[0]) : 2000;
+    int trainCount = (argc > 1) ? atoi(argv[1]) : queryCount;
+    mt19937 rng(498);
+    vector<SIFTDescriptor> legacyQuery, legacyTrain;
+    DescriptorSet query, train;
+
+    buildRandomDescriptors(queryCount, rng, &legacyQuery, query);
+    buildRandomDescriptors(trainCount, rng, &legacyTrain, train);
+    query.quantize();
+    train.quantize();
+
+    double pairs = (double) queryCount * trainCount;
+    vector<int> reference(queryCount, -1);
+
+    // Baseline: the original double loop over SIFTDescriptor::SSD
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int i = 0; i < queryCount; i++) {
+        double best = DBL_MAX;
+
+        for (int j = 0; j < trainCount; j++) {
+            double ssd = legacyTrain[j].SSD(legacyQuery[i]);
+            if (ssd < best) {
+                best = ssd;
+                reference[i] = j;
+            }
+        }
+    }
+    double baseline = elapsedMilliseconds(start);
+
+    printf("%-16s %-8s %12s %14s %9s %10s\n", "path", "type", "ms", "pairs/s", "speedup", "agreement");
+    printf("%-16s %-8s %12.2f %14.0f %9.2f %10s\n", "SIFTDescriptor", "double", baseline,
+           pairs / (baseline / 1000.0), 1.0, "-");
+
+    DistanceKernels::InstructionSet best = DistanceKernels::getBestSupported();
+    vector<TopTwoMatch> results(queryCount);
+
+    for (int s = DistanceKernels::SCALAR; s <= best; s++) {
+        DistanceKernels::InstructionSet set = (DistanceKernels::InstructionSet) s;
+        DistanceKernels::setInstructionSet(set);
+
+        for (int quantized = 0; quantized < 2; quantized++) {
+            start = chrono::steady_clock::now();
+            if (quantized) {
+                DistanceKernels::matchTopTwo(query.getQuantizedDescriptors(), query.size(),
+                                             train.getQuantizedDescriptors(), train.size(), results.data());
+            }
+            else {
+                DistanceKernels::matchTopTwo(query.getDescriptors(), query.size(),
+                                             train.getDescriptors(), train.size(), results.data());
+            }
+            double ms = elapsedMilliseconds(start);
+
+            // Normalization and quantization may reorder near ties, so report agreement rather than assert it
+            int agree = 0;
+            for (int i = 0; i < queryCount; i++) {
+                agree += (results[i].bestIndex == reference[i]) ? 1 : 0;
+            }
+
+            printf("%-16s %-8s %12.2f %14.0f %9.2f %9.1f%%\n", DistanceKernels::getInstructionSetName(set),
+                   quantized ? "uint8" : "float32", ms, pairs / (ms / 1000.0), baseline / ms,
+                   100.0 * agree / (queryCount > 0 ? queryCount : 1));
+        }
+    }
+
+    DistanceKernels::setInstructionSet(best);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/Panorama.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Align a set of images and print the verified pairs
+ *
+ * @param files Images to align
+ * @param octaves Pyramid octaves to detect on
+ * @param coarseToFine Whether pairs are estimated coarse-to-fine
+ * @return double Milliseconds taken by the alignment
+ */
+static double alignImages(const vector<string> &files, int octaves, bool coarseToFine) {
+    Panorama panorama = Panorama(files);
+    panorama.setOctaves(octaves);
+    panorama.setCoarseToFine(coarseToFine);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    panorama.align();
+    double ms = elapsedMilliseconds(start);
+
+    int inliers = 0;
+    for (const Panorama::Edge &e : panorama.getEdges()) {
+        inliers += e.inliers;
+    }
+
+    printf("%-8d %-8s %10.2f %8zu %10d\n", octaves, coarseToFine ? "yes" : "no", ms, panorama.getEdges().size(),
+           inliers);
+    return ms;
+}
+
+/**
+ * Single octave alignment against pyramid detection, with and without coarse-to-fine pair estimation
+ *
+ * @param argc Remaining argument count
+ * @param argv [images...]
+ * @return int
+ */
+int runPyramidBenchmark(int argc, char **argv) {
+    vector<string> files(argv, argv + argc);
+    if (files.empty()) {
+        files = {"images/graf/img1.ppm", "images/graf/img2.ppm", "images/graf/img4.ppm"};
+    }
+
+    printf("%-8s %-8s %10s %8s %10s\n", "octaves", "coarse", "ms", "pairs", "inliers");
+    alignImages(files, 1, false);
+    alignImages(files, 3, false);
+    alignImages(files, 3, true);
+
+    return 0;
+}
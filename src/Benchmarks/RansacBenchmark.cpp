@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/RansacEngine.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Synthetic correspondences: a fraction related by a fixed homography with pixel noise, the rest uniform outliers.
+ * The optional quality mimics a ratio test score, lower is better, and is only loosely correlated with correctness.
+ *
+ * @param count Number of correspondences
+ * @param inlierRatio Fraction of true correspondences
+ * @param rng Random source
+ * @param src Receives count points, interleaved x, y
+ * @param dst Receives count points, interleaved x, y
+ * @param quality Receives count scores if not null
+ * @return void
+ */
+void buildCorrespondences(int count, double inlierRatio, mt19937 &rng, vector<float> &src, vector<float> &dst,
+                          vector<float> *quality) {
+    const double H[9] = {0.9, 0.05, 30, -0.04, 1.1, -20, 1e-5, 2e-5, 1};
+    uniform_real_distribution<float> coordinate(0.0f, 800.0f);
+    uniform_real_distribution<double> coin(0.0, 1.0);
+    normal_distribution<float> noise(0.0f, 0.5f);
+
+    uniform_real_distribution<float> inlierQuality(0.0f, 0.7f);
+    uniform_real_distribution<float> outlierQuality(0.3f, 1.0f);
+
+    src.resize(2 * count);
+    dst.resize(2 * count);
+    if (quality != nullptr) {
+        quality->resize(count);
+    }
+
+    for (int i = 0; i < count; i++) {
+        float x = coordinate(rng), y = coordinate(rng);
+        src[2 * i] = x;
+        src[2 * i + 1] = y;
+
+        if (coin(rng) < inlierRatio) {
+            double w = H[6] * x + H[7] * y + H[8];
+            dst[2 * i] = (float) ((H[0] * x + H[1] * y + H[2]) / w) + noise(rng);
+            dst[2 * i + 1] = (float) ((H[3] * x + H[4] * y + H[5]) / w) + noise(rng);
+            if (quality != nullptr) {
+                (*quality)[i] = inlierQuality(rng);
+            }
+        }
+        else {
+            dst[2 * i] = coordinate(rng);
+            dst[2 * i + 1] = coordinate(rng);
+            if (quality != nullptr) {
+                (*quality)[i] = outlierQuality(rng);
+            }
+        }
+    }
+}
+
+/**
+ * The scoring path RansacEngine replaced: findHomography on four points and a cv::Mat product per projected point
+ *
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param count Number of correspondences
+ * @param iterations Hypotheses to score
+ * @param threshold Inlier distance
+ * @return int Best inlier count
+ */
+static int legacyRansac(const vector<float> &src, const vector<float> &dst, int count, int iterations,
+                        float threshold) {
+    int best = 0;
+
+    for (int i = 0; i < iterations; i++) {
+        vector<Point2f> a, b;
+        for (int j = 0; j < 4; j++) {
+            int m = rand() % count;
+            a.emplace_back(Point2f(src[2 * m], src[2 * m + 1]));
+            b.emplace_back(Point2f(dst[2 * m], dst[2 * m + 1]));
+        }
+
+        Mat H = findHomography(a, b, 0);
+        if (H.empty()) {
+            continue;
+        }
+
+        Mat projection;
+        H.convertTo(projection, CV_32F);
+        vector<int> inliers;
+
+        for (int k = 0; k < count; k++) {
+            Mat point = Mat::zeros(3, 1, CV_32F);
+            point.at<float>(0, 0) = src[2 * k];
+            point.at<float>(1, 0) = src[2 * k + 1];
+            point.at<float>(2, 0) = 1.0;
+            Mat result = projection * point;
+            float px = result.at<float>(0, 0) / result.at<float>(2, 0);
+            float py = result.at<float>(1, 0) / result.at<float>(2, 0);
+
+            if (sqrt(pow(px - dst[2 * k], 2) + pow(py - dst[2 * k + 1], 2)) <= threshold) {
+                inliers.push_back(k);
+            }
+        }
+
+        best = max(best, (int) inliers.size());
+    }
+
+    return best;
+}
+
+/**
+ * Every sampling and preemption combination of RansacEngine over a range of inlier ratios, averaged over several seeds
+ *
+ * @param count Number of correspondences
+ * @param threshold Inlier distance
+ * @return void
+ */
+static void compareStrategies(int count, float threshold) {
+    const double RATIOS[] = {0.1, 0.2, 0.3, 0.5};
+    const int SEEDS = 5;
+    const char *SAMPLING_NAMES[] = {"uniform", "prosac"};
+    const char *PREEMPTION_NAMES[] = {"none", "tdd", "sprt"};
+
+    printf("\n%-6s %-8s %-6s %12s %14s %10s %10s\n", "ratio", "sampling", "test", "hypotheses", "verifications",
+           "ms", "inliers");
+
+    for (double ratio : RATIOS) {
+        for (int sampling = RansacEngine::UNIFORM; sampling <= RansacEngine::PROSAC; sampling++) {
+            for (int preemption = RansacEngine::NONE; preemption <= RansacEngine::SPRT; preemption++) {
+                double hypotheses = 0, verifications = 0, ms = 0, inliers = 0;
+
+                for (int s = 0; s < SEEDS; s++) {
+                    mt19937 rng(498 + s);
+                    vector<float> src, dst, quality;
+                    vector<int> order(count);
+                    double H[9];
+
+                    buildCorrespondences(count, ratio, rng, src, dst, &quality);
+                    iota(order.begin(), order.end(), 0);
+                    stable_sort(order.begin(), order.end(), [&quality](int a, int b) {
+                        return quality[a] < quality[b];
+                    });
+
+                    RansacEngine engine = RansacEngine(threshold, 100000, 0.995, 498 + s);
+                    engine.setSampling((RansacEngine::Sampling) sampling);
+                    engine.setPreemption((RansacEngine::Preemption) preemption);
+
+                    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+                    inliers += engine.estimate(src.data(), dst.data(), count, H, order.data());
+                    ms += elapsedMilliseconds(start);
+                    hypotheses += engine.getIterations();
+                    verifications += (double) engine.getVerifications();
+                }
+
+                printf("%-6.2f %-8s %-6s %12.0f %14.0f %10.2f %10.1f\n", ratio, SAMPLING_NAMES[sampling],
+                       PREEMPTION_NAMES[preemption], hypotheses / SEEDS, verifications / SEEDS, ms / SEEDS,
+                       inliers / SEEDS);
+            }
+        }
+    }
+}
+
+/**
+ * Hypotheses per second of the legacy scoring path against RansacEngine at a fixed iteration count, the adaptive
+ * engine's iteration count and wall time, then the sampling and preemption strategies side by side
+ *
+ * @param argc Remaining argument count
+ * @param argv [matches] [inlier ratio]
+ * @return int
+ */
+int runRansacBenchmark(int argc, char **argv) {
+    int count = (argc > 0) ? atoi(argv[0]) : 1000;
+    double ratio = (argc > 1) ? atof(argv[1]) : 0.3;
+    const int FIXED_ITERATIONS = 500;
+    const float THRESHOLD = 3.0f;
+    mt19937 rng(498);
+    vector<float> src, dst;
+    double H[9];
+
+    buildCorrespondences(count, ratio, rng, src, dst);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int legacyBest = legacyRansac(src, dst, count, FIXED_ITERATIONS, THRESHOLD);
+    double legacyMs = elapsedMilliseconds(start);
+
+    // Confidence 1 disables the adaptive bound so both paths score the same number of hypotheses
+    RansacEngine fixed = RansacEngine(THRESHOLD, FIXED_ITERATIONS, 1.0);
+    start = chrono::steady_clock::now();
+    int fixedBest = fixed.estimate(src.data(), dst.data(), count, H);
+    double fixedMs = elapsedMilliseconds(start);
+
+    RansacEngine adaptive = RansacEngine(THRESHOLD, 100000, 0.995);
+    start = chrono::steady_clock::now();
+    int adaptiveBest = adaptive.estimate(src.data(), dst.data(), count, H);
+    double adaptiveMs = elapsedMilliseconds(start);
+
+    printf("%-10s %12s %10s %14s %10s\n", "path", "hypotheses", "ms", "hypotheses/s", "inliers");
+    printf("%-10s %12d %10.2f %14.0f %10d\n", "legacy", FIXED_ITERATIONS, legacyMs,
+           FIXED_ITERATIONS / (legacyMs / 1000.0), legacyBest);
+    printf("%-10s %12d %10.2f %14.0f %10d\n", "engine", fixed.getIterations(), fixedMs,
+           fixed.getIterations() / (fixedMs / 1000.0), fixedBest);
+    printf("%-10s %12d %10.2f %14.0f %10d\n", "adaptive", adaptive.getIterations(), adaptiveMs,
+           adaptive.getIterations() / (adaptiveMs / 1000.0), adaptiveBest);
+
+    compareStrategies(count, THRESHOLD);
+
+    return 0;
+}
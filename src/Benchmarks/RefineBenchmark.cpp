@@ -0,0 +1,259 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/BundleAdjuster.h"
+#include "../ImageStitching/HomographyRefiner.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Project a point through a row major homography
+ *
+ * @param H Homography
+ * @param x Horizontal position
+ * @param y Vertical position
+ * @param u Receives the projected horizontal position
+ * @param v Receives the projected vertical position
+ * @return void
+ */
+static void project(const double *H, double x, double y, double &u, double &v) {
+    double w = H[6] * x + H[7] * y + H[8];
+    u = (H[0] * x + H[1] * y + H[2]) / w;
+    v = (H[3] * x + H[4] * y + H[5]) / w;
+}
+
+/**
+ * RMS distance between the projections of two homographies over a grid covering the image, the error that shows as
+ * misalignment in the panorama
+ *
+ * @param H Estimate
+ * @param truth Ground truth
+ * @param width Image width
+ * @param height Image height
+ * @return double Pixels
+ */
+static double alignmentError(const double *H, const double *truth, int width, int height) {
+    const int STEPS = 10;
+    double sum = 0;
+
+    for (int i = 0; i <= STEPS; i++) {
+        for (int j = 0; j <= STEPS; j++) {
+            double x = (double) width * j / STEPS, y = (double) height * i / STEPS;
+            double u, v, tu, tv;
+            project(H, x, y, u, v);
+            project(truth, x, y, tu, tv);
+            sum += (u - tu) * (u - tu) + (v - tv) * (v - tv);
+        }
+    }
+
+    return sqrt(sum / ((STEPS + 1) * (STEPS + 1)));
+}
+
+/**
+ * Inlier sets of a RANSAC hypothesis: true correspondences with detector noise, on the pixel grid or not, plus a few
+ * mismatches that still fall inside the inlier threshold
+ *
+ * @param count Number of correspondences
+ * @param truth Homography relating them
+ * @param integer Round the positions to whole pixels, as integer corner locations are
+ * @param rng Random source
+ * @param src Receives count points, interleaved x, y
+ * @param dst Receives count points, interleaved x, y
+ * @return void
+ */
+static void buildInlierSet(int count, const double *truth, bool integer, mt19937 &rng, vector<float> &src,
+                           vector<float> &dst) {
+    const float MISMATCH_RATE = 0.05f;
+    const float MISMATCH_OFFSET = 10.0f;    // Within Panorama's inlier threshold of 15 pixels
+    uniform_real_distribution<float> coordinate(0.0f, 1000.0f);
+    uniform_real_distribution<float> offset(-MISMATCH_OFFSET, MISMATCH_OFFSET);
+    uniform_real_distribution<float> coin(0.0f, 1.0f);
+    normal_distribution<float> noise(0.0f, 0.3f);
+
+    src.resize(2 * count);
+    dst.resize(2 * count);
+    for (int i = 0; i < count; i++) {
+        double x = coordinate(rng), y = 0.8 * coordinate(rng), u, v;
+        project(truth, x, y, u, v);
+
+        float p[4] = {(float) x + noise(rng), (float) y + noise(rng), (float) u + noise(rng), (float) v + noise(rng)};
+        if (coin(rng) < MISMATCH_RATE) {
+            p[2] += offset(rng);
+            p[3] += offset(rng);
+        }
+        for (int k = 0; k < 4 && integer; k++) {
+            p[k] = round(p[k]);
+        }
+
+        src[2 * i] = p[0];
+        src[2 * i + 1] = p[1];
+        dst[2 * i] = p[2];
+        dst[2 * i + 1] = p[3];
+    }
+}
+
+/**
+ * Pairwise refinement: the least squares refit Panorama used to run over a RANSAC inlier set against
+ * HomographyRefiner, on integer and on subpixel keypoint positions
+ *
+ * @param count Correspondences per inlier set
+ * @param trials Inlier sets per row
+ * @return void
+ */
+static void comparePairwise(int count, int trials) {
+    const double TRUTH[9] = {0.9, 0.05, 30, -0.04, 1.1, -20, 1e-4, 2e-5, 1};
+    const double START_ERROR[9] = {1.005, 0, 3, 0, 0.995, -2, 2e-6, 0, 1};   // A good RANSAC hypothesis' error
+    mt19937 rng(498);
+
+    printf("%-10s %-10s %12s %12s %12s\n", "positions", "fit", "align px", "transfer px", "us/fit");
+    for (int integer = 1; integer >= 0; integer--) {
+        double leastSquaresError = 0, refinedError = 0, leastSquaresTransfer = 0, refinedTransfer = 0;
+        double leastSquaresMs = 0, refinedMs = 0;
+
+        for (int t = 0; t < trials; t++) {
+            vector<float> src, dst;
+            vector<Point2f> points1, points2;
+            buildInlierSet(count, TRUTH, integer != 0, rng, src, dst);
+            for (int i = 0; i < count; i++) {
+                points1.emplace_back(Point2f(src[2 * i], src[2 * i + 1]));
+                points2.emplace_back(Point2f(dst[2 * i], dst[2 * i + 1]));
+            }
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            Mat fitted = findHomography(points1, points2, 0);
+            leastSquaresMs += elapsedMilliseconds(start);
+            fitted.convertTo(fitted, CV_64F);
+            leastSquaresError += alignmentError(fitted.ptr<double>(), TRUTH, 1000, 800);
+            leastSquaresTransfer += HomographyRefiner::transferError(fitted.ptr<double>(), src.data(), dst.data(),
+                                                                     nullptr, count);
+
+            double H[9], M[9];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    M[r * 3 + c] = START_ERROR[r * 3] * TRUTH[c] + START_ERROR[r * 3 + 1] * TRUTH[3 + c] +
+                                   START_ERROR[r * 3 + 2] * TRUTH[6 + c];
+                }
+            }
+            for (int k = 0; k < 9; k++) {
+                H[k] = M[k] / M[8];
+            }
+
+            start = chrono::steady_clock::now();
+            HomographyRefiner::refine(src.data(), dst.data(), nullptr, count, H);
+            refinedMs += elapsedMilliseconds(start);
+            refinedError += alignmentError(H, TRUTH, 1000, 800);
+            refinedTransfer += HomographyRefiner::transferError(H, src.data(), dst.data(), nullptr, count);
+        }
+
+        const char *positions = integer ? "integer" : "subpixel";
+        printf("%-10s %-10s %12.3f %12.3f %12.1f\n", positions, "lsq", leastSquaresError / trials,
+               leastSquaresTransfer / trials, 1000.0 * leastSquaresMs / trials);
+        printf("%-10s %-10s %12.3f %12.3f %12.1f\n", positions, "lm-huber", refinedError / trials,
+               refinedTransfer / trials, 1000.0 * refinedMs / trials);
+    }
+}
+
+/**
+ * Bundle adjustment: a ring of images whose pairwise homographies are refined one pair at a time, chained along the
+ * ring from the reference, then adjusted together with the pair that closes the ring
+ *
+ * @param images Images in the ring
+ * @param count Correspondences per pair
+ * @return void
+ */
+static void compareBundle(int images, int count) {
+    const int SIDE = 600;
+    mt19937 rng(498);
+    uniform_real_distribution<float> coordinate(0.0f, (float) SIDE);
+    uniform_real_distribution<float> coin(0.0f, 1.0f);
+    normal_distribution<float> noise(0.0f, 0.5f);
+
+    // Image i into the reference frame, panning right with a slow roll and some perspective
+    vector<vector<double> > truth(images, vector<double>(9));
+    for (int i = 0; i < images; i++) {
+        double a = 0.02 * i;
+        double H[9] = {cos(a), -sin(a), 0.6 * SIDE * i, sin(a), cos(a), 10.0 * i, 2e-5 * i, -1e-5 * i, 1};
+        truth[i].assign(H, H + 9);
+    }
+
+    vector<vector<float> > points1(images), points2(images);
+    vector<BundleAdjuster::Pair> pairs;
+    for (int e = 0; e < images; e++) {
+        int a = e, b = (e + 1) % images;
+        double inverse[9];
+        HomographyRefiner::invert(truth[b].data(), inverse);
+
+        for (int k = 0; k < count; k++) {
+            double x = coordinate(rng), y = coordinate(rng), X, Y, u, v;
+            project(truth[a].data(), x, y, X, Y);
+            project(inverse, X, Y, u, v);
+            bool mismatch = coin(rng) < 0.05f;
+
+            points1[e].push_back((float) x + noise(rng));
+            points1[e].push_back((float) y + noise(rng));
+            points2[e].push_back((float) u + noise(rng) + (mismatch ? 8.0f : 0.0f));
+            points2[e].push_back((float) v + noise(rng));
+        }
+
+        BundleAdjuster::Pair pair = {a, b, points1[e].data(), points2[e].data(), count};
+        pairs.push_back(pair);
+    }
+
+    // Chain the refined pairwise homographies along the ring, leaving the closing pair out
+    vector<Mat> transforms(images);
+    transforms[0] = Mat::eye(3, 3, CV_64F);
+    for (int i = 1; i < images; i++) {
+        Mat t = Mat(3, 3, CV_64F, truth[i - 1].data()).clone();
+        Mat toPrevious = Mat(Mat(3, 3, CV_64F, truth[i].data()).inv() * t);
+        toPrevious = toPrevious / toPrevious.at<double>(2, 2);
+        HomographyRefiner::refine(points1[i - 1].data(), points2[i - 1].data(), nullptr, count,
+                                  toPrevious.ptr<double>());
+
+        Mat chained = transforms[i - 1] * toPrevious.inv();
+        transforms[i] = chained / chained.at<double>(2, 2);
+    }
+
+    auto error = [&]() {
+        double sum = 0;
+        for (int i = 0; i < images; i++) {
+            double e = alignmentError(transforms[i].ptr<double>(), truth[i].data(), SIDE, SIDE);
+            sum += e * e;
+        }
+        return sqrt(sum / images);
+    };
+
+    printf("\n%-10s %12s %12s %12s %10s\n", "transforms", "align px", "pair rms px", "ms", "steps");
+    double chainedError = error();
+
+    BundleAdjuster adjuster = BundleAdjuster();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    adjuster.adjust(pairs, transforms, 0);
+    double ms = elapsedMilliseconds(start);
+
+    printf("%-10s %12.3f %12.3f %12s %10s\n", "chained", chainedError, adjuster.getInitialError(), "-", "-");
+    printf("%-10s %12.3f %12.3f %12.2f %10d\n", "adjusted", error(), adjuster.getFinalError(), ms,
+           adjuster.getIterations());
+}
+
+/**
+ * Homography refinement accuracy and cost. Pairwise: ground truth alignment error and symmetric transfer error of the
+ * least squares refit against HomographyRefiner. Bundle: the same for a ring of images before and after adjustment.
+ *
+ * @param argc Remaining argument count
+ * @param argv [inliers] [images]
+ * @return int
+ */
+int runRefineBenchmark(int argc, char **argv) {
+    int count = (argc > 0) ? atoi(argv[0]) : 300;
+    int images = (argc > 1) ? atoi(argv[1]) : 8;
+
+    comparePairwise(count, 50);
+    compareBundle(images, count);
+
+    return 0;
+}
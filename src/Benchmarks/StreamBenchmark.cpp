@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/StreamingStitcher.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Feed frames to a StreamingStitcher and print the cost of every frame next to the size of the mosaic so far
+ *
+ * @param frames Frames in capture order
+ * @param backingFile Scratch file to keep the mosaic in, in memory if empty
+ * @param cacheTiles Tiles kept mapped when backed
+ * @return void
+ */
+static void streamFrames(const vector<Mat> &frames, const string &backingFile = "",
+                         size_t cacheTiles = TiledCanvas::DEFAULT_CACHE_TILES) {
+    StreamingStitcher stream = StreamingStitcher();
+    double total = 0, worst = 0;
+
+    if (!backingFile.empty() && !stream.setBackingFile(backingFile, cacheTiles)) {
+        printf("could not create %s, the mosaic stays in memory\n", backingFile.c_str());
+    }
+
+    printf("%-6s %-8s %-7s %8s %8s %10s %12s %7s %12s\n", "frame", "tracked", "guided", "matches", "inliers", "ms",
+           "mosaic", "tiles", "memory MiB");
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        StreamingStitcher::FrameResult r = stream.addFrame(frames[i]);
+        const Rect &bounds = stream.getCanvas().getBounds();
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", bounds.width, bounds.height);
+
+        printf("%-6zu %-8s %-7s %8d %8d %10.2f %12s %7zu %12.1f\n", i, r.tracked ? "yes" : "no",
+               r.guided ? "yes" : "no", r.matches, r.inliers, r.milliseconds, size, stream.getCanvas().getTileCount(),
+               stream.getCanvas().getBytes() / 1048576.0);
+        total += r.milliseconds;
+        worst = max(worst, r.milliseconds);
+    }
+
+    printf("mean %.2f ms, worst %.2f ms per frame\n\n", total / max((size_t) 1, frames.size()), worst);
+}
+
+/**
+ * Streaming stitching of a captured sequence, and of a long synthetic pan across one image so the mosaic keeps growing
+ * while the per-frame cost should not. The pan is run again with the mosaic in a backing file and a small tile cache,
+ * where the memory held by the mosaic stays flat as well.
+ *
+ * @param argc Remaining argument count
+ * @param argv [frames...]
+ * @return int 1 if a frame cannot be read
+ */
+int runStreamBenchmark(int argc, char **argv) {
+    const int PAN_FRAMES = 32;
+    const size_t PAN_CACHE_TILES = 32;
+    vector<string> files(argv, argv + argc);
+    if (files.empty()) {
+        files = {"images/rainier/Rainier1.png", "images/rainier/Rainier2.png", "images/rainier/Rainier3.png",
+                 "images/rainier/Rainier4.png"};
+    }
+
+    vector<Mat> frames;
+    for (const string &file : files) {
+        Mat frame = imread(file, IMREAD_COLOR);
+        if (frame.empty()) {
+            fprintf(stderr, "could not read %s\n", file.c_str());
+            return 1;
+        }
+        frames.push_back(frame);
+    }
+    printf("sequence of %zu frames\n", frames.size());
+    streamFrames(frames);
+
+    // Quarter width crops sliding left to right across the first frame, upscaled so the pan covers a wide mosaic
+    Mat scene;
+    resize(frames[0], scene, Size(), 3.0, 3.0, INTER_LINEAR);
+    int width = scene.cols / 4;
+    int height = scene.rows / 2;
+    vector<Mat> pan;
+    for (int i = 0; i < PAN_FRAMES; i++) {
+        int x = (scene.cols - width) * i / (PAN_FRAMES - 1);
+        pan.push_back(scene(Rect(x, scene.rows / 4, width, height)).clone());
+    }
+    printf("synthetic pan of %d frames\n", PAN_FRAMES);
+    streamFrames(pan);
+
+    printf("synthetic pan of %d frames, backed by a file with %zu cached tiles\n", PAN_FRAMES, PAN_CACHE_TILES);
+    streamFrames(pan, "stream_benchmark.canvas", PAN_CACHE_TILES);
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/Panorama.h"
+#include "../Tools/Profiler.h"
+#include "../Tools/ThreadPool.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * Stitch one image set with the command line's panorama settings, every step timed by the profiler, and write its
+ * result as one JSON object
+ *
+ * @param name Label of the set
+ * @param files Images of the set
+ * @param out Stream to write to
+ * @return void
+ */
+static void profileSet(const string &name, const vector<string> &files, ostream &out) {
+    static Profiler::Timer &encodeTimer = Profiler::timer("panorama.encode");
+    Profiler::reset();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    Panorama panorama = Panorama(files);
+    panorama.setOctaves(3);
+    panorama.setCoarseToFine(true);
+    panorama.decode();
+
+    // Like the batch decode stage, a set with an unreadable image is reported as failed rather than stitched short
+    int loaded = 0;
+    string missing;
+    for (size_t i = 0; i < files.size(); i++) {
+        if (panorama.getImages()[i].empty()) {
+            missing = missing.empty() ? files[i] : missing;
+        }
+        else {
+            loaded++;
+        }
+    }
+    if (!missing.empty()) {
+        out << "{\"set\":\"" << name << "\",\"status\":\"failed\",\"images\":" << files.size() << ",\"loaded\":"
+            << loaded << ",\"error\":\"could not read " << missing << "\"}";
+        return;
+    }
+
+    panorama.detect();
+    panorama.align();
+    Mat mosaic = panorama.composite();
+
+    // Encoded in memory, the suite writes nothing but its report
+    vector<uchar> encoded;
+    {
+        Profiler::Scope scope(encodeTimer);
+        if (!mosaic.empty()) {
+            imencode(".png", mosaic, encoded);
+        }
+    }
+    double wall = elapsedMilliseconds(start);
+
+    int connected = 0;
+    for (const Mat &transform : panorama.getTransforms()) {
+        connected += transform.empty() ? 0 : 1;
+    }
+
+    out << "{\"set\":\"" << name << "\",\"status\":\"ok\",\"images\":" << files.size() << ",\"loaded\":" << loaded
+        << ",\"pairs\":" << panorama.getEdges().size() << ",\"connected\":" << connected << ",\"width\":" << mosaic.cols
+        << ",\"height\":" << mosaic.rows << ",\"encoded_bytes\":" << encoded.size() << ",\"wall_ms\":" << wall
+        << ",\"profile\":";
+    Profiler::report(out);
+    out << "}";
+}
+
+/**
+ * Stitch every bundled image set headless with the profiler on and report timings and counters as JSON, one set per
+ * line, so runs of different versions can be compared
+ *
+ * @param argc Remaining argument count
+ * @param argv [output.json], stdout if not given
+ * @return int
+ */
+int runSuiteBenchmark(int argc, char **argv) {
+    vector<pair<string, vector<string> > > sets = {
+        {"rainier", {"images/rainier/Rainier1.png", "images/rainier/Rainier2.png", "images/rainier/Rainier3.png",
+                     "images/rainier/Rainier4.png", "images/rainier/Rainier5.png", "images/rainier/Rainier6.png"}},
+        {"yosemite", {"images/yosemite/Yosemite1.jpg", "images/yosemite/Yosemite2.jpg"}},
+        {"graf", {"images/graf/img1.ppm", "images/graf/img2.ppm", "images/graf/img4.ppm"}}
+    };
+
+    ofstream file;
+    if (argc >= 1) {
+        file.open(argv[0]);
+        if (!file) {
+            cerr << "could not write " << argv[0] << endl;
+            return 1;
+        }
+    }
+    ostream &out = (argc >= 1) ? file : cout;
+
+    Profiler::setEnabled(true);
+    out << "{\"suite\":\"image_sets\",\"threads\":" << ThreadPool::getShared().getThreadCount() << ",\"sets\":[\n";
+    for (size_t s = 0; s < sets.size(); s++) {
+        profileSet(sets[s].first, sets[s].second, out);
+        out << ((s + 1 < sets.size()) ? ",\n" : "\n");
+    }
+    out << "]}" << endl;
+    Profiler::setEnabled(false);
+
+    return 0;
+}
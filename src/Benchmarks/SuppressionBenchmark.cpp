@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../FeatureMatching/HarrisKernel.h"
+#include "../FeatureMatching/Suppression.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * The fixed block suppression Suppression::localMaxima replaced: one maximum per non-overlapping window
+ *
+ * @param response Corner strengths
+ * @param window Block side
+ * @return int Maxima found
+ */
+static int legacyBlockSuppression(const Mat &response, int window) {
+    int mid = window / 2;
+    int count = 0;
+
+    for (int i = mid; i < response.rows - mid; i += window) {
+        for (int j = mid; j < response.cols - mid; j += window) {
+            float max = 0;
+
+            for (int k = i - mid; k <= i + mid; k++) {
+                for (int l = j - mid; l <= j + mid; l++) {
+                    max = std::max(max, response.at<float>(k, l));
+                }
+            }
+
+            count += (max > 0) ? 1 : 0;
+        }
+    }
+
+    return count;
+}
+
+/**
+ * Block suppression against the running maximum local maxima and adaptive suppression on a synthetic Harris response
+ *
+ * @param argc Remaining argument count
+ * @param argv [width] [height] [budget]
+ * @return int
+ */
+int runSuppressionBenchmark(int argc, char **argv) {
+    const float THRESHOLD = 0.008f;
+    const int WINDOW = 27;
+    const int REPEATS = 5;
+    int width = (argc > 0) ? atoi(argv[0]) : 4000;
+    int height = (argc > 1) ? atoi(argv[1]) : 3000;
+    int budget = (argc > 2) ? atoi(argv[2]) : 2000;
+
+    Mat gray = Mat(height, width, CV_8U), response;
+    randu(gray, Scalar::all(0), Scalar::all(255));
+    GaussianBlur(gray, gray, Size(5, 5), 1.5);
+    gray.convertTo(gray, CV_32F, 1. / 255);
+    HarrisKernel::compute(gray, THRESHOLD, response);
+
+    Rect all = Rect(0, 0, width, height);
+    vector<Point> maxima;
+    vector<float> responses;
+    vector<int> kept;
+    int blocks = 0;
+    double blockMs = 1e30, localMs = 1e30, adaptiveMs = 1e30;
+
+    for (int r = 0; r < REPEATS; r++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        blocks = legacyBlockSuppression(response, WINDOW);
+        blockMs = min(blockMs, elapsedMilliseconds(start));
+
+        start = chrono::steady_clock::now();
+        Suppression::localMaxima(response, WINDOW / 2, all, maxima);
+        localMs = min(localMs, elapsedMilliseconds(start));
+
+        responses.clear();
+        for (const Point &p : maxima) {
+            responses.push_back(response.at<float>(p.y, p.x));
+        }
+
+        start = chrono::steady_clock::now();
+        kept = Suppression::adaptive(maxima, responses, budget);
+        adaptiveMs = min(adaptiveMs, elapsedMilliseconds(start));
+    }
+
+    double pixels = (double) response.total();
+
+    printf("%-12s %10s %14s %10s\n", "stage", "ms", "Mpixels/s", "points");
+    printf("%-12s %10.2f %14.1f %10d\n", "block", blockMs, pixels / (blockMs * 1000.0), blocks);
+    printf("%-12s %10.2f %14.1f %10zu\n", "local max", localMs, pixels / (localMs * 1000.0), maxima.size());
+    printf("%-12s %10.2f %14s %10zu\n", "adaptive", adaptiveMs, "-", kept.size());
+
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <opencv2/opencv.hpp>
+#include "Benchmarks.h"
+#include "../ImageStitching/Warper.h"
+
+using namespace std;
+using namespace cv;
+
+/**
+ * The warp Warper replaced: a cv::Mat product per output pixel followed by a nearest neighbour read
+ *
+ * @param source Image to sample, CV_32FC3
+ * @param H Homography from output coordinates to source coordinates, CV_32F
+ * @param output Receives the warped image
+ * @return void
+ */
+static void legacyWarp(const Mat &source, const Mat &H, Mat &output) {
+    for (int i = 0; i < output.rows; i++) {
+        for (int j = 0; j < output.cols; j++) {
+            Mat point = Mat::zeros(3, 1, CV_32F);
+            point.at<float>(0, 0) = (float) j;
+            point.at<float>(1, 0) = (float) i;
+            point.at<float>(2, 0) = 1.0;
+            Mat result = H * point;
+            int x = (int) (result.at<float>(0, 0) / result.at<float>(2, 0));
+            int y = (int) (result.at<float>(1, 0) / result.at<float>(2, 0));
+
+            if (x >= 0 && y >= 0 && x < source.cols && y < source.rows) {
+                output.at<Vec3f>(i, j) = source.at<Vec3f>(y, x);
+            }
+        }
+    }
+}
+
+/**
+ * Per pixel cv::Mat projection against Warper table construction and sampling for every interpolation and depth,
+ * plus the cost of reusing a cached table
+ *
+ * @param argc Remaining argument count
+ * @param argv [width] [height]
+ * @return int
+ */
+int runWarpBenchmark(int argc, char **argv) {
+    int width = (argc > 0) ? atoi(argv[0]) : 2000;
+    int height = (argc > 1) ? atoi(argv[1]) : 1500;
+    const int INTERPOLATIONS[] = {INTER_NEAREST, INTER_LINEAR, INTER_CUBIC};
+    const char *INTERPOLATION_NAMES[] = {"nearest", "linear", "cubic"};
+    const double VALUES[9] = {0.9, 0.05, 30, -0.04, 1.1, -20, 1e-5, 2e-5, 1};
+    Mat H = Mat(3, 3, CV_64F, (void *) VALUES).clone();
+    Mat source8 = Mat(height, width, CV_8UC3);
+    Mat source32, output;
+    Rect roi = Rect(0, 0, width, height);
+    double pixels = (double) width * height;
+
+    randu(source8, Scalar::all(0), Scalar::all(255));
+    source8.convertTo(source32, CV_32FC3);
+
+    Mat legacyH, legacyOutput = Mat::zeros(height, width, CV_32FC3);
+    H.convertTo(legacyH, CV_32F);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    legacyWarp(source32, legacyH, legacyOutput);
+    double legacyMs = elapsedMilliseconds(start);
+
+    printf("%-10s %-8s %10s %10s %10s %14s\n", "path", "depth", "table ms", "warp ms", "reuse ms", "pixels/s");
+    printf("%-10s %-8s %10s %10.2f %10s %14.0f\n", "legacy", "float32", "-", legacyMs, "-",
+           pixels / (legacyMs / 1000.0));
+
+    for (int k = 0; k < 3; k++) {
+        Warper warper = Warper(INTERPOLATIONS[k]);
+        Warper::RemapTable table;
+
+        start = chrono::steady_clock::now();
+        warper.buildTable(H, roi, source8.size(), table);
+        double tableMs = elapsedMilliseconds(start);
+
+        for (int floating = 0; floating < 2; floating++) {
+            const Mat &source = floating ? source32 : source8;
+
+            start = chrono::steady_clock::now();
+            warper.warp(source, table, output);
+            double warpMs = elapsedMilliseconds(start);
+
+            // A second frame with the same homography only pays for sampling
+            start = chrono::steady_clock::now();
+            warper.warp(source, table, output);
+            double reuseMs = elapsedMilliseconds(start);
+
+            printf("%-10s %-8s %10.2f %10.2f %10.2f %14.0f\n", INTERPOLATION_NAMES[k], floating ? "float32" : "uint8",
+                   tableMs, tableMs + warpMs, reuseMs, pixels / (reuseMs / 1000.0));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <iostream>
+#include <string>
+#include "Benchmarks.h"
+
+using namespace std;
+
+/**
+ * Build count descriptors from synthetic gradient windows. Every 4x4 cell gets a dominant orientation plus noise so
+ * the histograms are peaked like those of real corners. Each descriptor is stored both as a legacy SIFTDescriptor
+ * object (when legacy is not null) and in set.
+ *
+ * @param count Number of descriptors
+ * @param rng Random source
+ * @param legacy Receives the SIFTDescriptor objects, may be null
+ * @param set Receives the same histograms
+ * @return void
+ */
+void buildRandomDescriptors(int count, mt19937 &rng, vector<SIFTDescriptor> *legacy, DescriptorSet &set) {
+    const int WINDOW = 16;
+    const int CELL = 4;
+    uniform_real_distribution<float> angle(0.0f, 2.0f * (float) M_PI);
+    uniform_real_distribution<float> magnitude(0.0f, 0.3f);
+    normal_distribution<float> noise(0.0f, 0.05f);
+    float windowX[WINDOW][WINDOW];
+    float windowY[WINDOW][WINDOW];
+
+    set.reserve(set.size() + count);
+
+    for (int n = 0; n < count; n++) {
+        for (int ci = 0; ci < WINDOW; ci += CELL) {
+            for (int cj = 0; cj < WINDOW; cj += CELL) {
+                float theta = angle(rng);
+                float m = magnitude(rng);
+
+                for (int i = ci; i < ci + CELL; i++) {
+                    for (int j = cj; j < cj + CELL; j++) {
+                        windowX[i][j] = m * cos(theta) + noise(rng);
+                        windowY[i][j] = m * sin(theta) + noise(rng);
+                    }
+                }
+            }
+        }
+
+        SIFTDescriptor d = SIFTDescriptor(n, n);
+        d.generateHistograms(windowX, windowY);
+        if (legacy != nullptr) {
+            legacy->push_back(d);
+        }
+        set.add((float) n, (float) n, 1.0f, d.getBins());
+    }
+}
+
+/**
+ * Print the available benchmarks
+ *
+ * @return int
+ */
+static int usage() {
+    cout << "usage: feature_detection_bench <benchmark> [options]" << endl;
+    cout << "  matcher [queries] [train]   brute-force SSD kernels against SIFTDescriptor::SSD" << endl;
+    cout << "  ann [train] [queries]       k-d forest recall@2 and queries/sec against exact matching" << endl;
+    cout << "  ransac [matches] [ratio]    RansacEngine hypotheses/sec against the cv::Mat scoring path" << endl;
+    cout << "  refine [inliers] [images]   least squares refit against LM, chained against adjusted" << endl;
+    cout << "  warp [width] [height]       Warper remap tables against per-pixel cv::Mat projection" << endl;
+    cout << "  blend [w] [h] [overlap]     feather and multi-band blending time, memory and per-band cost" << endl;
+    cout << "  harris [image | w h]        fused Harris response against the multi-pass filter2D path" << endl;
+    cout << "  detect [image]              tiled and low-memory detection against the whole-image path" << endl;
+    cout << "  suppression [w h] [budget]  running maximum and adaptive suppression against block suppression" << endl;
+    cout << "  pyramid [images...]         alignment with one octave, three octaves and coarse-to-fine pairs" << endl;
+    cout << "  descriptor [count]          batched descriptor construction against SIFTDescriptor objects" << endl;
+    cout << "  binary [image1 image2]      steered BRIEF and Hamming matching against histogram descriptors" << endl;
+    cout << "  stream [frames...]          per-frame cost of streaming stitching as the mosaic grows" << endl;
+    cout << "  batch [manifest]            manifest jobs run stage after stage against pipelined" << endl;
+    cout << "  suite [output.json]         profiled stitching of every bundled image set, as JSON" << endl;
+    cout << "  arena [image] [repeats]     scratch arena against the heap, allocations/s and peak memory" << endl;
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        return usage();
+    }
+
+    string name = argv[1];
+
+    if (name == "matcher") {
+        return runMatcherBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "ann") {
+        return runAnnBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "ransac") {
+        return runRansacBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "refine") {
+        return runRefineBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "warp") {
+        return runWarpBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "blend") {
+        return runBlendBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "harris") {
+        return runHarrisBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "detect") {
+        return runDetectBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "suppression") {
+        return runSuppressionBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "pyramid") {
+        return runPyramidBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "descriptor") {
+        return runDescriptorBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "binary") {
+        return runBinaryBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "stream") {
+        return runStreamBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "batch") {
+        return runBatchBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "suite") {
+        return runSuiteBenchmark(argc - 2, argv + 2);
+    }
+    if (name == "arena") {
+        return runArenaBenchmark(argc - 2, argv + 2);
+    }
+
+    return usage();
+}
@@ -0,0 +1,169 @@
+#include "SteeredBRIEF.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "../SIFT/DescriptorBuilder.h"
+
+using namespace cv;
+using namespace std;
+
+static const float TWO_PI = 6.2831853f;
+
+/**
+ * Test pattern at every orientation step and the Gaussian weights of the orientation window. The pattern is drawn
+ * once from a fixed seed with Box-Muller on mt19937's raw output, so it is the same with every standard library.
+ */
+struct SamplingTables {
+    int tests[SteeredBRIEF::ANGLE_STEPS][SteeredBRIEF::BITS][2];    // Positions in the smoothed patch, row-major
+    float weights[DescriptorBuilder::WINDOW_PIXELS];
+
+    SamplingTables() {
+        const int RADIUS = SteeredBRIEF::PATCH_RADIUS;
+        const int SIDE = SteeredBRIEF::PATCH_SIDE;
+        const float SPREAD = SIDE / 5.0f;           // BRIEF's isotropic Gaussian, sigma of a fifth of the patch
+        mt19937 rng(SteeredBRIEF::PATTERN_SEED);
+        float points[SteeredBRIEF::BITS][2][2];
+
+        for (int b = 0; b < SteeredBRIEF::BITS; b++) {
+            for (int p = 0; p < 2; p++) {
+                float r, c;
+
+                // Points are kept inside the disc, so no rotation moves them off the patch
+                do {
+                    double u1 = (rng() + 0.5) / 4294967296.0;
+                    double u2 = (rng() + 0.5) / 4294967296.0;
+                    double length = SPREAD * sqrt(-2.0 * log(u1));
+                    r = (float) (length * cos(TWO_PI * u2));
+                    c = (float) (length * sin(TWO_PI * u2));
+                } while (r * r + c * c > RADIUS * RADIUS);
+
+                points[b][p][0] = r;
+                points[b][p][1] = c;
+            }
+        }
+
+        for (int a = 0; a < SteeredBRIEF::ANGLE_STEPS; a++) {
+            float theta = TWO_PI * a / SteeredBRIEF::ANGLE_STEPS;
+            float cosine = cos(theta);
+            float sine = sin(theta);
+
+            for (int b = 0; b < SteeredBRIEF::BITS; b++) {
+                for (int p = 0; p < 2; p++) {
+                    float r = points[b][p][0];
+                    float c = points[b][p][1];
+                    int rotatedRow = (int) lround(r * cosine - c * sine);
+                    int rotatedCol = (int) lround(r * sine + c * cosine);
+                    tests[a][b][p] = (rotatedRow + RADIUS) * SIDE + (rotatedCol + RADIUS);
+                }
+            }
+        }
+
+        const int SIZE = DescriptorBuilder::WINDOW_SIZE;
+        const float CENTRE = 0.5f * (SIZE - 1);
+        const float SIGMA = 0.5f * SIZE;
+
+        for (int i = 0; i < SIZE; i++) {
+            for (int j = 0; j < SIZE; j++) {
+                float dr = i - CENTRE;
+                float dc = j - CENTRE;
+                weights[i * SIZE + j] = exp(-(dr * dr + dc * dc) / (2.0f * SIGMA * SIGMA));
+            }
+        }
+    }
+};
+
+static const SamplingTables TABLES;
+
+/**
+ * Dominant gradient orientation of a derivative window: the peak of a Gaussian weighted orientation histogram,
+ * refined with a parabola through the peak and its neighbours. Measured from the row axis towards the column axis,
+ * the frame the test pattern is rotated in.
+ *
+ * @param windowX DescriptorBuilder::WINDOW_PIXELS vertical derivatives, row-major
+ * @param windowY DescriptorBuilder::WINDOW_PIXELS horizontal derivatives, row-major
+ * @return float Radians in [0, 2 pi)
+ */
+float SteeredBRIEF::orientation(const float *windowX, const float *windowY) {
+    float histogram[ORIENTATION_BINS];
+    fill(histogram, histogram + ORIENTATION_BINS, 0.0f);
+
+    for (int p = 0; p < DescriptorBuilder::WINDOW_PIXELS; p++) {
+        float x = windowX[p];
+        float y = windowY[p];
+        float m = sqrt(x * x + y * y) * TABLES.weights[p];
+        float bin = DescriptorBuilder::polarAngle(y, x) * (ORIENTATION_BINS / TWO_PI);
+        int b0 = (int) bin;
+        float f = bin - b0;
+
+        histogram[b0 % ORIENTATION_BINS] += m * (1.0f - f);
+        histogram[(b0 + 1) % ORIENTATION_BINS] += m * f;
+    }
+
+    int peak = (int) (max_element(histogram, histogram + ORIENTATION_BINS) - histogram);
+    float left = histogram[(peak + ORIENTATION_BINS - 1) % ORIENTATION_BINS];
+    float centre = histogram[peak];
+    float right = histogram[(peak + 1) % ORIENTATION_BINS];
+    float curvature = left - 2.0f * centre + right;
+    float offset = (curvature < 0) ? 0.5f * (left - right) / curvature : 0.0f;
+    float angle = (peak + offset) * (TWO_PI / ORIENTATION_BINS);
+
+    return (angle < 0) ? angle + TWO_PI : (angle >= TWO_PI ? angle - TWO_PI : angle);
+}
+
+/**
+ * Binary descriptor of one keypoint. The patch is read with its edges replicated, so keypoints near the border of the
+ * level are still described.
+ *
+ * @param level CV_8U gray pyramid level the keypoint was found on
+ * @param row Row of the keypoint on level
+ * @param col Column of the keypoint on level
+ * @param angle Orientation from orientation(), in radians
+ * @param descriptor Receives WORDS packed tests, bit b of the descriptor in word b / 64
+ * @return void
+ */
+void SteeredBRIEF::describe(const Mat &level, int row, int col, float angle, uint64_t *descriptor) {
+    const int REACH = PATCH_RADIUS + SMOOTHING_RADIUS;
+    const int RAW_SIDE = 2 * REACH + 1;
+    const int BOX = 2 * SMOOTHING_RADIUS + 1;
+    int raw[RAW_SIDE][RAW_SIDE];
+    int rowSums[RAW_SIDE][PATCH_SIDE];
+    int smoothed[PATCH_SIDE * PATCH_SIDE];
+
+    for (int i = 0; i < RAW_SIDE; i++) {
+        const uchar *source = level.ptr<uchar>(min(max(row - REACH + i, 0), level.rows - 1));
+
+        for (int j = 0; j < RAW_SIDE; j++) {
+            raw[i][j] = source[min(max(col - REACH + j, 0), level.cols - 1)];
+        }
+    }
+
+    // Box sums stand in for averages, the tests only compare them
+    for (int i = 0; i < RAW_SIDE; i++) {
+        for (int j = 0; j < PATCH_SIDE; j++) {
+            int sum = 0;
+            for (int k = 0; k < BOX; k++) {
+                sum += raw[i][j + k];
+            }
+            rowSums[i][j] = sum;
+        }
+    }
+    for (int i = 0; i < PATCH_SIDE; i++) {
+        for (int j = 0; j < PATCH_SIDE; j++) {
+            int sum = 0;
+            for (int k = 0; k < BOX; k++) {
+                sum += rowSums[i + k][j];
+            }
+            smoothed[i * PATCH_SIDE + j] = sum;
+        }
+    }
+
+    int step = (int) floor(angle * (ANGLE_STEPS / TWO_PI) + 0.5f) % ANGLE_STEPS;
+    const int (*tests)[2] = TABLES.tests[(step < 0) ? step + ANGLE_STEPS : step];
+
+    fill(descriptor, descriptor + WORDS, 0ULL);
+    for (int b = 0; b < BITS; b++) {
+        if (smoothed[tests[b][0]] < smoothed[tests[b][1]]) {
+            descriptor[b >> 6] |= 1ULL << (b & 63);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+/**
+ * 256 bit binary descriptor in the style of ORB's steered BRIEF. Each bit compares the box smoothed intensity at two
+ * points of a fixed random pattern around the keypoint. The pattern is rotated to the keypoint's dominant gradient
+ * orientation, taken from the same derivative window the histogram descriptor reads, so the bits survive in-plane
+ * rotation. Rotated patterns are precomputed for ANGLE_STEPS orientations.
+ */
+class SteeredBRIEF {
+public:
+    const static int BITS = 256;
+    const static int WORDS = BITS / 64;
+    const static int PATCH_RADIUS = 15;                 // Every test point lies within this distance, at any angle
+    const static int PATCH_SIDE = 2 * PATCH_RADIUS + 1;
+    const static int SMOOTHING_RADIUS = 2;              // Tests compare 5x5 box sums rather than single pixels
+    const static int ANGLE_STEPS = 30;                  // 12 degree orientation steps
+    const static int ORIENTATION_BINS = 36;
+    const static unsigned int PATTERN_SEED = 498;
+    static float orientation(const float *windowX, const float *windowY);
+    static void describe(const cv::Mat &level, int row, int col, float angle, uint64_t *descriptor);
+};
\ No newline at end of file
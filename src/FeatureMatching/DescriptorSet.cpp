@@ -0,0 +1,285 @@
+#include "DescriptorSet.h"
+#include <cmath>
+#include <opencv2/opencv.hpp>
+
+using namespace std;
+
+/**
+ * Replace the contents with count keypoints whose descriptors are already normalized, as when loading a stored set
+ *
+ * @param count Number of keypoints
+ * @param rows count rows
+ * @param cols count columns
+ * @param responses count corner strengths
+ * @param descriptors count x DESCRIPTOR_SIZE normalized values
+ * @param scales count detection scales, all 1 if null
+ * @return void
+ */
+void DescriptorSet::assign(size_t count, const float *rows, const float *cols, const float *responses,
+                           const float *descriptors, const float *scales) {
+    this->rows.assign(rows, rows + count);
+    this->cols.assign(cols, cols + count);
+    this->responses.assign(responses, responses + count);
+    if (scales != nullptr) {
+        this->scales.assign(scales, scales + count);
+    }
+    else {
+        this->scales.assign(count, 1.0f);
+    }
+    this->descriptors.assign(descriptors, descriptors + count * DESCRIPTOR_SIZE);
+    this->quantized.clear();
+    this->binary.clear();
+    this->hasQuantized = false;
+    this->type = SIFT;
+}
+
+/**
+ * Replace the contents with count keypoints with binary descriptors, as when loading a stored BRIEF set
+ *
+ * @param count Number of keypoints
+ * @param rows count rows
+ * @param cols count columns
+ * @param responses count corner strengths
+ * @param descriptors count x BINARY_WORDS packed tests
+ * @param scales count detection scales, all 1 if null
+ * @return void
+ */
+void DescriptorSet::assignBinary(size_t count, const float *rows, const float *cols, const float *responses,
+                                 const uint64_t *descriptors, const float *scales) {
+    this->rows.assign(rows, rows + count);
+    this->cols.assign(cols, cols + count);
+    this->responses.assign(responses, responses + count);
+    if (scales != nullptr) {
+        this->scales.assign(scales, scales + count);
+    }
+    else {
+        this->scales.assign(count, 1.0f);
+    }
+    this->binary.assign(descriptors, descriptors + count * BINARY_WORDS);
+    this->descriptors.clear();
+    this->quantized.clear();
+    this->hasQuantized = false;
+    this->type = BRIEF;
+}
+
+/**
+ * Quantize a single normalized descriptor component to 8 bits
+ *
+ * @param value Normalized descriptor component
+ * @return uint8_t
+ */
+static inline uint8_t quantizeComponent(float value) {
+    float scaled = value * DescriptorSet::QUANTIZATION_SCALE + 0.5f;
+
+    if (scaled <= 0) {
+        return 0;
+    }
+
+    return (scaled >= 255) ? 255 : (uint8_t) scaled;
+}
+
+/**
+ * Constructor
+ *
+ * @param type Kind of descriptor the set holds
+ */
+DescriptorSet::DescriptorSet(Type type) {
+    this->type = type;
+    this->rows = vector<float>();
+    this->cols = vector<float>();
+    this->responses = vector<float>();
+    this->scales = vector<float>();
+    this->hasQuantized = false;
+}
+
+/**
+ * Reserve storage for n keypoints
+ *
+ * @param n Expected number of keypoints
+ * @return void
+ */
+void DescriptorSet::reserve(size_t n) {
+    rows.reserve(n);
+    cols.reserve(n);
+    responses.reserve(n);
+    scales.reserve(n);
+    if (type == BRIEF) {
+        binary.reserve(n * BINARY_WORDS);
+    }
+    else {
+        descriptors.reserve(n * DESCRIPTOR_SIZE);
+    }
+}
+
+/**
+ * Remove all keypoints, the descriptor type is kept
+ *
+ * @return void
+ */
+void DescriptorSet::clear() {
+    rows.clear();
+    cols.clear();
+    responses.clear();
+    scales.clear();
+    descriptors.clear();
+    quantized.clear();
+    binary.clear();
+    hasQuantized = false;
+}
+
+/**
+ * Append a keypoint to a SIFT set. The descriptor is copied and L2 normalized on the way in so distances between sets
+ * do not depend on local contrast.
+ *
+ * @param row Row of interest point in original image
+ * @param col Column of interest point in original image
+ * @param response Corner strength of interest point
+ * @param descriptor DESCRIPTOR_SIZE raw histogram values
+ * @param scale Original image pixels per pixel of the level the descriptor was sampled on
+ * @return size_t Index of the new keypoint
+ */
+size_t DescriptorSet::add(float row, float col, float response, const float *descriptor, float scale) {
+    CV_Assert(type == SIFT);
+    float norm = 0;
+
+    for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+        norm += descriptor[i] * descriptor[i];
+    }
+
+    float normalizer = (norm > 0) ? 1.0f / sqrt(norm) : 0.0f;
+    size_t index = rows.size();
+
+    rows.push_back(row);
+    cols.push_back(col);
+    responses.push_back(response);
+    scales.push_back(scale);
+
+    for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+        descriptors.push_back(descriptor[i] * normalizer);
+    }
+
+    // Keep the quantized copy in step once it exists
+    if (hasQuantized) {
+        const float *d = getDescriptor(index);
+        for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+            quantized.push_back(quantizeComponent(d[i]));
+        }
+    }
+
+    return index;
+}
+
+/**
+ * Append a keypoint with a binary descriptor to a BRIEF set
+ *
+ * @param row Row of interest point in original image
+ * @param col Column of interest point in original image
+ * @param response Corner strength of interest point
+ * @param descriptor BINARY_WORDS packed tests
+ * @param scale Original image pixels per pixel of the level the descriptor was sampled on
+ * @return size_t Index of the new keypoint
+ */
+size_t DescriptorSet::addBinary(float row, float col, float response, const uint64_t *descriptor, float scale) {
+    CV_Assert(type == BRIEF);
+    size_t index = rows.size();
+
+    rows.push_back(row);
+    cols.push_back(col);
+    responses.push_back(response);
+    scales.push_back(scale);
+    binary.insert(binary.end(), descriptor, descriptor + BINARY_WORDS);
+
+    return index;
+}
+
+/**
+ * Append a bit-exact copy of one keypoint of another set of the same type. The descriptor is already normalized, so it
+ * is copied as stored rather than passed through add() again.
+ *
+ * @param other Set holding the keypoint
+ * @param index Keypoint in other
+ * @return size_t Index of the new keypoint
+ */
+size_t DescriptorSet::append(const DescriptorSet &other, size_t index) {
+    CV_Assert(type == other.type);
+    size_t appended = rows.size();
+
+    rows.push_back(other.rows[index]);
+    cols.push_back(other.cols[index]);
+    responses.push_back(other.responses[index]);
+    scales.push_back(other.scales[index]);
+
+    if (type == BRIEF) {
+        const uint64_t *words = other.getBinaryDescriptor(index);
+        binary.insert(binary.end(), words, words + BINARY_WORDS);
+        return appended;
+    }
+
+    const float *descriptor = other.getDescriptor(index);
+    descriptors.insert(descriptors.end(), descriptor, descriptor + DESCRIPTOR_SIZE);
+
+    // Keep the quantized copy in step once it exists
+    if (hasQuantized) {
+        for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+            quantized.push_back(quantizeComponent(descriptor[i]));
+        }
+    }
+
+    return appended;
+}
+
+/**
+ * Build the uint8 copy of every float descriptor, BRIEF sets have nothing to quantize
+ *
+ * @return void
+ */
+void DescriptorSet::quantize() {
+    quantized.resize(descriptors.size());
+
+    for (size_t i = 0; i < descriptors.size(); i++) {
+        quantized[i] = quantizeComponent(descriptors[i]);
+    }
+
+    hasQuantized = true;
+}
+
+/**
+ * Return a distance (SSD) between a descriptor of this set and a descriptor of another set
+ *
+ * @param index Keypoint in this set
+ * @param other Set holding the keypoint to compare against
+ * @param otherIndex Keypoint in other
+ * @return float
+ */
+float DescriptorSet::SSD(size_t index, const DescriptorSet &other, size_t otherIndex) const {
+    const float *a = getDescriptor(index);
+    const float *b = other.getDescriptor(otherIndex);
+    float score = 0;
+
+    for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+        float d = a[i] - b[i];
+        score += d * d;
+    }
+
+    return score;
+}
+
+size_t DescriptorSet::size() const { return rows.size(); }
+bool DescriptorSet::empty() const { return rows.empty(); }
+DescriptorSet::Type DescriptorSet::getType() const { return type; }
+bool DescriptorSet::isBinary() const { return type == BRIEF; }
+bool DescriptorSet::isQuantized() const { return hasQuantized; }
+float DescriptorSet::getRow(size_t index) const { return rows[index]; }
+float DescriptorSet::getCol(size_t index) const { return cols[index]; }
+float DescriptorSet::getResponse(size_t index) const { return responses[index]; }
+float DescriptorSet::getScale(size_t index) const { return scales[index]; }
+const float *DescriptorSet::getDescriptor(size_t index) const { return &descriptors[index * DESCRIPTOR_SIZE]; }
+const uint8_t *DescriptorSet::getQuantizedDescriptor(size_t index) const { return &quantized[index * DESCRIPTOR_SIZE]; }
+const float *DescriptorSet::getDescriptors() const { return descriptors.data(); }
+const float *DescriptorSet::getRows() const { return rows.data(); }
+const float *DescriptorSet::getCols() const { return cols.data(); }
+const float *DescriptorSet::getResponses() const { return responses.data(); }
+const float *DescriptorSet::getScales() const { return scales.data(); }
+const uint8_t *DescriptorSet::getQuantizedDescriptors() const { return quantized.data(); }
+const uint64_t *DescriptorSet::getBinaryDescriptor(size_t index) const { return &binary[index * BINARY_WORDS]; }
+const uint64_t *DescriptorSet::getBinaryDescriptors() const { return binary.data(); }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../Tools/AlignedAllocator.h"
+
+/**
+ * Structure-of-arrays store for the keypoints of one image. Positions, responses and descriptors are kept in separate
+ * contiguous arrays so matching only touches the descriptor rows it needs. A set holds one type of descriptor: 128-D
+ * float gradient histograms, or 256 bit binary tests packed into 64 bit words.
+ */
+class DescriptorSet {
+public:
+    enum Type { SIFT = 0, BRIEF = 1 };
+    const static int DESCRIPTOR_SIZE = 128;
+    const static int QUANTIZATION_SCALE = 512;   // SIFT convention, components above 0.5 saturate
+    const static int BINARY_BITS = 256;
+    const static int BINARY_WORDS = BINARY_BITS / 64;
+private:
+    Type type;
+    std::vector<float> rows;        // Row of interest point in original image
+    std::vector<float> cols;        // Column of interest point in original image
+    std::vector<float> responses;   // Corner strength of interest point
+    std::vector<float> scales;      // Original image pixels per pixel of the level it was detected on
+    std::vector<float, AlignedAllocator<float> > descriptors;       // count x DESCRIPTOR_SIZE, L2 normalized
+    std::vector<uint8_t, AlignedAllocator<uint8_t> > quantized;     // count x DESCRIPTOR_SIZE, empty until quantize()
+    std::vector<uint64_t, AlignedAllocator<uint64_t> > binary;      // count x BINARY_WORDS, BRIEF sets only
+    bool hasQuantized;
+public:
+    explicit DescriptorSet(Type type = SIFT);
+    void reserve(size_t n);
+    void clear();
+    size_t add(float row, float col, float response, const float *descriptor, float scale = 1.0f);
+    size_t addBinary(float row, float col, float response, const uint64_t *descriptor, float scale = 1.0f);
+    size_t append(const DescriptorSet &other, size_t index);
+    void assign(size_t count, const float *rows, const float *cols, const float *responses, const float *descriptors,
+                const float *scales = nullptr);
+    void assignBinary(size_t count, const float *rows, const float *cols, const float *responses,
+                      const uint64_t *descriptors, const float *scales = nullptr);
+    const float *getRows() const;
+    const float *getCols() const;
+    const float *getResponses() const;
+    const float *getScales() const;
+    void quantize();
+    float SSD(size_t index, const DescriptorSet &other, size_t otherIndex) const;
+    size_t size() const;
+    bool empty() const;
+    Type getType() const;
+    bool isBinary() const;
+    bool isQuantized() const;
+    float getRow(size_t index) const;
+    float getCol(size_t index) const;
+    float getResponse(size_t index) const;
+    float getScale(size_t index) const;
+    const float *getDescriptor(size_t index) const;
+    const uint8_t *getQuantizedDescriptor(size_t index) const;
+    const float *getDescriptors() const;
+    const uint8_t *getQuantizedDescriptors() const;
+    const uint64_t *getBinaryDescriptor(size_t index) const;
+    const uint64_t *getBinaryDescriptors() const;
+};
\ No newline at end of file
@@ -0,0 +1,494 @@
+#include "FeatureCache.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "FeatureDetector_498.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+static const char MAGIC[8] = {'F', 'D', '4', '9', '8', 'F', 'T', 'R'};
+static const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+/**
+ * Fixed size header at the start of every feature file. Offsets are in bytes from the start of the file.
+ */
+struct FeatureFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;             // BYTE_ORDER_MARK as written, files are only read on the same byte order
+    uint32_t descriptorSize;        // Elements per descriptor: floats for SIFT, 64 bit words for BRIEF
+    uint32_t descriptorType;        // DescriptorSet::Type
+    uint64_t contentHash;
+    uint64_t parameterHash;
+    uint64_t count;
+    uint64_t parametersOffset;
+    uint64_t parametersLength;
+    uint64_t rowsOffset;
+    uint64_t colsOffset;
+    uint64_t responsesOffset;
+    uint64_t scalesOffset;
+    uint64_t descriptorsOffset;
+    uint64_t fileSize;
+};
+
+/**
+ * Read-only view of a whole file, memory mapped where the platform allows and read into memory otherwise
+ */
+class MappedFile {
+private:
+    const unsigned char *data;
+    size_t size;
+    vector<unsigned char> buffer;
+    bool mapped;
+public:
+    explicit MappedFile(const string &path) : data(nullptr), size(0), mapped(false) {
+#ifdef _WIN32
+        ifstream in(path.c_str(), ios::binary);
+        if (in) {
+            buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+            data = buffer.data();
+            size = buffer.size();
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat info;
+
+        if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > 0) {
+            void *view = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view != MAP_FAILED) {
+                data = static_cast<const unsigned char *>(view);
+                size = (size_t) info.st_size;
+                mapped = true;
+            }
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (mapped) {
+            munmap(const_cast<unsigned char *>(data), size);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    const unsigned char *getData() const { return data; }
+    size_t getSize() const { return size; }
+};
+
+/**
+ * Round an offset up to the next multiple of alignment
+ *
+ * @param offset Byte offset
+ * @param alignment Power of two
+ * @return uint64_t
+ */
+static inline uint64_t alignUp(uint64_t offset, uint64_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/**
+ * Whether a section lies inside a file, checked without any sum that could wrap
+ *
+ * @param offset Byte offset of the section
+ * @param length Bytes in the section
+ * @param size Bytes in the file
+ * @return bool
+ */
+static inline bool fits(uint64_t offset, uint64_t length, uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+/**
+ * Elements per stored descriptor and bytes per element for a descriptor type
+ *
+ * @param type Descriptor type
+ * @param elementSize Receives the bytes per element
+ * @return uint32_t
+ */
+static uint32_t descriptorLayout(DescriptorSet::Type type, uint64_t &elementSize) {
+    if (type == DescriptorSet::BRIEF) {
+        elementSize = sizeof(uint64_t);
+        return DescriptorSet::BINARY_WORDS;
+    }
+
+    elementSize = sizeof(float);
+    return DescriptorSet::DESCRIPTOR_SIZE;
+}
+
+/**
+ * Create a directory and any missing parents
+ *
+ * @param directory Path to create
+ * @return void
+ */
+static void makeDirectories(const string &directory) {
+    for (size_t i = 1; i <= directory.size(); i++) {
+        if (i == directory.size() || directory[i] == '/') {
+            string prefix = directory.substr(0, i);
+#ifdef _WIN32
+            _mkdir(prefix.c_str());
+#else
+            mkdir(prefix.c_str(), 0755);
+#endif
+        }
+    }
+}
+
+/**
+ * Identifier of the running process
+ *
+ * @return long
+ */
+static long processId() {
+#ifdef _WIN32
+    return (long) _getpid();
+#else
+    return (long) getpid();
+#endif
+}
+
+/**
+ * Constructor
+ *
+ * @param directory Where feature files are stored, created on the first store
+ */
+FeatureCache::FeatureCache(string directory) {
+    this->directory = directory;
+}
+
+/**
+ * Continue a 64 bit FNV-1a hash over a block of bytes
+ *
+ * @param data Bytes to hash
+ * @param length Number of bytes
+ * @param hash Hash so far, the FNV offset basis for a new hash
+ * @return uint64_t
+ */
+uint64_t FeatureCache::fnv1a(const unsigned char *data, size_t length, uint64_t hash) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * Hash of encoded image bytes already in memory, equal to hashFile() of a file holding them
+ *
+ * @param data Bytes to hash
+ * @param length Number of bytes
+ * @return uint64_t
+ */
+uint64_t FeatureCache::hashBytes(const unsigned char *data, size_t length) {
+    return fnv1a(data, length, 0xCBF29CE484222325ULL);
+}
+
+/**
+ * Hash of a file's encoded bytes. Hashing the file rather than the decoded pixels avoids decoding it at all on a hit.
+ *
+ * @param file Path of the file
+ * @return uint64_t 0 if the file cannot be read
+ */
+uint64_t FeatureCache::hashFile(const string &file) {
+    const size_t CHUNK = 1 << 16;
+    ifstream in(file.c_str(), ios::binary);
+    vector<char> buffer(CHUNK);
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    if (!in) {
+        return 0;
+    }
+
+    while (in) {
+        in.read(buffer.data(), CHUNK);
+        hash = fnv1a(reinterpret_cast<const unsigned char *>(buffer.data()), (size_t) in.gcount(), hash);
+    }
+
+    return hash;
+}
+
+/**
+ * Hash of a string, used for the detector parameters
+ *
+ * @param text Text to hash
+ * @return uint64_t
+ */
+uint64_t FeatureCache::hashString(const string &text) {
+    return fnv1a(reinterpret_cast<const unsigned char *>(text.data()), text.size(), 0xCBF29CE484222325ULL);
+}
+
+/**
+ * Write a feature file. The file is written beside its final name under a name no other writer uses and renamed into
+ * place, so readers never see a partial file. The temporary file is removed if either step fails.
+ *
+ * @param path Destination
+ * @param contentHash Hash of the image the features came from
+ * @param parameters Detector parameters the features were produced with
+ * @param features Features to store
+ * @return bool Whether the file was written
+ */
+bool FeatureCache::write(const string &path, uint64_t contentHash, const string &parameters,
+                         const DescriptorSet &features) {
+    const uint64_t count = features.size();
+    uint64_t elementSize = 0;
+    FeatureFileHeader header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.descriptorSize = descriptorLayout(features.getType(), elementSize);
+    header.descriptorType = (uint32_t) features.getType();
+    header.contentHash = contentHash;
+    header.parameterHash = hashString(parameters);
+    header.count = count;
+    header.parametersOffset = sizeof(header);
+    header.parametersLength = parameters.size();
+    header.rowsOffset = alignUp(header.parametersOffset + header.parametersLength, ALIGNMENT);
+    header.colsOffset = alignUp(header.rowsOffset + count * sizeof(float), ALIGNMENT);
+    header.responsesOffset = alignUp(header.colsOffset + count * sizeof(float), ALIGNMENT);
+    header.scalesOffset = alignUp(header.responsesOffset + count * sizeof(float), ALIGNMENT);
+    header.descriptorsOffset = alignUp(header.scalesOffset + count * sizeof(float), ALIGNMENT);
+    header.fileSize = header.descriptorsOffset + count * header.descriptorSize * elementSize;
+
+    // Assemble in memory so every section lands at its offset with zero padding between
+    vector<char> file(header.fileSize, 0);
+    memcpy(&file[0], &header, sizeof(header));
+    memcpy(&file[header.parametersOffset], parameters.data(), parameters.size());
+    if (count > 0) {
+        memcpy(&file[header.rowsOffset], features.getRows(), count * sizeof(float));
+        memcpy(&file[header.colsOffset], features.getCols(), count * sizeof(float));
+        memcpy(&file[header.responsesOffset], features.getResponses(), count * sizeof(float));
+        memcpy(&file[header.scalesOffset], features.getScales(), count * sizeof(float));
+        if (features.isBinary()) {
+            memcpy(&file[header.descriptorsOffset], features.getBinaryDescriptors(),
+                   count * header.descriptorSize * elementSize);
+        }
+        else {
+            memcpy(&file[header.descriptorsOffset], features.getDescriptors(),
+                   count * header.descriptorSize * elementSize);
+        }
+    }
+
+    // Unique per process and per call, so writers of the same entry never share a temporary file
+    static atomic<unsigned long long> written(0);
+    char suffix[64];
+    snprintf(suffix, sizeof(suffix), ".%ld.%llu.tmp", processId(), written.fetch_add(1));
+    string temporary = path + suffix;
+    ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+    out.write(file.data(), file.size());
+    out.close();
+    bool complete = !out.fail();
+
+    if (!complete || rename(temporary.c_str(), path.c_str()) != 0) {
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Load a feature file through a memory map. Any mismatch in format, hashes, parameters or sizes is treated as a miss.
+ *
+ * @param path Feature file
+ * @param contentHash Hash the image must have
+ * @param parameters Detector parameters the features must have been produced with
+ * @param features Receives the stored features on success
+ * @return bool Whether features were loaded
+ */
+bool FeatureCache::read(const string &path, uint64_t contentHash, const string &parameters,
+                        DescriptorSet &features) {
+    MappedFile file(path);
+    const unsigned char *data = file.getData();
+    FeatureFileHeader header;
+
+    if (data == nullptr || file.getSize() < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    const uint64_t count = header.count;
+    const DescriptorSet::Type type = (header.descriptorType == (uint32_t) DescriptorSet::BRIEF) ? DescriptorSet::BRIEF
+                                                                                                 : DescriptorSet::SIFT;
+    uint64_t elementSize = 0;
+    const uint64_t descriptorSize = descriptorLayout(type, elementSize);
+    const uint64_t fileSize = header.fileSize;
+    const uint64_t perFeature = 4 * sizeof(float) + descriptorSize * elementSize;
+
+    // The count is bounded before any size is computed from it, so a corrupt header cannot wrap the checks below
+    bool valid = memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == FORMAT_VERSION &&
+                 header.byteOrder == BYTE_ORDER_MARK && header.descriptorType <= (uint32_t) DescriptorSet::BRIEF &&
+                 header.descriptorSize == descriptorSize && header.contentHash == contentHash &&
+                 header.parameterHash == hashString(parameters) && fileSize == file.getSize() &&
+                 count <= fileSize / perFeature && header.parametersLength == parameters.size() &&
+                 fits(header.parametersOffset, header.parametersLength, fileSize) &&
+                 fits(header.rowsOffset, count * sizeof(float), fileSize) &&
+                 fits(header.colsOffset, count * sizeof(float), fileSize) &&
+                 fits(header.responsesOffset, count * sizeof(float), fileSize) &&
+                 fits(header.scalesOffset, count * sizeof(float), fileSize) &&
+                 fits(header.descriptorsOffset, count * descriptorSize * elementSize, fileSize);
+
+    // The full parameter text guards against hash collisions
+    if (!valid || memcmp(data + header.parametersOffset, parameters.data(), parameters.size()) != 0) {
+        return false;
+    }
+
+    if (type == DescriptorSet::BRIEF) {
+        features.assignBinary((size_t) count, reinterpret_cast<const float *>(data + header.rowsOffset),
+                              reinterpret_cast<const float *>(data + header.colsOffset),
+                              reinterpret_cast<const float *>(data + header.responsesOffset),
+                              reinterpret_cast<const uint64_t *>(data + header.descriptorsOffset),
+                              reinterpret_cast<const float *>(data + header.scalesOffset));
+    }
+    else {
+        features.assign((size_t) count, reinterpret_cast<const float *>(data + header.rowsOffset),
+                        reinterpret_cast<const float *>(data + header.colsOffset),
+                        reinterpret_cast<const float *>(data + header.responsesOffset),
+                        reinterpret_cast<const float *>(data + header.descriptorsOffset),
+                        reinterpret_cast<const float *>(data + header.scalesOffset));
+    }
+    return true;
+}
+
+/**
+ * File an entry is stored under: content hash, then parameter hash, both in hex
+ *
+ * @param contentHash Hash of the image file
+ * @param parameters Detector parameters
+ * @return string
+ */
+string FeatureCache::pathFor(uint64_t contentHash, const string &parameters) const {
+    char name[64];
+    snprintf(name, sizeof(name), "%016llx-%016llx.features", (unsigned long long) contentHash,
+             (unsigned long long) hashString(parameters));
+    return this->directory + "/" + name;
+}
+
+/**
+ * Load the features stored for an image
+ *
+ * @param image Path of the image
+ * @param parameters Detector parameters
+ * @param features Receives the features on a hit
+ * @return bool Whether the cache held them
+ */
+bool FeatureCache::load(const string &image, const string &parameters, DescriptorSet &features) const {
+    uint64_t contentHash = hashFile(image);
+    return contentHash != 0 && read(pathFor(contentHash, parameters), contentHash, parameters, features);
+}
+
+/**
+ * Store the features of an image
+ *
+ * @param image Path of the image
+ * @param parameters Detector parameters
+ * @param features Features detected in image
+ * @return bool Whether the entry was written
+ */
+bool FeatureCache::store(const string &image, const string &parameters, const DescriptorSet &features) const {
+    uint64_t contentHash = hashFile(image);
+    if (contentHash == 0) {
+        return false;
+    }
+
+    makeDirectories(this->directory);
+    return write(pathFor(contentHash, parameters), contentHash, parameters, features);
+}
+
+/**
+ * Detect and describe the features of an image and store them under its content hash
+ *
+ * @param contentHash Hash of the image file, 0 to skip storing
+ * @param parameters Detector parameters, from octaves and descriptorType
+ * @param image BGR image, empty if the file could not be decoded
+ * @param octaves Pyramid octaves to detect on
+ * @param descriptorType Descriptor to describe them with
+ * @param features Receives the features
+ * @return bool Always false, the features did not come from the cache
+ */
+bool FeatureCache::describe(uint64_t contentHash, const string &parameters, const Mat &image, int octaves,
+                            DescriptorSet::Type descriptorType, DescriptorSet &features) const {
+    FeatureDetector_498 fd = FeatureDetector_498(image);
+    fd.setOctaves(octaves);
+    fd.setDescriptorType(descriptorType);
+    fd.detectFeatures();
+    features = fd.describeFeatures();
+
+    // A file that hashes but does not decode has no features worth keeping
+    if (contentHash != 0 && !fd.isEmpty()) {
+        makeDirectories(this->directory);
+        write(pathFor(contentHash, parameters), contentHash, parameters, features);
+    }
+
+    return false;
+}
+
+/**
+ * Features of an image with FeatureDetector_498's parameters, from the cache when present and otherwise detected and
+ * stored for next time. The image file is hashed once and only decoded on a miss.
+ *
+ * @param image Path of the image
+ * @param features Receives the features
+ * @param octaves Pyramid octaves to detect on
+ * @param descriptorType Descriptor to describe them with
+ * @return bool Whether they came from the cache
+ */
+bool FeatureCache::detect(const string &image, DescriptorSet &features, int octaves,
+                          DescriptorSet::Type descriptorType) const {
+    const string parameters = FeatureDetector_498::getParameters(octaves, FeatureDetector_498::KEYPOINT_BUDGET,
+                                                                 descriptorType);
+    uint64_t contentHash = hashFile(image);
+
+    if (contentHash != 0 && read(pathFor(contentHash, parameters), contentHash, parameters, features)) {
+        return true;
+    }
+
+    return describe(contentHash, parameters, imread(image, IMREAD_COLOR), octaves, descriptorType, features);
+}
+
+/**
+ * Features of an image already decoded by the caller, which hashed the encoded bytes with hashBytes() as it read them.
+ * Neither the file nor the image is read again.
+ *
+ * @param contentHash Hash of the encoded image, 0 if unknown, which skips the cache
+ * @param image BGR image decoded from those bytes
+ * @param features Receives the features
+ * @param octaves Pyramid octaves to detect on
+ * @param descriptorType Descriptor to describe them with
+ * @return bool Whether they came from the cache
+ */
+bool FeatureCache::detect(uint64_t contentHash, const Mat &image, DescriptorSet &features, int octaves,
+                          DescriptorSet::Type descriptorType) const {
+    const string parameters = FeatureDetector_498::getParameters(octaves, FeatureDetector_498::KEYPOINT_BUDGET,
+                                                                 descriptorType);
+
+    if (contentHash != 0 && read(pathFor(contentHash, parameters), contentHash, parameters, features)) {
+        return true;
+    }
+
+    return describe(contentHash, parameters, image, octaves, descriptorType, features);
+}
+
+const string &FeatureCache::getDirectory() const { return directory; }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "DescriptorSet.h"
+
+/**
+ * On-disk store of detected features, keyed by a hash of the encoded image file and a hash of the detector
+ * parameters. Each entry is one versioned binary file laid out so it can be memory mapped: a fixed header, the
+ * parameter text, then the row, column, response and scale arrays and the descriptor matrix, each 32 byte aligned. The
+ * descriptor matrix holds floats or packed binary words, as recorded in the header.
+ */
+class FeatureCache {
+public:
+    const static uint32_t FORMAT_VERSION = 3;   // Bump whenever the layout below changes
+private:
+    const static int ALIGNMENT = 32;            // Array alignment inside the file, matches AlignedAllocator
+    std::string directory;
+    static uint64_t fnv1a(const unsigned char *data, size_t length, uint64_t hash);
+    bool describe(uint64_t contentHash, const std::string &parameters, const cv::Mat &image, int octaves,
+                  DescriptorSet::Type descriptorType, DescriptorSet &features) const;
+public:
+    explicit FeatureCache(std::string directory = "cache/features");
+    static uint64_t hashBytes(const unsigned char *data, size_t length);
+    static uint64_t hashFile(const std::string &file);
+    static uint64_t hashString(const std::string &text);
+    static bool write(const std::string &path, uint64_t contentHash, const std::string &parameters,
+                      const DescriptorSet &features);
+    static bool read(const std::string &path, uint64_t contentHash, const std::string &parameters,
+                     DescriptorSet &features);
+    std::string pathFor(uint64_t contentHash, const std::string &parameters) const;
+    bool load(const std::string &image, const std::string &parameters, DescriptorSet &features) const;
+    bool store(const std::string &image, const std::string &parameters, const DescriptorSet &features) const;
+    bool detect(const std::string &image, DescriptorSet &features, int octaves = 1,
+                DescriptorSet::Type descriptorType = DescriptorSet::SIFT) const;
+    bool detect(uint64_t contentHash, const cv::Mat &image, DescriptorSet &features, int octaves = 1,
+                DescriptorSet::Type descriptorType = DescriptorSet::SIFT) const;
+    const std::string &getDirectory() const;
+};
\ No newline at end of file
@@ -1,4 +1,9 @@
 #include "FeatureDetector_498.h"
+#include "HarrisKernel.h"
+#include "Suppression.h"
+#include <algorithm>
+#include <sstream>
+#include "../Tools/Profiler.h"
 
 using namespace cv;
 using namespace std;
@@ -7,188 +12,533 @@ using namespace std;
  * Constructor
  *
  * @param file File path to image being processed
+ * @param pool Threads that detection runs on, the shared pool if null
  */
-FeatureDetector_498::FeatureDetector_498(string file) {
-    // Init original image
-    this->raw = imread(file, IMREAD_COLOR);
-    this->image = imread(file, IMREAD_COLOR);
-    this->gray = Mat::zeros(image.size(), image.type());
+FeatureDetector_498::FeatureDetector_498(string file, ThreadPool *pool) {
+    // Init image, read once and only drawn on
+    init(imread(file, IMREAD_COLOR), pool);
+}
 
-    // Init gray scale image
-    cvtColor(this->image, this->gray, COLOR_BGR2GRAY);
-    this->gray.convertTo(this->gray, CV_32F);
-    this->gray *= 1./255;
+/**
+ * Constructor for a frame already in memory, such as one from a camera
+ *
+ * @param frame BGR image, copied since detection draws on it
+ * @param pool Threads that detection runs on, the shared pool if null
+ */
+FeatureDetector_498::FeatureDetector_498(const Mat &frame, ThreadPool *pool) {
+    init(frame.clone(), pool);
+}
 
-    // Init derivative images
-    this->Ix = Mat::zeros(this->gray.size(), CV_32F);
-    this->Iy = Mat::zeros(this->gray.size(), CV_32F);
+/**
+ * Shared constructor body. An empty image, e.g. from a file that could not be read, leaves the detector empty: it
+ * detects and describes nothing.
+ *
+ * @param image BGR image the detector owns
+ * @param pool Threads that detection runs on, the shared pool if null
+ * @return void
+ */
+void FeatureDetector_498::init(const Mat &image, ThreadPool *pool) {
+    this->image = image;
 
-    float sobelFilter[] = {
-            1.0/6, 0, -1.0/6,
-            2.0/6, 0, -2.0/6,
-            1.0/6, 0, -1.0/6
-    };
+    // Init 8 bit gray scale image, converted to float region by region where it is needed
+    this->pyramid.assign(1, Mat());
+    if (!this->image.empty()) {
+        cvtColor(this->image, this->pyramid[0], COLOR_BGR2GRAY);
+    }
 
-    // Apply Sobel Filters
-    Mat s_v = Mat(3, 3, CV_32F, sobelFilter);
-    Mat s_h = s_v.t();      // Transpose of horizontal Sobel matrix
+    // Derivative planes are only built by the whole image mode
+    this->Ix = Mat();
+    this->Iy = Mat();
 
-    filter2D(this->gray, this->Ix, -1, s_h);
-    filter2D(this->gray, this->Iy, -1, s_v);
+    // Init keypoint and descriptor stores
+    this->keypoints = vector<Keypoint>();
+    this->descriptors = DescriptorSet();
 
-    //Init helper matrices
-    this->harris = Mat::zeros(image.size(), CV_32F);
-    this->suppressed = Mat::zeros(image.size(), CV_32F);
+    this->mode = TILED;
+    this->descriptorType = DescriptorSet::SIFT;
+    this->octaves = 1;
+    this->keypointBudget = KEYPOINT_BUDGET;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+}
 
-    // Init descriptor vector
-    this->descriptors = vector<SIFTDescriptor>();
+/**
+ * Part of a pyramid level where a descriptor window fits, the only place keypoints are kept
+ *
+ * @param size Size of the level
+ * @return Rect
+ */
+Rect FeatureDetector_498::describable(const Size &size) {
+    return Rect(DESCRIPTOR_MID, DESCRIPTOR_MID, size.width - 2 * DESCRIPTOR_MID, size.height - 2 * DESCRIPTOR_MID);
 }
 
 /**
- * Detect feature points using Harris Corner Detection
+ * Gray levels of part of a pyramid level, scaled to [0, 1]. The conversion works pixel by pixel, so a region holds
+ * exactly the values a whole level conversion would.
  *
+ * @param level CV_8U pyramid level
+ * @param area Part of the level
+ * @param arena Arena of the calling thread, the plane lives until its open scope closes
  * @return Mat (CV_32F)
  */
-Mat FeatureDetector_498::harrisCornerDetector() {
-    // Init and clear matrices
-    Mat Ixx = Mat::zeros(Ix.size(), CV_32F);        // IxIx
-    Mat Iyy = Mat::zeros(Iy.size(), CV_32F);        // IyIy
-    Mat Ixy = Mat::zeros(Ix.size(), CV_32F);        // IxIy
-    Mat Corners = Mat::zeros(image.size(), CV_32F); // C = det(H) - trace(h)
-
-    // Create Harris matrix components
-    for (int i = 0; i < gray.rows; i++) {
-        for (int j = 0; j < gray.cols; j++) {
-            float x = Ix.at<float>(i,j);
-            float y = Iy.at<float>(i,j);
-            Ixx.at<float>(i,j) = x * x;     // IxIx
-            Iyy.at<float>(i,j) = y * y;     // IyIy
-            Ixy.at<float>(i,j) = x * y;     // IxIy
+Mat FeatureDetector_498::grayRegion(const Mat &level, const Rect &area, ScratchArena &arena) {
+    Mat region = arena.mat(area.height, area.width, CV_32F);
+    level(area).convertTo(region, CV_32F, 1./255);
+
+    return region;
+}
+
+/**
+ * Gaussian pyramid of the gray image, one level per octave. Levels too small to hold a few suppression windows are
+ * not built, so small images may get fewer octaves than asked for.
+ *
+ * @return void
+ */
+void FeatureDetector_498::buildPyramid() {
+    pyramid.resize(1);
+
+    while ((int) pyramid.size() < octaves) {
+        const Mat &last = pyramid.back();
+        if (min(last.rows, last.cols) / 2 < MIN_LEVEL_SIDE) {
+            break;
         }
+
+        Mat next;
+        pyrDown(last, next);
+        pyramid.push_back(next);
     }
+}
 
-    // Apply Gaussian
-    GaussianBlur(Ixx, Ixx, Size(3, 3), 1);
-    GaussianBlur(Iyy, Iyy, Size(3, 3), 1);
-    GaussianBlur(Ixy, Ixy, Size(3, 3), 1);
+/**
+ * Share of the keypoint budget for one octave, in proportion to the area of its level
+ *
+ * @param octave Pyramid level
+ * @return int 0 when the budget is unlimited
+ */
+int FeatureDetector_498::octaveBudget(int octave) const {
+    if (keypointBudget <= 0) {
+        return 0;
+    }
 
-    // Calculate corner strength matrix
-    for (int i = 0; i < image.rows; i++) {
-        for (int j = 0; j < image.cols; j++) {
-            float a = Ixx.at<float>(i, j);
-            float b = Ixy.at<float>(i, j);
-            float c = Ixy.at<float>(i, j);
-            float d = Iyy.at<float>(i, j);
-            float cornerStrength;
+    double total = 0;
+    for (const Mat &level : pyramid) {
+        total += (double) level.total();
+    }
 
+    return max(1, (int) (keypointBudget * (double) pyramid[octave].total() / total + 0.5));
+}
 
-            // c(H) = det/trace, det = ad-bc, trace = a+d
-            if (a + d == 0) {
-                cornerStrength = 0;
-            }
-            else {
-                cornerStrength = ((a*d)-(b*c))/(a + d);
-            }
+/**
+ * Detect feature points using Harris Corner Detection. Sobel derivatives, their Gaussian windowed products and the
+ * det/trace corner strength are computed in one fused pass over row strips, which also fills Ix and Iy for the
+ * descriptors.
+ *
+ * @return Mat (CV_32F)
+ */
+Mat FeatureDetector_498::harrisCornerDetector() {
+    ScratchArena &arena = ScratchArena::local();
+    ScratchArena::Scope scope(arena);
+    Mat corners;
 
-            // Apply threshold
-            if (cornerStrength > HARRIS_THRESHOLD) {
-                Corners.at<float>(i, j) = cornerStrength;
-            }
-        }
+    HarrisKernel::compute(grayRegion(pyramid[0], Rect(0, 0, pyramid[0].cols, pyramid[0].rows), arena),
+                          HARRIS_THRESHOLD, corners, &this->Ix, &this->Iy, this->pool);
+
+    return corners;
+}
+
+/**
+ * Adaptive suppression of the local maxima of one level down to a budget
+ *
+ * @param candidates Local maxima in row-major order
+ * @param budget Keypoints to keep, 0 keeps all
+ * @return vector<Keypoint> The kept ones, still in row-major order
+ */
+vector<FeatureDetector_498::Keypoint> FeatureDetector_498::selectKeypoints(const vector<Keypoint> &candidates,
+                                                                           int budget) const {
+    vector<Point> points(candidates.size());
+    vector<float> responses(candidates.size());
+    vector<Keypoint> selected;
+
+    for (size_t k = 0; k < candidates.size(); k++) {
+        points[k] = Point(candidates[k].col, candidates[k].row);
+        responses[k] = candidates[k].response;
     }
 
-    return Corners;
+    for (int k : Suppression::adaptive(points, responses, budget, pool)) {
+        selected.push_back(candidates[k]);
+    }
+
+    return selected;
 }
 
 /**
- * Suppress non maximum values in a Corner Strength matrix from Harris Corner Detection
+ * Suppress non maximum values in a Corner Strength matrix from Harris Corner Detection. A point survives when it is the
+ * largest in the SUPPRESSION_WINDOW square centred on it, and adaptive suppression then keeps the keypoint budget's
+ * worth of the survivors spread over the image. The corners are those of the full resolution octave.
  *
  * @param harrisCorners non-suppressed corner strength values from harris corner detector
- * @return Mat (CV_32F)
+ * @return vector<Keypoint> In row-major order
  */
-Mat FeatureDetector_498::nonMaximaSuppression(Mat harrisCorners) {
-    Mat s = Mat::zeros(image.size(), CV_32F);
-    float max = 0;
-    float current;
-    int maxRow = 0;
-    int maxCol = 0;
-
-    // Iterate through image jumping by window size
-    for (int i = SUPPRESSION_MID; i < gray.rows - SUPPRESSION_MID; i += SUPPRESSION_WINDOW) {
-        for (int j = SUPPRESSION_MID; j < gray.cols - SUPPRESSION_MID; j += SUPPRESSION_WINDOW) {
-            max = 0;
-
-            // Perform suppression within the window
-            for (int k = i - SUPPRESSION_MID; k <= i + SUPPRESSION_MID; k++) {
-                for (int l = j - SUPPRESSION_MID; l <= j + SUPPRESSION_MID; l++) {
-                    current = harrisCorners.at<float>(k, l);
-
-                    if (current > max) {
-                        max = current;
-                        maxRow = k;
-                        maxCol = l;
-                    }
-                }
-            }
+vector<FeatureDetector_498::Keypoint> FeatureDetector_498::nonMaximaSuppression(const Mat &harrisCorners) {
+    vector<Point> maxima;
+    vector<Keypoint> candidates;
+
+    Suppression::localMaxima(harrisCorners, SUPPRESSION_MID, describable(harrisCorners.size()), maxima, pool);
+
+    candidates.reserve(maxima.size());
+    for (const Point &p : maxima) {
+        Point2f offset = Suppression::subpixelOffset(harrisCorners, p);
+        Keypoint k;
+        k.row = p.y;
+        k.col = p.x;
+        k.dRow = offset.y;
+        k.dCol = offset.x;
+        k.response = harrisCorners.at<float>(p.y, p.x);
+        k.octave = 0;
+        candidates.push_back(k);
+    }
 
-            // Maintain maximum value and draw circle on the originating image to highlight interest point
-            if (max > 0) {
-                s.at<float>(maxRow, maxCol) = max;
-                circle(image, Point(maxCol, maxRow), 4, Scalar(0, 0, 0, 255));
-            }
+    return selectKeypoints(candidates, octaveBudget(0));
+}
+
+/**
+ * Local maxima inside one region of a pyramid level. Harris runs on the region plus a halo clipped to the level; the
+ * response is exact two pixels in from the halo edge, which covers the suppression window of every pixel in the
+ * region. At the level edge the clipped halo reflects exactly like the whole level does, so the maxima are those the
+ * whole level pass finds in the region.
+ *
+ * @param level CV_8U pyramid level
+ * @param region Tile or band in level coordinates
+ * @param threads Pool for the Harris and suppression strips of the region
+ * @param found Receives the maxima of the region in row-major order, octave not set
+ * @return void
+ */
+void FeatureDetector_498::detectRegion(const Mat &level, const Rect &region, ThreadPool &threads,
+                                       vector<Keypoint> &found) const {
+    Rect area = Rect(region.x - REGION_HALO, region.y - REGION_HALO, region.width + 2 * REGION_HALO,
+                     region.height + 2 * REGION_HALO) & Rect(0, 0, level.cols, level.rows);
+    Rect search = region & describable(level.size());
+    ScratchArena &arena = ScratchArena::local();
+    ScratchArena::Scope scope(arena);
+    Mat corners = arena.mat(area.height, area.width, CV_32F);
+    vector<Point> maxima;
+
+    HarrisKernel::compute(grayRegion(level, area, arena), HARRIS_THRESHOLD, corners, nullptr, nullptr, &threads);
+    Suppression::localMaxima(corners, SUPPRESSION_MID, Rect(search.x - area.x, search.y - area.y, search.width,
+                                                            search.height), maxima, &threads);
+
+    found.reserve(found.size() + maxima.size());
+    for (const Point &p : maxima) {
+        Point2f offset = Suppression::subpixelOffset(corners, p);
+        Keypoint k;
+        k.row = p.y + area.y;
+        k.col = p.x + area.x;
+        k.dRow = offset.y;
+        k.dCol = offset.x;
+        k.response = corners.at<float>(p.y, p.x);
+        k.octave = 0;
+        found.push_back(k);
+    }
+}
+
+/**
+ * Detection over tiles of one level spread across the pool. Idle threads claim the next undone tile, so tiles with
+ * many corners do not hold up the rest. Each thread holds the planes of one tile at a time.
+ *
+ * @param level CV_8U pyramid level
+ * @return vector<Keypoint> Local maxima in row-major order
+ */
+vector<FeatureDetector_498::Keypoint> FeatureDetector_498::detectTiled(const Mat &level) const {
+    const int tileRows = (level.rows + TILE_SIDE - 1) / TILE_SIDE;
+    const int tileCols = (level.cols + TILE_SIDE - 1) / TILE_SIDE;
+    vector<vector<Keypoint> > found(tileRows * tileCols);
+    ThreadPool serial(1);
+
+    pool->parallelFor(0, found.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            int x = (int) (t % tileCols) * TILE_SIDE;
+            int y = (int) (t / tileCols) * TILE_SIDE;
+            Rect tile = Rect(x, y, min((int) TILE_SIDE, level.cols - x), min((int) TILE_SIDE, level.rows - y));
+
+            detectRegion(level, tile, serial, found[t]);
         }
+    });
+
+    // Merge in the order the whole level scan meets the points
+    vector<Keypoint> candidates;
+    for (const vector<Keypoint> &tile : found) {
+        candidates.insert(candidates.end(), tile.begin(), tile.end());
+    }
+    sort(candidates.begin(), candidates.end(), [](const Keypoint &a, const Keypoint &b) {
+        return (a.row != b.row) ? a.row < b.row : a.col < b.col;
+    });
+
+    return candidates;
+}
+
+/**
+ * Detection over full width bands of one level from top to bottom, each one split into strips on the pool. Only the
+ * gray and response rows of one band plus its halo are alive at a time, however many threads run.
+ *
+ * @param level CV_8U pyramid level
+ * @return vector<Keypoint> Local maxima in row-major order
+ */
+vector<FeatureDetector_498::Keypoint> FeatureDetector_498::detectBanded(const Mat &level) const {
+    vector<Keypoint> candidates;
+
+    for (int top = 0; top < level.rows; top += BAND_ROWS) {
+        detectRegion(level, Rect(0, top, level.cols, min((int) BAND_ROWS, level.rows - top)), *pool, candidates);
+    }
+
+    return candidates;
+}
+
+/**
+ * Keypoints of one octave, suppressed down to the octave's share of the budget. Only the full resolution octave of
+ * the whole image mode keeps its derivative planes.
+ *
+ * @param octave Pyramid level
+ * @return vector<Keypoint> In row-major order
+ */
+vector<FeatureDetector_498::Keypoint> FeatureDetector_498::detectOctave(int octave) {
+    const Mat &level = pyramid[octave];
+    vector<Keypoint> selected;
+
+    if (octave == 0 && mode == WHOLE_IMAGE) {
+        return nonMaximaSuppression(harrisCornerDetector());
+    }
+
+    if (mode == LOW_MEMORY) {
+        selected = selectKeypoints(detectBanded(level), octaveBudget(octave));
+    }
+    else if (mode == TILED) {
+        selected = selectKeypoints(detectTiled(level), octaveBudget(octave));
+    }
+    else {
+        vector<Keypoint> candidates;
+        detectRegion(level, Rect(0, 0, level.cols, level.rows), *pool, candidates);
+        selected = selectKeypoints(candidates, octaveBudget(octave));
     }
 
-    return s;
+    for (Keypoint &k : selected) {
+        k.octave = octave;
+    }
+
+    return selected;
 }
 
 /**
- * Driver method for feature detection using Harris corner detection and non-maximal suppression
+ * Driver method for feature detection using Harris corner detection and non-maximal suppression. The octaves are
+ * detected in parallel, each one also spreading its own work over the pool. Planes the descriptors do not need are
+ * released before returning.
  *
- * @return Mat (CV_8U)
+ * @return Mat (CV_8U), empty with no keypoints if the detector has no image
  */
 Mat FeatureDetector_498::detectFeatures() {
-    harris = harrisCornerDetector();
-    suppressed = nonMaximaSuppression(harris);
+    static Profiler::Timer &timer = Profiler::timer("detect");
+    static Profiler::Counter &keypointCount = Profiler::counter("detect.keypoints");
+    Profiler::Scope scope(timer);
+
+    descriptors.clear();
+    keypoints.clear();
+    if (isEmpty()) {
+        return image;
+    }
+
+    buildPyramid();
+
+    vector<vector<Keypoint> > found(pyramid.size());
+    pool->parallelFor(0, found.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t o = begin; o < end; o++) {
+            found[o] = detectOctave((int) o);
+        }
+    });
+
+    keypoints.clear();
+    for (const vector<Keypoint> &octave : found) {
+        keypoints.insert(keypoints.end(), octave.begin(), octave.end());
+    }
+    keypointCount.add((long long) keypoints.size());
+
+    // Circle the kept points on the originating image once suppression is done, larger for coarser octaves
+    for (const Keypoint &k : keypoints) {
+        circle(image, Point(k.col << k.octave, k.row << k.octave), 4 << k.octave, Scalar(0, 0, 0, 255));
+    }
 
     return image;
 }
 
 /**
- * Creates descriptions of feature interest points produced by harris corner detection
+ * Copy the 16x16 derivative window around one interest point
  *
- * @return vector<SIFTDescriptor>
+ * @param ix Vertical derivatives
+ * @param iy Horizontal derivatives
+ * @param row Row of the point in the image
+ * @param col Column of the point in the image
+ * @param origin Image position of the first pixel of ix and iy
+ * @param windowX Receives the window of ix, row-major
+ * @param windowY Receives the window of iy, row-major
+ * @return void
  */
-vector<SIFTDescriptor> FeatureDetector_498::describeFeatures() {
-    int count = 0;
-    for (int i = DESCRIPTOR_MID; i < suppressed.rows - DESCRIPTOR_MID; i++) {
-        for (int j = DESCRIPTOR_MID; j < suppressed.cols - DESCRIPTOR_MID; j++) {
-            float point = suppressed.at<float>(i,j);
+void FeatureDetector_498::gatherWindow(const Mat &ix, const Mat &iy, int row, int col, Point origin, float *windowX,
+                                       float *windowY) {
+    int top = row - DESCRIPTOR_MID - origin.y;
+    int left = col - DESCRIPTOR_MID - origin.x;
 
-            if (point > 0.0) {
-                float x, y;
-                float windowX[DESCRIPTOR_WINDOW][DESCRIPTOR_WINDOW];
-                float windowY[DESCRIPTOR_WINDOW][DESCRIPTOR_WINDOW];
+    for (int k = 0; k < DESCRIPTOR_WINDOW; k++) {
+        const float *x = ix.ptr<float>(top + k) + left;
+        const float *y = iy.ptr<float>(top + k) + left;
 
-                for (int k = i-DESCRIPTOR_MID; k < i+DESCRIPTOR_MID; k++) {
-                    for (int l = j-DESCRIPTOR_MID; l < j+DESCRIPTOR_MID; l++) {
-                        x = Ix.at<float>(k, l);
-                        y = Iy.at<float>(k, l);
-                        windowX[k-(i-DESCRIPTOR_MID)][l-(j-DESCRIPTOR_MID)] = x;
-                        windowY[k-(i-DESCRIPTOR_MID)][l-(j-DESCRIPTOR_MID)] = y;
-                    }
-                }
+        copy(x, x + DESCRIPTOR_WINDOW, windowX + k * DESCRIPTOR_WINDOW);
+        copy(y, y + DESCRIPTOR_WINDOW, windowY + k * DESCRIPTOR_WINDOW);
+    }
+}
 
-                SIFTDescriptor d = SIFTDescriptor(windowX, windowY, i, j);
-                d.generateHistograms();
-                count++;
+/**
+ * Derivative window of one interest point from the patch under it, on the level of its octave. The patch has a one
+ * pixel border, clipped to the level, so the derivatives equal those of the whole level.
+ *
+ * @param keypoint Point to describe
+ * @param serial Pool without workers, keypoints are already spread over the threads
+ * @param windowX Receives the vertical derivative window, row-major
+ * @param windowY Receives the horizontal derivative window, row-major
+ * @return void
+ */
+void FeatureDetector_498::patchWindow(const Keypoint &keypoint, ThreadPool &serial, float *windowX,
+                                      float *windowY) const {
+    const Mat &level = pyramid[keypoint.octave];
+    Rect area = Rect(keypoint.col - DESCRIPTOR_MID - 1, keypoint.row - DESCRIPTOR_MID - 1, DESCRIPTOR_WINDOW + 2,
+                     DESCRIPTOR_WINDOW + 2) & Rect(0, 0, level.cols, level.rows);
+    ScratchArena &arena = ScratchArena::local();
+    ScratchArena::Scope scope(arena);
+    Mat response = arena.mat(area.height, area.width, CV_32F);
+    Mat ix = arena.mat(area.height, area.width, CV_32F);
+    Mat iy = arena.mat(area.height, area.width, CV_32F);
+
+    HarrisKernel::compute(grayRegion(level, area, arena), HARRIS_THRESHOLD, response, &ix, &iy, &serial);
+
+    gatherWindow(ix, iy, keypoint.row, keypoint.col, area.tl(), windowX, windowY);
+}
 
-                descriptors.push_back(d);
+/**
+ * Creates descriptions of the detected keypoints, octave by octave in row-major order, with positions in original
+ * image pixels at their subpixel response peaks; the windows themselves stay on the pixel grid. The whole image mode
+ * reads its full resolution derivative planes and then releases them; everything else takes its windows from a small
+ * patch per keypoint. Windows are gathered a chunk at a time and each chunk is turned into histograms by one
+ * DescriptorBuilder call, chunks in parallel. BRIEF descriptors use the window only for their orientation and test the
+ * gray level itself.
+ *
+ * @return DescriptorSet
+ */
+const DescriptorSet &FeatureDetector_498::describeFeatures() {
+    static Profiler::Timer &timer = Profiler::timer("describe");
+    static Profiler::Counter &descriptorCount = Profiler::counter("describe.descriptors");
+    Profiler::Scope scope(timer);
+
+    const bool binary = (descriptorType == DescriptorSet::BRIEF);
+    vector<float> described(binary ? 0 : keypoints.size() * DescriptorBuilder::DESCRIPTOR_SIZE);
+    vector<uint64_t> tests(binary ? keypoints.size() * SteeredBRIEF::WORDS : 0);
+    ThreadPool serial(1);
+
+    pool->parallelFor(0, keypoints.size(), DESCRIBE_CHUNK, [&](size_t begin, size_t end) {
+        ScratchArena &arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        float *windowsX = arena.allocate<float>((end - begin) * DescriptorBuilder::WINDOW_PIXELS);
+        float *windowsY = arena.allocate<float>((end - begin) * DescriptorBuilder::WINDOW_PIXELS);
+
+        for (size_t k = begin; k < end; k++) {
+            const Keypoint &keypoint = keypoints[k];
+            float *windowX = windowsX + (k - begin) * DescriptorBuilder::WINDOW_PIXELS;
+            float *windowY = windowsY + (k - begin) * DescriptorBuilder::WINDOW_PIXELS;
+
+            if (keypoint.octave == 0 && !Ix.empty()) {
+                gatherWindow(Ix, Iy, keypoint.row, keypoint.col, Point(0, 0), windowX, windowY);
             }
+            else {
+                patchWindow(keypoint, serial, windowX, windowY);
+            }
+        }
+
+        if (!binary) {
+            DescriptorBuilder::build(windowsX, windowsY, end - begin,
+                                     described.data() + begin * DescriptorBuilder::DESCRIPTOR_SIZE);
+            return;
+        }
+
+        for (size_t k = begin; k < end; k++) {
+            const Keypoint &keypoint = keypoints[k];
+            float angle = SteeredBRIEF::orientation(windowsX + (k - begin) * DescriptorBuilder::WINDOW_PIXELS,
+                                                    windowsY + (k - begin) * DescriptorBuilder::WINDOW_PIXELS);
+            SteeredBRIEF::describe(pyramid[keypoint.octave], keypoint.row, keypoint.col, angle,
+                                   tests.data() + k * SteeredBRIEF::WORDS);
+        }
+    });
+
+    Ix.release();
+    Iy.release();
+
+    descriptors = DescriptorSet(descriptorType);
+    descriptors.reserve(keypoints.size());
+    for (size_t k = 0; k < keypoints.size(); k++) {
+        const Keypoint &keypoint = keypoints[k];
+        const float scale = (float) (1 << keypoint.octave);
+        const float row = (keypoint.row + keypoint.dRow) * scale;
+        const float col = (keypoint.col + keypoint.dCol) * scale;
+
+        if (binary) {
+            descriptors.addBinary(row, col, keypoint.response, tests.data() + k * SteeredBRIEF::WORDS, scale);
+        }
+        else {
+            descriptors.add(row, col, keypoint.response, described.data() + k * DescriptorBuilder::DESCRIPTOR_SIZE,
+                            scale);
         }
     }
+    descriptorCount.add((long long) descriptors.size());
 
     return descriptors;
 }
 
+/**
+ * Every setting that changes the detected features, as text. Stored features are only reused when this matches.
+ * The mode is left out because it does not change the result.
+ *
+ * @param octaves Pyramid octaves of the detector the features come from
+ * @param keypointBudget Budget of the detector the features come from
+ * @param descriptorType Descriptor the features were described with
+ * @return string
+ */
+string FeatureDetector_498::getParameters(int octaves, int keypointBudget, DescriptorSet::Type descriptorType) {
+    ostringstream parameters;
+    parameters << "harris_threshold=" << HARRIS_THRESHOLD
+               << ";suppression_window=" << SUPPRESSION_WINDOW
+               << ";suppression=local_max"
+               << ";subpixel=quadratic"
+               << ";keypoint_budget=" << keypointBudget
+               << ";octaves=" << octaves
+               << ";descriptor_window=" << DESCRIPTOR_WINDOW;
+    if (descriptorType == DescriptorSet::BRIEF) {
+        parameters << ";descriptor=brief" << SteeredBRIEF::BITS
+                   << ";patch_radius=" << SteeredBRIEF::PATCH_RADIUS
+                   << ";angle_steps=" << SteeredBRIEF::ANGLE_STEPS
+                   << ";pattern_seed=" << SteeredBRIEF::PATTERN_SEED;
+    }
+    else {
+        parameters << ";grid_size=" << GRID_SIZE
+                   << ";descriptor=sift" << DescriptorSet::DESCRIPTOR_SIZE
+                   << ";binning=trilinear"
+                   << ";clip=" << DescriptorBuilder::CLIP_THRESHOLD;
+    }
+    return parameters.str();
+}
 
+const vector<FeatureDetector_498::Keypoint> &FeatureDetector_498::getKeypoints() const { return keypoints; }
+bool FeatureDetector_498::isEmpty() const { return image.empty(); }
+FeatureDetector_498::Mode FeatureDetector_498::getMode() const { return mode; }
+void FeatureDetector_498::setMode(Mode mode) { FeatureDetector_498::mode = mode; }
+DescriptorSet::Type FeatureDetector_498::getDescriptorType() const { return descriptorType; }
+void FeatureDetector_498::setDescriptorType(DescriptorSet::Type descriptorType) {
+    FeatureDetector_498::descriptorType = descriptorType;
+}
+int FeatureDetector_498::getOctaves() const { return octaves; }
+void FeatureDetector_498::setOctaves(int octaves) { FeatureDetector_498::octaves = (octaves > 0) ? octaves : 1; }
+int FeatureDetector_498::getKeypointBudget() const { return keypointBudget; }
+void FeatureDetector_498::setKeypointBudget(int keypointBudget) { FeatureDetector_498::keypointBudget = keypointBudget; }
@@ -2,9 +2,39 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
-#include "SIFT/SIFTDescriptor.h"
+#include "SIFT/DescriptorBuilder.h"
+#include "BRIEF/SteeredBRIEF.h"
+#include "DescriptorSet.h"
+#include "../Tools/ScratchArena.h"
+#include "../Tools/ThreadPool.h"
 
+/**
+ * Harris corners described by 128 bin gradient histograms, built in batches by DescriptorBuilder, or by 256 bit steered
+ * BRIEF tests for fast Hamming matching. Detection yields a sparse keypoint list; how much of the image is held as
+ * float planes while it runs depends on the mode, but every mode gives the same keypoints and descriptors. With more
+ * than one octave, corners are also detected on a Gaussian pyramid, every octave at once, and described on the level
+ * they were found on, so the descriptor window grows with the keypoint's scale.
+ */
 class FeatureDetector_498 {
+public:
+    /**
+     * WHOLE_IMAGE keeps full frame gray, response and derivative planes. TILED runs overlapping tiles on the pool and
+     * LOW_MEMORY full width bands one after another, both keeping only the planes of the region being processed.
+     */
+    enum Mode { WHOLE_IMAGE = 0, TILED = 1, LOW_MEMORY = 2 };
+    const static int KEYPOINT_BUDGET = 2000;    // Default keypoints kept by adaptive suppression, 0 keeps all
+
+    /**
+     * Interest point, row and col on the pyramid level of its octave. The response peaks at (row + dRow, col + dCol).
+     */
+    struct Keypoint {
+        int row;
+        int col;
+        float dRow;
+        float dCol;
+        float response;
+        int octave;
+    };
 private:
     const static int SUPPRESSION_WINDOW = 27;
     const static int SUPPRESSION_MID = SUPPRESSION_WINDOW/2;
@@ -12,18 +42,53 @@ private:
     const static int DESCRIPTOR_WINDOW = 16;
     const static int DESCRIPTOR_MID = DESCRIPTOR_WINDOW/2;
     const static int GRID_SIZE = 4;
-    cv::Mat raw;
+    const static int TILE_SIDE = 513;                   // Pixels per tile side
+    const static int BAND_ROWS = 128;                   // Rows per band in LOW_MEMORY mode
+    const static int REGION_HALO = SUPPRESSION_MID + 2; // Suppression reach plus the rows the response needs
+    const static int DESCRIBE_CHUNK = 64;               // Keypoints per task when describing from patches
+    const static int MIN_LEVEL_SIDE = 2 * SUPPRESSION_WINDOW;  // Smallest pyramid level worth detecting on
     cv::Mat image;
-    cv::Mat gray;
-    cv::Mat harris;
-    cv::Mat suppressed;
+    std::vector<cv::Mat> pyramid;                       // CV_8U gray levels, each half the size of the one before
     cv::Mat Ix;
     cv::Mat Iy;
-    std::vector<SIFTDescriptor> descriptors;
+    std::vector<Keypoint> keypoints;
+    DescriptorSet descriptors;
+    Mode mode;
+    DescriptorSet::Type descriptorType;
+    int octaves;
+    int keypointBudget;
+    ThreadPool *pool;
+    void init(const cv::Mat &image, ThreadPool *pool);
+    static cv::Rect describable(const cv::Size &size);
+    static cv::Mat grayRegion(const cv::Mat &level, const cv::Rect &area, ScratchArena &arena);
+    void buildPyramid();
+    int octaveBudget(int octave) const;
+    std::vector<Keypoint> selectKeypoints(const std::vector<Keypoint> &candidates, int budget) const;
+    void detectRegion(const cv::Mat &level, const cv::Rect &region, ThreadPool &threads,
+                      std::vector<Keypoint> &found) const;
+    std::vector<Keypoint> detectTiled(const cv::Mat &level) const;
+    std::vector<Keypoint> detectBanded(const cv::Mat &level) const;
+    std::vector<Keypoint> detectOctave(int octave);
+    void patchWindow(const Keypoint &keypoint, ThreadPool &serial, float *windowX, float *windowY) const;
+    static void gatherWindow(const cv::Mat &ix, const cv::Mat &iy, int row, int col, cv::Point origin, float *windowX,
+                             float *windowY);
 public:
-    FeatureDetector_498(std::string file);
+    FeatureDetector_498(std::string file, ThreadPool *pool = nullptr);
+    FeatureDetector_498(const cv::Mat &frame, ThreadPool *pool = nullptr);
     cv::Mat harrisCornerDetector();
-    cv::Mat nonMaximaSuppression(cv::Mat harrisCorners);
+    std::vector<Keypoint> nonMaximaSuppression(const cv::Mat &harrisCorners);
     cv::Mat detectFeatures();
-    std::vector<SIFTDescriptor> describeFeatures();
+    const DescriptorSet &describeFeatures();
+    static std::string getParameters(int octaves = 1, int keypointBudget = KEYPOINT_BUDGET,
+                                     DescriptorSet::Type descriptorType = DescriptorSet::SIFT);
+    const std::vector<Keypoint> &getKeypoints() const;
+    bool isEmpty() const;
+    Mode getMode() const;
+    void setMode(Mode mode);
+    DescriptorSet::Type getDescriptorType() const;
+    void setDescriptorType(DescriptorSet::Type descriptorType);
+    int getOctaves() const;
+    void setOctaves(int octaves);
+    int getKeypointBudget() const;
+    void setKeypointBudget(int keypointBudget);
 };
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "HarrisKernel.h"
+#include <algorithm>
+#include "../Tools/ScratchArena.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+static const float SIXTH = 1.0f / 6.0f;
+
+/**
+ * Index of p in a line of length len under BORDER_REFLECT_101, the default border of filter2D and GaussianBlur
+ *
+ * @param p Position, possibly outside the line
+ * @param len Line length
+ * @return int
+ */
+static inline int reflect101(int p, int len) {
+    if (len == 1) {
+        return 0;
+    }
+
+    while (p < 0 || p >= len) {
+        p = (p < 0) ? -p : 2 * len - 2 - p;
+    }
+
+    return p;
+}
+
+/**
+ * Derivatives of one row from the gray rows above, at and below it
+ *
+ * @param above Gray row above, already reflected at the image edge
+ * @param centre Gray row
+ * @param below Gray row below, already reflected at the image edge
+ * @param cols Row length
+ * @param ix Receives the vertical derivative
+ * @param iy Receives the horizontal derivative
+ * @return void
+ */
+void HarrisKernel::derivativeRow(const float *above, const float *centre, const float *below, int cols, float *ix,
+                                 float *iy) {
+    int j = 1;
+
+#ifdef __SSE2__
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 sixth = _mm_set1_ps(SIXTH);
+
+    for (; j + 4 <= cols - 1; j += 4) {
+        __m128 aL = _mm_loadu_ps(above + j - 1), aC = _mm_loadu_ps(above + j), aR = _mm_loadu_ps(above + j + 1);
+        __m128 bL = _mm_loadu_ps(below + j - 1), bC = _mm_loadu_ps(below + j), bR = _mm_loadu_ps(below + j + 1);
+        __m128 cL = _mm_loadu_ps(centre + j - 1), cR = _mm_loadu_ps(centre + j + 1);
+
+        __m128 vertical = _mm_add_ps(_mm_add_ps(_mm_sub_ps(aL, bL), _mm_sub_ps(aR, bR)),
+                                     _mm_mul_ps(two, _mm_sub_ps(aC, bC)));
+        __m128 horizontal = _mm_add_ps(_mm_add_ps(_mm_sub_ps(aL, aR), _mm_sub_ps(bL, bR)),
+                                       _mm_mul_ps(two, _mm_sub_ps(cL, cR)));
+
+        _mm_storeu_ps(ix + j, _mm_mul_ps(vertical, sixth));
+        _mm_storeu_ps(iy + j, _mm_mul_ps(horizontal, sixth));
+    }
+#endif
+
+    for (; j < cols - 1; j++) {
+        ix[j] = ((above[j - 1] - below[j - 1]) + (above[j + 1] - below[j + 1]) + 2.0f * (above[j] - below[j])) * SIXTH;
+        iy[j] = ((above[j - 1] - above[j + 1]) + (below[j - 1] - below[j + 1]) + 2.0f * (centre[j - 1] - centre[j + 1])) *
+                SIXTH;
+    }
+
+    // Edge columns reflect their neighbours
+    const int EDGES[2] = {0, cols - 1};
+    for (int e = 0; e < ((cols > 1) ? 2 : 1); e++) {
+        int c = EDGES[e];
+        int l = reflect101(c - 1, cols), r = reflect101(c + 1, cols);
+
+        ix[c] = ((above[l] - below[l]) + (above[r] - below[r]) + 2.0f * (above[c] - below[c])) * SIXTH;
+        iy[c] = ((above[l] - above[r]) + (below[l] - below[r]) + 2.0f * (centre[l] - centre[r])) * SIXTH;
+    }
+}
+
+/**
+ * Products of the derivatives smoothed horizontally by the Gaussian, computed straight from the derivatives so the
+ * unsmoothed products are never stored
+ *
+ * @param ix Vertical derivative row
+ * @param iy Horizontal derivative row
+ * @param cols Row length
+ * @param xx Receives the smoothed Ix * Ix
+ * @param yy Receives the smoothed Iy * Iy
+ * @param xy Receives the smoothed Ix * Iy
+ * @return void
+ */
+void HarrisKernel::windowRow(const float *ix, const float *iy, int cols, float *xx, float *yy, float *xy) {
+    int j = 1;
+
+#ifdef __SSE2__
+    const __m128 centre = _mm_set1_ps(GAUSSIAN_CENTRE);
+    const __m128 edge = _mm_set1_ps(GAUSSIAN_EDGE);
+
+    for (; j + 4 <= cols - 1; j += 4) {
+        __m128 xL = _mm_loadu_ps(ix + j - 1), xC = _mm_loadu_ps(ix + j), xR = _mm_loadu_ps(ix + j + 1);
+        __m128 yL = _mm_loadu_ps(iy + j - 1), yC = _mm_loadu_ps(iy + j), yR = _mm_loadu_ps(iy + j + 1);
+
+        __m128 sxx = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_mul_ps(xL, xL), _mm_mul_ps(xR, xR))),
+                                _mm_mul_ps(centre, _mm_mul_ps(xC, xC)));
+        __m128 syy = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_mul_ps(yL, yL), _mm_mul_ps(yR, yR))),
+                                _mm_mul_ps(centre, _mm_mul_ps(yC, yC)));
+        __m128 sxy = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_mul_ps(xL, yL), _mm_mul_ps(xR, yR))),
+                                _mm_mul_ps(centre, _mm_mul_ps(xC, yC)));
+
+        _mm_storeu_ps(xx + j, sxx);
+        _mm_storeu_ps(yy + j, syy);
+        _mm_storeu_ps(xy + j, sxy);
+    }
+#endif
+
+    for (; j < cols - 1; j++) {
+        xx[j] = GAUSSIAN_EDGE * (ix[j - 1] * ix[j - 1] + ix[j + 1] * ix[j + 1]) + GAUSSIAN_CENTRE * (ix[j] * ix[j]);
+        yy[j] = GAUSSIAN_EDGE * (iy[j - 1] * iy[j - 1] + iy[j + 1] * iy[j + 1]) + GAUSSIAN_CENTRE * (iy[j] * iy[j]);
+        xy[j] = GAUSSIAN_EDGE * (ix[j - 1] * iy[j - 1] + ix[j + 1] * iy[j + 1]) + GAUSSIAN_CENTRE * (ix[j] * iy[j]);
+    }
+
+    const int EDGES[2] = {0, cols - 1};
+    for (int e = 0; e < ((cols > 1) ? 2 : 1); e++) {
+        int c = EDGES[e];
+        int l = reflect101(c - 1, cols), r = reflect101(c + 1, cols);
+
+        xx[c] = GAUSSIAN_EDGE * (ix[l] * ix[l] + ix[r] * ix[r]) + GAUSSIAN_CENTRE * (ix[c] * ix[c]);
+        yy[c] = GAUSSIAN_EDGE * (iy[l] * iy[l] + iy[r] * iy[r]) + GAUSSIAN_CENTRE * (iy[c] * iy[c]);
+        xy[c] = GAUSSIAN_EDGE * (ix[l] * iy[l] + ix[r] * iy[r]) + GAUSSIAN_CENTRE * (ix[c] * iy[c]);
+    }
+}
+
+/**
+ * Vertical Gaussian over three horizontally smoothed rows, then the thresholded det/trace response
+ *
+ * @param xx Smoothed Ix * Ix of the rows above, at and below
+ * @param yy Smoothed Iy * Iy of the same rows
+ * @param xy Smoothed Ix * Iy of the same rows
+ * @param cols Row length
+ * @param threshold Responses at or below this become 0
+ * @param response Receives the response row
+ * @return void
+ */
+void HarrisKernel::responseRow(const float *const xx[3], const float *const yy[3], const float *const xy[3], int cols,
+                               float threshold, float *response) {
+    int j = 0;
+
+#ifdef __SSE2__
+    const __m128 centre = _mm_set1_ps(GAUSSIAN_CENTRE);
+    const __m128 edge = _mm_set1_ps(GAUSSIAN_EDGE);
+    const __m128 limit = _mm_set1_ps(threshold);
+
+    for (; j + 4 <= cols; j += 4) {
+        __m128 a = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_loadu_ps(xx[0] + j), _mm_loadu_ps(xx[2] + j))),
+                              _mm_mul_ps(centre, _mm_loadu_ps(xx[1] + j)));
+        __m128 d = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_loadu_ps(yy[0] + j), _mm_loadu_ps(yy[2] + j))),
+                              _mm_mul_ps(centre, _mm_loadu_ps(yy[1] + j)));
+        __m128 b = _mm_add_ps(_mm_mul_ps(edge, _mm_add_ps(_mm_loadu_ps(xy[0] + j), _mm_loadu_ps(xy[2] + j))),
+                              _mm_mul_ps(centre, _mm_loadu_ps(xy[1] + j)));
+
+        // A zero trace gives 0/0, and NaN fails the threshold comparison like any weak response
+        __m128 strength = _mm_div_ps(_mm_sub_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, b)), _mm_add_ps(a, d));
+        _mm_storeu_ps(response + j, _mm_and_ps(strength, _mm_cmpgt_ps(strength, limit)));
+    }
+#endif
+
+    for (; j < cols; j++) {
+        float a = GAUSSIAN_EDGE * (xx[0][j] + xx[2][j]) + GAUSSIAN_CENTRE * xx[1][j];
+        float d = GAUSSIAN_EDGE * (yy[0][j] + yy[2][j]) + GAUSSIAN_CENTRE * yy[1][j];
+        float b = GAUSSIAN_EDGE * (xy[0][j] + xy[2][j]) + GAUSSIAN_CENTRE * xy[1][j];
+        float strength = (a + d == 0) ? 0.0f : (a * d - b * b) / (a + d);
+
+        response[j] = (strength > threshold) ? strength : 0.0f;
+    }
+}
+
+/**
+ * Harris response of a gray image. Each task owns a strip of output rows and recomputes the one row of derivatives
+ * above and below it, keeping a three row ring of smoothed products.
+ *
+ * @param gray CV_32F single channel image
+ * @param threshold Responses at or below this become 0
+ * @param response Receives the CV_32F response
+ * @param Ix Receives the vertical derivative if not null
+ * @param Iy Receives the horizontal derivative if not null
+ * @param pool Threads to run strips on, the shared pool if null
+ * @return void
+ */
+void HarrisKernel::compute(const Mat &gray, float threshold, Mat &response, Mat *Ix, Mat *Iy, ThreadPool *pool) {
+    CV_Assert(gray.type() == CV_32F);
+
+    const int rows = gray.rows, cols = gray.cols;
+    response.create(rows, cols, CV_32F);
+    if (Ix != nullptr) {
+        Ix->create(rows, cols, CV_32F);
+    }
+    if (Iy != nullptr) {
+        Iy->create(rows, cols, CV_32F);
+    }
+    if (pool == nullptr) {
+        pool = &ThreadPool::getShared();
+    }
+
+    pool->parallelFor(0, (size_t) rows, STRIP_ROWS, [&](size_t begin, size_t end) {
+        ScratchArena &arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        float *ix = arena.allocate<float>(11 * (size_t) cols);
+        float *iy = ix + cols;
+        float *ring = ix + 2 * (size_t) cols;   // 3 rows each of xx, yy, xy
+
+        // Rows of smoothed products from one above the strip to one below it, reflected at the image edge
+        for (int q = (int) begin - 1; q <= (int) end; q++) {
+            int r = reflect101(q, rows);
+            bool owned = q == r && q >= (int) begin && q < (int) end;
+            float *dx = (owned && Ix != nullptr) ? Ix->ptr<float>(r) : ix;
+            float *dy = (owned && Iy != nullptr) ? Iy->ptr<float>(r) : iy;
+            int slot = (q + 3) % 3;
+
+            derivativeRow(gray.ptr<float>(reflect101(r - 1, rows)), gray.ptr<float>(r),
+                          gray.ptr<float>(reflect101(r + 1, rows)), cols, dx, dy);
+            windowRow(dx, dy, cols, ring + (3 * slot) * (size_t) cols, ring + (3 * slot + 1) * (size_t) cols,
+                      ring + (3 * slot + 2) * (size_t) cols);
+
+            // Three rows are ready, finish the row between them
+            if (q >= (int) begin + 1) {
+                int out = q - 1;
+                const float *xx[3], *yy[3], *xy[3];
+
+                for (int k = 0; k < 3; k++) {
+                    int s = (out - 1 + k + 3) % 3;
+                    xx[k] = ring + (3 * s) * (size_t) cols;
+                    yy[k] = ring + (3 * s + 1) * (size_t) cols;
+                    xy[k] = ring + (3 * s + 2) * (size_t) cols;
+                }
+
+                responseRow(xx, yy, xy, cols, threshold, response.ptr<float>(out));
+            }
+        }
+    });
+}
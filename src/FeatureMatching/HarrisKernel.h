@@ -0,0 +1,28 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Single pass Harris corner response. Sobel derivatives, their products, the separable 3x3 Gaussian window and the
+ * det/trace response are computed row strip by row strip, so each input row is read once and only a few rows of
+ * intermediates are alive per thread. Matches FeatureDetector_498's original sequence of filter2D, product,
+ * GaussianBlur and response passes, including its REFLECT_101 borders, up to float rounding.
+ *
+ * The derivative naming follows the detector: Ix is the vertical difference (row above minus row below) and Iy the
+ * horizontal one (column left minus column right), each smoothed 1-2-1 and divided by 6.
+ */
+class HarrisKernel {
+private:
+    const static int STRIP_ROWS = 32;                           // Output rows per task
+    constexpr static float GAUSSIAN_CENTRE = 0.45186276f;       // 3 tap Gaussian, sigma 1: 1 / (1 + 2e^-0.5)
+    constexpr static float GAUSSIAN_EDGE = 0.27406862f;         // e^-0.5 / (1 + 2e^-0.5)
+    static void derivativeRow(const float *above, const float *centre, const float *below, int cols, float *ix,
+                              float *iy);
+    static void windowRow(const float *ix, const float *iy, int cols, float *xx, float *yy, float *xy);
+    static void responseRow(const float *const xx[3], const float *const yy[3], const float *const xy[3], int cols,
+                            float threshold, float *response);
+public:
+    static void compute(const cv::Mat &gray, float threshold, cv::Mat &response, cv::Mat *Ix = nullptr,
+                        cv::Mat *Iy = nullptr, ThreadPool *pool = nullptr);
+};
\ No newline at end of file
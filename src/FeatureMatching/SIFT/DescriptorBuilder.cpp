@@ -0,0 +1,220 @@
+#include "DescriptorBuilder.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Odd ninth order minimax polynomial for atan on [0, 1], Abramowitz and Stegun 4.4.49, absolute error below 1e-5 rad
+static const float ATAN_C1 = 0.9998660f;
+static const float ATAN_C3 = -0.3302995f;
+static const float ATAN_C5 = 0.1801410f;
+static const float ATAN_C7 = -0.0851330f;
+static const float ATAN_C9 = 0.0208351f;
+static const float HALF_PI = 1.5707963f;
+static const float PI = 3.1415927f;
+static const float TWO_PI = 6.2831853f;
+static const float BINS_PER_RADIAN = DescriptorBuilder::NUMBER_OF_BINS / TWO_PI;
+
+/**
+ * Spatial half of the trilinear weights. Every pixel of the window adds to at most two cell rows and two cell columns;
+ * the four products, times a Gaussian of the distance to the window centre, are fixed and kept per pixel.
+ */
+struct SpatialWeights {
+    int cells[DescriptorBuilder::WINDOW_PIXELS][4];
+    float weights[DescriptorBuilder::WINDOW_PIXELS][4];
+
+    SpatialWeights() {
+        const int SIZE = DescriptorBuilder::WINDOW_SIZE;
+        const int GRID = DescriptorBuilder::GRID_SIZE;
+        const float SIGMA = 0.5f * SIZE;
+        const float CENTRE = 0.5f * (SIZE - 1);
+
+        for (int i = 0; i < SIZE; i++) {
+            for (int j = 0; j < SIZE; j++) {
+                int p = i * SIZE + j;
+                float r = (i + 0.5f) / DescriptorBuilder::CELL_SIZE - 0.5f;
+                float c = (j + 0.5f) / DescriptorBuilder::CELL_SIZE - 0.5f;
+                int r0 = (int) floor(r);
+                int c0 = (int) floor(c);
+                float fr = r - r0;
+                float fc = c - c0;
+                float dr = i - CENTRE;
+                float dc = j - CENTRE;
+                float gaussian = exp(-(dr * dr + dc * dc) / (2.0f * SIGMA * SIGMA));
+
+                for (int s = 0; s < 4; s++) {
+                    int cr = r0 + (s >> 1);
+                    int cc = c0 + (s & 1);
+                    float w = ((s >> 1) ? fr : 1.0f - fr) * ((s & 1) ? fc : 1.0f - fc);
+                    bool inside = cr >= 0 && cr < GRID && cc >= 0 && cc < GRID;
+
+                    // Cells outside the grid get no weight, pointing them at cell 0 keeps the loop branch free
+                    cells[p][s] = inside ? cr * GRID + cc : 0;
+                    weights[p][s] = inside ? w * gaussian : 0.0f;
+                }
+            }
+        }
+    }
+};
+
+static const SpatialWeights SPATIAL_WEIGHTS;
+
+/**
+ * Angle of the vector (x, y) counter-clockwise from the x axis, in [0, 2 pi], from a polynomial instead of atan2
+ *
+ * @param y Second component
+ * @param x First component
+ * @return float
+ */
+float DescriptorBuilder::polarAngle(float y, float x) {
+    float ax = fabs(x);
+    float ay = fabs(y);
+    float a = min(ax, ay) / max(max(ax, ay), 1e-30f);
+    float s = a * a;
+    float r = (((ATAN_C9 * s + ATAN_C7) * s + ATAN_C5) * s + ATAN_C3) * s * a + ATAN_C1 * a;
+
+    r = (ay > ax) ? HALF_PI - r : r;
+    r = (x < 0) ? PI - r : r;
+    return (y < 0) ? TWO_PI - r : r;
+}
+
+/**
+ * Magnitude and orientation of count derivative pairs. Orientations are given in bins, in [0, NUMBER_OF_BINS].
+ *
+ * @param x Vertical derivatives
+ * @param y Horizontal derivatives
+ * @param count Number of pixels
+ * @param magnitudes Receives count magnitudes
+ * @param orientations Receives count orientations
+ * @return void
+ */
+void DescriptorBuilder::gradients(const float *x, const float *y, size_t count, float *magnitudes,
+                                  float *orientations) {
+    size_t p = 0;
+
+#ifdef __SSE2__
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 tiny = _mm_set1_ps(1e-30f);
+    const __m128 c1 = _mm_set1_ps(ATAN_C1), c3 = _mm_set1_ps(ATAN_C3), c5 = _mm_set1_ps(ATAN_C5);
+    const __m128 c7 = _mm_set1_ps(ATAN_C7), c9 = _mm_set1_ps(ATAN_C9);
+    const __m128 halfPi = _mm_set1_ps(HALF_PI), pi = _mm_set1_ps(PI), twoPi = _mm_set1_ps(TWO_PI);
+    const __m128 binsPerRadian = _mm_set1_ps(BINS_PER_RADIAN);
+
+    for (; p + 4 <= count; p += 4) {
+        __m128 vx = _mm_loadu_ps(x + p);
+        __m128 vy = _mm_loadu_ps(y + p);
+        __m128 ax = _mm_andnot_ps(signMask, vx);
+        __m128 ay = _mm_andnot_ps(signMask, vy);
+        __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), tiny));
+        __m128 s = _mm_mul_ps(a, a);
+        __m128 r = _mm_add_ps(_mm_mul_ps(c9, s), c7);
+        r = _mm_add_ps(_mm_mul_ps(r, s), c5);
+        r = _mm_add_ps(_mm_mul_ps(r, s), c3);
+        r = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(r, s), a), _mm_mul_ps(c1, a));
+
+        // Unfold the first octant into the full circle with selects instead of branches
+        __m128 steep = _mm_cmpgt_ps(ay, ax);
+        r = _mm_or_ps(_mm_and_ps(steep, _mm_sub_ps(halfPi, r)), _mm_andnot_ps(steep, r));
+        __m128 left = _mm_cmplt_ps(vx, zero);
+        r = _mm_or_ps(_mm_and_ps(left, _mm_sub_ps(pi, r)), _mm_andnot_ps(left, r));
+        __m128 below = _mm_cmplt_ps(vy, zero);
+        r = _mm_or_ps(_mm_and_ps(below, _mm_sub_ps(twoPi, r)), _mm_andnot_ps(below, r));
+
+        _mm_storeu_ps(magnitudes + p, _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy))));
+        _mm_storeu_ps(orientations + p, _mm_mul_ps(r, binsPerRadian));
+    }
+#endif
+
+    for (; p < count; p++) {
+        magnitudes[p] = sqrt(x[p] * x[p] + y[p] * y[p]);
+        orientations[p] = polarAngle(y[p], x[p]) * BINS_PER_RADIAN;
+    }
+}
+
+/**
+ * Trilinear histogram of one window
+ *
+ * @param magnitudes WINDOW_PIXELS gradient magnitudes
+ * @param orientations WINDOW_PIXELS orientations in bins
+ * @param histogram Receives DESCRIPTOR_SIZE values, cell-major
+ * @return void
+ */
+void DescriptorBuilder::accumulate(const float *magnitudes, const float *orientations, float *histogram) {
+    fill(histogram, histogram + DESCRIPTOR_SIZE, 0.0f);
+
+    for (int p = 0; p < WINDOW_PIXELS; p++) {
+        float o = orientations[p];
+        int o0 = (int) o;
+        float f = o - o0;
+        float low = magnitudes[p] * (1.0f - f);
+        float high = magnitudes[p] * f;
+
+        // An angle of exactly 2 pi lands on bin NUMBER_OF_BINS, the same bin as 0
+        o0 &= NUMBER_OF_BINS - 1;
+        int o1 = (o0 + 1) & (NUMBER_OF_BINS - 1);
+
+        for (int s = 0; s < 4; s++) {
+            float *h = histogram + SPATIAL_WEIGHTS.cells[p][s] * NUMBER_OF_BINS;
+            float w = SPATIAL_WEIGHTS.weights[p][s];
+            h[o0] += w * low;
+            h[o1] += w * high;
+        }
+    }
+}
+
+/**
+ * L2 normalize, clip every component to CLIP_THRESHOLD and normalize again. All zero descriptors are left as they are.
+ *
+ * @param descriptor DESCRIPTOR_SIZE values, changed in place
+ * @return void
+ */
+void DescriptorBuilder::normalize(float *descriptor) {
+    for (int pass = 0; pass < 2; pass++) {
+        float norm = 0;
+
+        for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+            norm += descriptor[i] * descriptor[i];
+        }
+
+        if (norm <= 0) {
+            return;
+        }
+
+        float normalizer = 1.0f / sqrt(norm);
+        for (int i = 0; i < DESCRIPTOR_SIZE; i++) {
+            descriptor[i] *= normalizer;
+            if (pass == 0) {
+                descriptor[i] = min(descriptor[i], CLIP_THRESHOLD);
+            }
+        }
+    }
+}
+
+/**
+ * Descriptors of count windows
+ *
+ * @param windowsX count x WINDOW_PIXELS vertical derivatives
+ * @param windowsY count x WINDOW_PIXELS horizontal derivatives
+ * @param count Number of windows
+ * @param descriptors Receives count x DESCRIPTOR_SIZE normalized values
+ * @return void
+ */
+void DescriptorBuilder::build(const float *windowsX, const float *windowsY, size_t count, float *descriptors) {
+    vector<float> magnitudes(count * WINDOW_PIXELS);
+    vector<float> orientations(count * WINDOW_PIXELS);
+
+    gradients(windowsX, windowsY, count * WINDOW_PIXELS, magnitudes.data(), orientations.data());
+
+    for (size_t k = 0; k < count; k++) {
+        float *descriptor = descriptors + k * DESCRIPTOR_SIZE;
+
+        accumulate(magnitudes.data() + k * WINDOW_PIXELS, orientations.data() + k * WINDOW_PIXELS, descriptor);
+        normalize(descriptor);
+    }
+}
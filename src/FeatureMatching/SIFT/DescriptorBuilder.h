@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * Builds 128 bin gradient histogram descriptors for many keypoints in one call. Magnitudes and orientations of every
+ * window are computed first in one vectorized pass with a polynomial atan2, then each window is binned with trilinear
+ * interpolation (two rows, two columns and two orientations per pixel) under a Gaussian weight, L2 normalized,
+ * clipped and normalized again.
+ *
+ * Windows are WINDOW_SIZE x WINDOW_SIZE row-major blocks of the vertical (x) and horizontal (y) derivatives, laid out
+ * one after another, in the naming of HarrisKernel.
+ */
+class DescriptorBuilder {
+public:
+    const static int WINDOW_SIZE = 16;
+    const static int WINDOW_PIXELS = WINDOW_SIZE * WINDOW_SIZE;
+    const static int GRID_SIZE = 4;                     // Cells per window side
+    const static int CELL_SIZE = WINDOW_SIZE / GRID_SIZE;
+    const static int NUMBER_OF_BINS = 8;
+    const static int DESCRIPTOR_SIZE = GRID_SIZE * GRID_SIZE * NUMBER_OF_BINS;
+    constexpr static float CLIP_THRESHOLD = 0.2f;       // Largest normalized component, limits lighting effects
+private:
+    static void gradients(const float *x, const float *y, size_t count, float *magnitudes, float *orientations);
+    static void accumulate(const float *magnitudes, const float *orientations, float *histogram);
+    static void normalize(float *descriptor);
+public:
+    static float polarAngle(float y, float x);
+    static void build(const float *windowsX, const float *windowsY, size_t count, float *descriptors);
+};
\ No newline at end of file
@@ -4,22 +4,12 @@
 /**
  * Constructor
  *
- * @param x Window of x derivative values
- * @param y Window of y derivative values
  * @param row Row position of originating interest point
  * @param col Column position of originating interest point
  */
-SIFTDescriptor::SIFTDescriptor(float x[WINDOW_SIZE][WINDOW_SIZE], float y[WINDOW_SIZE][WINDOW_SIZE], int row, int col) {
-    // Init neighbourhood window
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        for (int j = 0; j < WINDOW_SIZE; j++) {
-            this->windowX[i][j] = x[i][j];
-            this->windowY[i][j] = y[i][j];
-        }
-    }
-
+SIFTDescriptor::SIFTDescriptor(int row, int col) {
     // Init bins to 0;
-    for (int i = 0; i < WINDOW_SIZE; i++) {
+    for (int i = 0; i < NUMBER_OF_GRIDS; i++) {
         for (int j = 0; j < NUMBER_OF_BINS; j++) {
             bins[i][j] = 0.0;
         }
@@ -31,14 +21,18 @@ SIFTDescriptor::SIFTDescriptor(float x[WINDOW_SIZE][WINDOW_SIZE], float y[WINDOW
 }
 
 /**
- * Generate the histograms for all grids within the window
+ * Generate the histograms for all grids within the window. The derivative windows are only read here and are not kept,
+ * so the caller can discard them as soon as this returns.
  *
+ * @param windowX Window of x derivative values
+ * @param windowY Window of y derivative values
  * @return void
  */
-void SIFTDescriptor::generateHistograms() {
+void SIFTDescriptor::generateHistograms(const float windowX[WINDOW_SIZE][WINDOW_SIZE],
+                                        const float windowY[WINDOW_SIZE][WINDOW_SIZE]) {
     const float MAGNITUDE_THRESHOLD = 0.2;
     float m;
-    int a;
+    float a;
 
     for (int i = 0; i < WINDOW_SIZE; i++) {
         int gX = i/4;               // X Grid Value
@@ -52,7 +46,7 @@ void SIFTDescriptor::generateHistograms() {
 
             // Calculate magnitude, angle, bin placement
             m = sqrt((x*x)+(y*y));
-            a = (int) ((atan(y/x)*180)/M_PI) % 360; // Angle in degrees
+            a = (atan2(y, x)*180)/M_PI;  // Angle in degrees, all four quadrants
             bin = indexForTheta(a);
 
             // Threshold
@@ -64,7 +58,7 @@ void SIFTDescriptor::generateHistograms() {
 /**
  * Maps theta to a bin index
  *
- * @param theta Calculated angle from 0 to 360 degrees
+ * @param theta Calculated angle from -180 to 360 degrees
  * @return int
  */
 int SIFTDescriptor::indexForTheta(float theta) {
@@ -111,3 +105,4 @@ double SIFTDescriptor::SSD(SIFTDescriptor f1) {
 
 int SIFTDescriptor::getFeatureRow() const { return featureRow; }
 int SIFTDescriptor::getFeatureCol() const { return featureCol; }
+const float *SIFTDescriptor::getBins() const { return &bins[0][0]; }
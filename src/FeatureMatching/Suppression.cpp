@@ -0,0 +1,260 @@
+#include "Suppression.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include "../Tools/ScratchArena.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Maximum over [i - radius, i + radius] for every i of a row, with the window clipped to the row. The padded row is
+ * cut into blocks of one window length; a window then covers the end of one block and the start of the next, so its
+ * maximum is the larger of a suffix maximum and a prefix maximum: three comparisons per element for any radius.
+ *
+ * @param src Row to filter
+ * @param n Row length
+ * @param radius Half window
+ * @param dst Receives the n maxima, may not alias src
+ * @param scratch 3 * padded floats, padded being n + 2 * radius rounded up to a multiple of the window
+ * @return void
+ */
+void Suppression::runningMax(const float *src, int n, int radius, float *dst, float *scratch) {
+    const int window = 2 * radius + 1;
+    const int padded = (n + 2 * radius + window - 1) / window * window;
+
+    float *x = scratch;
+    float *prefix = x + padded;
+    float *suffix = prefix + padded;
+
+    fill(x, x + radius, -FLT_MAX);
+    copy(src, src + n, x + radius);
+    fill(x + radius + n, x + padded, -FLT_MAX);
+
+    for (int block = 0; block < padded; block += window) {
+        prefix[block] = x[block];
+        for (int k = block + 1; k < block + window; k++) {
+            prefix[k] = max(prefix[k - 1], x[k]);
+        }
+
+        suffix[block + window - 1] = x[block + window - 1];
+        for (int k = block + window - 2; k >= block; k--) {
+            suffix[k] = max(suffix[k + 1], x[k]);
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        dst[i] = max(suffix[i], prefix[i + window - 1]);
+    }
+}
+
+/**
+ * Pixels of area that are positive and the largest in the (2 radius + 1) square around them. The window reads the
+ * whole response, clipped at its edges, so a point on the border of area is still compared with pixels outside it.
+ * Both running maxima work on row strips, the vertical one on whole rows at a time, so the cost per pixel is constant
+ * and no full size intermediate is allocated. Equal neighbours on a plateau are all kept.
+ *
+ * @param response Corner strengths (CV_32F)
+ * @param radius Half window
+ * @param area Where maxima may lie, in response coordinates
+ * @param maxima Receives the maxima in row-major order
+ * @param pool Threads to run on, the shared pool if null
+ * @return void
+ */
+void Suppression::localMaxima(const Mat &response, int radius, const Rect &area, vector<Point> &maxima,
+                              ThreadPool *pool) {
+    CV_Assert(response.type() == CV_32F);
+
+    const int rows = response.rows, cols = response.cols;
+    const int window = 2 * radius + 1;
+    Rect region = area & Rect(0, 0, cols, rows);
+
+    maxima.clear();
+    if (region.width <= 0 || region.height <= 0) {
+        return;
+    }
+    if (pool == nullptr) {
+        pool = &ThreadPool::getShared();
+    }
+
+    vector<vector<Point> > found((region.height + STRIP_ROWS - 1) / STRIP_ROWS);
+
+    // Buffers sized for a full strip and a full row
+    const int stripPadded = (STRIP_ROWS + 2 * radius + window - 1) / window * window;
+    const int rowPadded = (cols + 2 * radius + window - 1) / window * window;
+
+    pool->parallelFor(0, found.size(), 1, [&](size_t begin, size_t end) {
+        ScratchArena &arena = ScratchArena::local();
+        ScratchArena::Scope scope(arena);
+        float *scratch = arena.allocate<float>(3 * (size_t) rowPadded);
+        float *prefix = arena.allocate<float>((size_t) stripPadded * cols);
+        float *suffix = arena.allocate<float>((size_t) stripPadded * cols);
+
+        for (size_t s = begin; s < end; s++) {
+            int top = region.y + (int) s * STRIP_ROWS;
+            int bottom = min(top + (int) STRIP_ROWS, region.y + region.height);
+            int padded = (bottom - top + 2 * radius + window - 1) / window * window;
+
+            // Horizontal maxima of every row the strip's windows reach, rows past the edge never win
+            for (int k = 0; k < padded; k++) {
+                int r = top - radius + k;
+                float *row = &prefix[(size_t) k * cols];
+
+                if (r >= 0 && r < rows) {
+                    runningMax(response.ptr<float>(r), cols, radius, row, scratch);
+                }
+                else {
+                    fill(row, row + cols, -FLT_MAX);
+                }
+            }
+
+            // Vertical running maximum over whole rows: suffix maxima first, then prefix maxima in place
+            for (int block = 0; block < padded; block += window) {
+                float *last = &suffix[(size_t) (block + window - 1) * cols];
+                copy(&prefix[(size_t) (block + window - 1) * cols], &prefix[(size_t) (block + window - 1) * cols] + cols,
+                     last);
+
+                for (int k = block + window - 2; k >= block; k--) {
+                    const float *below = &suffix[(size_t) (k + 1) * cols];
+                    const float *x = &prefix[(size_t) k * cols];
+                    float *out = &suffix[(size_t) k * cols];
+
+                    for (int j = 0; j < cols; j++) {
+                        out[j] = max(below[j], x[j]);
+                    }
+                }
+                for (int k = block + 1; k < block + window; k++) {
+                    const float *above = &prefix[(size_t) (k - 1) * cols];
+                    float *out = &prefix[(size_t) k * cols];
+
+                    for (int j = 0; j < cols; j++) {
+                        out[j] = max(above[j], out[j]);
+                    }
+                }
+            }
+
+            for (int i = top; i < bottom; i++) {
+                const float *value = response.ptr<float>(i);
+                const float *fromBlockEnd = &suffix[(size_t) (i - top) * cols];
+                const float *fromBlockStart = &prefix[(size_t) (i - top + 2 * radius) * cols];
+
+                for (int j = region.x; j < region.x + region.width; j++) {
+                    if (value[j] > 0 && value[j] >= max(fromBlockEnd[j], fromBlockStart[j])) {
+                        found[s].push_back(Point(j, i));
+                    }
+                }
+            }
+        }
+    });
+
+    for (const vector<Point> &strip : found) {
+        maxima.insert(maxima.end(), strip.begin(), strip.end());
+    }
+}
+
+/**
+ * Adaptive non-maximal suppression. Every point gets the squared distance to the nearest point whose response is
+ * clearly larger than its own, and the count points with the largest distances are kept, so strong corners in busy
+ * regions do not crowd out the rest of the image. The clearly stronger points are a prefix of the points ordered by
+ * response, which bounds the search for each point.
+ *
+ * @param points Candidate positions
+ * @param responses Corner strength of each candidate
+ * @param count Points to keep, 0 or less keeps all
+ * @param pool Threads to run on, the shared pool if null
+ * @return vector<int> Indices into points of the kept points, ascending
+ */
+vector<int> Suppression::adaptive(const vector<Point> &points, const vector<float> &responses, int count,
+                                  ThreadPool *pool) {
+    const size_t CHUNK = 256;
+    const size_t n = points.size();
+    vector<int> selected;
+
+    if (count <= 0 || n <= (size_t) count) {
+        selected.resize(n);
+        iota(selected.begin(), selected.end(), 0);
+        return selected;
+    }
+    if (pool == nullptr) {
+        pool = &ThreadPool::getShared();
+    }
+
+    vector<int> order(n);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&responses](int a, int b) { return responses[a] > responses[b]; });
+
+    vector<float> radius(n);
+    pool->parallelFor(0, n, CHUNK, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; p++) {
+            const Point &point = points[order[p]];
+            float response = responses[order[p]];
+            size_t stronger = partition_point(order.begin(), order.begin() + p, [&](int j) {
+                return ANMS_ROBUSTNESS * responses[j] > response;
+            }) - order.begin();
+            float nearest = FLT_MAX;
+
+            for (size_t q = 0; q < stronger; q++) {
+                float dx = (float) (points[order[q]].x - point.x);
+                float dy = (float) (points[order[q]].y - point.y);
+                nearest = min(nearest, dx * dx + dy * dy);
+            }
+
+            radius[p] = nearest;
+        }
+    });
+
+    // Largest radius first, the stronger point first on equal radii
+    vector<int> rank(n);
+    iota(rank.begin(), rank.end(), 0);
+    partial_sort(rank.begin(), rank.begin() + count, rank.end(), [&radius](int a, int b) {
+        return (radius[a] != radius[b]) ? radius[a] > radius[b] : a < b;
+    });
+
+    selected.resize(count);
+    for (int k = 0; k < count; k++) {
+        selected[k] = order[rank[k]];
+    }
+    sort(selected.begin(), selected.end());
+
+    return selected;
+}
+
+/**
+ * Offset of a response maximum from the pixel it was found on. The quadratic through the 3x3 neighbourhood has its
+ * gradient and Hessian from central differences, and its stationary point is the peak. The offset is zero when that
+ * quadratic has no maximum or puts it more than half a pixel away, where a neighbour would have been the maximum.
+ *
+ * @param response CV_32F corner response
+ * @param peak Local maximum of response
+ * @return Point2f Offset in x and y, each within half a pixel
+ */
+Point2f Suppression::subpixelOffset(const Mat &response, const Point &peak) {
+    if (peak.x < 1 || peak.y < 1 || peak.x >= response.cols - 1 || peak.y >= response.rows - 1) {
+        return Point2f(0.0f, 0.0f);
+    }
+
+    const float *above = response.ptr<float>(peak.y - 1) + peak.x;
+    const float *row = response.ptr<float>(peak.y) + peak.x;
+    const float *below = response.ptr<float>(peak.y + 1) + peak.x;
+
+    double dx = 0.5 * ((double) row[1] - row[-1]);
+    double dy = 0.5 * ((double) below[0] - above[0]);
+    double dxx = (double) row[1] - 2.0 * row[0] + row[-1];
+    double dyy = (double) below[0] - 2.0 * row[0] + above[0];
+    double dxy = 0.25 * ((double) below[1] - below[-1] - above[1] + above[-1]);
+    double det = dxx * dyy - dxy * dxy;
+
+    // A maximum needs a negative definite Hessian
+    if (dxx >= 0 || det <= 0) {
+        return Point2f(0.0f, 0.0f);
+    }
+
+    double ox = -(dyy * dx - dxy * dy) / det;
+    double oy = -(dxx * dy - dxy * dx) / det;
+    if (fabs(ox) > 0.5 || fabs(oy) > 0.5) {
+        return Point2f(0.0f, 0.0f);
+    }
+
+    return Point2f((float) ox, (float) oy);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Keypoint selection on a corner response. localMaxima keeps the pixels that are the largest in the square window
+ * around them, using the van Herk/Gil-Werman running maximum so the cost per pixel does not depend on the window size.
+ * adaptive then keeps a fixed number of them spread over the image, ranked by the distance to the nearest clearly
+ * stronger point (Brown, Szeliski and Winder's adaptive non-maximal suppression). subpixelOffset finally places a
+ * kept maximum between pixels.
+ */
+class Suppression {
+private:
+    const static int STRIP_ROWS = 64;                   // Output rows per task
+    constexpr static float ANMS_ROBUSTNESS = 0.9f;      // A point suppresses only those below 90% of its response
+    static void runningMax(const float *src, int n, int radius, float *dst, float *scratch);
+public:
+    static void localMaxima(const cv::Mat &response, int radius, const cv::Rect &area, std::vector<cv::Point> &maxima,
+                            ThreadPool *pool = nullptr);
+    static std::vector<int> adaptive(const std::vector<cv::Point> &points, const std::vector<float> &responses,
+                                     int count, ThreadPool *pool = nullptr);
+    static cv::Point2f subpixelOffset(const cv::Mat &response, const cv::Point &peak);
+};
\ No newline at end of file
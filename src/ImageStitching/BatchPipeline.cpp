@@ -0,0 +1,435 @@
+#include "BatchPipeline.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include "Panorama.h"
+#include "../Tools/BoundedQueue.h"
+#include "../Tools/ScratchArena.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * One job in flight and what its stages produced so far
+ */
+struct Work {
+    BatchPipeline::Job job;
+    shared_ptr<Panorama> panorama;      // Released once composited
+    Mat mosaic;                         // Released once encoded
+    Size size;
+    int pairs;                          // Verified image pairs
+    int connected;                      // Images chained to the reference
+    string error;                       // Why the job failed, empty while it has not
+};
+
+typedef shared_ptr<Work> WorkPointer;
+
+/**
+ * One step every job goes through
+ */
+struct Stage {
+    string name;
+    function<void(Work &)> body;
+};
+
+/**
+ * Destination of the JSON lines, shared by the stage threads
+ */
+struct PipelineLog {
+    ostream *out;
+    mutex lock;
+    size_t completed;
+    size_t failed;
+    size_t total;
+};
+
+/**
+ * JSON string literal of a text
+ *
+ * @param text Text to quote
+ * @return string
+ */
+static string quote(const string &text) {
+    string quoted = "\"";
+
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if ((unsigned char) c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", (unsigned int) (unsigned char) c);
+            quoted += escape;
+        }
+        else {
+            quoted += c;
+        }
+    }
+
+    return quoted + "\"";
+}
+
+/**
+ * Write one line to the log and flush it, so a reader following the output sees progress as it happens
+ *
+ * @param log Log to write to
+ * @param line JSON object
+ * @return void
+ */
+static void writeLine(PipelineLog &log, const string &line) {
+    lock_guard<mutex> guard(log.lock);
+    *log.out << line << "\n";
+    log.out->flush();
+}
+
+/**
+ * Job parameters of the interactive panorama mode: three octaves, coarse-to-fine matching, SIFT and multiband blending
+ */
+BatchPipeline::Job::Job() {
+    this->octaves = 3;
+    this->coarseToFine = true;
+    this->descriptorType = DescriptorSet::SIFT;
+    this->blendMode = Blender::MULTIBAND;
+    this->bands = 5;
+}
+
+/**
+ * Constructor
+ *
+ * @param pool Threads every stage spreads its work over, the shared pool if null
+ */
+BatchPipeline::BatchPipeline(ThreadPool *pool) {
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+    this->cache = nullptr;
+    this->pipelined = true;
+}
+
+/**
+ * Set a job parameter from a key=value token
+ *
+ * @param token Manifest token
+ * @param job Job to change
+ * @return bool Whether the key and value were understood
+ */
+bool BatchPipeline::applyParameter(const string &token, Job &job) {
+    size_t equals = token.find('=');
+    string key = token.substr(0, equals);
+    string value = token.substr(equals + 1);
+
+    if (key == "octaves" || key == "bands") {
+        int number = atoi(value.c_str());
+        if (number < 1) {
+            return false;
+        }
+        (key == "octaves" ? job.octaves : job.bands) = number;
+        return true;
+    }
+    if (key == "coarse_to_fine" && (value == "0" || value == "1")) {
+        job.coarseToFine = (value == "1");
+        return true;
+    }
+    if (key == "descriptor" && (value == "sift" || value == "brief")) {
+        job.descriptorType = (value == "brief") ? DescriptorSet::BRIEF : DescriptorSet::SIFT;
+        return true;
+    }
+    if (key == "blend" && (value == "overwrite" || value == "feather" || value == "multiband")) {
+        job.blendMode = (value == "overwrite") ? Blender::OVERWRITE :
+                        (value == "feather") ? Blender::FEATHER : Blender::MULTIBAND;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * Read a job manifest. Each line is one job: the output path, its image paths, then key=value parameters for that job
+ * alone. A line starting with "set" changes the parameters of every job after it. Paths are separated by whitespace;
+ * blank lines and lines starting with # are ignored.
+ *
+ *     set octaves=3 blend=multiband
+ *     results/Stitched/rainier.bmp images/rainier/Rainier1.png images/rainier/Rainier2.png
+ *     results/Stitched/yosemite.bmp images/yosemite/Yosemite1.jpg images/yosemite/Yosemite2.jpg descriptor=brief
+ *
+ * Parameters are octaves=<n>, coarse_to_fine=0|1, descriptor=sift|brief, blend=overwrite|feather|multiband and
+ * bands=<n>.
+ *
+ * @param path Manifest file
+ * @param jobs Receives the jobs in manifest order
+ * @param error Receives the first problem found
+ * @return bool Whether the whole manifest was read
+ */
+bool BatchPipeline::readManifest(const string &path, vector<Job> &jobs, string &error) {
+    ifstream in(path.c_str());
+    Job defaults;
+    string line;
+    int number = 0;
+
+    jobs.clear();
+    if (!in) {
+        error = "could not read " + path;
+        return false;
+    }
+
+    while (getline(in, line)) {
+        istringstream tokens(line);
+        string token;
+        vector<string> paths;
+        bool setting = false;
+        Job job = defaults;
+        number++;
+
+        while (tokens >> token) {
+            if (paths.empty() && !setting && token[0] == '#') {
+                break;
+            }
+            if (paths.empty() && !setting && token == "set") {
+                setting = true;
+            }
+            else if (token.find('=') != string::npos) {
+                if (!applyParameter(token, setting ? defaults : job)) {
+                    error = path + ":" + to_string(number) + ": bad parameter " + token;
+                    return false;
+                }
+            }
+            else if (setting) {
+                error = path + ":" + to_string(number) + ": expected key=value after set, got " + token;
+                return false;
+            }
+            else {
+                paths.push_back(token);
+            }
+        }
+
+        if (paths.empty()) {
+            continue;
+        }
+        if (paths.size() < 2) {
+            error = path + ":" + to_string(number) + ": a job needs an output and at least one image";
+            return false;
+        }
+
+        job.output = paths[0];
+        job.name = job.output.substr(job.output.find_last_of("/\\") + 1);
+        job.images.assign(paths.begin() + 1, paths.end());
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+/**
+ * Stitch every job. Stages run on their own threads unless the pipeline is turned off, in which case each job goes
+ * through every stage before the next starts. A job that fails in one stage skips the rest and is reported; the other
+ * jobs carry on.
+ *
+ * Every stage a job passes logs {"event":"stage"} with its time and the jobs queued behind it, every finished job logs
+ * {"event":"job"} with the time since the run started, and the run ends with one {"event":"stage_summary"} per stage
+ * and a {"event":"batch"} total.
+ *
+ * @param jobs Panoramas to stitch
+ * @param log Stream receiving one JSON object per line
+ * @return int Number of jobs that failed
+ */
+int BatchPipeline::run(const vector<Job> &jobs, ostream &log) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    PipelineLog output;
+    output.out = &log;
+    output.completed = 0;
+    output.failed = 0;
+    output.total = jobs.size();
+
+    vector<Stage> stages = {
+        {"decode", [this](Work &work) {
+            const Job &job = work.job;
+            work.panorama = make_shared<Panorama>(job.images, this->pool);
+            work.panorama->setCache(this->cache);
+            work.panorama->setOctaves(job.octaves);
+            work.panorama->setCoarseToFine(job.coarseToFine);
+            work.panorama->setDescriptorType(job.descriptorType);
+            Blender blender = Blender(job.blendMode, job.bands, this->pool);
+            blender.setSeamMethod(SeamFinder::GRAPH_CUT);
+            work.panorama->setBlender(blender);
+            work.panorama->decode();
+
+            for (size_t i = 0; i < job.images.size(); i++) {
+                if (work.panorama->getImages()[i].empty()) {
+                    work.error = "could not read " + job.images[i];
+                    return;
+                }
+            }
+        }},
+        {"detect", [](Work &work) {
+            work.panorama->detect();
+        }},
+        {"match", [](Work &work) {
+            work.panorama->align();
+            work.pairs = (int) work.panorama->getEdges().size();
+            work.connected = 0;
+            for (const Mat &transform : work.panorama->getTransforms()) {
+                work.connected += transform.empty() ? 0 : 1;
+            }
+        }},
+        {"composite", [](Work &work) {
+            work.mosaic = work.panorama->composite();
+            work.size = work.mosaic.size();
+            work.panorama.reset();
+
+            if (work.mosaic.empty()) {
+                work.error = "nothing to composite";
+            }
+        }},
+        {"encode", [](Work &work) {
+            if (!imwrite(work.job.output, work.mosaic)) {
+                work.error = "could not write " + work.job.output;
+            }
+            work.mosaic.release();
+        }}
+    };
+
+    this->stats.assign(stages.size(), StageStats());
+    for (size_t s = 0; s < stages.size(); s++) {
+        this->stats[s].name = stages[s].name;
+        this->stats[s].jobs = 0;
+        this->stats[s].images = 0;
+        this->stats[s].milliseconds = 0;
+    }
+
+    // Run one stage on a job and log it; each stage only updates its own stats
+    auto process = [&](size_t s, Work &work, size_t queued) {
+        if (!work.error.empty()) {
+            return;
+        }
+
+        // Scratch the stage carves on this thread is given back, and the arena reset, once the job leaves the stage
+        ScratchArena::Scope scratch;
+        chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+        try {
+            stages[s].body(work);
+        }
+        catch (const exception &e) {
+            work.error = e.what();
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+
+        if (work.error.empty()) {
+            this->stats[s].jobs++;
+            this->stats[s].images += (int) work.job.images.size();
+            this->stats[s].milliseconds += ms;
+        }
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "{\"event\":\"stage\",\"job\":" << quote(work.job.name) << ",\"stage\":"
+             << quote(stages[s].name) << ",\"status\":" << quote(work.error.empty() ? "ok" : "failed")
+             << ",\"ms\":" << ms << ",\"queued\":" << queued << "}";
+        writeLine(output, line.str());
+    };
+
+    // Report a job that left the last stage or failed on the way, with the time since the run started
+    auto finish = [&](Work &work) {
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        size_t completed;
+        {
+            lock_guard<mutex> guard(output.lock);
+            completed = ++output.completed;
+            output.failed += work.error.empty() ? 0 : 1;
+        }
+
+        ostringstream line;
+        line << fixed << setprecision(2) << "{\"event\":\"job\",\"job\":" << quote(work.job.name) << ",\"status\":"
+             << quote(work.error.empty() ? "ok" : "failed");
+        if (work.error.empty()) {
+            line << ",\"output\":" << quote(work.job.output) << ",\"images\":" << work.job.images.size()
+                 << ",\"pairs\":" << work.pairs << ",\"connected\":" << work.connected << ",\"width\":"
+                 << work.size.width << ",\"height\":" << work.size.height;
+        }
+        else {
+            line << ",\"error\":" << quote(work.error);
+        }
+        line << ",\"elapsed_ms\":" << ms << ",\"completed\":" << completed << ",\"total\":" << output.total << "}";
+        writeLine(output, line.str());
+    };
+
+    if (this->pipelined) {
+        vector<unique_ptr<BoundedQueue<WorkPointer> > > queues;
+        queues.emplace_back(new BoundedQueue<WorkPointer>(max(jobs.size(), (size_t) 1)));
+        for (size_t s = 1; s < stages.size(); s++) {
+            queues.emplace_back(new BoundedQueue<WorkPointer>(QUEUE_CAPACITY));
+        }
+
+        for (const Job &job : jobs) {
+            WorkPointer work = make_shared<Work>();
+            work->job = job;
+            queues[0]->push(work);
+        }
+        queues[0]->close();
+
+        vector<thread> threads;
+        for (size_t s = 0; s < stages.size(); s++) {
+            threads.emplace_back([&, s] {
+                WorkPointer work;
+                bool last = (s + 1 == stages.size());
+
+                while (queues[s]->pop(work)) {
+                    process(s, *work, queues[s]->size());
+                    if (last || !work->error.empty()) {
+                        finish(*work);
+                    }
+                    else {
+                        queues[s + 1]->push(work);
+                    }
+                }
+                if (!last) {
+                    queues[s + 1]->close();
+                }
+            });
+        }
+        for (thread &stageThread : threads) {
+            stageThread.join();
+        }
+    }
+    else {
+        for (size_t j = 0; j < jobs.size(); j++) {
+            Work work = Work();
+            work.job = jobs[j];
+
+            for (size_t s = 0; s < stages.size() && work.error.empty(); s++) {
+                process(s, work, jobs.size() - j - 1);
+            }
+            finish(work);
+        }
+    }
+
+    double wall = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    for (const StageStats &stage : this->stats) {
+        double seconds = max(stage.milliseconds, 1e-3) / 1000.0;
+        ostringstream line;
+        line << fixed << setprecision(2) << "{\"event\":\"stage_summary\",\"stage\":" << quote(stage.name)
+             << ",\"jobs\":" << stage.jobs << ",\"images\":" << stage.images << ",\"busy_ms\":" << stage.milliseconds
+             << ",\"jobs_per_second\":" << stage.jobs / seconds << ",\"images_per_second\":" << stage.images / seconds
+             << "}";
+        writeLine(output, line.str());
+    }
+
+    ostringstream line;
+    line << fixed << setprecision(2) << "{\"event\":\"batch\",\"jobs\":" << jobs.size() << ",\"failed\":"
+         << output.failed << ",\"pipelined\":" << (this->pipelined ? "true" : "false") << ",\"ms\":" << wall
+         << ",\"jobs_per_second\":" << jobs.size() / (max(wall, 1e-3) / 1000.0) << "}";
+    writeLine(output, line.str());
+
+    return (int) output.failed;
+}
+
+const FeatureCache *BatchPipeline::getCache() const { return cache; }
+void BatchPipeline::setCache(const FeatureCache *cache) { BatchPipeline::cache = cache; }
+bool BatchPipeline::isPipelined() const { return pipelined; }
+void BatchPipeline::setPipelined(bool pipelined) { BatchPipeline::pipelined = pipelined; }
+const vector<BatchPipeline::StageStats> &BatchPipeline::getStats() const { return stats; }
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Blender.h"
+#include "../FeatureMatching/DescriptorSet.h"
+#include "../FeatureMatching/FeatureCache.h"
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Headless batch driver for many panoramas. A manifest lists the jobs, each with its own images, output and
+ * parameters. Jobs flow through five stages, each on its own thread and linked by bounded queues: decode reads the
+ * images, detect describes their features, match matches candidate pairs, verifies them with RANSAC and chains the
+ * homographies, composite warps and blends, and encode writes the result. While one job is being matched the next
+ * one's images are read, so disk I/O overlaps compute across jobs; within a stage, work is still spread over the
+ * thread pool.
+ *
+ * Progress and per-stage throughput are logged as JSON lines, one object per event.
+ */
+class BatchPipeline {
+public:
+    /**
+     * One panorama to stitch
+     */
+    struct Job {
+        std::string name;                       // Label in the log, the output's file name
+        std::string output;
+        std::vector<std::string> images;
+        int octaves;
+        bool coarseToFine;
+        DescriptorSet::Type descriptorType;
+        Blender::Mode blendMode;
+        int bands;
+        Job();
+    };
+
+    /**
+     * Work done by one stage over the last run()
+     */
+    struct StageStats {
+        std::string name;
+        int jobs;                               // Jobs the stage processed, failed ones excluded
+        int images;                             // Images in those jobs
+        double milliseconds;                    // Time the stage spent working, not waiting on its queues
+    };
+private:
+    const static int QUEUE_CAPACITY = 2;        // Jobs waiting between two stages
+    ThreadPool *pool;
+    const FeatureCache *cache;                  // Stored features to reuse, detection always runs if null
+    bool pipelined;
+    std::vector<StageStats> stats;
+    static bool applyParameter(const std::string &token, Job &job);
+public:
+    explicit BatchPipeline(ThreadPool *pool = nullptr);
+    static bool readManifest(const std::string &path, std::vector<Job> &jobs, std::string &error);
+    int run(const std::vector<Job> &jobs, std::ostream &log);
+    const FeatureCache *getCache() const;
+    void setCache(const FeatureCache *cache);
+    bool isPipelined() const;
+    void setPipelined(bool pipelined);
+    const std::vector<StageStats> &getStats() const;
+};
\ No newline at end of file
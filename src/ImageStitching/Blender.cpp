@@ -0,0 +1,332 @@
+#include "Blender.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <mutex>
+#include "../Tools/Profiler.h"
+#include "../Tools/ScratchArena.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Milliseconds elapsed since start
+ *
+ * @param start Time point taken with steady_clock::now()
+ * @return double
+ */
+static double millisecondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+/**
+ * Replace a with the weighted average of a and b. Pixels where both weights are zero become zero.
+ *
+ * @param a First image, CV_32F with any channel count, receives the result
+ * @param b Second image of the same size and type
+ * @param wa Weight of a, CV_32F single channel
+ * @param wb Weight of b, CV_32F single channel
+ * @return void
+ */
+static void weightedAverage(Mat &a, const Mat &b, const Mat &wa, const Mat &wb) {
+    const int channels = a.channels();
+
+    for (int r = 0; r < a.rows; r++) {
+        float *pa = a.ptr<float>(r);
+        const float *pb = b.ptr<float>(r);
+        const float *qa = wa.ptr<float>(r);
+        const float *qb = wb.ptr<float>(r);
+
+        for (int c = 0; c < a.cols; c++) {
+            float total = qa[c] + qb[c];
+            float scale = (total > 0) ? 1.0f / total : 0.0f;
+            float fa = qa[c] * scale, fb = qb[c] * scale;
+
+            for (int k = c * channels; k < (c + 1) * channels; k++) {
+                pa[k] = pa[k] * fa + pb[k] * fb;
+            }
+        }
+    }
+}
+
+/**
+ * Constructor
+ *
+ * @param mode OVERWRITE, FEATHER or MULTIBAND
+ * @param bands Laplacian pyramid levels below full resolution used by MULTIBAND
+ * @param pool Threads to blend tiles on, the shared pool if null
+ */
+Blender::Blender(Mode mode, int bands, ThreadPool *pool) {
+    this->mode = mode;
+    this->bands = min(max(bands, 1), (int) MAX_BANDS);
+    this->tileSize = TILE_SIZE;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+    this->seamFinder = SeamFinder(SeamFinder::DISTANCE);
+    this->overlap = Rect();
+    this->peakBytes = 0;
+}
+
+/**
+ * Blend an image into the canvas and add its mask to the canvas mask
+ *
+ * @param canvas Image being assembled, 8 bit or float
+ * @param canvasMask CV_8U, non zero where the canvas already holds image data
+ * @param image Image to add, same type as the canvas
+ * @param imageMask CV_8U, non zero where image is valid
+ * @param offset Canvas position of the image's top left pixel
+ * @return void
+ */
+void Blender::blend(Mat &canvas, Mat &canvasMask, const Mat &image, const Mat &imageMask, Point offset) {
+    static Profiler::Timer &timer = Profiler::timer("blend");
+    static Profiler::Counter &overlapPixels = Profiler::counter("blend.overlap_pixels");
+    static Profiler::Peak &workingSet = Profiler::peak("blend.peak_bytes");
+    Profiler::Scope scope(timer);
+
+    const int levels = (mode == MULTIBAND) ? bands : 0;
+    stats.assign(levels + 1, BandStats());
+    for (int l = 0; l <= levels; l++) {
+        stats[l].level = l;
+        stats[l].pixels = 0;
+        stats[l].milliseconds = 0;
+        stats[l].bytes = 0;
+    }
+    overlap = Rect();
+    peakBytes = 0;
+
+    // Work in the part of the canvas the image lands on
+    Rect footprint = Rect(offset.x, offset.y, image.cols, image.rows) & Rect(0, 0, canvas.cols, canvas.rows);
+    if (footprint.empty()) {
+        return;
+    }
+
+    // Weights and the blended box live until the copy below, in the calling thread's arena
+    ScratchArena::Scope scratch;
+    ScratchArena &arena = ScratchArena::local();
+    Rect local = Rect(footprint.x - offset.x, footprint.y - offset.y, footprint.width, footprint.height);
+    Mat canvasRegion = canvas(footprint);
+    Mat canvasMaskRegion = canvasMask(footprint);
+    Mat imageRegion = image(local);
+    Mat imageMaskRegion = imageMask(local);
+    const size_t elemSize = canvas.elemSize();
+
+    // Bounding box of the pixels both cover, in footprint coordinates
+    int top = INT_MAX, left = INT_MAX, bottom = -1, right = -1;
+    for (int r = 0; r < footprint.height; r++) {
+        const uchar *cm = canvasMaskRegion.ptr<uchar>(r);
+        const uchar *im = imageMaskRegion.ptr<uchar>(r);
+
+        for (int c = 0; c < footprint.width; c++) {
+            if (cm[c] && im[c]) {
+                top = min(top, r);
+                bottom = r;
+                left = min(left, c);
+                right = max(right, c);
+            }
+        }
+    }
+
+    Rect both = (bottom >= 0) ? Rect(left, top, right - left + 1, bottom - top + 1) : Rect();
+    Mat blended;
+
+    if (mode != OVERWRITE && !both.empty()) {
+        // Weights are needed a halo beyond the overlap so every tile sees the same pyramid support. pyrDown and pyrUp
+        // each reach 2 pixels of their input level, so a build and collapse over levels reaches just under 4 << levels.
+        const int halo = (mode == MULTIBAND) ? (4 << levels) : 0;
+        const int step = 1 << levels;
+        Rect expanded = Rect(both.x - halo, both.y - halo, both.width + 2 * halo, both.height + 2 * halo) &
+                        Rect(0, 0, footprint.width, footprint.height);
+        Mat canvasWeight = arena.mat(expanded.height, expanded.width, CV_32F);
+        Mat imageWeight = arena.mat(expanded.height, expanded.width, CV_32F);
+
+        distanceTransform(canvasMaskRegion(expanded), canvasWeight, DIST_L2, DIST_MASK_3);
+        distanceTransform(imageMaskRegion(expanded), imageWeight, DIST_L2, DIST_MASK_3);
+
+        // Multi-band blends across a hard seam, the pyramid does the smoothing. The seam finder, if it runs, decides
+        // the pixels both cover, otherwise the seam is where the two distances meet.
+        if (mode == MULTIBAND) {
+            Mat imageSide;
+            seamFinder.find(canvasRegion, canvasMaskRegion, imageRegion, imageMaskRegion, both, imageSide);
+
+            for (int r = 0; r < expanded.height; r++) {
+                float *dc = canvasWeight.ptr<float>(r);
+                float *di = imageWeight.ptr<float>(r);
+                int row = r + expanded.y - both.y;
+                const uchar *side = (!imageSide.empty() && row >= 0 && row < both.height) ?
+                                    imageSide.ptr<uchar>(row) : nullptr;
+
+                for (int c = 0; c < expanded.width; c++) {
+                    bool canvasWins = dc[c] > 0 && dc[c] >= di[c];
+                    if (side != nullptr && dc[c] > 0 && di[c] > 0) {
+                        canvasWins = side[c + expanded.x - both.x] == 0;
+                    }
+                    di[c] = (!canvasWins && di[c] > 0) ? 1.0f : 0.0f;
+                    dc[c] = canvasWins ? 1.0f : 0.0f;
+                }
+            }
+        }
+
+        vector<Rect> tiles;
+        for (int y = both.y; y < both.y + both.height; y += tileSize) {
+            for (int x = both.x; x < both.x + both.width; x += tileSize) {
+                tiles.push_back(Rect(x, y, min(tileSize, both.x + both.width - x),
+                                     min(tileSize, both.y + both.height - y)));
+            }
+        }
+
+        blended = arena.mat(both.height, both.width, canvas.type());
+        mutex statsLock;
+        size_t tileBytes = 0;
+
+        pool->parallelFor(0, tiles.size(), 1, [&](size_t begin, size_t end) {
+            vector<BandStats> tileStats;
+
+            for (size_t t = begin; t < end; t++) {
+                const Rect &tile = tiles[t];
+
+                // pyrDown keeps the even pixels from a tile's origin, so every origin is snapped down onto the grid of
+                // the coarsest level laid from the corner of expanded, the grid an untiled blend decimates on
+                int x = expanded.x + (max(tile.x - halo - expanded.x, 0) / step) * step;
+                int y = expanded.y + (max(tile.y - halo - expanded.y, 0) / step) * step;
+                Rect region = Rect(x, y, tile.x + tile.width + halo - x, tile.y + tile.height + halo - y) & expanded;
+                Rect weightRegion = Rect(region.x - expanded.x, region.y - expanded.y, region.width, region.height);
+                ScratchArena::Scope tileScratch;
+                Mat result;
+
+                tileStats.assign(levels + 1, BandStats());
+                blendTile(canvasRegion(region), imageRegion(region), canvasWeight(weightRegion),
+                          imageWeight(weightRegion), result, tileStats);
+
+                Mat inner = result(Rect(tile.x - region.x, tile.y - region.y, tile.width, tile.height));
+                Mat destination = blended(Rect(tile.x - both.x, tile.y - both.y, tile.width, tile.height));
+                inner.convertTo(destination, canvas.type());
+
+                lock_guard<mutex> guard(statsLock);
+                size_t total = 0;
+                for (int l = 0; l <= levels; l++) {
+                    stats[l].pixels += tileStats[l].pixels;
+                    stats[l].milliseconds += tileStats[l].milliseconds;
+                    stats[l].bytes = max(stats[l].bytes, tileStats[l].bytes);
+                    total += tileStats[l].bytes;
+                }
+                tileBytes = max(tileBytes, total);
+            }
+        });
+
+        size_t concurrent = min(tiles.size(), (size_t) pool->getThreadCount());
+        peakBytes = 2 * canvasWeight.total() * sizeof(float) + blended.total() * elemSize + concurrent * tileBytes;
+        overlap = Rect(footprint.x + both.x, footprint.y + both.y, both.width, both.height);
+        overlapPixels.add((long long) overlap.area());
+        workingSet.update((long long) peakBytes);
+    }
+
+    // Blended pixels inside the overlap box, image pixels wherever the canvas was empty
+    for (int r = 0; r < footprint.height; r++) {
+        uchar *destination = canvasRegion.ptr<uchar>(r);
+        uchar *cm = canvasMaskRegion.ptr<uchar>(r);
+        const uchar *source = imageRegion.ptr<uchar>(r);
+        const uchar *im = imageMaskRegion.ptr<uchar>(r);
+        bool inBox = !blended.empty() && r >= both.y && r < both.y + both.height;
+        const uchar *mixed = inBox ? blended.ptr<uchar>(r - both.y) : nullptr;
+
+        for (int c = 0; c < footprint.width; c++) {
+            if (inBox && c >= both.x && c < both.x + both.width && (cm[c] || im[c])) {
+                memcpy(destination + c * elemSize, mixed + (c - both.x) * elemSize, elemSize);
+            }
+            else if (im[c] && (!cm[c] || mode == OVERWRITE)) {
+                memcpy(destination + c * elemSize, source + c * elemSize, elemSize);
+            }
+
+            cm[c] = (cm[c] || im[c]) ? 255 : 0;
+        }
+    }
+}
+
+/**
+ * Blend one tile. With no pyramid levels this is the feathered average; otherwise both images are split into
+ * Laplacian pyramids, each band is averaged under the Gaussian pyramid of the weights, and the result is collapsed.
+ * Every level is carved from the calling thread's arena, so result is valid until the caller's Scope closes.
+ *
+ * @param canvas Canvas pixels of the tile and its halo
+ * @param image Image pixels of the same region
+ * @param canvasWeight Weight of the canvas, CV_32F
+ * @param imageWeight Weight of the image, CV_32F
+ * @param result Receives the blended region, CV_32F
+ * @param tileStats Receives the cost of every level
+ * @return void
+ */
+void Blender::blendTile(const Mat &canvas, const Mat &image, const Mat &canvasWeight, const Mat &imageWeight,
+                        Mat &result, vector<BandStats> &tileStats) const {
+    const int levels = (int) tileStats.size() - 1;
+    const int channels = canvas.channels();
+    const int type = CV_32FC(channels);
+    ScratchArena &arena = ScratchArena::local();
+    vector<Mat> canvasPyramid(levels + 1), imagePyramid(levels + 1);
+    vector<Mat> canvasWeights(levels + 1), imageWeights(levels + 1);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // OpenCV writes into a destination of the right size and type in place, so each level is carved before use
+    canvasPyramid[0] = arena.mat(canvas.rows, canvas.cols, type);
+    imagePyramid[0] = arena.mat(canvas.rows, canvas.cols, type);
+    canvas.convertTo(canvasPyramid[0], CV_32F);
+    image.convertTo(imagePyramid[0], CV_32F);
+    canvasWeights[0] = canvasWeight;
+    imageWeights[0] = imageWeight;
+
+    // Analysis: each level keeps the detail lost by the next coarser one
+    for (int l = 0; l < levels; l++) {
+        int rows = (canvasPyramid[l].rows + 1) / 2, cols = (canvasPyramid[l].cols + 1) / 2;
+        Mat up = arena.mat(canvasPyramid[l].rows, canvasPyramid[l].cols, type);
+
+        canvasPyramid[l + 1] = arena.mat(rows, cols, type);
+        imagePyramid[l + 1] = arena.mat(rows, cols, type);
+        canvasWeights[l + 1] = arena.mat(rows, cols, CV_32F);
+        imageWeights[l + 1] = arena.mat(rows, cols, CV_32F);
+        pyrDown(canvasPyramid[l], canvasPyramid[l + 1]);
+        pyrDown(imagePyramid[l], imagePyramid[l + 1]);
+        pyrDown(canvasWeights[l], canvasWeights[l + 1]);
+        pyrDown(imageWeights[l], imageWeights[l + 1]);
+
+        pyrUp(canvasPyramid[l + 1], up, canvasPyramid[l].size());
+        subtract(canvasPyramid[l], up, canvasPyramid[l]);
+        pyrUp(imagePyramid[l + 1], up, imagePyramid[l].size());
+        subtract(imagePyramid[l], up, imagePyramid[l]);
+
+        tileStats[l].milliseconds += millisecondsSince(start);
+        start = chrono::steady_clock::now();
+    }
+
+    for (int l = 0; l <= levels; l++) {
+        weightedAverage(canvasPyramid[l], imagePyramid[l], canvasWeights[l], imageWeights[l]);
+
+        tileStats[l].level = l;
+        tileStats[l].pixels = (long long) canvasPyramid[l].total();
+        tileStats[l].bytes = canvasPyramid[l].total() * (2 * channels + 2) * sizeof(float);
+        tileStats[l].milliseconds += millisecondsSince(start);
+        start = chrono::steady_clock::now();
+    }
+
+    // Synthesis, coarse to fine, each level collapsed into its own band
+    result = canvasPyramid[levels];
+    for (int l = levels - 1; l >= 0; l--) {
+        Mat up = arena.mat(canvasPyramid[l].rows, canvasPyramid[l].cols, type);
+        pyrUp(result, up, canvasPyramid[l].size());
+        add(up, canvasPyramid[l], canvasPyramid[l]);
+        result = canvasPyramid[l];
+
+        tileStats[l].milliseconds += millisecondsSince(start);
+        start = chrono::steady_clock::now();
+    }
+}
+
+Blender::Mode Blender::getMode() const { return mode; }
+void Blender::setMode(Mode mode) { Blender::mode = mode; }
+int Blender::getBands() const { return bands; }
+void Blender::setBands(int bands) { Blender::bands = min(max(bands, 1), (int) MAX_BANDS); }
+int Blender::getTileSize() const { return tileSize; }
+void Blender::setTileSize(int tileSize) { Blender::tileSize = max(tileSize, 1); }
+SeamFinder::Method Blender::getSeamMethod() const { return seamFinder.getMethod(); }
+void Blender::setSeamMethod(SeamFinder::Method method) { seamFinder.setMethod(method); }
+const Rect &Blender::getOverlap() const { return overlap; }
+size_t Blender::getPeakBytes() const { return peakBytes; }
+const vector<Blender::BandStats> &Blender::getStats() const { return stats; }
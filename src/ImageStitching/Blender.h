@@ -0,0 +1,59 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../Tools/ThreadPool.h"
+#include "SeamFinder.h"
+
+/**
+ * Blends an image into a canvas. Only the bounding box of the overlap is blended, tile by tile with a halo wider than
+ * the reach of a full pyramid build and collapse, so the float working set grows with the overlap and the tile size
+ * rather than with the canvas. Every tile starts on the decimation grid of the coarsest level, so tiled and untiled
+ * blends agree. Outside the overlap, covered image pixels are copied.
+ *
+ * FEATHER weights both images by their distance to the mask edge. MULTIBAND splits both into Laplacian pyramids and
+ * blends each band with a progressively smoother seam mask. The seam is where the distances to the two mask edges
+ * meet, unless a SeamFinder method is set to place it through the overlap where the images agree.
+ */
+class Blender {
+public:
+    enum Mode { OVERWRITE = 0, FEATHER = 1, MULTIBAND = 2 };
+
+    /**
+     * Cost of one pyramid level in the last blend(), summed over tiles
+     */
+    struct BandStats {
+        int level;
+        long long pixels;           // Pixels processed at this level
+        double milliseconds;        // Thread time spent building, blending and collapsing this level
+        size_t bytes;               // Float working set of this level in one tile
+    };
+private:
+    const static int TILE_SIZE = 512;   // Default overlap pixels per tile side, before the halo
+    const static int MAX_BANDS = 10;
+    Mode mode;
+    int bands;
+    int tileSize;
+    ThreadPool *pool;
+    SeamFinder seamFinder;              // Places the MULTIBAND seam
+    cv::Rect overlap;                   // Overlap bounding box of the last blend(), in canvas coordinates
+    size_t peakBytes;                   // Largest float working set alive at once during the last blend()
+    std::vector<BandStats> stats;
+    void blendTile(const cv::Mat &canvas, const cv::Mat &image, const cv::Mat &canvasWeight,
+                   const cv::Mat &imageWeight, cv::Mat &result, std::vector<BandStats> &tileStats) const;
+public:
+    explicit Blender(Mode mode = MULTIBAND, int bands = 5, ThreadPool *pool = nullptr);
+    void blend(cv::Mat &canvas, cv::Mat &canvasMask, const cv::Mat &image, const cv::Mat &imageMask,
+               cv::Point offset);
+    Mode getMode() const;
+    void setMode(Mode mode);
+    int getBands() const;
+    void setBands(int bands);
+    int getTileSize() const;
+    void setTileSize(int tileSize);
+    SeamFinder::Method getSeamMethod() const;
+    void setSeamMethod(SeamFinder::Method method);
+    const cv::Rect &getOverlap() const;
+    size_t getPeakBytes() const;
+    const std::vector<BandStats> &getStats() const;
+};
\ No newline at end of file
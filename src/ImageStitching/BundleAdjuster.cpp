@@ -0,0 +1,389 @@
+#include "BundleAdjuster.h"
+#include <algorithm>
+#include <cmath>
+#include "../Tools/Profiler.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Everything the cost of an adjustment depends on besides the parameters, in conditioned coordinates
+ */
+struct AdjustmentProblem {
+    /**
+     * Correspondences of one pair, a range of points1 and points2
+     */
+    struct Link {
+        int first;
+        int second;
+        size_t begin;
+        size_t count;
+    };
+
+    int parameters;                 // Eight per free image
+    vector<int> slot;               // Position of each image's parameters / 8, -1 if it is held fixed
+    vector<double> fixed;           // Conditioned homography of every image, used for the fixed ones
+    vector<Link> links;
+    vector<double> points1;         // Conditioned points of the pairs' first images
+    vector<double> points2;         // Conditioned points of the pairs' second images
+    double pixels;                  // Conditioned reference frame units to pixels
+    double lossScale;
+};
+
+/**
+ * C = A * B for row major 3x3 matrices
+ *
+ * @param A Left factor
+ * @param B Right factor
+ * @param C Receives the product, may not alias A or B
+ * @return void
+ */
+static void multiply(const double *A, const double *B, double *C) {
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            C[r * 3 + c] = A[r * 3] * B[c] + A[r * 3 + 1] * B[3 + c] + A[r * 3 + 2] * B[6 + c];
+        }
+    }
+}
+
+/**
+ * Conditioned homography of one image, from the parameters if it is free
+ *
+ * @param problem Adjustment
+ * @param parameters Current parameters
+ * @param image Image index
+ * @param H Receives the homography
+ * @return void
+ */
+static void imageHomography(const AdjustmentProblem &problem, const double *parameters, int image, double H[9]) {
+    const int slot = problem.slot[image];
+
+    if (slot < 0) {
+        copy(&problem.fixed[9 * image], &problem.fixed[9 * image] + 9, H);
+        return;
+    }
+
+    copy(parameters + 8 * slot, parameters + 8 * slot + 8, H);
+    H[8] = 1.0;
+}
+
+/**
+ * Robust cost of the parameters, and optionally the normal equations linearised there. Residuals are the reference
+ * frame distances between the two projections of each correspondence, in pixels.
+ *
+ * @param problem Adjustment
+ * @param parameters Current parameters
+ * @param normal Receives the upper triangle of J^T W J, skipped if null
+ * @param gradient Receives J^T W r
+ * @param squared Receives the sum of squared residuals
+ * @return double Total loss, HUGE_VAL if a point is sent to infinity
+ */
+static double evaluate(const AdjustmentProblem &problem, const double *parameters, double *normal, double *gradient,
+                       double &squared) {
+    const int n = problem.parameters;
+    const double pixels = problem.pixels;
+    double cost = 0;
+    int index[16];
+    double jx[16], jy[16];
+
+    squared = 0;
+    if (normal != nullptr) {
+        fill(normal, normal + (size_t) n * n, 0.0);
+        fill(gradient, gradient + n, 0.0);
+    }
+
+    for (const AdjustmentProblem::Link &link : problem.links) {
+        const int slots[2] = {problem.slot[link.first], problem.slot[link.second]};
+        double H[2][9];
+        imageHomography(problem, parameters, link.first, H[0]);
+        imageHomography(problem, parameters, link.second, H[1]);
+
+        for (size_t k = link.begin; k < link.begin + link.count; k++) {
+            const double *points[2] = {&problem.points1[2 * k], &problem.points2[2 * k]};
+            double projected[2][2], scale[2];
+
+            for (int side = 0; side < 2; side++) {
+                const double *h = H[side];
+                const double x = points[side][0], y = points[side][1];
+                double w = h[6] * x + h[7] * y + h[8];
+
+                if (fabs(w) < 1e-12) {
+                    return HUGE_VAL;
+                }
+                projected[side][0] = (h[0] * x + h[1] * y + h[2]) / w;
+                projected[side][1] = (h[3] * x + h[4] * y + h[5]) / w;
+                scale[side] = pixels / w;
+            }
+
+            double rx = (projected[0][0] - projected[1][0]) * pixels;
+            double ry = (projected[0][1] - projected[1][1]) * pixels;
+            double s = rx * rx + ry * ry;
+            cost += HomographyRefiner::huberLoss(s, problem.lossScale);
+            squared += s;
+
+            if (normal == nullptr) {
+                continue;
+            }
+
+            // The first image's projection enters the residual with a plus sign, the second's with a minus
+            int m = 0;
+            for (int side = 0; side < 2; side++) {
+                if (slots[side] < 0) {
+                    continue;
+                }
+
+                const double x = points[side][0], y = points[side][1];
+                const double px = projected[side][0], py = projected[side][1];
+                const double iw = (side == 0) ? scale[side] : -scale[side];
+                const double dx[8] = {x * iw, y * iw, iw, 0, 0, 0, -px * x * iw, -px * y * iw};
+                const double dy[8] = {0, 0, 0, x * iw, y * iw, iw, -py * x * iw, -py * y * iw};
+
+                for (int p = 0; p < 8; p++, m++) {
+                    index[m] = 8 * slots[side] + p;
+                    jx[m] = dx[p];
+                    jy[m] = dy[p];
+                }
+            }
+
+            double weight = HomographyRefiner::huberWeight(s, problem.lossScale);
+            for (int p = 0; p < m; p++) {
+                gradient[index[p]] += weight * (jx[p] * rx + jy[p] * ry);
+                for (int q = p; q < m; q++) {
+                    const int row = min(index[p], index[q]), col = max(index[p], index[q]);
+                    normal[(size_t) row * n + col] += weight * (jx[p] * jx[q] + jy[p] * jy[q]);
+                }
+            }
+        }
+    }
+
+    return cost;
+}
+
+/**
+ * Constructor
+ *
+ * @param lossScale Reference frame distance, in pixels, beyond which the loss grows linearly
+ * @param maxIterations Upper bound on accepted steps
+ */
+BundleAdjuster::BundleAdjuster(float lossScale, int maxIterations) {
+    this->lossScale = lossScale;
+    this->maxIterations = maxIterations;
+    this->iterations = 0;
+    this->initialError = 0;
+    this->finalError = 0;
+}
+
+/**
+ * Adjust the transforms of every image that takes part in a pair, all but the reference. Images without a transform,
+ * and pairs that touch one, are left out.
+ *
+ * @param pairs Inlier correspondences of the verified pairs
+ * @param transforms Each image into the reference frame, empty if unplaced; receives the adjusted ones
+ * @param reference Image held fixed
+ * @return bool False if there was nothing to adjust or the points were degenerate, transforms are then unchanged
+ */
+bool BundleAdjuster::adjust(const vector<Pair> &pairs, vector<Mat> &transforms, int reference) {
+    static Profiler::Timer &timer = Profiler::timer("bundle_adjust");
+    static Profiler::Counter &steps = Profiler::counter("bundle_adjust.iterations");
+    Profiler::Scope scope(timer);
+
+    const int images = (int) transforms.size();
+    AdjustmentProblem problem;
+
+    this->iterations = 0;
+    this->initialError = 0;
+    this->finalError = 0;
+
+    if (reference < 0 || reference >= images || transforms[reference].empty()) {
+        return false;
+    }
+
+    // Current transforms with H[8] = 1
+    vector<double> current(9 * (size_t) images, 0.0);
+    for (int i = 0; i < images; i++) {
+        if (transforms[i].empty()) {
+            continue;
+        }
+
+        Mat t;
+        transforms[i].convertTo(t, CV_64F);
+        for (int k = 0; k < 9; k++) {
+            current[9 * i + k] = t.at<double>(k / 3, k % 3) / t.at<double>(2, 2);
+        }
+    }
+
+    // Pairs between placed images, and each image's points over all of them
+    vector<const Pair *> used;
+    vector<vector<float> > imagePoints(images);
+    problem.slot.assign(images, -1);
+    int free = 0;
+
+    for (const Pair &pair : pairs) {
+        if (pair.first < 0 || pair.second < 0 || pair.first >= images || pair.second >= images ||
+            pair.first == pair.second || pair.count <= 0 || transforms[pair.first].empty() ||
+            transforms[pair.second].empty()) {
+            continue;
+        }
+
+        used.push_back(&pair);
+        imagePoints[pair.first].insert(imagePoints[pair.first].end(), pair.points1, pair.points1 + 2 * pair.count);
+        imagePoints[pair.second].insert(imagePoints[pair.second].end(), pair.points2, pair.points2 + 2 * pair.count);
+
+        for (int image : {pair.first, pair.second}) {
+            if (image != reference && problem.slot[image] < 0) {
+                problem.slot[image] = free++;
+            }
+        }
+    }
+
+    if (free == 0) {
+        return false;
+    }
+
+    // Condition every image by its own points and the reference frame by where they all land
+    vector<double> imageConditioning(9 * (size_t) images);
+    vector<float> landed;
+    for (int i = 0; i < images; i++) {
+        if (imagePoints[i].empty()) {
+            continue;
+        }
+        if (!HomographyRefiner::conditioning(imagePoints[i].data(), nullptr, (int) imagePoints[i].size() / 2,
+                                             &imageConditioning[9 * i])) {
+            return false;
+        }
+
+        const double *h = &current[9 * i];
+        for (size_t k = 0; k < imagePoints[i].size(); k += 2) {
+            double x = imagePoints[i][k], y = imagePoints[i][k + 1];
+            double w = h[6] * x + h[7] * y + h[8];
+            landed.push_back((float) ((h[0] * x + h[1] * y + h[2]) / w));
+            landed.push_back((float) ((h[3] * x + h[4] * y + h[5]) / w));
+        }
+    }
+
+    double Tr[9], TrInverse[9];
+    if (!HomographyRefiner::conditioning(landed.data(), nullptr, (int) landed.size() / 2, Tr) ||
+        !HomographyRefiner::invert(Tr, TrInverse)) {
+        return false;
+    }
+
+    // Conditioned homographies A_i = Tr * H_i * T_i^-1, the free ones scaled to A[8] = 1
+    problem.fixed.assign(9 * (size_t) images, 0.0);
+    problem.parameters = 8 * free;
+    vector<double> parameters(problem.parameters);
+    for (int i = 0; i < images; i++) {
+        if (imagePoints[i].empty()) {
+            continue;
+        }
+
+        double inverse[9], M[9];
+        double *A = &problem.fixed[9 * i];
+        HomographyRefiner::invert(&imageConditioning[9 * i], inverse);
+        multiply(&current[9 * i], inverse, M);
+        multiply(Tr, M, A);
+
+        if (problem.slot[i] >= 0) {
+            if (fabs(A[8]) < 1e-12) {
+                return false;
+            }
+            for (int k = 0; k < 8; k++) {
+                parameters[8 * problem.slot[i] + k] = A[k] / A[8];
+            }
+        }
+    }
+
+    size_t total = 0;
+    for (const Pair *pair : used) {
+        const double *T1 = &imageConditioning[9 * pair->first];
+        const double *T2 = &imageConditioning[9 * pair->second];
+        AdjustmentProblem::Link link = {pair->first, pair->second, total, (size_t) pair->count};
+
+        for (int k = 0; k < pair->count; k++) {
+            problem.points1.push_back(T1[0] * pair->points1[2 * k] + T1[2]);
+            problem.points1.push_back(T1[4] * pair->points1[2 * k + 1] + T1[5]);
+            problem.points2.push_back(T2[0] * pair->points2[2 * k] + T2[2]);
+            problem.points2.push_back(T2[4] * pair->points2[2 * k + 1] + T2[5]);
+        }
+
+        problem.links.push_back(link);
+        total += link.count;
+    }
+    problem.pixels = 1.0 / Tr[0];
+    problem.lossScale = this->lossScale;
+
+    // Levenberg-Marquardt with Marquardt's scaling, as in HomographyRefiner
+    const size_t n = (size_t) problem.parameters;
+    vector<double> normal(n * n), gradient(n), trialNormal(n * n), trialGradient(n), factor(n * n);
+    vector<double> step(n), trial(n);
+    double squared, trialSquared;
+
+    double cost = evaluate(problem, parameters.data(), normal.data(), gradient.data(), squared);
+    if (!isfinite(cost)) {
+        return false;
+    }
+    this->initialError = sqrt(squared / total);
+
+    double damping = INITIAL_DAMPING;
+    int rejected = 0;
+    while (this->iterations < this->maxIterations && rejected < MAX_REJECTED) {
+        if (!HomographyRefiner::solveDamped(normal.data(), gradient.data(), (int) n, damping, factor.data(),
+                                            step.data())) {
+            damping *= 10;
+            rejected++;
+            continue;
+        }
+
+        for (size_t k = 0; k < n; k++) {
+            trial[k] = parameters[k] - step[k];
+        }
+
+        double trialCost = evaluate(problem, trial.data(), trialNormal.data(), trialGradient.data(), trialSquared);
+        if (!(trialCost < cost)) {
+            damping *= 10;
+            rejected++;
+            continue;
+        }
+
+        bool converged = cost - trialCost <= CONVERGED * cost;
+        parameters.swap(trial);
+        normal.swap(trialNormal);
+        gradient.swap(trialGradient);
+        cost = trialCost;
+        squared = trialSquared;
+        damping /= 10;
+        rejected = 0;
+        this->iterations++;
+
+        if (converged) {
+            break;
+        }
+    }
+    this->finalError = sqrt(squared / total);
+    steps.add(this->iterations);
+
+    // H_i = Tr^-1 * A_i * T_i
+    for (int i = 0; i < images; i++) {
+        if (problem.slot[i] < 0) {
+            continue;
+        }
+
+        double A[9], M[9], H[9];
+        imageHomography(problem, parameters.data(), i, A);
+        multiply(A, &imageConditioning[9 * i], M);
+        multiply(TrInverse, M, H);
+        for (int k = 0; k < 9; k++) {
+            H[k] /= H[8];
+        }
+        transforms[i] = Mat(3, 3, CV_64F, H).clone();
+    }
+
+    return true;
+}
+
+int BundleAdjuster::getIterations() const { return iterations; }
+double BundleAdjuster::getInitialError() const { return initialError; }
+double BundleAdjuster::getFinalError() const { return finalError; }
+float BundleAdjuster::getLossScale() const { return lossScale; }
+void BundleAdjuster::setLossScale(float lossScale) { BundleAdjuster::lossScale = lossScale; }
+int BundleAdjuster::getMaxIterations() const { return maxIterations; }
+void BundleAdjuster::setMaxIterations(int maxIterations) { BundleAdjuster::maxIterations = maxIterations; }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "HomographyRefiner.h"
+
+/**
+ * Joint refinement of the homographies that take every image of a panorama into the reference frame. A verified
+ * pair's inlier correspondences should land on the same reference frame point from both of their images, so the
+ * adjustment minimises, under a Huber loss, the distance between the two projections of every correspondence of every
+ * pair at once. Chaining pairwise homographies along a spanning tree leaves the pairs outside the tree unexplained,
+ * and their disagreement shows up as a seam where a loop of images closes; the adjustment spreads it over all images
+ * instead. The reference image is held fixed, which pins the panorama's frame.
+ *
+ * Every free image has the eight parameters of its homography, solved by Levenberg-Marquardt on dense normal
+ * equations in coordinates conditioned per image, which suits the tens of images a panorama has.
+ */
+class BundleAdjuster {
+public:
+    /**
+     * Inlier correspondences of one verified pair, flat point arrays (x0, y0, x1, y1, ...) in either image
+     */
+    struct Pair {
+        int first;
+        int second;
+        const float *points1;
+        const float *points2;
+        int count;
+    };
+private:
+    const static int MAX_ITERATIONS = 30;           // Accepted steps
+    const static int MAX_REJECTED = 8;              // Damping increases without a cost decrease before giving up
+    constexpr static double INITIAL_DAMPING = 1e-3; // Relative to the normal equations' diagonal
+    constexpr static double CONVERGED = 1e-9;       // Relative cost decrease at which the adjustment has converged
+    float lossScale;
+    int maxIterations;
+    int iterations;                                 // Accepted steps of the last adjust()
+    double initialError;                            // RMS reference frame distance before the last adjust()
+    double finalError;                              // RMS reference frame distance after the last adjust()
+public:
+    BundleAdjuster(float lossScale = HomographyRefiner::DEFAULT_LOSS_SCALE, int maxIterations = MAX_ITERATIONS);
+    bool adjust(const std::vector<Pair> &pairs, std::vector<cv::Mat> &transforms, int reference);
+    int getIterations() const;
+    double getInitialError() const;
+    double getFinalError() const;
+    float getLossScale() const;
+    void setLossScale(float lossScale);
+    int getMaxIterations() const;
+    void setMaxIterations(int maxIterations);
+};
\ No newline at end of file
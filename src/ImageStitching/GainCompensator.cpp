@@ -0,0 +1,179 @@
+#include "GainCompensator.h"
+#include <algorithm>
+#include <cmath>
+#include "HomographyRefiner.h"
+#include "Warper.h"
+#include "../Tools/Profiler.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param pool Threads to sample the overlaps on, the shared pool if null
+ */
+GainCompensator::GainCompensator(ThreadPool *pool) {
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+}
+
+/**
+ * Estimate the gain of every image from the mean intensities of the overlaps between them. Each image is sampled
+ * through its transform onto a grid covering the canvas at most SAMPLE_SIZE pixels a side, so only a few samples per
+ * image are read whatever its resolution. Images without a transform, or that overlap nothing, keep a gain of 1.
+ *
+ * @param images 8 bit images, gray, BGR or BGRA
+ * @param transforms Each image into the reference frame, empty to leave the image out
+ * @param canvas Reference frame region the panorama covers
+ * @return bool False if the gains could not be solved for, every gain is then 1
+ */
+bool GainCompensator::estimate(const vector<Mat> &images, const vector<Mat> &transforms, Rect canvas) {
+    static Profiler::Timer &timer = Profiler::timer("gain.estimate");
+    static Profiler::Counter &overlapping = Profiler::counter("gain.overlapping_pairs");
+    Profiler::Scope scope(timer);
+
+    const int count = (int) images.size();
+    this->gains.clear();
+
+    if (count == 0 || transforms.size() != images.size() || canvas.empty()) {
+        return false;
+    }
+
+    // Grid pixel (u, v) is reference frame pixel (canvas.x + u / scale, canvas.y + v / scale)
+    double scale = min(1.0, (double) SAMPLE_SIZE / max(canvas.width, canvas.height));
+    Rect grid = Rect(0, 0, max(cvRound(canvas.width * scale), 1), max(cvRound(canvas.height * scale), 1));
+    double gridValues[9] = {scale, 0, -canvas.x * scale, 0, scale, -canvas.y * scale, 0, 0, 1};
+    Mat toGrid = Mat(3, 3, CV_64F, gridValues);
+    Warper warper = Warper(INTER_LINEAR, this->pool);
+    vector<Mat> gray(count), masks(count);
+    vector<Rect> footprints(count);
+
+    for (int i = 0; i < count; i++) {
+        if (transforms[i].empty() || images[i].empty()) {
+            continue;
+        }
+
+        Mat transform;
+        transforms[i].convertTo(transform, CV_64F);
+        Mat H = Mat(toGrid * transform);
+        footprints[i] = Warper::bounds(H, images[i].size()) & grid;
+        if (footprints[i].empty()) {
+            continue;
+        }
+
+        Warper::RemapTable table;
+        Mat warped;
+        warper.buildTable(H.inv(), footprints[i], images[i].size(), table);
+        warper.warp(images[i], table, warped);
+
+        if (warped.channels() == 1) {
+            gray[i] = warped;
+        }
+        else {
+            cvtColor(warped, gray[i], (warped.channels() == 4) ? COLOR_BGRA2GRAY : COLOR_BGR2GRAY);
+        }
+        masks[i] = table.mask;
+    }
+
+    // Mean intensity of each image over its overlap with every other, and the overlap's sampled area
+    vector<double> means((size_t) count * count, 0.0);
+    vector<double> overlaps((size_t) count * count, 0.0);
+
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count; j++) {
+            Rect shared = footprints[i] & footprints[j];
+            if (gray[i].empty() || gray[j].empty() || shared.empty()) {
+                continue;
+            }
+
+            Rect inI = Rect(shared.x - footprints[i].x, shared.y - footprints[i].y, shared.width, shared.height);
+            Rect inJ = Rect(shared.x - footprints[j].x, shared.y - footprints[j].y, shared.width, shared.height);
+            Mat overlap;
+            bitwise_and(masks[i](inI), masks[j](inJ), overlap);
+
+            int area = countNonZero(overlap);
+            if (area < MIN_OVERLAP) {
+                continue;
+            }
+
+            means[i * count + j] = mean(gray[i](inI), overlap)[0];
+            means[j * count + i] = mean(gray[j](inJ), overlap)[0];
+            overlaps[i * count + j] = area;
+            overlaps[j * count + i] = area;
+            overlapping.add(1);
+        }
+    }
+
+    if (!solve(means, overlaps, count, this->gains)) {
+        this->gains.clear();
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Gains minimising sum over pairs N_ij * ((g_i I_ij - g_j I_ji)^2 / SIGMA_N^2 + ((1 - g_i)^2 + (1 - g_j)^2) /
+ * SIGMA_G^2), where I_ij is the mean intensity of image i over its overlap with image j and N_ij the overlap's area.
+ * The cost is quadratic in the gains, so they are the solution of one small symmetric linear system.
+ *
+ * @param means count x count row major, I_ij
+ * @param overlaps count x count row major, N_ij, 0 where the images do not overlap
+ * @param count Number of images
+ * @param gains Receives the gain of every image
+ * @return bool False if the system could not be solved
+ */
+bool GainCompensator::solve(const vector<double> &means, const vector<double> &overlaps, int count,
+                            vector<double> &gains) {
+    const double noise = 1.0 / (SIGMA_N * SIGMA_N);
+    const double prior = 1.0 / (SIGMA_G * SIGMA_G);
+    vector<double> normal((size_t) count * count, 0.0), factor((size_t) count * count);
+    vector<double> rhs(count, 0.0);
+
+    for (int i = 0; i < count; i++) {
+        for (int j = 0; j < count; j++) {
+            double area = overlaps[i * count + j];
+            if (j == i || area <= 0) {
+                continue;
+            }
+
+            double own = means[i * count + j], other = means[j * count + i];
+            normal[i * count + i] += area * (own * own * noise + prior);
+            if (j > i) {
+                normal[i * count + j] -= area * own * other * noise;
+            }
+            rhs[i] += area * prior;
+        }
+
+        // An image that overlaps nothing is unconstrained, pin it at 1
+        if (normal[i * count + i] == 0) {
+            normal[i * count + i] = 1.0;
+            rhs[i] = 1.0;
+        }
+    }
+
+    gains.assign(count, 1.0);
+    if (!HomographyRefiner::solveDamped(normal.data(), rhs.data(), count, 0.0, factor.data(), gains.data())) {
+        return false;
+    }
+
+    for (double gain : gains) {
+        if (!(gain > 0) || !std::isfinite(gain)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Gain of one image, 1 for images the last estimate() did not cover
+ *
+ * @param image Index of the image
+ * @return double
+ */
+double GainCompensator::getGain(int image) const {
+    return (image >= 0 && image < (int) this->gains.size()) ? this->gains[image] : 1.0;
+}
+
+const vector<double> &GainCompensator::getGains() const { return gains; }
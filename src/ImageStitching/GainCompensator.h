@@ -0,0 +1,30 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Per image gains that even out exposure differences between the images of a panorama. Where two images overlap they
+ * should have the same mean intensity once each is scaled by its gain, so the gains minimise, over every overlapping
+ * pair weighted by its overlap area, the squared difference of the scaled means plus a prior that keeps each gain
+ * near 1 (Brown and Lowe). The overlap statistics are gathered on a canvas of at most SAMPLE_SIZE pixels a side,
+ * sampling the full resolution images sparsely through the warp, so the cost does not grow with the image size. The
+ * gains are applied by Warper::warp() while it samples each image.
+ */
+class GainCompensator {
+private:
+    const static int SAMPLE_SIZE = 256;             // Longest side of the canvas the overlaps are sampled on
+    const static int MIN_OVERLAP = 16;              // Sampled pixels a pair needs to tie its gains together
+    constexpr static double SIGMA_N = 10.0;         // Standard deviation of the mean intensity error, 8 bit levels
+    constexpr static double SIGMA_G = 0.1;          // Standard deviation of the gains around 1
+    ThreadPool *pool;
+    std::vector<double> gains;                      // Gain of every image, empty until estimate() succeeds
+public:
+    explicit GainCompensator(ThreadPool *pool = nullptr);
+    bool estimate(const std::vector<cv::Mat> &images, const std::vector<cv::Mat> &transforms, cv::Rect canvas);
+    static bool solve(const std::vector<double> &means, const std::vector<double> &overlaps, int count,
+                      std::vector<double> &gains);
+    double getGain(int image) const;
+    const std::vector<double> &getGains() const;
+};
\ No newline at end of file
@@ -0,0 +1,417 @@
+#include "HomographyRefiner.h"
+#include <cmath>
+#include <cstring>
+#include "../Tools/Profiler.h"
+
+using namespace std;
+
+/**
+ * C = A * B for row major 3x3 matrices
+ *
+ * @param A Left factor
+ * @param B Right factor
+ * @param C Receives the product, may not alias A or B
+ * @return void
+ */
+static inline void multiply(const double A[9], const double B[9], double C[9]) {
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            C[r * 3 + c] = A[r * 3] * B[c] + A[r * 3 + 1] * B[3 + c] + A[r * 3 + 2] * B[6 + c];
+        }
+    }
+}
+
+/**
+ * Add one residual vector, already in pixels, to the cost and to the weighted normal equations
+ *
+ * @param rx Horizontal residual
+ * @param ry Vertical residual
+ * @param jx Derivatives of rx by the parameters
+ * @param jy Derivatives of ry by the parameters
+ * @param lossScale Huber scale
+ * @param normal Upper triangle of J^T W J, skipped if null
+ * @param gradient J^T W r
+ * @return double Loss of the residual
+ */
+static inline double accumulate(double rx, double ry, const double *jx, const double *jy, double lossScale,
+                                double *normal, double *gradient) {
+    const int n = HomographyRefiner::PARAMETERS;
+    double squared = rx * rx + ry * ry;
+
+    if (normal != nullptr) {
+        double w = HomographyRefiner::huberWeight(squared, lossScale);
+        for (int a = 0; a < n; a++) {
+            gradient[a] += w * (jx[a] * rx + jy[a] * ry);
+            for (int b = a; b < n; b++) {
+                normal[a * n + b] += w * (jx[a] * jx[b] + jy[a] * jy[b]);
+            }
+        }
+    }
+
+    return HomographyRefiner::huberLoss(squared, lossScale);
+}
+
+/**
+ * Robust symmetric transfer cost of a conditioned homography, and optionally the normal equations linearised there.
+ * Residuals are measured in the conditioned frames and scaled back into pixels, so the Huber scale stays in pixels.
+ *
+ * @param h Conditioned homography, H[8] = 1 implied
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param indices Correspondences to use, all count if null
+ * @param count Number of correspondences
+ * @param Ts Conditioning of the first image's points
+ * @param Td Conditioning of the second image's points
+ * @param lossScale Huber scale in pixels
+ * @param normal Receives the upper triangle of J^T W J, 8x8 row major, skipped if null
+ * @param gradient Receives J^T W r
+ * @return double Total loss, HUGE_VAL if h is singular or sends a point to infinity
+ */
+double HomographyRefiner::evaluate(const double h[PARAMETERS], const float *src, const float *dst, const int *indices,
+                                   int count, const double Ts[9], const double Td[9], double lossScale, double *normal,
+                                   double *gradient) {
+    const double H[9] = {h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], 1.0};
+    const double srcPixels = 1.0 / Ts[0];      // Conditioned units to pixels
+    const double dstPixels = 1.0 / Td[0];
+    double G[9], jx[PARAMETERS], jy[PARAMETERS];
+    double cost = 0;
+
+    if (!invert(H, G)) {
+        return HUGE_VAL;
+    }
+    if (normal != nullptr) {
+        fill(normal, normal + PARAMETERS * PARAMETERS, 0.0);
+        fill(gradient, gradient + PARAMETERS, 0.0);
+    }
+
+    for (int k = 0; k < count; k++) {
+        const int i = (indices != nullptr) ? indices[k] : k;
+        const double x = Ts[0] * src[2 * i] + Ts[2], y = Ts[4] * src[2 * i + 1] + Ts[5];
+        const double u = Td[0] * dst[2 * i] + Td[2], v = Td[4] * dst[2 * i + 1] + Td[5];
+
+        // Forward, x through H against u
+        double w = H[6] * x + H[7] * y + 1.0;
+        if (fabs(w) < 1e-12) {
+            return HUGE_VAL;
+        }
+        double px = (H[0] * x + H[1] * y + H[2]) / w;
+        double py = (H[3] * x + H[4] * y + H[5]) / w;
+        double iw = dstPixels / w;
+
+        jx[0] = x * iw;
+        jx[1] = y * iw;
+        jx[2] = iw;
+        jx[3] = jx[4] = jx[5] = 0;
+        jx[6] = -px * x * iw;
+        jx[7] = -px * y * iw;
+        jy[0] = jy[1] = jy[2] = 0;
+        jy[3] = x * iw;
+        jy[4] = y * iw;
+        jy[5] = iw;
+        jy[6] = -py * x * iw;
+        jy[7] = -py * y * iw;
+        cost += accumulate((px - u) * dstPixels, (py - v) * dstPixels, jx, jy, lossScale, normal, gradient);
+
+        // Backward, u through G = H^-1 against x. dG/dh_k = -G E_k G, so the point moves by -G E_k (G u).
+        double back[3] = {G[0] * u + G[1] * v + G[2], G[3] * u + G[4] * v + G[5], G[6] * u + G[7] * v + G[8]};
+        if (fabs(back[2]) < 1e-12) {
+            return HUGE_VAL;
+        }
+        double qx = back[0] / back[2];
+        double qy = back[1] / back[2];
+        double iz = srcPixels / back[2];
+
+        for (int p = 0; p < PARAMETERS; p++) {
+            const int r = p / 3;
+            const double moved = -back[p % 3];
+            double dx = moved * G[r], dy = moved * G[3 + r], dz = moved * G[6 + r];
+            jx[p] = (dx - qx * dz) * iz;
+            jy[p] = (dy - qy * dz) * iz;
+        }
+        cost += accumulate((qx - x) * srcPixels, (qy - y) * srcPixels, jx, jy, lossScale, normal, gradient);
+    }
+
+    return cost;
+}
+
+/**
+ * Refine H over a set of correspondences by Levenberg-Marquardt with Marquardt's diagonal scaling. The Huber weights
+ * are recomputed at every accepted step, and a step is only taken when it lowers the robust cost, so H never gets
+ * worse than it came in.
+ *
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param indices Correspondences to fit, typically the inliers of a RANSAC hypothesis; all count if null
+ * @param count Number of correspondences to fit
+ * @param H Starting homography from src to dst, row major; receives the refined one with H[8] = 1
+ * @param lossScale Residual, in pixels, beyond which the loss grows linearly
+ * @param iterations Receives the accepted steps if not null
+ * @return bool False if fewer than four correspondences were given or H was unusable, H is then unchanged
+ */
+bool HomographyRefiner::refine(const float *src, const float *dst, const int *indices, int count, double H[9],
+                               float lossScale, int *iterations) {
+    static Profiler::Timer &timer = Profiler::timer("refine");
+    static Profiler::Counter &steps = Profiler::counter("refine.iterations");
+    Profiler::Scope scope(timer);
+
+    const int n = PARAMETERS;
+    double Ts[9], Td[9], TsInverse[9], TdInverse[9], M[9], Hn[9];
+    double h[PARAMETERS], trial[PARAMETERS], step[PARAMETERS];
+    double normal[PARAMETERS * PARAMETERS], gradient[PARAMETERS];
+    double trialNormal[PARAMETERS * PARAMETERS], trialGradient[PARAMETERS];
+    double factor[PARAMETERS * PARAMETERS];
+
+    if (iterations != nullptr) {
+        *iterations = 0;
+    }
+    if (count < 4 || !conditioning(src, indices, count, Ts) || !conditioning(dst, indices, count, Td)) {
+        return false;
+    }
+
+    // Hn = Td * H * Ts^-1
+    invert(Ts, TsInverse);
+    invert(Td, TdInverse);
+    multiply(H, TsInverse, M);
+    multiply(Td, M, Hn);
+    if (fabs(Hn[8]) < 1e-12) {
+        return false;
+    }
+    for (int k = 0; k < n; k++) {
+        h[k] = Hn[k] / Hn[8];
+    }
+
+    double cost = evaluate(h, src, dst, indices, count, Ts, Td, lossScale, normal, gradient);
+    if (!isfinite(cost)) {
+        return false;
+    }
+
+    double damping = INITIAL_DAMPING;
+    int accepted = 0, rejected = 0;
+    while (accepted < MAX_ITERATIONS && rejected < MAX_REJECTED) {
+        if (!solveDamped(normal, gradient, n, damping, factor, step)) {
+            damping *= 10;
+            rejected++;
+            continue;
+        }
+
+        for (int k = 0; k < n; k++) {
+            trial[k] = h[k] - step[k];
+        }
+
+        double trialCost = evaluate(trial, src, dst, indices, count, Ts, Td, lossScale, trialNormal, trialGradient);
+        if (!(trialCost < cost)) {
+            damping *= 10;
+            rejected++;
+            continue;
+        }
+
+        bool converged = cost - trialCost <= CONVERGED * cost;
+        memcpy(h, trial, sizeof(h));
+        memcpy(normal, trialNormal, sizeof(normal));
+        memcpy(gradient, trialGradient, sizeof(gradient));
+        cost = trialCost;
+        damping /= 10;
+        rejected = 0;
+        accepted++;
+
+        if (converged) {
+            break;
+        }
+    }
+
+    // H = Td^-1 * Hn * Ts
+    const double refined[9] = {h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7], 1.0};
+    multiply(refined, Ts, M);
+    multiply(TdInverse, M, Hn);
+    for (int k = 0; k < 9; k++) {
+        H[k] = Hn[k] / Hn[8];
+    }
+
+    if (iterations != nullptr) {
+        *iterations = accepted;
+    }
+    steps.add(accepted);
+    return true;
+}
+
+/**
+ * Root mean square symmetric transfer error, the distance of every point's projection from its match in both images
+ *
+ * @param H Homography from src to dst, row major
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param indices Correspondences to measure, all count if null
+ * @param count Number of correspondences
+ * @return double Pixels, HUGE_VAL if H is singular
+ */
+double HomographyRefiner::transferError(const double H[9], const float *src, const float *dst, const int *indices,
+                                        int count) {
+    double G[9];
+    double sum = 0;
+
+    if (count <= 0 || !invert(H, G)) {
+        return HUGE_VAL;
+    }
+
+    for (int k = 0; k < count; k++) {
+        const int i = (indices != nullptr) ? indices[k] : k;
+        const double x = src[2 * i], y = src[2 * i + 1];
+        const double u = dst[2 * i], v = dst[2 * i + 1];
+        double w = H[6] * x + H[7] * y + H[8];
+        double z = G[6] * u + G[7] * v + G[8];
+        double fx = (H[0] * x + H[1] * y + H[2]) / w - u;
+        double fy = (H[3] * x + H[4] * y + H[5]) / w - v;
+        double bx = (G[0] * u + G[1] * v + G[2]) / z - x;
+        double by = (G[3] * u + G[4] * v + G[5]) / z - y;
+
+        sum += fx * fx + fy * fy + bx * bx + by * by;
+    }
+
+    return sqrt(sum / (2.0 * count));
+}
+
+/**
+ * Similarity that moves the centroid of a point set to the origin and scales the mean distance from it to sqrt(2),
+ * Hartley's conditioning for homography estimation
+ *
+ * @param points Flat point array
+ * @param indices Points to use, all count if null
+ * @param count Number of points
+ * @param T Receives the transform, row major: T[0] = T[4] is the scale, T[2] and T[5] the translation
+ * @return bool False if the points coincide
+ */
+bool HomographyRefiner::conditioning(const float *points, const int *indices, int count, double T[9]) {
+    double cx = 0, cy = 0, spread = 0;
+
+    if (count <= 0) {
+        return false;
+    }
+
+    for (int k = 0; k < count; k++) {
+        const int i = (indices != nullptr) ? indices[k] : k;
+        cx += points[2 * i];
+        cy += points[2 * i + 1];
+    }
+    cx /= count;
+    cy /= count;
+
+    for (int k = 0; k < count; k++) {
+        const int i = (indices != nullptr) ? indices[k] : k;
+        double dx = points[2 * i] - cx, dy = points[2 * i + 1] - cy;
+        spread += sqrt(dx * dx + dy * dy);
+    }
+    spread /= count;
+
+    if (spread < 1e-9) {
+        return false;
+    }
+
+    const double s = M_SQRT2 / spread;
+    const double conditioned[9] = {s, 0, -s * cx, 0, s, -s * cy, 0, 0, 1};
+    memcpy(T, conditioned, sizeof(conditioned));
+    return true;
+}
+
+/**
+ * Inverse of a 3x3 matrix from its adjugate
+ *
+ * @param H Row major matrix
+ * @param inverse Receives the inverse, may not alias H
+ * @return bool False if H is singular
+ */
+bool HomographyRefiner::invert(const double H[9], double inverse[9]) {
+    double c0 = H[4] * H[8] - H[5] * H[7];
+    double c1 = H[5] * H[6] - H[3] * H[8];
+    double c2 = H[3] * H[7] - H[4] * H[6];
+    double det = H[0] * c0 + H[1] * c1 + H[2] * c2;
+
+    if (fabs(det) < 1e-15 || !isfinite(det)) {
+        return false;
+    }
+
+    double d = 1.0 / det;
+    inverse[0] = c0 * d;
+    inverse[1] = (H[2] * H[7] - H[1] * H[8]) * d;
+    inverse[2] = (H[1] * H[5] - H[2] * H[4]) * d;
+    inverse[3] = c1 * d;
+    inverse[4] = (H[0] * H[8] - H[2] * H[6]) * d;
+    inverse[5] = (H[2] * H[3] - H[0] * H[5]) * d;
+    inverse[6] = c2 * d;
+    inverse[7] = (H[1] * H[6] - H[0] * H[7]) * d;
+    inverse[8] = (H[0] * H[4] - H[1] * H[3]) * d;
+    return true;
+}
+
+/**
+ * Huber loss of a residual: its square up to the scale, growing linearly beyond it
+ *
+ * @param squared Squared residual length
+ * @param scale Residual length where the loss turns linear
+ * @return double
+ */
+double HomographyRefiner::huberLoss(double squared, double scale) {
+    return (squared <= scale * scale) ? squared : 2.0 * scale * sqrt(squared) - scale * scale;
+}
+
+/**
+ * Iteratively reweighted least squares weight of a residual under the Huber loss
+ *
+ * @param squared Squared residual length
+ * @param scale Residual length where the loss turns linear
+ * @return double 1 inside the scale, falling as 1 / length beyond it
+ */
+double HomographyRefiner::huberWeight(double squared, double scale) {
+    return (squared <= scale * scale) ? 1.0 : scale / sqrt(squared);
+}
+
+/**
+ * Solve (N + damping * diag(N)) step = gradient by Cholesky factorisation, the Levenberg-Marquardt step with
+ * Marquardt's scaling
+ *
+ * @param normal Upper triangle of the symmetric n x n normal matrix N, row major
+ * @param gradient Right hand side
+ * @param n Size of the system
+ * @param damping Relative damping of the diagonal
+ * @param factor n x n scratch, receives the lower Cholesky factor
+ * @param step Receives the solution
+ * @return bool False if the damped system is not positive definite
+ */
+bool HomographyRefiner::solveDamped(const double *normal, const double *gradient, int n, double damping,
+                                    double *factor, double *step) {
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j <= i; j++) {
+            double sum = (i == j) ? normal[i * n + i] * (1.0 + damping) : normal[j * n + i];
+            for (int k = 0; k < j; k++) {
+                sum -= factor[i * n + k] * factor[j * n + k];
+            }
+
+            if (i == j) {
+                if (!(sum > 0)) {
+                    return false;
+                }
+                factor[i * n + i] = sqrt(sum);
+            }
+            else {
+                factor[i * n + j] = sum / factor[j * n + j];
+            }
+        }
+    }
+
+    // L z = gradient, then L^T step = z
+    for (int i = 0; i < n; i++) {
+        double sum = gradient[i];
+        for (int k = 0; k < i; k++) {
+            sum -= factor[i * n + k] * step[k];
+        }
+        step[i] = sum / factor[i * n + i];
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double sum = step[i];
+        for (int k = i + 1; k < n; k++) {
+            sum -= factor[k * n + i] * step[k];
+        }
+        step[i] = sum / factor[i * n + i];
+    }
+
+    return true;
+}
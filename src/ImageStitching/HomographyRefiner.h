@@ -0,0 +1,32 @@
+#pragma once
+
+/**
+ * Levenberg-Marquardt refinement of a homography over correspondences given as flat point arrays (x0, y0, x1, y1, ...).
+ * It minimises the symmetric transfer error, how far each point lands from its match when projected into the other
+ * image in both directions, under a Huber loss so mismatches left in an inlier set pull on the fit only linearly. The
+ * eight free entries of H, with H[8] = 1, are solved in coordinates centred and scaled like the four point solver's,
+ * on fixed size normal equations: nothing is allocated.
+ */
+class HomographyRefiner {
+public:
+    const static int PARAMETERS = 8;                    // Free entries of a homography
+    constexpr static float DEFAULT_LOSS_SCALE = 2.0f;   // Pixels beyond which the loss grows linearly
+private:
+    const static int MAX_ITERATIONS = 20;               // Accepted steps
+    const static int MAX_REJECTED = 8;                  // Damping increases without a cost decrease before giving up
+    constexpr static double INITIAL_DAMPING = 1e-3;     // Relative to the normal equations' diagonal
+    constexpr static double CONVERGED = 1e-9;           // Relative cost decrease at which the fit has converged
+    static double evaluate(const double h[PARAMETERS], const float *src, const float *dst, const int *indices,
+                           int count, const double Ts[9], const double Td[9], double lossScale, double *normal,
+                           double *gradient);
+public:
+    static bool refine(const float *src, const float *dst, const int *indices, int count, double H[9],
+                       float lossScale = DEFAULT_LOSS_SCALE, int *iterations = nullptr);
+    static double transferError(const double H[9], const float *src, const float *dst, const int *indices, int count);
+    static bool conditioning(const float *points, const int *indices, int count, double T[9]);
+    static bool invert(const double H[9], double inverse[9]);
+    static double huberLoss(double squared, double scale);
+    static double huberWeight(double squared, double scale);
+    static bool solveDamped(const double *normal, const double *gradient, int n, double damping, double *factor,
+                            double *step);
+};
\ No newline at end of file
@@ -0,0 +1,689 @@
+#include "Panorama.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <queue>
+#include <set>
+#include "BundleAdjuster.h"
+#include "GainCompensator.h"
+#include "HomographyRefiner.h"
+#include "RansacEngine.h"
+#include "Warper.h"
+#include "../FeatureMatching/FeatureDetector_498.h"
+#include "../Tools/KDForest.h"
+#include "../Tools/Matcher.h"
+#include "../Tools/Profiler.h"
+#include "../Tools/ScratchArena.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param files Paths of the images to stitch, in any order
+ * @param pool Threads to detect, match and composite on, the shared pool if null
+ */
+Panorama::Panorama(const vector<string> &files, ThreadPool *pool) {
+    this->files = files;
+    this->reference = -1;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+    this->cache = nullptr;
+    this->blender = Blender(Blender::MULTIBAND, 5, this->pool);
+    this->blender.setSeamMethod(SeamFinder::GRAPH_CUT);
+    this->octaves = 1;
+    this->coarseToFine = false;
+    this->descriptorType = DescriptorSet::SIFT;
+    this->bundleAdjustment = true;
+    this->gainCompensation = true;
+}
+
+/**
+ * Octaves to detect on, coarse-to-fine matching needs at least up to COARSE_OCTAVE
+ *
+ * @return int
+ */
+int Panorama::detectionOctaves() const {
+    return this->coarseToFine ? max(this->octaves, (int) COARSE_OCTAVE + 1) : this->octaves;
+}
+
+/**
+ * Read every image, one image per task. Images that cannot be read are left empty. With a cache, each file is read
+ * into memory once, hashed for the cache and decoded from there, so detect() touches neither the file nor the pixels
+ * again.
+ *
+ * @return void
+ */
+void Panorama::decode() {
+    static Profiler::Timer &timer = Profiler::timer("panorama.decode");
+    Profiler::Scope scope(timer);
+
+    this->images.assign(this->files.size(), Mat());
+    this->hashes.assign(this->files.size(), 0);
+
+    pool->parallelFor(0, this->files.size(), 1, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (this->cache == nullptr) {
+                this->images[i] = imread(this->files[i], IMREAD_COLOR);
+                continue;
+            }
+
+            ifstream in(this->files[i].c_str(), ios::binary);
+            vector<uchar> bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+            if (!in || bytes.empty()) {
+                continue;
+            }
+
+            this->hashes[i] = FeatureCache::hashBytes(bytes.data(), bytes.size());
+            this->images[i] = imdecode(bytes, IMREAD_COLOR);
+        }
+    });
+}
+
+/**
+ * Detect and describe the features of every image once, one image per task, decoding the images first if decode() has
+ * not run. With a cache, unchanged images skip detection entirely. Images that could not be read get no features.
+ *
+ * @return void
+ */
+void Panorama::detect() {
+    static Profiler::Timer &timer = Profiler::timer("panorama.detect");
+    Profiler::Scope scope(timer);
+
+    if (this->images.size() != this->files.size()) {
+        decode();
+    }
+
+    this->features.assign(this->files.size(), DescriptorSet(this->descriptorType));
+
+    pool->parallelFor(0, this->files.size(), 1, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            if (this->images[i].empty()) {
+                continue;
+            }
+            if (this->cache != nullptr) {
+                // Images decoded before the cache was set were not hashed, hashing the file still skips a decode
+                uint64_t hash = (this->hashes[i] != 0) ? this->hashes[i] : FeatureCache::hashFile(this->files[i]);
+                this->cache->detect(hash, this->images[i], this->features[i], detectionOctaves(),
+                                    this->descriptorType);
+            }
+            else {
+                FeatureDetector_498 fd = FeatureDetector_498(this->images[i]);
+                fd.setOctaves(detectionOctaves());
+                fd.setDescriptorType(this->descriptorType);
+                fd.detectFeatures();
+                this->features[i] = fd.describeFeatures();
+            }
+        }
+    });
+}
+
+/**
+ * Overlap prior: score every image against the others on their PRIOR_FEATURES strongest keypoints and keep, for each
+ * image, the few best scoring partners, so the full matching that follows runs on at most CANDIDATES_PER_IMAGE pairs
+ * per image. Float descriptors of every image are pooled into one KDForest and each queries it once; a pair of images
+ * scores one vote per pair of keypoints that are each other's nearest neighbour in another image. That is N *
+ * PRIOR_FEATURES searches of logarithmic cost rather than a match per pair of images. The forest does not index BRIEF
+ * descriptors, so binary sets are still scored by matching every pair.
+ *
+ * @return vector<pair<int, int> > Candidate pairs, first index lower
+ */
+vector<pair<int, int> > Panorama::candidatePairs() const {
+    const int n = (int) this->features.size();
+    vector<DescriptorSet> strongest(n);
+    vector<map<int, int> > score(n);
+    bool binary = false;
+
+    for (int i = 0; i < n; i++) {
+        const DescriptorSet &f = this->features[i];
+        vector<size_t> order(f.size());
+        iota(order.begin(), order.end(), 0);
+        sort(order.begin(), order.end(), [&f](size_t a, size_t b) {
+            return f.getResponse(a) > f.getResponse(b) || (f.getResponse(a) == f.getResponse(b) && a < b);
+        });
+
+        size_t count = min(order.size(), (size_t) PRIOR_FEATURES);
+        strongest[i] = DescriptorSet(f.getType());
+        strongest[i].reserve(count);
+        for (size_t k = 0; k < count; k++) {
+            strongest[i].append(f, order[k]);
+        }
+        binary = binary || f.isBinary();
+    }
+
+    if (binary) {
+        Matcher matcher = Matcher(DISTANCE_THRESHOLD, RATIO_THRESHOLD, false, this->pool);
+        for (int i = 0; i < n; i++) {
+            for (int j = i + 1; j < n; j++) {
+                int matched = (int) matcher.match(strongest[i], strongest[j]).size();
+                if (matched > 0) {
+                    score[i][j] = matched;
+                    score[j][i] = matched;
+                }
+            }
+        }
+    }
+    else {
+        DescriptorSet pooled = DescriptorSet(DescriptorSet::SIFT);
+        vector<int> owner;
+        for (int i = 0; i < n; i++) {
+            for (size_t k = 0; k < strongest[i].size(); k++) {
+                pooled.append(strongest[i], k);
+                owner.push_back(i);
+            }
+        }
+
+        KDForest index = KDForest();
+        index.build(pooled);
+        vector<TopTwoMatch> nearest = index.search(pooled, this->pool);
+
+        // A query normally finds itself first, its nearest other keypoint is whichever of the two is not itself
+        vector<int> other(pooled.size(), -1);
+        for (size_t q = 0; q < pooled.size(); q++) {
+            other[q] = (nearest[q].bestIndex == (int) q) ? nearest[q].secondIndex : nearest[q].bestIndex;
+        }
+
+        for (size_t q = 0; q < pooled.size(); q++) {
+            int p = other[q];
+            if (p > (int) q && other[p] == (int) q && owner[p] != owner[q]) {
+                score[owner[q]][owner[p]]++;
+                score[owner[p]][owner[q]]++;
+            }
+        }
+    }
+
+    set<pair<int, int> > pairs;
+    for (int i = 0; i < n; i++) {
+        vector<pair<int, int> > partners(score[i].begin(), score[i].end());
+
+        sort(partners.begin(), partners.end(), [](const pair<int, int> &a, const pair<int, int> &b) {
+            return a.second > b.second || (a.second == b.second && a.first < b.first);
+        });
+
+        for (int k = 0; k < (int) partners.size() && k < CANDIDATES_PER_IMAGE; k++) {
+            pairs.insert(make_pair(min(i, partners[k].first), max(i, partners[k].first)));
+        }
+    }
+
+    return vector<pair<int, int> >(pairs.begin(), pairs.end());
+}
+
+/**
+ * Keypoints of a set that were detected at one scale
+ *
+ * @param features Keypoints of every octave
+ * @param scale Original image pixels per level pixel to keep
+ * @return DescriptorSet
+ */
+static DescriptorSet featuresAtScale(const DescriptorSet &features, float scale) {
+    DescriptorSet selected = DescriptorSet(features.getType());
+
+    for (size_t k = 0; k < features.size(); k++) {
+        if (features.getScale(k) == scale) {
+            selected.append(features, k);
+        }
+    }
+
+    return selected;
+}
+
+/**
+ * Homography between two images from their matches, accepted with the test of Brown and Lowe, "Automatic Panoramic
+ * Image Stitching using Invariant Features": inliers > 8 + 0.3 * matches. The best RANSAC hypothesis is refined over
+ * all of its inliers by minimising the robust symmetric transfer error.
+ *
+ * @param f1 Keypoints of the first image
+ * @param f2 Keypoints of the second image
+ * @param matches Matches between f1 and f2
+ * @param edge Receives the match count, the inlier count of the best hypothesis, the homography from the first image
+ *             to the second and the inlier locations; from and to are not set
+ * @return bool Whether the pair passed
+ */
+bool Panorama::estimate(const DescriptorSet &f1, const DescriptorSet &f2, const vector<Match> &matches,
+                        Edge &edge) const {
+    int count = (int) matches.size();
+
+    if (count < 4) {
+        return false;
+    }
+
+    vector<float> src(2 * count), dst(2 * count);
+    for (int m = 0; m < count; m++) {
+        src[2 * m] = f1.getCol(matches[m].getIndex1());
+        src[2 * m + 1] = f1.getRow(matches[m].getIndex1());
+        dst[2 * m] = f2.getCol(matches[m].getIndex2());
+        dst[2 * m + 1] = f2.getRow(matches[m].getIndex2());
+    }
+
+    vector<int> order = Matcher::qualityOrder(matches);
+    RansacEngine engine = RansacEngine((float) INLIER_THRESHOLD, RANSAC_ITERATIONS, 0.995, 498, this->pool);
+    engine.setSampling(RansacEngine::PROSAC);
+    engine.setPreemption(RansacEngine::SPRT);
+
+    double H[9];
+    int inliers = engine.estimate(src.data(), dst.data(), count, H, order.data());
+    if (inliers < 4 || inliers <= 8 + 0.3 * count) {
+        return false;
+    }
+
+    // Refine over every inlier of the best hypothesis, H keeps the hypothesis if that fails
+    vector<int> consistent;
+    RansacEngine::findInliers(H, src.data(), dst.data(), count, (float) INLIER_THRESHOLD, consistent);
+    HomographyRefiner::refine(src.data(), dst.data(), consistent.data(), (int) consistent.size(), H);
+
+    edge.matches = count;
+    edge.inliers = inliers;
+    edge.H = Mat(3, 3, CV_64F, H).clone();
+    edge.points1.clear();
+    edge.points2.clear();
+    for (int m : consistent) {
+        edge.points1.insert(edge.points1.end(), &src[2 * m], &src[2 * m] + 2);
+        edge.points2.insert(edge.points2.end(), &dst[2 * m], &dst[2 * m] + 2);
+    }
+    return true;
+}
+
+/**
+ * Fully match one candidate pair and add it to the graph if its homography is accepted. In coarse-to-fine mode the
+ * coarse octave's keypoints give a first estimate, and only the full resolution keypoints near where it maps them are
+ * matched for the final fit; the pair falls back to matching every keypoint when the coarse estimate fails.
+ *
+ * @param first Index of the first image
+ * @param second Index of the second image
+ * @return void
+ */
+void Panorama::matchPair(int first, int second) {
+    const DescriptorSet &f1 = this->features[first];
+    const DescriptorSet &f2 = this->features[second];
+    Matcher matcher = Matcher(DISTANCE_THRESHOLD, RATIO_THRESHOLD, true, this->pool);
+    bool accepted = false;
+    Edge edge;
+
+    if (this->coarseToFine) {
+        const float coarseScale = (float) (1 << COARSE_OCTAVE);
+        DescriptorSet coarse1 = featuresAtScale(f1, coarseScale);
+        DescriptorSet coarse2 = featuresAtScale(f2, coarseScale);
+        Edge coarse;
+
+        if (estimate(coarse1, coarse2, matcher.match(coarse1, coarse2), coarse)) {
+            DescriptorSet fine1 = featuresAtScale(f1, 1.0f);
+            DescriptorSet fine2 = featuresAtScale(f2, 1.0f);
+            accepted = estimate(fine1, fine2, matcher.matchGuided(fine1, fine2, coarse.H.ptr<double>(), GUIDED_RADIUS),
+                                edge);
+        }
+    }
+
+    if (!accepted) {
+        accepted = estimate(f1, f2, matcher.match(f1, f2), edge);
+    }
+    if (!accepted) {
+        return;
+    }
+
+    edge.from = first;
+    edge.to = second;
+    this->edges.push_back(edge);
+}
+
+/**
+ * Kruskal's algorithm over the verified pairs, heaviest first, so every image is linked to its neighbours through the
+ * most reliable homographies
+ *
+ * @return void
+ */
+void Panorama::buildTree() {
+    vector<int> byWeight(this->edges.size());
+    vector<int> parent(this->files.size());
+    iota(byWeight.begin(), byWeight.end(), 0);
+    iota(parent.begin(), parent.end(), 0);
+
+    sort(byWeight.begin(), byWeight.end(), [this](int a, int b) {
+        return this->edges[a].inliers > this->edges[b].inliers ||
+               (this->edges[a].inliers == this->edges[b].inliers && a < b);
+    });
+
+    // Union-find with path halving
+    auto find = [&parent](int v) {
+        while (parent[v] != v) {
+            parent[v] = parent[parent[v]];
+            v = parent[v];
+        }
+        return v;
+    };
+
+    this->tree.clear();
+    for (int e : byWeight) {
+        int a = find(this->edges[e].from);
+        int b = find(this->edges[e].to);
+
+        if (a != b) {
+            parent[a] = b;
+            this->tree.push_back(e);
+        }
+    }
+}
+
+/**
+ * Compose homographies along the spanning tree from the reference image outwards. Without a chosen reference, the
+ * image with the fewest hops to every other image of the largest connected component is used, which keeps chained
+ * error and perspective stretch low.
+ *
+ * @return void
+ */
+void Panorama::chainTransforms() {
+    const int n = (int) this->files.size();
+    vector<vector<int> > adjacent(n);
+    for (int e : this->tree) {
+        adjacent[this->edges[e].from].push_back(e);
+        adjacent[this->edges[e].to].push_back(e);
+    }
+
+    // Hops from start to every image it reaches, -1 for the rest
+    auto hops = [&](int start) {
+        vector<int> depth(n, -1);
+        queue<int> pending;
+        depth[start] = 0;
+        pending.push(start);
+
+        while (!pending.empty()) {
+            int u = pending.front();
+            pending.pop();
+
+            for (int e : adjacent[u]) {
+                int v = (this->edges[e].from == u) ? this->edges[e].to : this->edges[e].from;
+                if (depth[v] < 0) {
+                    depth[v] = depth[u] + 1;
+                    pending.push(v);
+                }
+            }
+        }
+
+        return depth;
+    };
+
+    if (this->reference < 0 || this->reference >= n) {
+        int bestReached = -1, bestDepth = 0;
+
+        for (int i = 0; i < n; i++) {
+            vector<int> depth = hops(i);
+            int reached = (int) count_if(depth.begin(), depth.end(), [](int d) { return d >= 0; });
+            int deepest = *max_element(depth.begin(), depth.end());
+
+            if (reached > bestReached || (reached == bestReached && deepest < bestDepth)) {
+                bestReached = reached;
+                bestDepth = deepest;
+                this->reference = i;
+            }
+        }
+    }
+
+    this->transforms.assign(n, Mat());
+    if (n == 0) {
+        return;
+    }
+
+    queue<int> pending;
+    this->transforms[this->reference] = Mat::eye(3, 3, CV_64F);
+    pending.push(this->reference);
+
+    while (!pending.empty()) {
+        int u = pending.front();
+        pending.pop();
+
+        for (int e : adjacent[u]) {
+            const Edge &edge = this->edges[e];
+            int v = (edge.from == u) ? edge.to : edge.from;
+
+            if (this->transforms[v].empty()) {
+                Mat toU = (edge.from == v) ? edge.H : Mat(edge.H.inv());    // Maps image v onto image u
+                Mat chained = this->transforms[u] * toU;
+                this->transforms[v] = chained / chained.at<double>(2, 2);
+                pending.push(v);
+            }
+        }
+    }
+}
+
+/**
+ * Refine the chained transforms over the inliers of every verified pair between connected images. Along the spanning
+ * tree alone each pair's homography is already the best for its own inliers, so this only runs when pairs outside the
+ * tree close a loop whose chained homographies disagree. The chained transforms are kept if the adjustment fails.
+ *
+ * @return void
+ */
+void Panorama::adjustTransforms() {
+    vector<BundleAdjuster::Pair> pairs;
+
+    for (const Edge &edge : this->edges) {
+        if (this->transforms[edge.from].empty() || this->transforms[edge.to].empty()) {
+            continue;
+        }
+
+        BundleAdjuster::Pair pair;
+        pair.first = edge.from;
+        pair.second = edge.to;
+        pair.points1 = edge.points1.data();
+        pair.points2 = edge.points2.data();
+        pair.count = (int) edge.points1.size() / 2;
+        pairs.push_back(pair);
+    }
+
+    size_t chained = 0;
+    for (int e : this->tree) {
+        chained += this->transforms[this->edges[e].from].empty() ? 0 : 1;
+    }
+    if (pairs.size() <= chained) {
+        return;
+    }
+
+    BundleAdjuster adjuster = BundleAdjuster();
+    adjuster.adjust(pairs, this->transforms, this->reference);
+}
+
+/**
+ * Match and verify candidate pairs, chain every image to the reference frame, and with bundle adjustment on, refine the
+ * chained transforms together. Features are detected first if detect() has not run.
+ *
+ * @return void
+ */
+void Panorama::align() {
+    static Profiler::Timer &timer = Profiler::timer("panorama.align");
+    static Profiler::Counter &candidates = Profiler::counter("panorama.candidate_pairs");
+    static Profiler::Counter &verified = Profiler::counter("panorama.verified_pairs");
+    Profiler::Scope scope(timer);
+
+    if (this->features.size() != this->files.size()) {
+        detect();
+    }
+
+    this->edges.clear();
+
+    vector<pair<int, int> > pairs = candidatePairs();
+    for (const pair<int, int> &p : pairs) {
+        matchPair(p.first, p.second);
+    }
+    candidates.add((long long) pairs.size());
+    verified.add((long long) this->edges.size());
+
+    buildTree();
+    chainTransforms();
+    if (this->bundleAdjustment) {
+        adjustTransforms();
+    }
+}
+
+/**
+ * Images to composite, reference first since it is the frame the others are aligned to. Images the match graph does
+ * not connect to the reference are left out.
+ *
+ * @param canvas Receives the union of the images' footprints in the reference frame
+ * @return vector<int>
+ */
+vector<int> Panorama::compositionOrder(Rect &canvas) {
+    if (this->transforms.size() != this->files.size()) {
+        align();
+    }
+
+    vector<int> order;
+    canvas = Rect();
+    for (int i = 0; i < (int) this->files.size(); i++) {
+        if (this->transforms[i].empty() || this->images[i].empty()) {
+            continue;
+        }
+
+        Rect footprint = Warper::bounds(this->transforms[i], this->images[i].size());
+        canvas = order.empty() ? footprint : (canvas | footprint);
+        order.insert((i == this->reference) ? order.begin() : order.end(), i);
+    }
+
+    return order;
+}
+
+/**
+ * Gain of every image, all 1 with gain compensation off or when the gains cannot be solved for
+ *
+ * @param canvas Reference frame region the panorama covers
+ * @return vector<double>
+ */
+vector<double> Panorama::estimateGains(Rect canvas) const {
+    GainCompensator compensator = GainCompensator(this->pool);
+
+    if (!this->gainCompensation || !compensator.estimate(this->images, this->transforms, canvas)) {
+        return vector<double>(this->images.size(), 1.0);
+    }
+
+    return compensator.getGains();
+}
+
+/**
+ * Warp every connected image into the reference frame, scaled by its gain, and blend it into one canvas. Images the
+ * match graph does not connect to the reference are left out.
+ *
+ * @return Mat
+ */
+Mat Panorama::composite() {
+    static Profiler::Timer &timer = Profiler::timer("panorama.composite");
+    Profiler::Scope scope(timer);
+
+    Rect canvas;
+    vector<int> order = compositionOrder(canvas);
+    vector<double> gains = estimateGains(canvas);
+
+    Mat panorama = Mat::zeros(canvas.height, canvas.width, CV_8UC3);
+    Mat covered = Mat::zeros(canvas.height, canvas.width, CV_8U);
+
+    for (int i : order) {
+        // The table and the warped image only live while the image is blended
+        ScratchArena::Scope scratch;
+        ScratchArena &arena = ScratchArena::local();
+        Rect footprint = Warper::bounds(this->transforms[i], this->images[i].size()) & canvas;
+        Warper warper = Warper(INTER_LINEAR, this->pool);
+        Warper::RemapTable table;
+        Mat warped = arena.mat(footprint.height, footprint.width, this->images[i].type());
+
+        warper.buildTable(this->transforms[i].inv(), footprint, this->images[i].size(), table, &arena);
+        warper.warp(this->images[i], table, warped, BORDER_CONSTANT, gains[i]);
+        this->blender.blend(panorama, covered, warped, table.mask,
+                            Point(footprint.x - canvas.x, footprint.y - canvas.y));
+    }
+
+    return panorama;
+}
+
+/**
+ * Composite the panorama and save it
+ *
+ * @param writeTo Location to save produced panorama
+ * @return Mat
+ */
+Mat Panorama::stitch(string writeTo) {
+    Mat panorama = composite();
+    imwrite(writeTo, panorama);
+    return panorama;
+}
+
+/**
+ * Stitch into a TiledCanvas kept in a backing file and save it as tiles, for panoramas too large for memory. Each image
+ * is warped and blended one chunk of its footprint at a time, CHUNK_TILES canvas tiles a side plus a margin as wide as
+ * the blender's pyramid reach, and only the chunk itself is written back. Memory is then bounded by the chunk size and
+ * the tile cache rather than by the footprint or the panorama. Seams are placed per chunk. Images whose footprint grows
+ * beyond MAX_FOOTPRINT_GROWTH image areas, from a transform close to degenerate, are left out.
+ *
+ * @param directory Directory to write the tiles and their index to, see TiledCanvas::writeTiles()
+ * @param backingFile Scratch file for the canvas, must not exist yet. The canvas stays in memory if it cannot be
+ * created.
+ * @param cacheTiles Tiles kept mapped at once
+ * @return bool Whether every image was placed and every tile was stored and written
+ */
+bool Panorama::stitchTiles(const string &directory, const string &backingFile, size_t cacheTiles) {
+    const int CHUNK = CHUNK_TILES * TiledCanvas::TILE_SIZE;
+    const int margin = (this->blender.getMode() == Blender::MULTIBAND) ? (4 << this->blender.getBands()) : 0;
+    Rect canvas;
+    vector<int> order = compositionOrder(canvas);
+    vector<double> gains = estimateGains(canvas);
+    TiledCanvas tiles = TiledCanvas(CV_8UC3, backingFile, cacheTiles);
+    bool complete = true;
+
+    for (int i : order) {
+        Rect footprint = Warper::bounds(this->transforms[i], this->images[i].size());
+        double growth = (double) footprint.width * footprint.height / ((double) this->images[i].total());
+        if (footprint.empty() || growth > MAX_FOOTPRINT_GROWTH) {
+            complete = false;
+            continue;
+        }
+
+        Warper warper = Warper(INTER_LINEAR, this->pool);
+        Mat inverse = this->transforms[i].inv();
+        int left = (int) floor((double) footprint.x / CHUNK) * CHUNK;
+        int top = (int) floor((double) footprint.y / CHUNK) * CHUNK;
+
+        for (int y = top; y < footprint.y + footprint.height; y += CHUNK) {
+            for (int x = left; x < footprint.x + footprint.width; x += CHUNK) {
+                Rect chunk = Rect(x, y, CHUNK, CHUNK) & footprint;
+                Rect area = Rect(chunk.x - margin, chunk.y - margin, chunk.width + 2 * margin,
+                                 chunk.height + 2 * margin) & footprint;
+                Rect inner = Rect(chunk.x - area.x, chunk.y - area.y, chunk.width, chunk.height);
+                ScratchArena::Scope scratch;
+                ScratchArena &arena = ScratchArena::local();
+                Warper::RemapTable table;
+                Mat region, covered;
+
+                warper.buildTable(inverse, area, this->images[i].size(), table, &arena);
+                if (countNonZero(table.mask(inner)) == 0) {
+                    continue;
+                }
+
+                Mat warped = arena.mat(area.height, area.width, this->images[i].type());
+                warper.warp(this->images[i], table, warped, BORDER_CONSTANT, gains[i]);
+                tiles.read(area, region, covered);
+                this->blender.blend(region, covered, warped, table.mask, Point(0, 0));
+                complete = tiles.write(chunk, region(inner), covered(inner)) && complete;
+            }
+        }
+    }
+
+    return tiles.writeTiles(directory) && complete;
+}
+
+const vector<string> &Panorama::getFiles() const { return files; }
+const vector<Mat> &Panorama::getImages() const { return images; }
+const vector<Panorama::Edge> &Panorama::getEdges() const { return edges; }
+const vector<Mat> &Panorama::getTransforms() const { return transforms; }
+int Panorama::getReference() const { return reference; }
+void Panorama::setReference(int reference) { Panorama::reference = reference; }
+const Blender &Panorama::getBlender() const { return blender; }
+void Panorama::setBlender(const Blender &blender) { Panorama::blender = blender; }
+const FeatureCache *Panorama::getCache() const { return cache; }
+void Panorama::setCache(const FeatureCache *cache) { Panorama::cache = cache; }
+int Panorama::getOctaves() const { return octaves; }
+void Panorama::setOctaves(int octaves) { Panorama::octaves = (octaves > 0) ? octaves : 1; }
+bool Panorama::isCoarseToFine() const { return coarseToFine; }
+void Panorama::setCoarseToFine(bool coarseToFine) { Panorama::coarseToFine = coarseToFine; }
+DescriptorSet::Type Panorama::getDescriptorType() const { return descriptorType; }
+void Panorama::setDescriptorType(DescriptorSet::Type descriptorType) { Panorama::descriptorType = descriptorType; }
+bool Panorama::isBundleAdjustment() const { return bundleAdjustment; }
+void Panorama::setBundleAdjustment(bool bundleAdjustment) { Panorama::bundleAdjustment = bundleAdjustment; }
+bool Panorama::isGainCompensation() const { return gainCompensation; }
+void Panorama::setGainCompensation(bool gainCompensation) { Panorama::gainCompensation = gainCompensation; }
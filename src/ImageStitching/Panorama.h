@@ -0,0 +1,110 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "../FeatureMatching/DescriptorSet.h"
+#include "../FeatureMatching/FeatureCache.h"
+#include "../Tools/Match.h"
+#include "../Tools/ThreadPool.h"
+#include "Blender.h"
+#include "TiledCanvas.h"
+
+/**
+ * Stitches any number of overlapping images. Features are detected once per image. A cheap prior, matching only the
+ * strongest keypoints of every pair, picks a few candidate neighbours per image, and only those pairs are fully
+ * matched and verified with RANSAC. The verified pairs form a graph whose maximum spanning tree, weighted by inlier
+ * count, chains every image's homography to a reference frame. Every pair's homography is refined over its inliers
+ * by HomographyRefiner, and when verified pairs outside the tree close loops, BundleAdjuster refines all the chained
+ * homographies together. GainCompensator evens out the images' exposure from their overlaps, and all images are then
+ * warped, each scaled by its gain, and blended across graph cut seams into one canvas, or into a disk backed
+ * TiledCanvas saved as tiles when the panorama does not fit in memory.
+ *
+ * The steps can be run one at a time, decode(), detect(), align() then composite(), so a pipeline can overlap the
+ * steps of different panoramas; each runs the steps before it that have not run yet.
+ *
+ * Features can be detected on several pyramid octaves so pairs at different zoom still match. In coarse-to-fine mode a
+ * pair's homography is first estimated from the keypoints of a coarse octave only, and the full resolution keypoints
+ * are then matched just around where that estimate puts them before the final fit.
+ */
+class Panorama {
+public:
+    /**
+     * Verified image pair, an edge of the match graph
+     */
+    struct Edge {
+        int from;
+        int to;
+        int matches;                // Matches that passed the ratio test
+        int inliers;                // Matches consistent with H
+        cv::Mat H;                  // Maps image from onto image to
+        std::vector<float> points1; // Inlier locations in image from, x0, y0, x1, y1, ...
+        std::vector<float> points2; // The matching locations in image to
+    };
+private:
+    const static int PRIOR_FEATURES = 128;          // Strongest keypoints per image matched by the overlap prior
+    const static int CANDIDATES_PER_IMAGE = 3;      // Neighbours fully matched per image
+    const static int RANSAC_ITERATIONS = 2000;
+    const static int INLIER_THRESHOLD = 15;
+    const static int COARSE_OCTAVE = 2;             // Octave the coarse-to-fine estimate is made on, quarter size
+    const static int CHUNK_TILES = 8;               // Canvas tiles per side stitchTiles warps and blends at once
+    const static int MAX_FOOTPRINT_GROWTH = 16;     // Largest footprint stitchTiles accepts, in image areas
+    constexpr static float GUIDED_RADIUS = 32.0;    // Pixels around the coarse prediction searched at full size
+    constexpr static float DISTANCE_THRESHOLD = 1.0;
+    constexpr static float RATIO_THRESHOLD = 0.36;
+    std::vector<std::string> files;
+    std::vector<cv::Mat> images;
+    std::vector<uint64_t> hashes;                   // Hash of each encoded file for the cache, 0 if not hashed
+    std::vector<DescriptorSet> features;
+    std::vector<Edge> edges;                        // Every verified pair
+    std::vector<int> tree;                          // Positions in edges of the maximum spanning tree
+    std::vector<cv::Mat> transforms;                // Each image into the reference frame, empty if unconnected
+    int reference;                                  // Reference image, -1 to pick the centre of the tree
+    ThreadPool *pool;
+    const FeatureCache *cache;                      // Stored features to reuse, detection always runs if null
+    Blender blender;
+    int octaves;                                    // Pyramid octaves features are detected on
+    bool coarseToFine;
+    DescriptorSet::Type descriptorType;             // BRIEF trades matching quality for speed, e.g. for previews
+    bool bundleAdjustment;                          // Refine the chained homographies together
+    bool gainCompensation;                          // Even out exposure differences between the images
+    int detectionOctaves() const;
+    std::vector<std::pair<int, int> > candidatePairs() const;
+    bool estimate(const DescriptorSet &f1, const DescriptorSet &f2, const std::vector<Match> &matches,
+                  Edge &edge) const;
+    void matchPair(int first, int second);
+    void buildTree();
+    void chainTransforms();
+    void adjustTransforms();
+    std::vector<int> compositionOrder(cv::Rect &canvas);
+    std::vector<double> estimateGains(cv::Rect canvas) const;
+public:
+    Panorama(const std::vector<std::string> &files, ThreadPool *pool = nullptr);
+    void decode();
+    void detect();
+    void align();
+    cv::Mat composite();
+    cv::Mat stitch(std::string writeTo);
+    bool stitchTiles(const std::string &directory, const std::string &backingFile,
+                     size_t cacheTiles = TiledCanvas::DEFAULT_CACHE_TILES);
+    const std::vector<std::string> &getFiles() const;
+    const std::vector<cv::Mat> &getImages() const;
+    const std::vector<Edge> &getEdges() const;
+    const std::vector<cv::Mat> &getTransforms() const;
+    int getReference() const;
+    void setReference(int reference);
+    const Blender &getBlender() const;
+    void setBlender(const Blender &blender);
+    const FeatureCache *getCache() const;
+    void setCache(const FeatureCache *cache);
+    int getOctaves() const;
+    void setOctaves(int octaves);
+    bool isCoarseToFine() const;
+    void setCoarseToFine(bool coarseToFine);
+    DescriptorSet::Type getDescriptorType() const;
+    void setDescriptorType(DescriptorSet::Type descriptorType);
+    bool isBundleAdjustment() const;
+    void setBundleAdjustment(bool bundleAdjustment);
+    bool isGainCompensation() const;
+    void setGainCompensation(bool gainCompensation);
+};
\ No newline at end of file
@@ -0,0 +1,530 @@
+#include "RansacEngine.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include "../Tools/Profiler.h"
+
+using namespace std;
+
+/**
+ * SplitMix64 step. Small enough to reseed per hypothesis, which keeps every hypothesis reproducible.
+ *
+ * @param state Generator state, advanced in place
+ * @return uint64_t
+ */
+static inline uint64_t splitMix(uint64_t &state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Whether correspondence i is within threshold of its projection through H. Compared in homogeneous form to avoid the
+ * division.
+ *
+ * @param H Row major homography
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param i Correspondence to check
+ * @param t2 Squared inlier threshold
+ * @return bool
+ */
+static inline bool isInlier(const double H[9], const float *src, const float *dst, int i, double t2) {
+    double x = src[2 * i], y = src[2 * i + 1];
+    double w = H[6] * x + H[7] * y + H[8];
+    double dx = (H[0] * x + H[1] * y + H[2]) - dst[2 * i] * w;
+    double dy = (H[3] * x + H[4] * y + H[5]) - dst[2 * i + 1] * w;
+
+    return w != 0 && dx * dx + dy * dy <= t2 * w * w;
+}
+
+/**
+ * Constructor
+ *
+ * @param inlierThreshold Largest reprojection distance, in pixels, of an inlier
+ * @param maxIterations Upper bound on hypotheses
+ * @param confidence Probability of having drawn one all-inlier sample when the adaptive bound stops the search
+ * @param seed Seed of the hypothesis generators
+ * @param pool Threads to score on, the shared pool if null
+ */
+RansacEngine::RansacEngine(float inlierThreshold, int maxIterations, double confidence, uint64_t seed,
+                           ThreadPool *pool) {
+    this->inlierThreshold = inlierThreshold;
+    this->maxIterations = maxIterations;
+    this->confidence = confidence;
+    this->seed = seed;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+    this->sampling = UNIFORM;
+    this->preemption = NONE;
+    this->iterations = 0;
+    this->rejected = 0;
+    this->verifications = 0;
+}
+
+/**
+ * Estimate the homography mapping src onto dst with the most inliers
+ *
+ * @param src count points of the first image
+ * @param dst count corresponding points of the second image
+ * @param count Number of correspondences
+ * @param H Receives the best hypothesis, row major, zero if none was found
+ * @param order Correspondence indices from best to worst quality, required for PROSAC sampling
+ * @return int Inlier count of H
+ */
+int RansacEngine::estimate(const float *src, const float *dst, int count, double H[9], const int *order) {
+    static Profiler::Timer &timer = Profiler::timer("ransac");
+    static Profiler::Counter &hypotheses = Profiler::counter("ransac.hypotheses");
+    static Profiler::Counter &verified = Profiler::counter("ransac.verifications");
+    static Profiler::Counter &inlierCount = Profiler::counter("ransac.inliers");
+    Profiler::Scope scope(timer);
+
+    const double t2 = (double) inlierThreshold * inlierThreshold;
+    const int m = SAMPLE_SIZE;
+    bool prosac = sampling == PROSAC && order != nullptr;
+    int bestCount = 0;
+    int limit = maxIterations;
+    vector<int> counts(BATCH_SIZE), tested(BATCH_SIZE), consistent(BATCH_SIZE);
+    vector<int> prosacSize(BATCH_SIZE);
+    vector<char> prosacGrowth(BATCH_SIZE);
+    vector<double> models(BATCH_SIZE * 9);
+
+    fill(H, H + 9, 0.0);
+    iterations = 0;
+    rejected = 0;
+    verifications = 0;
+
+    if (count < m) {
+        return 0;
+    }
+
+    // PROSAC schedule: T_n samples are expected from the top n correspondences before n grows
+    int n = m;
+    double Tn = PROSAC_GROWTH;
+    int TnPrime = 1;
+    for (int i = 0; i < m; i++) {
+        Tn *= (double) (m - i) / (count - i);
+    }
+
+    // SPRT state, epsilon and delta are the inlier fractions of good and bad models
+    double epsilon = SPRT_INITIAL_EPSILON;
+    double delta = SPRT_INITIAL_DELTA;
+    double A = sprtThreshold(epsilon, delta);
+    long long badTested = 0, badConsistent = 0;
+
+    while (iterations < limit) {
+        int batch = min((int) BATCH_SIZE, limit - iterations);
+        int first = iterations;
+
+        // The PROSAC schedule depends only on the hypothesis number, so it is advanced here in order
+        if (prosac) {
+            for (int k = 0; k < batch; k++) {
+                int t = first + k + 1;
+                while (t > TnPrime && n < count) {
+                    double Tn1 = Tn * (n + 1) / (n + 1 - m);
+                    TnPrime += (int) ceil(Tn1 - Tn);
+                    Tn = Tn1;
+                    n++;
+                }
+                prosacSize[k] = n;
+                prosacGrowth[k] = (t <= TnPrime) ? 1 : 0;
+            }
+        }
+
+        pool->parallelFor(0, (size_t) batch, 8, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; k++) {
+                uint64_t state = seed ^ ((uint64_t) (first + k) * 0xD1B54A32D192ED03ULL);
+                int sample[SAMPLE_SIZE];
+                int range = count;
+                int drawn = m;
+
+                // PROSAC draws from the top n and, while growing, always includes the n-th correspondence
+                if (prosac) {
+                    range = prosacGrowth[k] ? prosacSize[k] - 1 : prosacSize[k];
+                    if (prosacGrowth[k]) {
+                        drawn = m - 1;
+                        sample[m - 1] = prosacSize[k] - 1;
+                    }
+                }
+
+                for (int s = 0; s < drawn; s++) {
+                    bool duplicate;
+                    do {
+                        sample[s] = (int) (splitMix(state) % (uint64_t) range);
+                        duplicate = false;
+                        for (int p = 0; p < s; p++) {
+                            duplicate = duplicate || sample[p] == sample[s];
+                        }
+                    } while (duplicate);
+                }
+
+                if (prosac) {
+                    for (int s = 0; s < m; s++) {
+                        sample[s] = order[sample[s]];
+                    }
+                }
+
+                double *model = &models[k * 9];
+                tested[k] = 0;
+                consistent[k] = 0;
+                counts[k] = -1;
+
+                if (isDegenerateSample(src, dst, sample) || !solveHomography(src, dst, sample, model)) {
+                    continue;
+                }
+
+                if (preemption == TDD) {
+                    bool passed = true;
+                    for (int d = 0; d < TDD_POINTS && passed; d++) {
+                        tested[k]++;
+                        passed = isInlier(model, src, dst, (int) (splitMix(state) % (uint64_t) count), t2);
+                    }
+                    if (!passed) {
+                        continue;
+                    }
+                }
+
+                if (preemption == SPRT) {
+                    // Evaluate from a random offset and stop as soon as the likelihood ratio exceeds A
+                    int start = (int) (splitMix(state) % (uint64_t) count);
+                    double lambda = 1.0;
+                    int inliers = 0;
+                    int j = 0;
+
+                    for (; j < count && lambda <= A; j++) {
+                        int i = (start + j < count) ? start + j : start + j - count;
+                        bool good = isInlier(model, src, dst, i, t2);
+                        inliers += good ? 1 : 0;
+                        lambda *= good ? delta / epsilon : (1 - delta) / (1 - epsilon);
+                    }
+
+                    tested[k] += j;
+                    consistent[k] = inliers;
+                    if (lambda > A) {
+                        continue;
+                    }
+                    counts[k] = inliers;
+                }
+                else {
+                    tested[k] += count;
+                    counts[k] = countInliers(model, src, dst, count, inlierThreshold);
+                }
+            }
+        });
+
+        // Reduce in hypothesis order so ties keep the earliest hypothesis
+        bool improved = false;
+        for (int k = 0; k < batch; k++) {
+            verifications += tested[k];
+
+            if (counts[k] < 0) {
+                rejected++;
+                badTested += (preemption == SPRT) ? tested[k] : 0;
+                badConsistent += (preemption == SPRT) ? consistent[k] : 0;
+            }
+            else if (counts[k] > bestCount) {
+                bestCount = counts[k];
+                improved = true;
+                memcpy(H, &models[k * 9], 9 * sizeof(double));
+            }
+        }
+
+        iterations += batch;
+
+        if (bestCount > 0) {
+            double w = (double) bestCount / count;
+            double pass = 1.0;
+
+            if (preemption == TDD) {
+                pass = pow(w, TDD_POINTS);
+            }
+            else if (preemption == SPRT) {
+                // Re-estimate the SPRT model from the best hypothesis and the rejected ones
+                if (improved || badTested > 0) {
+                    if (badTested > 0) {
+                        delta = min(max((double) badConsistent / badTested, 0.001), 0.5);
+                    }
+                    epsilon = max(w, delta * 1.5);
+                    epsilon = min(epsilon, 0.999);
+                    A = sprtThreshold(epsilon, delta);
+                }
+                pass = 1.0 - 1.0 / A;
+            }
+
+            // PROSAC samples from the top n only, so the bound may use the inlier ratio there when it is higher
+            int inliers = bestCount;
+            int total = count;
+            if (prosac) {
+                int top = 0;
+                for (int p = 0; p < n; p++) {
+                    top += isInlier(H, src, dst, order[p], t2) ? 1 : 0;
+                }
+                verifications += n;
+
+                if (top >= PROSAC_MIN_INLIERS && (double) top / n > w) {
+                    inliers = top;
+                    total = n;
+                }
+            }
+
+            limit = min(maxIterations, requiredIterations(inliers, total, confidence, m, pass));
+        }
+    }
+
+    hypotheses.add(iterations);
+    verified.add(verifications);
+    inlierCount.add(bestCount);
+    return bestCount;
+}
+
+/**
+ * SPRT decision threshold A for the given good and bad model inlier fractions, from the fixed point iteration of
+ * Chum and Matas, "Optimal Randomized RANSAC"
+ *
+ * @param epsilon Inlier fraction of a good model
+ * @param delta Inlier fraction of a bad model
+ * @return double
+ */
+double RansacEngine::sprtThreshold(double epsilon, double delta) {
+    double C = (1 - delta) * log((1 - delta) / (1 - epsilon)) + delta * log(delta / epsilon);
+    double K = SPRT_MODEL_COST * C + 1;
+    double A = K;
+
+    for (int i = 0; i < 10; i++) {
+        A = K + log(A);
+    }
+
+    return A;
+}
+
+/**
+ * Reject samples that cannot define a proper homography: three nearly collinear points in either image, or a triangle
+ * whose orientation flips between the images
+ *
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param sample Four correspondence indices
+ * @return bool
+ */
+bool RansacEngine::isDegenerateSample(const float *src, const float *dst, const int *sample) {
+    const int TRIANGLES[4][3] = {{0, 1, 2}, {0, 1, 3}, {0, 2, 3}, {1, 2, 3}};
+    const double MIN_AREA = 1.0;   // Twice the triangle area, in square pixels
+
+    for (int t = 0; t < 4; t++) {
+        const int a = sample[TRIANGLES[t][0]], b = sample[TRIANGLES[t][1]], c = sample[TRIANGLES[t][2]];
+        double s = (double) (src[2 * b] - src[2 * a]) * (src[2 * c + 1] - src[2 * a + 1]) -
+                   (double) (src[2 * b + 1] - src[2 * a + 1]) * (src[2 * c] - src[2 * a]);
+        double d = (double) (dst[2 * b] - dst[2 * a]) * (dst[2 * c + 1] - dst[2 * a + 1]) -
+                   (double) (dst[2 * b + 1] - dst[2 * a + 1]) * (dst[2 * c] - dst[2 * a]);
+
+        if (fabs(s) < MIN_AREA || fabs(d) < MIN_AREA || (s > 0) != (d > 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * Exact homography through four correspondences. Points are centred and scaled before an 8x8 elimination with partial
+ * pivoting, and collinear or repeated samples are reported as degenerate.
+ *
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param sample Four correspondence indices
+ * @param H Receives the homography, row major with H[8] = 1
+ * @return bool False if the sample is degenerate
+ */
+bool RansacEngine::solveHomography(const float *src, const float *dst, const int *sample, double H[9]) {
+    double s[SAMPLE_SIZE][2], d[SAMPLE_SIZE][2];
+    double sCentre[2] = {0, 0}, dCentre[2] = {0, 0};
+    double sScale = 0, dScale = 0;
+
+    for (int i = 0; i < SAMPLE_SIZE; i++) {
+        s[i][0] = src[2 * sample[i]];
+        s[i][1] = src[2 * sample[i] + 1];
+        d[i][0] = dst[2 * sample[i]];
+        d[i][1] = dst[2 * sample[i] + 1];
+        sCentre[0] += s[i][0] / SAMPLE_SIZE;
+        sCentre[1] += s[i][1] / SAMPLE_SIZE;
+        dCentre[0] += d[i][0] / SAMPLE_SIZE;
+        dCentre[1] += d[i][1] / SAMPLE_SIZE;
+    }
+
+    for (int i = 0; i < SAMPLE_SIZE; i++) {
+        s[i][0] -= sCentre[0];
+        s[i][1] -= sCentre[1];
+        d[i][0] -= dCentre[0];
+        d[i][1] -= dCentre[1];
+        sScale += sqrt(s[i][0] * s[i][0] + s[i][1] * s[i][1]) / SAMPLE_SIZE;
+        dScale += sqrt(d[i][0] * d[i][0] + d[i][1] * d[i][1]) / SAMPLE_SIZE;
+    }
+
+    if (sScale < 1e-9 || dScale < 1e-9) {
+        return false;
+    }
+
+    sScale = M_SQRT2 / sScale;
+    dScale = M_SQRT2 / dScale;
+
+    // Two rows per correspondence of [A | b] with h33 = 1
+    double A[8][9];
+    for (int i = 0; i < SAMPLE_SIZE; i++) {
+        double x = s[i][0] * sScale, y = s[i][1] * sScale;
+        double u = d[i][0] * dScale, v = d[i][1] * dScale;
+        double r1[9] = {x, y, 1, 0, 0, 0, -u * x, -u * y, u};
+        double r2[9] = {0, 0, 0, x, y, 1, -v * x, -v * y, v};
+        memcpy(A[2 * i], r1, sizeof(r1));
+        memcpy(A[2 * i + 1], r2, sizeof(r2));
+    }
+
+    for (int c = 0; c < 8; c++) {
+        int pivot = c;
+        for (int r = c + 1; r < 8; r++) {
+            if (fabs(A[r][c]) > fabs(A[pivot][c])) {
+                pivot = r;
+            }
+        }
+
+        if (fabs(A[pivot][c]) < 1e-10) {
+            return false;
+        }
+
+        if (pivot != c) {
+            for (int k = 0; k < 9; k++) {
+                swap(A[c][k], A[pivot][k]);
+            }
+        }
+
+        for (int r = c + 1; r < 8; r++) {
+            double f = A[r][c] / A[c][c];
+            for (int k = c; k < 9; k++) {
+                A[r][k] -= f * A[c][k];
+            }
+        }
+    }
+
+    double h[9];
+    h[8] = 1.0;
+    for (int r = 7; r >= 0; r--) {
+        double v = A[r][8];
+        for (int k = r + 1; k < 8; k++) {
+            v -= A[r][k] * h[k];
+        }
+        h[r] = v / A[r][r];
+    }
+
+    // H = Td^-1 * Hn * Ts with Ts = [sScale 0 -sScale*cx; 0 sScale -sScale*cy; 0 0 1]
+    double Ts[9] = {sScale, 0, -sScale * sCentre[0], 0, sScale, -sScale * sCentre[1], 0, 0, 1};
+    double Tinv[9] = {1 / dScale, 0, dCentre[0], 0, 1 / dScale, dCentre[1], 0, 0, 1};
+    double M[9];
+
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            M[r * 3 + c] = h[r * 3] * Ts[c] + h[r * 3 + 1] * Ts[3 + c] + h[r * 3 + 2] * Ts[6 + c];
+        }
+    }
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 3; c++) {
+            H[r * 3 + c] = Tinv[r * 3] * M[c] + Tinv[r * 3 + 1] * M[3 + c] + Tinv[r * 3 + 2] * M[6 + c];
+        }
+    }
+
+    if (fabs(H[8]) < 1e-12) {
+        return false;
+    }
+
+    for (int k = 0; k < 9; k++) {
+        H[k] /= H[8];
+    }
+
+    return true;
+}
+
+/**
+ * Count correspondences whose projection through H lands within threshold of their match. Allocation free, one pass
+ * over the flat arrays.
+ *
+ * @param H Row major homography
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param count Number of correspondences
+ * @param threshold Largest reprojection distance of an inlier
+ * @return int
+ */
+int RansacEngine::countInliers(const double H[9], const float *src, const float *dst, int count, float threshold) {
+    const double t2 = (double) threshold * threshold;
+    int inliers = 0;
+
+    for (int i = 0; i < count; i++) {
+        inliers += isInlier(H, src, dst, i, t2) ? 1 : 0;
+    }
+
+    return inliers;
+}
+
+/**
+ * Indices of the correspondences that are inliers of H
+ *
+ * @param H Row major homography
+ * @param src Points of the first image
+ * @param dst Points of the second image
+ * @param count Number of correspondences
+ * @param threshold Largest reprojection distance of an inlier
+ * @param inliers Receives the indices in ascending order
+ * @return void
+ */
+void RansacEngine::findInliers(const double H[9], const float *src, const float *dst, int count, float threshold,
+                               vector<int> &inliers) {
+    const double t2 = (double) threshold * threshold;
+    inliers.clear();
+
+    for (int i = 0; i < count; i++) {
+        if (isInlier(H, src, dst, i, t2)) {
+            inliers.push_back(i);
+        }
+    }
+}
+
+/**
+ * Hypotheses needed to draw one all-inlier sample with the given confidence at the observed inlier ratio
+ *
+ * @param inliers Inlier count of the best hypothesis
+ * @param count Number of correspondences
+ * @param confidence Required probability
+ * @param sampleSize Correspondences per hypothesis
+ * @param passProbability Chance that an all-inlier hypothesis survives the preemptive test
+ * @return int
+ */
+int RansacEngine::requiredIterations(int inliers, int count, double confidence, int sampleSize,
+                                     double passProbability) {
+    if (inliers <= 0 || count <= 0) {
+        return INT_MAX;
+    }
+
+    double allInliers = pow((double) inliers / count, sampleSize) * passProbability;
+
+    if (allInliers >= 1.0) {
+        return 1;
+    }
+
+    double n = log(1.0 - confidence) / log(1.0 - allInliers);
+    return (n >= (double) INT_MAX) ? INT_MAX : (int) ceil(n);
+}
+
+int RansacEngine::getIterations() const { return iterations; }
+int RansacEngine::getRejected() const { return rejected; }
+long long RansacEngine::getVerifications() const { return verifications; }
+float RansacEngine::getInlierThreshold() const { return inlierThreshold; }
+void RansacEngine::setInlierThreshold(float inlierThreshold) { RansacEngine::inlierThreshold = inlierThreshold; }
+int RansacEngine::getMaxIterations() const { return maxIterations; }
+void RansacEngine::setMaxIterations(int maxIterations) { RansacEngine::maxIterations = maxIterations; }
+double RansacEngine::getConfidence() const { return confidence; }
+void RansacEngine::setConfidence(double confidence) { RansacEngine::confidence = confidence; }
+uint64_t RansacEngine::getSeed() const { return seed; }
+void RansacEngine::setSeed(uint64_t seed) { RansacEngine::seed = seed; }
+RansacEngine::Sampling RansacEngine::getSampling() const { return sampling; }
+void RansacEngine::setSampling(Sampling sampling) { RansacEngine::sampling = sampling; }
+RansacEngine::Preemption RansacEngine::getPreemption() const { return preemption; }
+void RansacEngine::setPreemption(Preemption preemption) { RansacEngine::preemption = preemption; }
\ No newline at end of file
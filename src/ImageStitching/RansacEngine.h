@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Homography RANSAC over flat point arrays (x0, y0, x1, y1, ...). Hypotheses are generated in fixed size batches that
+ * are scored in parallel, and the iteration count adapts to the best inlier ratio found so far. Hypothesis i always
+ * draws from a generator seeded with (seed, i), so the result does not depend on the number of threads.
+ *
+ * Samples are drawn uniformly or PROSAC style from a quality ordering, degenerate samples are skipped before solving,
+ * and hypotheses can be dropped early by a T(d,d) test or by Wald's SPRT.
+ */
+class RansacEngine {
+public:
+    enum Sampling { UNIFORM = 0, PROSAC = 1 };
+    enum Preemption { NONE = 0, TDD = 1, SPRT = 2 };
+private:
+    const static int BATCH_SIZE = 64;      // Hypotheses between termination checks
+    const static int SAMPLE_SIZE = 4;      // Matches per homography hypothesis
+    const static int TDD_POINTS = 1;       // d of the T(d,d) test
+    const static int PROSAC_GROWTH = 200000;   // T_N, hypotheses over which PROSAC grows to the full set
+    const static int PROSAC_MIN_INLIERS = 15;  // Top-n inliers needed before the bound trusts the top-n ratio
+    constexpr static double SPRT_MODEL_COST = 200.0;  // Solving a model, in point verifications
+    constexpr static double SPRT_INITIAL_EPSILON = 0.1;  // Inlier fraction of a good model before one is found
+    constexpr static double SPRT_INITIAL_DELTA = 0.01;   // Inlier fraction of a bad model before it is measured
+    float inlierThreshold;
+    int maxIterations;
+    double confidence;
+    uint64_t seed;
+    ThreadPool *pool;
+    Sampling sampling;
+    Preemption preemption;
+    int iterations;                         // Hypotheses generated by the last estimate()
+    int rejected;                           // Hypotheses dropped as degenerate or by the preemptive test
+    long long verifications;                // Point checks performed by the last estimate()
+    static double sprtThreshold(double epsilon, double delta);
+public:
+    RansacEngine(float inlierThreshold, int maxIterations, double confidence = 0.995, uint64_t seed = 498,
+                 ThreadPool *pool = nullptr);
+    int estimate(const float *src, const float *dst, int count, double H[9], const int *order = nullptr);
+    static bool solveHomography(const float *src, const float *dst, const int *sample, double H[9]);
+    static bool isDegenerateSample(const float *src, const float *dst, const int *sample);
+    static int countInliers(const double H[9], const float *src, const float *dst, int count, float threshold);
+    static void findInliers(const double H[9], const float *src, const float *dst, int count, float threshold,
+                            std::vector<int> &inliers);
+    static int requiredIterations(int inliers, int count, double confidence, int sampleSize,
+                                  double passProbability = 1.0);
+    int getIterations() const;
+    int getRejected() const;
+    long long getVerifications() const;
+    float getInlierThreshold() const;
+    void setInlierThreshold(float inlierThreshold);
+    int getMaxIterations() const;
+    void setMaxIterations(int maxIterations);
+    double getConfidence() const;
+    void setConfidence(double confidence);
+    uint64_t getSeed() const;
+    void setSeed(uint64_t seed);
+    Sampling getSampling() const;
+    void setSampling(Sampling sampling);
+    Preemption getPreemption() const;
+    void setPreemption(Preemption preemption);
+};
\ No newline at end of file
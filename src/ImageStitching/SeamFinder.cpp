@@ -0,0 +1,420 @@
+#include "SeamFinder.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "../Tools/Profiler.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Residual graph of a grid max-flow problem, edges stored as pairs of opposite arcs so arc e ^ 1 is the reverse of e
+ */
+struct FlowGraph {
+    vector<int> head;               // First arc out of each node, -1 if none
+    vector<int> next;               // Next arc out of the same node
+    vector<int> to;
+    vector<int> capacity;           // Residual capacity
+
+    explicit FlowGraph(int nodes) : head(nodes, -1) {}
+
+    /**
+     * Add an edge with a capacity in each direction
+     *
+     * @param u First node
+     * @param v Second node
+     * @param forward Capacity from u to v
+     * @param backward Capacity from v to u
+     * @return void
+     */
+    void add(int u, int v, int forward, int backward) {
+        to.push_back(v);
+        capacity.push_back(forward);
+        next.push_back(head[u]);
+        head[u] = (int) to.size() - 1;
+
+        to.push_back(u);
+        capacity.push_back(backward);
+        next.push_back(head[v]);
+        head[v] = (int) to.size() - 1;
+    }
+
+    /**
+     * Breadth first distances from a node over arcs with residual capacity
+     *
+     * @param source Node to start from
+     * @param level Receives the distance of every node, -1 where unreachable
+     * @return void
+     */
+    void levels(int source, vector<int> &level) const {
+        vector<int> queue(1, source);
+        level.assign(head.size(), -1);
+        level[source] = 0;
+
+        for (size_t q = 0; q < queue.size(); q++) {
+            int u = queue[q];
+            for (int e = head[u]; e != -1; e = next[e]) {
+                if (capacity[e] > 0 && level[to[e]] < 0) {
+                    level[to[e]] = level[u] + 1;
+                    queue.push_back(to[e]);
+                }
+            }
+        }
+    }
+
+    /**
+     * Maximum flow from source to sink by Dinic's algorithm. Augmenting paths are searched without recursion, as they
+     * can be as long as the grid is wide.
+     *
+     * @param source Source node
+     * @param sink Sink node
+     * @return long long Flow pushed
+     */
+    long long maxFlow(int source, int sink) {
+        vector<int> level, current, path;
+        long long flow = 0;
+
+        for (levels(source, level); level[sink] >= 0; levels(source, level)) {
+            current = head;
+
+            while (true) {
+                int u = source;
+                path.clear();
+
+                // Walk the level graph, retreating from dead ends and removing them from this phase
+                while (u != sink) {
+                    int &e = current[u];
+                    while (e != -1 && !(capacity[e] > 0 && level[to[e]] == level[u] + 1)) {
+                        e = next[e];
+                    }
+
+                    if (e != -1) {
+                        path.push_back(e);
+                        u = to[e];
+                        continue;
+                    }
+                    if (u == source) {
+                        break;
+                    }
+
+                    level[u] = -1;
+                    u = to[path.back() ^ 1];
+                    path.pop_back();
+                    current[u] = next[current[u]];
+                }
+
+                if (u != sink) {
+                    break;
+                }
+
+                int bottleneck = INT_MAX;
+                for (int e : path) {
+                    bottleneck = min(bottleneck, capacity[e]);
+                }
+                for (int e : path) {
+                    capacity[e] -= bottleneck;
+                    capacity[e ^ 1] += bottleneck;
+                }
+                flow += bottleneck;
+            }
+        }
+
+        return flow;
+    }
+};
+
+/**
+ * Transpose a row major grid
+ *
+ * @param values cols x rows grid, row major
+ * @param cols Columns of values
+ * @param rows Rows of values
+ * @return vector<T> rows x cols grid
+ */
+template <typename T>
+static vector<T> transposed(const vector<T> &values, int cols, int rows) {
+    vector<T> result(values.size());
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            result[c * rows + r] = values[r * cols + c];
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Constructor
+ *
+ * @param method DISTANCE leaves the seam to the blender, where the distances to the two mask edges meet
+ */
+SeamFinder::SeamFinder(Method method) {
+    this->method = method;
+}
+
+/**
+ * Label every pixel of the overlap box with the side that keeps it. Outside the box nothing is covered by both, so
+ * the pixels just outside it tie the cells along its border to whichever side covers them.
+ *
+ * @param canvas Canvas pixels, 8 bit or float, any channel count
+ * @param canvasMask CV_8U, non zero where the canvas holds image data
+ * @param image Image pixels in the same coordinates, same type as the canvas
+ * @param imageMask CV_8U, non zero where the image is valid
+ * @param box Bounding box of the pixels both cover
+ * @param imageSide Receives a box sized CV_8U label, 255 where the image keeps an overlap pixel
+ * @return bool False with the DISTANCE method or an empty box, imageSide is then left untouched
+ */
+bool SeamFinder::find(const Mat &canvas, const Mat &canvasMask, const Mat &image, const Mat &imageMask, Rect box,
+                      Mat &imageSide) const {
+    static Profiler::Timer &timer = Profiler::timer("seam");
+    static Profiler::Counter &cellCount = Profiler::counter("seam.cells");
+    Profiler::Scope scope(timer);
+
+    if (this->method == DISTANCE || box.empty()) {
+        return false;
+    }
+
+    const int cols = (box.width + DOWNSCALE - 1) / DOWNSCALE;
+    const int rows = (box.height + DOWNSCALE - 1) / DOWNSCALE;
+    const int channels = canvas.channels();
+    Mat canvasCells, imageCells, canvasCover, imageCover;
+
+    resize(canvas(box), canvasCells, Size(cols, rows), 0, 0, INTER_AREA);
+    resize(image(box), imageCells, Size(cols, rows), 0, 0, INTER_AREA);
+    resize(canvasMask(box), canvasCover, Size(cols, rows), 0, 0, INTER_AREA);
+    resize(imageMask(box), imageCover, Size(cols, rows), 0, 0, INTER_AREA);
+    canvasCells.convertTo(canvasCells, CV_32F);
+    imageCells.convertTo(imageCells, CV_32F);
+    cellCount.add((long long) cols * rows);
+
+    // Colour difference of the cells both mostly cover, the others are seeds of the side covering them
+    vector<float> difference((size_t) cols * rows, -1.0f);
+    vector<uchar> seeds((size_t) cols * rows, 0);
+    float largest = 0;
+
+    for (int r = 0; r < rows; r++) {
+        const float *a = canvasCells.ptr<float>(r);
+        const float *b = imageCells.ptr<float>(r);
+        const uchar *inCanvas = canvasCover.ptr<uchar>(r);
+        const uchar *inImage = imageCover.ptr<uchar>(r);
+
+        for (int c = 0; c < cols; c++) {
+            if (inCanvas[c] >= 128 && inImage[c] >= 128) {
+                float sum = 0;
+                for (int k = c * channels; k < (c + 1) * channels; k++) {
+                    sum += fabs(a[k] - b[k]);
+                }
+                difference[r * cols + c] = sum;
+                largest = max(largest, sum);
+            }
+            else if (inCanvas[c] >= 128) {
+                seeds[r * cols + c] = CANVAS_SEED;
+            }
+            else if (inImage[c] >= 128) {
+                seeds[r * cols + c] = IMAGE_SEED;
+            }
+        }
+    }
+
+    auto seedOutside = [&](int x, int y, int cell) {
+        if (x < 0 || y < 0 || x >= canvasMask.cols || y >= canvasMask.rows) {
+            return;
+        }
+        if (canvasMask.at<uchar>(y, x)) {
+            seeds[cell] |= CANVAS_SEED;
+        }
+        else if (imageMask.at<uchar>(y, x)) {
+            seeds[cell] |= IMAGE_SEED;
+        }
+    };
+    for (int x = 0; x < box.width; x++) {
+        seedOutside(box.x + x, box.y - 1, x / DOWNSCALE);
+        seedOutside(box.x + x, box.y + box.height, (rows - 1) * cols + x / DOWNSCALE);
+    }
+    for (int y = 0; y < box.height; y++) {
+        seedOutside(box.x - 1, box.y + y, (y / DOWNSCALE) * cols);
+        seedOutside(box.x + box.width, box.y + y, (y / DOWNSCALE) * cols + cols - 1);
+    }
+
+    // Costs scaled so the cut capacities do not depend on the pixel depth, -1 outside the overlap
+    vector<int> cost((size_t) cols * rows);
+    float scale = (largest > 0) ? COST_LEVELS / largest : 0.0f;
+    for (size_t i = 0; i < cost.size(); i++) {
+        cost[i] = (difference[i] < 0) ? -1 : cvRound(difference[i] * scale);
+    }
+
+    vector<uchar> labels;
+    bool canvasFirst;
+
+    if (this->method == DYNAMIC_PROGRAMMING && box.width > box.height) {
+        // Seam runs left to right, solved top to bottom on the transposed grid
+        vector<uchar> seedsT = transposed(seeds, cols, rows);
+        if (sides(seedsT, rows, cols, canvasFirst)) {
+            dynamicProgramming(transposed(cost, cols, rows), rows, cols, canvasFirst, labels);
+            labels = transposed(labels, rows, cols);
+        }
+    }
+    else if (this->method == DYNAMIC_PROGRAMMING && sides(seeds, cols, rows, canvasFirst)) {
+        dynamicProgramming(cost, cols, rows, canvasFirst, labels);
+    }
+
+    // Overlaps a single path cannot split, e.g. an image inside the canvas, are cut instead
+    if (labels.empty()) {
+        graphCut(cost, seeds, cols, rows, labels);
+    }
+
+    resize(Mat(rows, cols, CV_8U, labels.data()), imageSide, box.size(), 0, 0, INTER_NEAREST);
+    return true;
+}
+
+/**
+ * Which side of a top to bottom seam the canvas lies on, from the mean column of each side's seeds
+ *
+ * @param seeds Seed flags of every cell
+ * @param cols Grid columns
+ * @param rows Grid rows
+ * @param canvasFirst Receives whether the canvas lies left of the seam
+ * @return bool False if either side has no seeds or the two cannot be told apart
+ */
+bool SeamFinder::sides(const vector<uchar> &seeds, int cols, int rows, bool &canvasFirst) {
+    double canvasColumns = 0, imageColumns = 0;
+    long long canvasCount = 0, imageCount = 0;
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            uchar seed = seeds[r * cols + c];
+            if (seed == CANVAS_SEED) {
+                canvasColumns += c;
+                canvasCount++;
+            }
+            else if (seed == IMAGE_SEED) {
+                imageColumns += c;
+                imageCount++;
+            }
+        }
+    }
+
+    if (canvasCount == 0 || imageCount == 0) {
+        return false;
+    }
+
+    double canvasMean = canvasColumns / canvasCount, imageMean = imageColumns / imageCount;
+    canvasFirst = canvasMean < imageMean;
+    return canvasMean != imageMean;
+}
+
+/**
+ * Cheapest 8-connected path from the top row of the grid to the bottom. Cells left of the path go to the side
+ * canvasFirst names, the path and cells right of it to the other.
+ *
+ * @param cost Cost of every cell, -1 outside the overlap where the path pays OUTSIDE_COST
+ * @param cols Grid columns
+ * @param rows Grid rows
+ * @param canvasFirst Whether the canvas lies left of the seam
+ * @param imageSide Receives 255 for the cells the image keeps
+ * @return void
+ */
+void SeamFinder::dynamicProgramming(const vector<int> &cost, int cols, int rows, bool canvasFirst,
+                                    vector<uchar> &imageSide) {
+    vector<int> total((size_t) cols * rows);
+    vector<int> seam(rows);
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int cell = (cost[r * cols + c] < 0) ? (int) OUTSIDE_COST : cost[r * cols + c];
+            int best = 0;
+
+            if (r > 0) {
+                const int *above = &total[(r - 1) * cols];
+                best = above[c];
+                if (c > 0) {
+                    best = min(best, above[c - 1]);
+                }
+                if (c + 1 < cols) {
+                    best = min(best, above[c + 1]);
+                }
+            }
+            total[r * cols + c] = cell + best;
+        }
+    }
+
+    // Trace back from the cheapest end, preferring to go straight on ties
+    const int *last = &total[(rows - 1) * cols];
+    seam[rows - 1] = (int) (min_element(last, last + cols) - last);
+    for (int r = rows - 1; r > 0; r--) {
+        const int *above = &total[(r - 1) * cols];
+        int c = seam[r];
+        int best = c;
+
+        if (c > 0 && above[c - 1] < above[best]) {
+            best = c - 1;
+        }
+        if (c + 1 < cols && above[c + 1] < above[best]) {
+            best = c + 1;
+        }
+        seam[r - 1] = best;
+    }
+
+    imageSide.assign((size_t) cols * rows, 0);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            bool left = c < seam[r];
+            imageSide[r * cols + c] = (left != canvasFirst) ? 255 : 0;
+        }
+    }
+}
+
+/**
+ * Minimum cut between the canvas seeds and the image seeds over the 4-connected grid. Cutting between two cells costs
+ * their colour differences plus one, so the seam prefers short paths where the two sides agree. Cells outside the
+ * overlap count as the largest difference, otherwise cutting along the overlap's edge would cost half as much as
+ * anywhere inside it. Cells still connected to the canvas seeds after the cut go to the canvas.
+ *
+ * @param cost Cost of every cell, -1 outside the overlap
+ * @param seeds Seed flags of every cell
+ * @param cols Grid columns
+ * @param rows Grid rows
+ * @param imageSide Receives 255 for the cells the image keeps
+ * @return void
+ */
+void SeamFinder::graphCut(const vector<int> &cost, const vector<uchar> &seeds, int cols, int rows,
+                          vector<uchar> &imageSide) {
+    const int cells = cols * rows;
+    const int source = cells, sink = cells + 1;
+    FlowGraph graph = FlowGraph(cells + 2);
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int p = r * cols + c;
+            int own = (cost[p] < 0) ? (int) COST_LEVELS : cost[p];
+
+            if (seeds[p] & CANVAS_SEED) {
+                graph.add(source, p, HARD, 0);
+            }
+            if (seeds[p] & IMAGE_SEED) {
+                graph.add(p, sink, HARD, 0);
+            }
+            if (c + 1 < cols) {
+                int weight = own + ((cost[p + 1] < 0) ? (int) COST_LEVELS : cost[p + 1]) + 1;
+                graph.add(p, p + 1, weight, weight);
+            }
+            if (r + 1 < rows) {
+                int weight = own + ((cost[p + cols] < 0) ? (int) COST_LEVELS : cost[p + cols]) + 1;
+                graph.add(p, p + cols, weight, weight);
+            }
+        }
+    }
+
+    graph.maxFlow(source, sink);
+
+    vector<int> reached;
+    graph.levels(source, reached);
+    imageSide.assign((size_t) cells, 0);
+    for (int p = 0; p < cells; p++) {
+        imageSide[p] = (reached[p] < 0) ? 255 : 0;
+    }
+}
+
+SeamFinder::Method SeamFinder::getMethod() const { return method; }
+void SeamFinder::setMethod(Method method) { SeamFinder::method = method; }
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+/**
+ * Minimum cost seam between the canvas and an image being blended into it. Where both are covered, a seam through
+ * pixels on which they agree hides misalignment and keeps moving content from appearing twice, so each overlap pixel
+ * is given wholly to one side and the blender only smooths across the seam.
+ *
+ * The search runs only inside the bounding box of the overlap, on a grid DOWNSCALE times coarser than the pixels, and
+ * the labels are scaled back up, so its cost grows with the overlap area rather than the canvas. The cost of a cell is
+ * the colour difference of the two sides there. DYNAMIC_PROGRAMMING finds the cheapest path across the overlap along
+ * its longer side, which suits the strip two images side by side overlap in. GRAPH_CUT takes the minimum cut between
+ * the cells only the canvas reaches and those only the image reaches, which handles an overlap of any shape, as when
+ * an image lands among several already on the canvas.
+ */
+class SeamFinder {
+public:
+    enum Method { DISTANCE = 0, DYNAMIC_PROGRAMMING = 1, GRAPH_CUT = 2 };
+private:
+    const static int DOWNSCALE = 4;                 // Pixels per grid cell side
+    const static int COST_LEVELS = 255;             // Colour differences are scaled to 0..COST_LEVELS
+    const static int OUTSIDE_COST = 1024;           // Cell cost of a dynamic programming seam leaving the overlap
+    const static int HARD = 1 << 24;                // Capacity of the links tying a cell to a side
+    const static uchar CANVAS_SEED = 1;             // Cell only the canvas covers, or next to canvas outside the box
+    const static uchar IMAGE_SEED = 2;              // Cell only the image covers, or next to image outside the box
+    Method method;
+    static bool sides(const std::vector<uchar> &seeds, int cols, int rows, bool &canvasFirst);
+    static void dynamicProgramming(const std::vector<int> &cost, int cols, int rows, bool canvasFirst,
+                                   std::vector<uchar> &imageSide);
+    static void graphCut(const std::vector<int> &cost, const std::vector<uchar> &seeds, int cols, int rows,
+                         std::vector<uchar> &imageSide);
+public:
+    explicit SeamFinder(Method method = DISTANCE);
+    bool find(const cv::Mat &canvas, const cv::Mat &canvasMask, const cv::Mat &image, const cv::Mat &imageMask,
+              cv::Rect box, cv::Mat &imageSide) const;
+    Method getMethod() const;
+    void setMethod(Method method);
+};
\ No newline at end of file
@@ -1,62 +1,87 @@
-#include <stdlib.h>
 #include "Stitching.h"
+#include "GainCompensator.h"
+#include "HomographyRefiner.h"
+#include "../Tools/Matcher.h"
+#include "../Tools/Profiler.h"
+#include "../Tools/ScratchArena.h"
 
 using namespace std;
 using namespace cv;
 
-Stitching::Stitching(string img1, string img2, vector<Match> matches) {
+/**
+ * Constructor
+ *
+ * @param img1 File path to the first image
+ * @param img2 File path to the second image
+ * @param features1 Keypoints of the first image
+ * @param features2 Keypoints of the second image
+ * @param matches Index pairs into features1 and features2
+ */
+Stitching::Stitching(string img1, string img2, const DescriptorSet &features1, const DescriptorSet &features2,
+                     vector<Match> matches) {
     this->bestInlierCount = 0;
     this->bestHomography = Mat::zeros(3, 3, 0);
+    this->seed = DEFAULT_SEED;
+    this->sampling = RansacEngine::UNIFORM;
+    this->preemption = RansacEngine::NONE;
+    this->warper = Warper(INTER_LINEAR);
+    this->blender = Blender(Blender::MULTIBAND);
+    this->blender.setSeamMethod(SeamFinder::DYNAMIC_PROGRAMMING);
+    this->gainCompensation = true;
     this->image1 = imread(img1, IMREAD_UNCHANGED);
     this->image2 = imread(img2, IMREAD_UNCHANGED);
     this->matches = matches;
+
+    // Resolve match indices to point locations once so the estimation loops never touch the descriptor sets
+    this->points1 = vector<Point2f>();
+    this->points2 = vector<Point2f>();
+    this->points1.reserve(matches.size());
+    this->points2.reserve(matches.size());
+
+    for (const Match &m : this->matches) {
+        this->points1.emplace_back(Point_<float>(features1.getCol(m.getIndex1()), features1.getRow(m.getIndex1())));
+        this->points2.emplace_back(Point_<float>(features2.getCol(m.getIndex2()), features2.getRow(m.getIndex2())));
+    }
 }
 
 /**
- * Implementation of RANSAC to estimate and refine the homography to be used for stitching
+ * Implementation of RANSAC to estimate and refine the homography to be used for stitching. Hypotheses are scored by
+ * RansacEngine, which stops once the best inlier ratio makes further sampling unnecessary. With PROSAC sampling the
+ * matches are tried in order of their ratio test score. The best hypothesis is then refined by HomographyRefiner over
+ * its inliers.
  *
  * @param numMatches
- * @param numIterations
+ * @param numIterations Upper bound on hypotheses
  * @param inlierThreshold
  * @return Mat
  */
 cv::Mat Stitching::RANSAC(int numMatches, int numIterations, int inlierThreshold, string writeTo) {
-    int matchesPerIterations = 4;
-    vector<Match> inliers = vector<Match>();
-
-    // Estimate Homography using 4 random matches
-    for (int i = 0; i < numIterations; i++) {
-        vector<Point2f> img1Points;   // src
-        vector<Point2f> img2Points;   // dst
-
-        // Generate Arrays
-        for (int j = 0; j < matchesPerIterations; j++) {
-            Match m = getRandomMatch();
-            img1Points.emplace_back(Point_<float>(m.getPoint1().getFeatureCol(), m.getPoint1().getFeatureRow()));
-            img2Points.emplace_back(Point_<float>(m.getPoint2().getFeatureCol(), m.getPoint2().getFeatureRow()));
-        }
-
-        Mat H = findHomography(img1Points, img2Points, 0);
-        inliers = computerInlierCount(H, inlierThreshold);
-
-        if (inliers.size() > this->bestInlierCount) {
-            this->bestInlierCount = (int) inliers.size();
-            this->bestHomography = H;
-        }
-    }
+    static Profiler::Timer &timer = Profiler::timer("stitching.ransac");
+    Profiler::Scope scope(timer);
 
-    // Generate a final Homography from all inlier matches of the best estimate
-    inliers = computerInlierCount(this->bestHomography, inlierThreshold);
-    vector<Point2f> img1Points;   // src
-    vector<Point2f> img2Points;   // dst
+    vector<int> inliers = vector<int>();
+    const float *src = reinterpret_cast<const float *>(this->points1.data());   // Point2f is two packed floats
+    const float *dst = reinterpret_cast<const float *>(this->points2.data());
+    double H[9];
 
-    for (auto m : inliers) {
-        img1Points.emplace_back(Point_<float>(m.getPoint1().getFeatureCol(), m.getPoint1().getFeatureRow()));
-        img2Points.emplace_back(Point_<float>(m.getPoint2().getFeatureCol(), m.getPoint2().getFeatureRow()));
-    }
+    // Most distinctive matches first
+    vector<int> order = Matcher::qualityOrder(this->matches);
+
+    // Estimate Homography using 4 matches per hypothesis
+    RansacEngine engine = RansacEngine((float) inlierThreshold, numIterations, RANSAC_CONFIDENCE, this->seed);
+    engine.setSampling(this->sampling);
+    engine.setPreemption(this->preemption);
+    this->bestInlierCount = engine.estimate(src, dst, (int) this->matches.size(), H, order.data());
+    this->bestHomography = Mat(3, 3, CV_64F, H).clone();
 
-    // Store final homography
-    this->finalHomography = findHomography(img1Points, img2Points, 0);
+    // Refine the best estimate over all of its inlier matches, which needs at least four of them
+    inliers = computerInlierCount(this->bestHomography, inlierThreshold);
+    if (inliers.size() >= 4 && HomographyRefiner::refine(src, dst, inliers.data(), (int) inliers.size(), H)) {
+        this->finalHomography = Mat(3, 3, CV_64F, H).clone();
+    }
+    else {
+        this->finalHomography = this->bestHomography.clone();
+    }
 
     // Return the concatenated images with highlighted inlier matches
     Mat o = drawMatches(inlierThreshold, this->finalHomography);
@@ -65,26 +90,22 @@ cv::Mat Stitching::RANSAC(int numMatches, int numIterations, int inlierThreshold
 }
 
 /**
- * Project point p1 using a homography H producing the points location in the projected space
+ * Project point p1 using a homography H producing the points location in the projected space. Reads the entries of H
+ * in place, so no temporary matrices are allocated per point.
  *
  * @param p1 Point to project
- * @param H Homography to guide projection
+ * @param H Homography to guide projection (CV_32F or CV_64F)
  * @return Point2f
  */
 Point2f Stitching::project(Point2f p1, Mat H) {
-    // Convert point to homogeneous space vector
-    Mat point = Mat::zeros(3, 1, CV_32F);
-    point.at<float>(0,0) = p1.x;
-    point.at<float>(1,0) = p1.y;
-    point.at<float>(2,0) = 1.0;
-
-    Mat projection;
-    H.convertTo(projection, CV_32F);
-
-    Mat result = projection * point;
+    double h[9];
+    for (int i = 0; i < 9; i++) {
+        h[i] = (H.depth() == CV_64F) ? H.at<double>(i / 3, i % 3) : (double) H.at<float>(i / 3, i % 3);
+    }
 
-    // Convert and return the homogeneous projection as cartesian Point
-    return Point_<float>(result.at<float>(0,0)/result.at<float>(2,0), result.at<float>(1,0)/result.at<float>(2,0));
+    // Homogeneous projection converted back to a cartesian Point
+    double w = h[6] * p1.x + h[7] * p1.y + h[8];
+    return Point2f((float) ((h[0] * p1.x + h[1] * p1.y + h[2]) / w), (float) ((h[3] * p1.x + h[4] * p1.y + h[5]) / w));
 }
 
 /**
@@ -93,24 +114,16 @@ Point2f Stitching::project(Point2f p1, Mat H) {
  *
  * @param H Homography to guide projection
  * @param inlierThreshold Distance threshold for determining inliers
- * @return vector<Match>
+ * @return vector<int> Positions of the inlier matches
  */
-vector<Match> Stitching::computerInlierCount(Mat H, int inlierThreshold) {
-    int count = 0;
-    vector<Match> inliers = vector<Match>();
-
-    for (auto match : this->matches) {
-        Point2f p1 = Point_<float>(match.getPoint1().getFeatureCol(), match.getPoint1().getFeatureRow());
-        Point2f p2 = Point_<float>(match.getPoint2().getFeatureCol(), match.getPoint2().getFeatureRow());
-        Point2f projection = project(p1, H);
-
-        double distance = sqrt(pow(projection.x-p2.x, 2) + pow(projection.y-p2.y, 2));
+vector<int> Stitching::computerInlierCount(Mat H, int inlierThreshold) {
+    vector<int> inliers = vector<int>();
+    Mat h;
+    H.convertTo(h, CV_64F);
 
-        if (distance <= inlierThreshold) {
-            count++;
-            inliers.emplace_back(match);
-        }
-    }
+    RansacEngine::findInliers(h.ptr<double>(0), reinterpret_cast<const float *>(this->points1.data()),
+                              reinterpret_cast<const float *>(this->points2.data()), (int) this->matches.size(),
+                              (float) inlierThreshold, inliers);
 
     return inliers;
 }
@@ -124,7 +137,7 @@ vector<Match> Stitching::computerInlierCount(Mat H, int inlierThreshold) {
  */
 Mat Stitching::drawMatches(int inlierThreshold, Mat H) {
     RNG rng(12345);
-    vector<Match> inliers = computerInlierCount(H, inlierThreshold);    // Determine inlier matches to draw
+    vector<int> inliers = computerInlierCount(H, inlierThreshold);      // Determine inlier matches to draw
 
     // Produce concatenated output image
     int width = this->image1.cols + this->image2.cols;
@@ -134,10 +147,10 @@ Mat Stitching::drawMatches(int inlierThreshold, Mat H) {
     hconcat(this->image1, this->image2, result);
 
     // Draw matches on output image
-    for (auto match : inliers) {
+    for (int m : inliers) {
         Scalar color = Scalar(rng.uniform(0,255), rng.uniform(0, 255), rng.uniform(0, 255));
-        Point p1 = Point(match.getPoint1().getFeatureCol(), match.getPoint1().getFeatureRow());
-        Point p2 = Point(match.getPoint2().getFeatureCol()+this->image1.cols, match.getPoint2().getFeatureRow());
+        Point p1 = Point((int) this->points1[m].x, (int) this->points1[m].y);
+        Point p2 = Point((int) this->points2[m].x + this->image1.cols, (int) this->points2[m].y);
 
         circle(result, p1, 4, color);
         circle(result, p2, 4, color);
@@ -148,119 +161,114 @@ Mat Stitching::drawMatches(int inlierThreshold, Mat H) {
 }
 
 /**
- * Stitches class members image1 and image2 together.
+ * Stitches class members image1 and image2 together. The panorama is laid out in image 1 coordinates, image 2 is
+ * inverse warped into it through the final homography, and the overlap is blended across a dynamic programming seam
+ * through the pixels where the two images agree. With gain compensation on, each image is scaled by its gain as it
+ * is copied or warped in, evening out exposure differences across the seam. The coverage mask and the warped image are
+ * carved from the calling thread's arena; the remap table stays in the warper, which reuses it while the homography is
+ * unchanged.
  *
  * @param writeTo Location to save produced panorama
  * @return Mat
  */
 Mat Stitching::stitch(string writeTo) {
-    Mat homInv = this->finalHomography.inv();
+    static Profiler::Timer &timer = Profiler::timer("stitching.stitch");
+    Profiler::Scope scope(timer);
+
     Mat img1 = this->image1;
     Mat img2 = this->image2;
 
-    cvtColor(img1, img1, CV_BGRA2BGR);
-    cvtColor(img2, img2, CV_BGRA2BGR);
-    img1.convertTo(img1, CV_32FC3);
-    img2.convertTo(img2, CV_32FC3);
-
-    // Determine size of stitched image
-    vector<Point2f> corners;
-    int offsetx = 0;    // Create space of points to the left of img1
-    int offsety = 0;    // Create space for points above img1
-    int overflowx = 0;  // Create space for points to the right of img1
-    int overflowy = 0;  // Create space for points below img1
-
-    corners.emplace_back(project(Point(0, 0), homInv));
-    corners.emplace_back(project(Point(img2.cols, 0), homInv));
-    corners.emplace_back(project(Point(0, img2.rows), homInv));
-    corners.emplace_back(project(Point(img2.cols, img2.rows), homInv));
-
-    for (auto c : corners) {
-        if (c.x < 0 && c.x < offsetx) {
-            offsetx = (int) floor(c.x);
-        }
-        else if (c.x > img1.cols && c.x - img1.cols > overflowx) {
-            overflowx = (int) ceil(c.x) - img1.cols;
-        }
-
-        if (c.y < 0 && c.y < offsety) {
-            offsety = (int) floor(c.y);
-        }
-        else if (c.y > img1.rows && c.y - img1.rows > overflowy) {
-            overflowy = (int) ceil(c.y) - img1.rows;
-        }
+    if (img1.channels() == 4) {
+        cvtColor(img1, img1, CV_BGRA2BGR);
+    }
+    if (img2.channels() == 4) {
+        cvtColor(img2, img2, CV_BGRA2BGR);
     }
 
-    offsetx = abs(offsetx);
-    offsety = abs(offsety);
-
-    // Initialize stiched image matrix
-    Mat stitched = Mat::zeros(img1.rows + offsety + overflowy,
-                              img1.cols + offsetx + overflowx,
-                              CV_32FC3);
-
-    // Copy img1 to stitched
-    for (int i = 0; i < img1.rows; i++) {
-        for (int j = 0; j < img1.cols; j++) {
-            Vec3f value = img1.at<Vec3f>(i, j);
-            stitched.at<Vec3f>(i+offsety, j+offsetx) = value;
-        }
+    // Panorama bounds: image 1 plus the corners of image 2 projected back into image 1
+    Rect canvas = Rect(0, 0, img1.cols, img1.rows) | Warper::bounds(this->finalHomography.inv(), img2.size());
+    Rect placed = Rect(-canvas.x, -canvas.y, img1.cols, img1.rows);
+    Mat stitched = Mat::zeros(canvas.height, canvas.width, img1.type());
+
+    // Coverage and the warped image are only needed until the blend is done
+    ScratchArena::Scope scratch;
+    ScratchArena &arena = ScratchArena::local();
+    Mat covered = arena.mat(canvas.height, canvas.width, CV_8U);
+    Mat warped = arena.mat(canvas.height, canvas.width, img2.type());
+    covered.setTo(Scalar(0));
+
+    GainCompensator compensator = GainCompensator();
+    if (this->gainCompensation) {
+        compensator.estimate({img1, img2}, {Mat::eye(3, 3, CV_64F), this->finalHomography.inv()}, canvas);
     }
 
-    // Find points on panorama output which map to img2 and populate their pixels with information from img2
-    for (int i = 0; i < stitched.rows; i++) {
-        for (int j = 0; j < stitched.cols; j++) {
-            Point p = project(Point(j, i), this->finalHomography);
+    Mat base = stitched(placed);
+    img1.convertTo(base, -1, compensator.getGain(0));
+    covered(placed).setTo(Scalar(255));
 
-            if (pointInImage(p, img2)) {
-                stitched.at<Vec3f>(i+offsety, j+offsetx) = img2.at<Vec3f>(p.y, p.x);
-            }
-        }
-    }
+    // Sample img2 at the panorama pixels that map into it and blend it over the overlap
+    const Warper::RemapTable &table = this->warper.warp(img2, this->finalHomography, canvas, warped,
+                                                        compensator.getGain(1));
+    this->blender.blend(stitched, covered, warped, table.mask, Point(0, 0));
 
     cvtColor(stitched, stitched, CV_BGR2BGRA);
-    stitched.convertTo(stitched, CV_8UC4);
 
     imwrite(writeTo, stitched);
     return stitched;
 }
 
-/**
- * Grab random set of potentially matching points
- *
- * @return Match
- */
-Match Stitching::getRandomMatch() {
-    return this->matches.at((rand() % this->matches.size()-1) + 1);
+int Stitching::getBestInlierCount() const {
+    return bestInlierCount;
 }
 
-/**
- * Check if the components of Point p fall within the boundaries of image img
- *
- * @param p
- * @param img
- * @return bool
- */
-bool Stitching::pointInImage(cv::Point p, cv::Mat img) {
-    if (p.x > img.cols || p.x < 0) {
-        return false;
-    }
-    else if (p.y > img.rows || p.y < 0) {
-        return false;
-    }
-    else {
-        return true;
-    }
+const Mat &Stitching::getBestHomography() const {
+    return bestHomography;
 }
 
-Mat Stitching::alphaBlend(Mat img, bool left) {
+uint64_t Stitching::getSeed() const {
+    return seed;
+}
 
+void Stitching::setSeed(uint64_t seed) {
+    Stitching::seed = seed;
 }
 
-int Stitching::getBestInlierCount() const {
-    return bestInlierCount;
+RansacEngine::Sampling Stitching::getSampling() const {
+    return sampling;
 }
 
-const Mat &Stitching::getBestHomography() const {
-    return bestHomography;
+void Stitching::setSampling(RansacEngine::Sampling sampling) {
+    Stitching::sampling = sampling;
+}
+
+RansacEngine::Preemption Stitching::getPreemption() const {
+    return preemption;
+}
+
+void Stitching::setPreemption(RansacEngine::Preemption preemption) {
+    Stitching::preemption = preemption;
+}
+
+int Stitching::getInterpolation() const {
+    return warper.getInterpolation();
+}
+
+void Stitching::setInterpolation(int interpolation) {
+    warper.setInterpolation(interpolation);
+}
+
+const Blender &Stitching::getBlender() const {
+    return blender;
+}
+
+void Stitching::setBlender(const Blender &blender) {
+    Stitching::blender = blender;
+}
+
+bool Stitching::isGainCompensation() const {
+    return gainCompensation;
+}
+
+void Stitching::setGainCompensation(bool gainCompensation) {
+    Stitching::gainCompensation = gainCompensation;
 }
@@ -1,27 +1,52 @@
 #pragma once
 
 #include <opencv2/opencv.hpp>
+#include <cstdint>
 #include <vector>
 #include "../Tools/Match.h"
+#include "../FeatureMatching/DescriptorSet.h"
+#include "RansacEngine.h"
+#include "Warper.h"
+#include "Blender.h"
 
 class Stitching {
 private:
+    const static uint64_t DEFAULT_SEED = 498;
+    constexpr static double RANSAC_CONFIDENCE = 0.995;
     int bestInlierCount;
     cv::Mat bestHomography;
     cv::Mat finalHomography;
     cv::Mat image1;
     cv::Mat image2;
+    uint64_t seed;                      // Seed of the RANSAC hypothesis generators
+    RansacEngine::Sampling sampling;    // How RANSAC draws its samples
+    RansacEngine::Preemption preemption;    // Early rejection test applied to each hypothesis
     std::vector<Match> matches;
-    std::vector<Match> computerInlierCount(cv::Mat H, int inlierThreshold);
-    Match getRandomMatch();
-    bool pointInImage(cv::Point p, cv::Mat img);
-    cv::Mat alphaBlend(cv::Mat img, bool left);
+    std::vector<cv::Point2f> points1;   // Image 1 location of each match
+    std::vector<cv::Point2f> points2;   // Image 2 location of each match
+    Warper warper;                      // Keeps the remap table of the last stitch() for reuse
+    Blender blender;                    // Blends the overlap, reports the cost of the last stitch()
+    bool gainCompensation;              // Even out the exposure of the two images in stitch()
+    std::vector<int> computerInlierCount(cv::Mat H, int inlierThreshold);
 public:
     cv::Point2f project(cv::Point2f p1, cv::Mat H);
-    Stitching(std::string img1, std::string img2, std::vector<Match> matches);
+    Stitching(std::string img1, std::string img2, const DescriptorSet &features1, const DescriptorSet &features2,
+              std::vector<Match> matches);
     cv::Mat RANSAC(int numMatches, int numIterations, int inlierThreshold, std::string writeTo);
     cv::Mat drawMatches(int inlierThreshold, cv::Mat H);
     cv::Mat stitch(std::string writeTo);
     int getBestInlierCount() const;
     const cv::Mat &getBestHomography() const;
+    uint64_t getSeed() const;
+    void setSeed(uint64_t seed);
+    RansacEngine::Sampling getSampling() const;
+    void setSampling(RansacEngine::Sampling sampling);
+    RansacEngine::Preemption getPreemption() const;
+    void setPreemption(RansacEngine::Preemption preemption);
+    int getInterpolation() const;
+    void setInterpolation(int interpolation);
+    const Blender &getBlender() const;
+    void setBlender(const Blender &blender);
+    bool isGainCompensation() const;
+    void setGainCompensation(bool gainCompensation);
 };
\ No newline at end of file
@@ -0,0 +1,238 @@
+#include "StreamingStitcher.h"
+#include <chrono>
+#include "HomographyRefiner.h"
+#include "RansacEngine.h"
+#include "Warper.h"
+#include "../FeatureMatching/FeatureDetector_498.h"
+#include "../Tools/Matcher.h"
+#include "../Tools/ScratchArena.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param pool Threads to detect, match, warp and blend on, the shared pool if null
+ */
+StreamingStitcher::StreamingStitcher(ThreadPool *pool) {
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+    this->canvas = TiledCanvas(CV_8UC3);
+    this->blender = Blender(Blender::MULTIBAND, 5, this->pool);
+    this->keypointBudget = FeatureDetector_498::KEYPOINT_BUDGET;
+    this->descriptorType = DescriptorSet::SIFT;
+    reset();
+}
+
+/**
+ * Forget every frame and empty the mosaic
+ *
+ * @return void
+ */
+void StreamingStitcher::reset() {
+    this->canvas.clear();
+    this->previousFeatures = DescriptorSet(this->descriptorType);
+    this->previousTransform = Mat();
+    this->motion = Mat();
+    this->frames = 0;
+}
+
+/**
+ * Keep the mosaic in a backing file instead of in memory, for sequences whose mosaic does not fit. Forgets every frame
+ * added so far.
+ *
+ * @param backingFile Scratch file for the canvas, must not exist yet
+ * @param cacheTiles Tiles kept mapped at once
+ * @return bool Whether the file was created, the mosaic stays in memory otherwise
+ */
+bool StreamingStitcher::setBackingFile(const string &backingFile, size_t cacheTiles) {
+    this->canvas = TiledCanvas(CV_8UC3, backingFile, cacheTiles);
+    reset();
+    return this->canvas.isBacked();
+}
+
+/**
+ * Homography from the current frame onto the previous one, accepted with the same test as Panorama: inliers > 8 + 0.3
+ * * matches, then refined over the inliers by HomographyRefiner
+ *
+ * @param current Keypoints of the current frame
+ * @param matches Matches from current into the previous frame's keypoints
+ * @param inliers Receives the inlier count of the best hypothesis
+ * @param H Receives the homography
+ * @return bool Whether the frame registered
+ */
+bool StreamingStitcher::estimate(const DescriptorSet &current, const vector<Match> &matches, int &inliers,
+                                 Mat &H) const {
+    int count = (int) matches.size();
+
+    inliers = 0;
+    if (count < 4) {
+        return false;
+    }
+
+    vector<float> src(2 * count), dst(2 * count);
+    for (int m = 0; m < count; m++) {
+        src[2 * m] = current.getCol(matches[m].getIndex1());
+        src[2 * m + 1] = current.getRow(matches[m].getIndex1());
+        dst[2 * m] = previousFeatures.getCol(matches[m].getIndex2());
+        dst[2 * m + 1] = previousFeatures.getRow(matches[m].getIndex2());
+    }
+
+    vector<int> order = Matcher::qualityOrder(matches);
+    RansacEngine engine = RansacEngine((float) INLIER_THRESHOLD, RANSAC_ITERATIONS, 0.995, 498, this->pool);
+    engine.setSampling(RansacEngine::PROSAC);
+    engine.setPreemption(RansacEngine::SPRT);
+
+    double best[9];
+    inliers = engine.estimate(src.data(), dst.data(), count, best, order.data());
+    if (inliers < 4 || inliers <= 8 + 0.3 * count) {
+        return false;
+    }
+
+    vector<int> consistent;
+    RansacEngine::findInliers(best, src.data(), dst.data(), count, (float) INLIER_THRESHOLD, consistent);
+    HomographyRefiner::refine(src.data(), dst.data(), consistent.data(), (int) consistent.size(), best);
+    H = Mat(3, 3, CV_64F, best).clone();
+    return true;
+}
+
+/**
+ * Warp a frame over its footprint and blend it into the canvas. Only the tiles under the footprint are read and
+ * written back. The remap table and the warped frame are scratch, carved from the calling thread's arena.
+ *
+ * @param frame Frame to add
+ * @param transform Frame into the mosaic
+ * @param footprint Canvas area the warped frame covers
+ * @return bool False if the canvas could not store all of it
+ */
+bool StreamingStitcher::composite(const Mat &frame, const Mat &transform, const Rect &footprint) {
+    ScratchArena::Scope scratch;
+    ScratchArena &arena = ScratchArena::local();
+    Mat region, covered;
+    Mat warped = arena.mat(footprint.height, footprint.width, frame.type());
+    Warper warper = Warper(INTER_LINEAR, this->pool);
+    Warper::RemapTable table;
+
+    canvas.read(footprint, region, covered);
+    warper.buildTable(transform.inv(), footprint, frame.size(), table, &arena);
+    warper.warp(frame, table, warped);
+    blender.blend(region, covered, warped, table.mask, Point(0, 0));
+    return canvas.write(footprint, region, covered);
+}
+
+/**
+ * Register a frame against the previous one and add it to the mosaic. The previous motion is used as the prediction
+ * for this step; when guided matching does not verify, the frame is matched in full against the previous frame. A
+ * frame that does not register, or whose footprint grows beyond MAX_FOOTPRINT_GROWTH frame areas, is skipped and the
+ * next frame is matched in full against the last registered one.
+ *
+ * @param frame BGR frame
+ * @return FrameResult
+ */
+StreamingStitcher::FrameResult StreamingStitcher::addFrame(const Mat &frame) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    FrameResult result;
+    result.tracked = false;
+    result.guided = false;
+    result.matches = 0;
+    result.inliers = 0;
+    result.footprint = Rect();
+
+    if (frame.empty()) {
+        result.milliseconds = 0;
+        return result;
+    }
+
+    FeatureDetector_498 fd = FeatureDetector_498(frame, this->pool);
+    fd.setKeypointBudget(this->keypointBudget);
+    fd.setDescriptorType(this->descriptorType);
+    fd.detectFeatures();
+    DescriptorSet features = fd.describeFeatures();
+
+    Mat H = Mat::eye(3, 3, CV_64F);
+    Mat transform = H;
+    bool registered = this->previousTransform.empty();
+
+    if (!registered) {
+        Matcher matcher = Matcher(DISTANCE_THRESHOLD, RATIO_THRESHOLD, false, this->pool);
+        vector<Match> matches;
+
+        if (!this->motion.empty()) {
+            matches = matcher.matchGuided(features, this->previousFeatures, this->motion.ptr<double>(),
+                                          SEARCH_RADIUS);
+            registered = result.guided = estimate(features, matches, result.inliers, H);
+        }
+        if (!registered) {
+            matcher.setCrossCheck(true);
+            matches = matcher.match(features, this->previousFeatures);
+            registered = estimate(features, matches, result.inliers, H);
+        }
+
+        result.matches = (int) matches.size();
+        if (registered) {
+            Mat chained = this->previousTransform * H;
+            transform = chained / chained.at<double>(2, 2);
+        }
+    }
+
+    Rect footprint = registered ? Warper::bounds(transform, frame.size()) : Rect();
+    if (footprint.area() <= 0 || footprint.area() > (double) MAX_FOOTPRINT_GROWTH * frame.cols * frame.rows) {
+        this->motion = Mat();
+        result.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
+
+    bool stored = composite(frame, transform, footprint);
+
+    this->motion = (this->frames > 0) ? H : Mat();
+    this->previousTransform = transform;
+    this->previousFeatures = features;
+    this->frames++;
+
+    result.tracked = stored;
+    result.footprint = footprint;
+    result.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+/**
+ * The whole mosaic as one image. This reads every tile, unlike addFrame().
+ *
+ * @return Mat
+ */
+Mat StreamingStitcher::render() const {
+    return canvas.render();
+}
+
+/**
+ * Save the mosaic as tiles and an index, one tile at a time, see TiledCanvas::writeTiles()
+ *
+ * @param directory Directory to write to
+ * @return bool Whether every file was written
+ */
+bool StreamingStitcher::writeTiles(const string &directory) const {
+    return canvas.writeTiles(directory);
+}
+
+/**
+ * Save the mosaic
+ *
+ * @param writeTo Location to save the mosaic
+ * @return bool Whether it was written
+ */
+bool StreamingStitcher::write(const string &writeTo) const {
+    Mat mosaic = render();
+    return !mosaic.empty() && imwrite(writeTo, mosaic);
+}
+
+const TiledCanvas &StreamingStitcher::getCanvas() const { return canvas; }
+const Mat &StreamingStitcher::getTransform() const { return previousTransform; }
+int StreamingStitcher::getFrames() const { return frames; }
+const Blender &StreamingStitcher::getBlender() const { return blender; }
+void StreamingStitcher::setBlender(const Blender &blender) { StreamingStitcher::blender = blender; }
+int StreamingStitcher::getKeypointBudget() const { return keypointBudget; }
+void StreamingStitcher::setKeypointBudget(int keypointBudget) { StreamingStitcher::keypointBudget = keypointBudget; }
+DescriptorSet::Type StreamingStitcher::getDescriptorType() const { return descriptorType; }
+void StreamingStitcher::setDescriptorType(DescriptorSet::Type descriptorType) {
+    StreamingStitcher::descriptorType = descriptorType;
+}
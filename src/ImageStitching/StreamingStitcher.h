@@ -0,0 +1,67 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include "Blender.h"
+#include "TiledCanvas.h"
+#include "../FeatureMatching/DescriptorSet.h"
+#include "../Tools/Match.h"
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Stitches a continuous sequence of frames, such as a camera sweep, one frame at a time. Each frame is matched only
+ * against the previous one: the previous motion predicts where its keypoints land, and matching is restricted to a
+ * window around that prediction. The frame is then warped over its own footprint and blended into a TiledCanvas, so
+ * the work per frame depends on the frame and its keypoint budget and not on how large the mosaic has grown.
+ *
+ * The mosaic is kept in the coordinates of the first frame, in memory or, after setBackingFile(), on disk.
+ */
+class StreamingStitcher {
+public:
+    /**
+     * Outcome of one addFrame()
+     */
+    struct FrameResult {
+        bool tracked;               // Whether the frame was registered and composited
+        bool guided;                // Whether the motion prediction was used, false for a full match
+        int matches;                // Matches that passed the ratio test
+        int inliers;                // Matches consistent with the frame's homography
+        cv::Rect footprint;         // Canvas area the frame was written to
+        double milliseconds;        // Time spent in addFrame()
+    };
+private:
+    const static int RANSAC_ITERATIONS = 2000;
+    const static int INLIER_THRESHOLD = 15;
+    const static int MAX_FOOTPRINT_GROWTH = 4;      // Largest footprint accepted, in frame areas
+    constexpr static float SEARCH_RADIUS = 48.0;    // Pixels around a predicted position searched for its match
+    constexpr static float DISTANCE_THRESHOLD = 1.0;
+    constexpr static float RATIO_THRESHOLD = 0.36;
+    ThreadPool *pool;
+    TiledCanvas canvas;
+    Blender blender;
+    DescriptorSet previousFeatures;
+    cv::Mat previousTransform;      // Previous frame into the mosaic, empty before the first frame
+    cv::Mat motion;                 // Previous frame onto the one before it, the prediction for the next step
+    int frames;
+    int keypointBudget;
+    DescriptorSet::Type descriptorType;
+    bool estimate(const DescriptorSet &current, const std::vector<Match> &matches, int &inliers, cv::Mat &H) const;
+    bool composite(const cv::Mat &frame, const cv::Mat &transform, const cv::Rect &footprint);
+public:
+    explicit StreamingStitcher(ThreadPool *pool = nullptr);
+    bool setBackingFile(const std::string &backingFile, size_t cacheTiles = TiledCanvas::DEFAULT_CACHE_TILES);
+    FrameResult addFrame(const cv::Mat &frame);
+    cv::Mat render() const;
+    bool write(const std::string &writeTo) const;
+    bool writeTiles(const std::string &directory) const;
+    void reset();
+    const TiledCanvas &getCanvas() const;
+    const cv::Mat &getTransform() const;
+    int getFrames() const;
+    const Blender &getBlender() const;
+    void setBlender(const Blender &blender);
+    int getKeypointBudget() const;
+    void setKeypointBudget(int keypointBudget);
+    DescriptorSet::Type getDescriptorType() const;
+    void setDescriptorType(DescriptorSet::Type descriptorType);
+};
\ No newline at end of file
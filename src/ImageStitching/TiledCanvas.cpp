@@ -0,0 +1,465 @@
+#include "TiledCanvas.h"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include "../Tools/Profiler.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param type Pixel type of the mosaic, CV_8UC3 for color frames
+ * @param backingFile File to keep tiles in, in memory if empty. It must not exist yet; if it cannot be created the
+ * canvas stays in memory, see isBacked().
+ * @param cacheTiles Tiles a backed canvas keeps mapped at once
+ */
+TiledCanvas::TiledCanvas(int type, const string &backingFile, size_t cacheTiles) {
+    this->type = type;
+    this->backing = -1;
+    this->cacheTiles = max(cacheTiles, (size_t) 1);
+    this->bounds = Rect();
+
+#ifndef _WIN32
+    if (!backingFile.empty()) {
+        this->backing = open(backingFile.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (this->backing >= 0) {
+            unlink(backingFile.c_str());
+        }
+    }
+#endif
+}
+
+/**
+ * Move constructor, the backing file moves with the tiles
+ *
+ * @param other Canvas to take over, left empty and in memory
+ */
+TiledCanvas::TiledCanvas(TiledCanvas &&other) : backing(-1) {
+    *this = std::move(other);
+}
+
+/**
+ * Move assignment, the backing file moves with the tiles
+ *
+ * @param other Canvas to take over, left empty and in memory
+ * @return TiledCanvas&
+ */
+TiledCanvas &TiledCanvas::operator=(TiledCanvas &&other) {
+    if (this != &other) {
+        release();
+        this->type = other.type;
+        this->tiles = std::move(other.tiles);
+        this->recent = std::move(other.recent);
+        this->slots = std::move(other.slots);
+        this->backing = other.backing;
+        this->cacheTiles = other.cacheTiles;
+        this->bounds = other.bounds;
+
+        other.tiles.clear();
+        other.recent.clear();
+        other.slots.clear();
+        other.backing = -1;
+        other.bounds = Rect();
+    }
+
+    return *this;
+}
+
+/**
+ * Destructor, unmaps every tile and closes the backing file
+ */
+TiledCanvas::~TiledCanvas() {
+    release();
+}
+
+/**
+ * Map key of a tile
+ *
+ * @param tileX Tile column, may be negative
+ * @param tileY Tile row, may be negative
+ * @return int64_t
+ */
+int64_t TiledCanvas::key(int tileX, int tileY) {
+    return (int64_t) (((uint64_t) (uint32_t) tileY << 32) | (uint32_t) tileX);
+}
+
+/**
+ * Tile holding a canvas coordinate, rounding towards negative infinity
+ *
+ * @param coordinate Canvas row or column
+ * @return int
+ */
+int TiledCanvas::tileIndex(int coordinate) {
+    return (coordinate >= 0) ? coordinate / TILE_SIZE : -((-coordinate + TILE_SIZE - 1) / TILE_SIZE);
+}
+
+/**
+ * Bytes of one tile in the backing file, pixels followed by mask. TILE_SIZE squared is a multiple of 64 KiB, so every
+ * slot starts on a page boundary and can be mapped on its own.
+ *
+ * @return size_t
+ */
+size_t TiledCanvas::slotBytes() const {
+    return (size_t) TILE_SIZE * TILE_SIZE * (CV_ELEM_SIZE(type) + 1);
+}
+
+/**
+ * Tile with a key, mapped from the backing file if it is not mapped yet
+ *
+ * @param tileKey Key of the tile
+ * @return const Tile* Null if nothing was written to the tile
+ */
+const TiledCanvas::Tile *TiledCanvas::findTile(int64_t tileKey) const {
+    unordered_map<int64_t, Tile>::iterator found = tiles.find(tileKey);
+
+    if (found != tiles.end()) {
+        if (backing >= 0) {
+            recent.splice(recent.begin(), recent, found->second.recent);
+        }
+        return &found->second;
+    }
+
+    unordered_map<int64_t, int64_t>::const_iterator slot = slots.find(tileKey);
+    return (slot != slots.end()) ? mapTile(tileKey, slot->second) : nullptr;
+}
+
+/**
+ * Tile with a key, mapped from the backing file if it is not mapped yet
+ *
+ * @param tileKey Key of the tile
+ * @return Tile* Null if nothing was written to the tile
+ */
+TiledCanvas::Tile *TiledCanvas::findTile(int64_t tileKey) {
+    return const_cast<Tile *>(static_cast<const TiledCanvas *>(this)->findTile(tileKey));
+}
+
+/**
+ * Add an empty tile. A backed canvas grows its file by one slot, which reads as zeros until written.
+ *
+ * @param tileKey Key of the tile
+ * @return Tile* Null if the backing file could not grow
+ */
+TiledCanvas::Tile *TiledCanvas::createTile(int64_t tileKey) {
+    if (backing < 0) {
+        Tile tile;
+        tile.pixels = Mat::zeros(TILE_SIZE, TILE_SIZE, type);
+        tile.mask = Mat::zeros(TILE_SIZE, TILE_SIZE, CV_8U);
+        return &tiles.insert(make_pair(tileKey, tile)).first->second;
+    }
+
+#ifndef _WIN32
+    int64_t slot = (int64_t) slots.size();
+    if (ftruncate(backing, (off_t) ((slot + 1) * (int64_t) slotBytes())) != 0) {
+        return nullptr;
+    }
+
+    Tile *tile = mapTile(tileKey, slot);
+    if (tile != nullptr) {
+        slots[tileKey] = slot;
+    }
+    return tile;
+#else
+    return nullptr;
+#endif
+}
+
+/**
+ * Map a slot of the backing file, unmapping the least recently used tiles first if the cache is full
+ *
+ * @param tileKey Key of the tile
+ * @param slot Slot of the tile in the backing file
+ * @return Tile* Null if the slot could not be mapped
+ */
+TiledCanvas::Tile *TiledCanvas::mapTile(int64_t tileKey, int64_t slot) const {
+#ifndef _WIN32
+    while (!recent.empty() && tiles.size() >= cacheTiles) {
+        evictTile();
+    }
+
+    size_t bytes = slotBytes();
+    size_t pixelBytes = (size_t) TILE_SIZE * TILE_SIZE * CV_ELEM_SIZE(type);
+    void *view = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, backing, (off_t) (slot * (int64_t) bytes));
+    if (view == MAP_FAILED) {
+        return nullptr;
+    }
+
+    Tile tile;
+    tile.pixels = Mat(TILE_SIZE, TILE_SIZE, type, view);
+    tile.mask = Mat(TILE_SIZE, TILE_SIZE, CV_8U, static_cast<uchar *>(view) + pixelBytes);
+    recent.push_front(tileKey);
+    tile.recent = recent.begin();
+    return &tiles.insert(make_pair(tileKey, tile)).first->second;
+#else
+    (void) tileKey;
+    (void) slot;
+    return nullptr;
+#endif
+}
+
+/**
+ * Unmap the least recently used tile. Its pages stay in the file and are read back by the next mapTile().
+ *
+ * @return void
+ */
+void TiledCanvas::evictTile() const {
+#ifndef _WIN32
+    unordered_map<int64_t, Tile>::iterator oldest = tiles.find(recent.back());
+    munmap(oldest->second.pixels.data, slotBytes());
+    tiles.erase(oldest);
+    recent.pop_back();
+#endif
+}
+
+/**
+ * Unmap every tile of a backed canvas, or drop every tile of one in memory
+ *
+ * @return void
+ */
+void TiledCanvas::unmapTiles() {
+#ifndef _WIN32
+    if (backing >= 0) {
+        for (const pair<const int64_t, Tile> &entry : tiles) {
+            munmap(entry.second.pixels.data, slotBytes());
+        }
+    }
+#endif
+    tiles.clear();
+    recent.clear();
+}
+
+/**
+ * Drop every tile and close the backing file
+ *
+ * @return void
+ */
+void TiledCanvas::release() {
+    unmapTiles();
+    slots.clear();
+
+#ifndef _WIN32
+    if (backing >= 0) {
+        close(backing);
+    }
+#endif
+    backing = -1;
+}
+
+/**
+ * Copy an area of the canvas into contiguous images. Parts no frame has reached read as zero with a zero mask.
+ *
+ * @param area Canvas area to read
+ * @param pixels Receives the area's pixels
+ * @param mask Receives the area's coverage, CV_8U
+ * @return void
+ */
+void TiledCanvas::read(const Rect &area, Mat &pixels, Mat &mask) const {
+    pixels = Mat::zeros(area.height, area.width, type);
+    mask = Mat::zeros(area.height, area.width, CV_8U);
+
+    if (area.width <= 0 || area.height <= 0) {
+        return;
+    }
+
+    for (int ty = tileIndex(area.y); ty <= tileIndex(area.y + area.height - 1); ty++) {
+        for (int tx = tileIndex(area.x); tx <= tileIndex(area.x + area.width - 1); tx++) {
+            const Tile *tile = findTile(key(tx, ty));
+            if (tile == nullptr) {
+                continue;
+            }
+
+            Rect tileArea = Rect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            Rect part = area & tileArea;
+            Rect inTile = part - tileArea.tl();
+            Rect inArea = part - area.tl();
+
+            tile->pixels(inTile).copyTo(pixels(inArea));
+            tile->mask(inTile).copyTo(mask(inArea));
+        }
+    }
+}
+
+/**
+ * Store an area of the canvas. Tiles are only created where the mask covers something, so writing a frame's whole
+ * bounding box does not allocate the empty corners around a rotated frame.
+ *
+ * @param area Canvas area to write
+ * @param pixels Area's pixels, of the canvas type
+ * @param mask Area's coverage, CV_8U
+ * @return bool False if the backing file could not grow, the tiles it could not hold are not written
+ */
+bool TiledCanvas::write(const Rect &area, const Mat &pixels, const Mat &mask) {
+    static Profiler::Peak &resident = Profiler::peak("canvas.resident_bytes");
+    bool complete = true;
+
+    if (area.width <= 0 || area.height <= 0) {
+        return complete;
+    }
+
+    for (int ty = tileIndex(area.y); ty <= tileIndex(area.y + area.height - 1); ty++) {
+        for (int tx = tileIndex(area.x); tx <= tileIndex(area.x + area.width - 1); tx++) {
+            Rect tileArea = Rect(tx * TILE_SIZE, ty * TILE_SIZE, TILE_SIZE, TILE_SIZE);
+            Rect part = area & tileArea;
+            Rect inTile = part - tileArea.tl();
+            Rect inArea = part - area.tl();
+            Tile *tile = findTile(key(tx, ty));
+
+            if (tile == nullptr) {
+                if (countNonZero(mask(inArea)) == 0) {
+                    continue;
+                }
+
+                tile = createTile(key(tx, ty));
+                if (tile == nullptr) {
+                    complete = false;
+                    continue;
+                }
+            }
+
+            pixels(inArea).copyTo(tile->pixels(inTile));
+            mask(inArea).copyTo(tile->mask(inTile));
+            bounds = (bounds.area() > 0) ? (bounds | part) : part;
+        }
+    }
+
+    resident.update((long long) getBytes());
+    return complete;
+}
+
+/**
+ * The whole mosaic as one image, positioned at getBounds(). This needs memory for the whole mosaic; use writeTiles()
+ * for mosaics that do not fit.
+ *
+ * @param mask Receives the coverage if not null
+ * @return Mat
+ */
+Mat TiledCanvas::render(Mat *mask) const {
+    Mat pixels, coverage;
+    read(bounds, pixels, coverage);
+
+    if (mask != nullptr) {
+        *mask = coverage;
+    }
+
+    return pixels;
+}
+
+/**
+ * Save the mosaic one tile at a time, so only one tile is held beyond the cache. Every tile is written as
+ * tile_<x>_<y>.png, with the coverage as alpha for color canvases, and listed in index.txt:
+ *
+ *     tile_size <pixels>
+ *     bounds <x> <y> <width> <height>
+ *     tile <x> <y> <file>          one line per tile, row by row; the tile covers x * tile_size, y * tile_size
+ *
+ * Tiles nothing was written to are left out and are transparent.
+ *
+ * @param directory Directory to write to, created if missing
+ * @return bool Whether every file was written
+ */
+bool TiledCanvas::writeTiles(const string &directory) const {
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+
+    vector<Point> positions;
+    if (backing >= 0) {
+        for (const pair<const int64_t, int64_t> &entry : slots) {
+            positions.push_back(Point((int32_t) (uint32_t) entry.first, (int32_t) (uint32_t) (entry.first >> 32)));
+        }
+    }
+    else {
+        for (const pair<const int64_t, Tile> &entry : tiles) {
+            positions.push_back(Point((int32_t) (uint32_t) entry.first, (int32_t) (uint32_t) (entry.first >> 32)));
+        }
+    }
+    sort(positions.begin(), positions.end(), [](const Point &a, const Point &b) {
+        return (a.y != b.y) ? a.y < b.y : a.x < b.x;
+    });
+
+    ofstream index((directory + "/index.txt").c_str());
+    index << "tile_size " << TILE_SIZE << "\n";
+    index << "bounds " << bounds.x << " " << bounds.y << " " << bounds.width << " " << bounds.height << "\n";
+
+    for (const Point &position : positions) {
+        const Tile *tile = findTile(key(position.x, position.y));
+        if (tile == nullptr) {
+            return false;
+        }
+
+        string name = "tile_" + to_string(position.x) + "_" + to_string(position.y) + ".png";
+        Mat output = tile->pixels;
+        if (output.channels() == 3) {
+            vector<Mat> channels;
+            split(tile->pixels, channels);
+            channels.push_back(tile->mask);
+            merge(channels, output);
+        }
+        if (!imwrite(directory + "/" + name, output)) {
+            return false;
+        }
+
+        index << "tile " << position.x << " " << position.y << " " << name << "\n";
+    }
+
+    return index.good();
+}
+
+/**
+ * Drop every tile. A backed canvas keeps its file and truncates it.
+ *
+ * @return void
+ */
+void TiledCanvas::clear() {
+    unmapTiles();
+    slots.clear();
+    bounds = Rect();
+
+#ifndef _WIN32
+    if (backing >= 0 && ftruncate(backing, 0) != 0) {
+        release();
+    }
+#endif
+}
+
+/**
+ * Whether tiles are kept in a backing file rather than in memory
+ *
+ * @return bool
+ */
+bool TiledCanvas::isBacked() const {
+    return backing >= 0;
+}
+
+/**
+ * Tiles written so far, mapped or not
+ *
+ * @return size_t
+ */
+size_t TiledCanvas::getTileCount() const {
+    return (backing >= 0) ? slots.size() : tiles.size();
+}
+
+/**
+ * Memory held by tile pixels and masks. For a backed canvas this is the mapped tiles only, the rest is on disk.
+ *
+ * @return size_t
+ */
+size_t TiledCanvas::getBytes() const {
+    return tiles.size() * slotBytes();
+}
+
+const Rect &TiledCanvas::getBounds() const { return bounds; }
+int TiledCanvas::getType() const { return type; }
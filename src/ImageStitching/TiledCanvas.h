@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <opencv2/opencv.hpp>
+
+/**
+ * Unbounded mosaic stored as fixed size square tiles, created the first time something is written to them. Positions
+ * may be negative, so a mosaic can grow in any direction without moving what is already there. Reading or writing an
+ * area only touches the tiles under it, so the cost of adding a frame depends on the frame's footprint and not on the
+ * size of the mosaic.
+ *
+ * A canvas given a backing file keeps its tiles in that file instead of in memory. Each tile is one slot of the file,
+ * memory mapped while it is in use; at most cacheTiles slots are mapped at once and the least recently used is
+ * unmapped to make room, leaving the page cache to write it back. The mosaic is then limited by disk rather than by
+ * memory. The backing file is scratch space: it is unlinked as soon as it is opened and disappears with the canvas.
+ * Backing files are not supported on Windows, where the canvas stays in memory.
+ */
+class TiledCanvas {
+public:
+    const static int TILE_SIZE = 256;                   // Pixels per tile side
+    const static size_t DEFAULT_CACHE_TILES = 256;      // Mapped tiles of a backed canvas, 64 MiB of CV_8UC3
+private:
+    /**
+     * Pixels and coverage of one tile
+     */
+    struct Tile {
+        cv::Mat pixels;
+        cv::Mat mask;                   // CV_8U, non zero where pixels hold image data
+        std::list<int64_t>::iterator recent;            // Position in the use order, backed canvases only
+    };
+    int type;
+    mutable std::unordered_map<int64_t, Tile> tiles;    // Every tile in memory, the mapped ones when backed
+    mutable std::list<int64_t> recent;                  // Keys of mapped tiles, most recently used first
+    std::unordered_map<int64_t, int64_t> slots;         // Slot of every tile in the backing file
+    int backing;                        // Descriptor of the backing file, -1 when held in memory
+    size_t cacheTiles;
+    cv::Rect bounds;                    // Bounding box of every area written with coverage
+    static int64_t key(int tileX, int tileY);
+    static int tileIndex(int coordinate);
+    size_t slotBytes() const;
+    const Tile *findTile(int64_t tileKey) const;
+    Tile *findTile(int64_t tileKey);
+    Tile *createTile(int64_t tileKey);
+    Tile *mapTile(int64_t tileKey, int64_t slot) const;
+    void evictTile() const;
+    void unmapTiles();
+    void release();
+public:
+    explicit TiledCanvas(int type = CV_8UC3, const std::string &backingFile = "",
+                         size_t cacheTiles = DEFAULT_CACHE_TILES);
+    TiledCanvas(TiledCanvas &&other);
+    TiledCanvas &operator=(TiledCanvas &&other);
+    TiledCanvas(const TiledCanvas &) = delete;
+    TiledCanvas &operator=(const TiledCanvas &) = delete;
+    ~TiledCanvas();
+    void read(const cv::Rect &area, cv::Mat &pixels, cv::Mat &mask) const;
+    bool write(const cv::Rect &area, const cv::Mat &pixels, const cv::Mat &mask);
+    cv::Mat render(cv::Mat *mask = nullptr) const;
+    bool writeTiles(const std::string &directory) const;
+    void clear();
+    bool isBacked() const;
+    const cv::Rect &getBounds() const;
+    size_t getTileCount() const;
+    size_t getBytes() const;
+    int getType() const;
+};
\ No newline at end of file
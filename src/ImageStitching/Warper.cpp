@@ -0,0 +1,253 @@
+#include "Warper.h"
+#include <climits>
+#include <cstring>
+#include "../Tools/Profiler.h"
+
+using namespace cv;
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param interpolation INTER_NEAREST, INTER_LINEAR or INTER_CUBIC
+ * @param pool Threads to build and sample tiles on, the shared pool if null
+ */
+Warper::Warper(int interpolation, ThreadPool *pool) {
+    this->interpolation = interpolation;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+}
+
+/**
+ * Compute the source coordinate of every output pixel. Each row starts from an exact product and then steps the
+ * homogeneous coordinate by the first column of H, so the per pixel cost is three additions and a division.
+ * Coordinates are stored in cv::remap's fixed point layout: integer part in map1 and the INTER_BITS fractional bits of
+ * x and y packed into map2. Sources too large for 16 bit coordinates get float coordinates in map1 and no map2. The
+ * mask only covers pixels whose whole interpolation kernel lies inside the source. A table built once per image can
+ * take its maps from a scratch arena instead of the heap; it is then valid only until the arena's open Scope closes.
+ *
+ * @param H Homography from output coordinates to source coordinates
+ * @param roi Output region, in the coordinates H maps from
+ * @param sourceSize Size of the image that will be sampled
+ * @param table Receives the maps and coverage mask
+ * @param arena Arena of the calling thread to carve the maps from, the heap if null
+ * @return void
+ */
+void Warper::buildTable(const Mat &H, Rect roi, Size sourceSize, RemapTable &table, ScratchArena *arena) const {
+    static Profiler::Timer &timer = Profiler::timer("warp.table");
+    static Profiler::Peak &tableBytes = Profiler::peak("warp.table_bytes");
+    Profiler::Scope scope(timer);
+
+    Mat h;
+    H.convertTo(h, CV_64F);
+
+    // Keep w positive for points in front of the camera so a single sign test rejects the rest
+    double m[9];
+    double sign = (h.at<double>(2, 2) < 0) ? -1.0 : 1.0;
+    for (int k = 0; k < 9; k++) {
+        m[k] = sign * h.at<double>(k / 3, k % 3);
+    }
+
+    memcpy(table.H, h.ptr<double>(0), 9 * sizeof(double));
+    table.roi = roi;
+    table.sourceSize = sourceSize;
+    table.interpolation = this->interpolation;
+
+    // Anything further out than the widest kernel only samples the border, so it is parked at one fixed point
+    const double MARGIN = 3.0;
+    const short OUTSIDE = -2 * (short) MARGIN;
+    const double maxX = sourceSize.width - 1, maxY = sourceSize.height - 1;
+    const bool fixedPoint = max(sourceSize.width, sourceSize.height) < SHRT_MAX - 2 * (int) MARGIN;
+    const bool nearest = this->interpolation == INTER_NEAREST;
+    const bool fractions = fixedPoint && !nearest;
+    const int mapType = fixedPoint ? CV_16SC2 : CV_32FC2;
+
+    // The cubic kernel reads one pixel before and two after the sample, the farthest with zero weight when the sample
+    // falls on a pixel, so its coverage stops one pixel in from every edge instead of ringing against the border
+    const double radius = (this->interpolation == INTER_CUBIC) ? 1.0 : 0.0;
+
+    if (arena != nullptr) {
+        table.map1 = arena->mat(roi.height, roi.width, mapType);
+        table.mask = arena->mat(roi.height, roi.width, CV_8U);
+        table.map2 = fractions ? arena->mat(roi.height, roi.width, CV_16UC1) : Mat();
+    }
+    else {
+        table.map1.create(roi.height, roi.width, mapType);
+        table.mask.create(roi.height, roi.width, CV_8U);
+        if (fractions) {
+            table.map2.create(roi.height, roi.width, CV_16UC1);
+        }
+        else {
+            table.map2.release();
+        }
+    }
+    tableBytes.update((long long) (table.map1.total() * table.map1.elemSize() + table.map2.total() *
+                                   table.map2.elemSize() + table.mask.total()));
+
+    pool->parallelFor(0, (size_t) roi.height, TILE_ROWS, [&](size_t begin, size_t end) {
+        for (size_t r = begin; r < end; r++) {
+            double y = roi.y + (double) r;
+            double X = m[0] * roi.x + m[1] * y + m[2];
+            double Y = m[3] * roi.x + m[4] * y + m[5];
+            double W = m[6] * roi.x + m[7] * y + m[8];
+            short *xy = fixedPoint ? table.map1.ptr<short>((int) r) : nullptr;
+            float *xyFloat = fixedPoint ? nullptr : table.map1.ptr<float>((int) r);
+            ushort *fraction = fractions ? table.map2.ptr<ushort>((int) r) : nullptr;
+            uchar *covered = table.mask.ptr<uchar>((int) r);
+
+            for (int c = 0; c < roi.width; c++, X += m[0], Y += m[3], W += m[6]) {
+                double sx = -MARGIN * 2, sy = -MARGIN * 2;
+                if (W > 0) {
+                    double inverse = 1.0 / W;
+                    sx = X * inverse;
+                    sy = Y * inverse;
+                }
+
+                covered[c] = (sx >= radius && sy >= radius && sx <= maxX - radius && sy <= maxY - radius) ? 255 : 0;
+
+                bool outside = sx < -MARGIN || sy < -MARGIN || sx > maxX + MARGIN || sy > maxY + MARGIN;
+                if (!fixedPoint) {
+                    xyFloat[2 * c] = outside ? (float) OUTSIDE : (float) sx;
+                    xyFloat[2 * c + 1] = outside ? (float) OUTSIDE : (float) sy;
+                }
+                else if (outside) {
+                    xy[2 * c] = OUTSIDE;
+                    xy[2 * c + 1] = OUTSIDE;
+                    if (fraction != nullptr) {
+                        fraction[c] = 0;
+                    }
+                }
+                else if (nearest) {
+                    xy[2 * c] = (short) cvRound(sx);
+                    xy[2 * c + 1] = (short) cvRound(sy);
+                }
+                else {
+                    int ix = cvRound(sx * INTER_TAB_SIZE);
+                    int iy = cvRound(sy * INTER_TAB_SIZE);
+                    xy[2 * c] = (short) (ix >> INTER_BITS);
+                    xy[2 * c + 1] = (short) (iy >> INTER_BITS);
+                    fraction[c] = (ushort) ((iy & (INTER_TAB_SIZE - 1)) * INTER_TAB_SIZE + (ix & (INTER_TAB_SIZE - 1)));
+                }
+            }
+        }
+    });
+}
+
+/**
+ * Sample a source image through a prebuilt table, one row tile per task. Works for any channel count at 8 bit and
+ * float depth. The gain scales each tile while it is still in cache, saturating at 8 bit, so exposure compensation
+ * costs no extra pass over the output. An output already of the right size and type, e.g. carved from an arena, is
+ * written in place.
+ *
+ * @param source Image to sample, of the size the table was built for
+ * @param table Coordinate maps from buildTable()
+ * @param output Receives the warped image, roi sized
+ * @param borderMode How pixels outside the source are filled
+ * @param gain Factor applied to every sampled value
+ * @return void
+ */
+void Warper::warp(const Mat &source, const RemapTable &table, Mat &output, int borderMode, double gain) const {
+    static Profiler::Timer &timer = Profiler::timer("warp");
+    static Profiler::Counter &pixels = Profiler::counter("warp.pixels");
+    Profiler::Scope scope(timer);
+
+    CV_Assert(source.size() == table.sourceSize);
+    pixels.add((long long) table.roi.area());
+
+    output.create(table.roi.height, table.roi.width, source.type());
+
+    pool->parallelFor(0, (size_t) table.roi.height, TILE_ROWS, [&](size_t begin, size_t end) {
+        Mat tile = output.rowRange((int) begin, (int) end);
+        Mat map2 = table.map2.empty() ? Mat() : table.map2.rowRange((int) begin, (int) end);
+
+        remap(source, tile, table.map1.rowRange((int) begin, (int) end), map2, table.interpolation, borderMode);
+        if (gain != 1.0) {
+            tile.convertTo(tile, -1, gain);
+        }
+    });
+}
+
+/**
+ * Warp a source image, rebuilding the cached table only when the homography, region or source size changed
+ *
+ * @param source Image to sample
+ * @param H Homography from output coordinates to source coordinates
+ * @param roi Output region, in the coordinates H maps from
+ * @param output Receives the warped image
+ * @param gain Factor applied to every sampled value
+ * @return RemapTable The table used, valid until the next call
+ */
+const Warper::RemapTable &Warper::warp(const Mat &source, const Mat &H, Rect roi, Mat &output, double gain) {
+    Mat h;
+    H.convertTo(h, CV_64F);
+
+    if (!matches(this->cached, h.ptr<double>(0), roi, source.size())) {
+        buildTable(h, roi, source.size(), this->cached);
+    }
+
+    warp(source, this->cached, output, BORDER_CONSTANT, gain);
+    return this->cached;
+}
+
+/**
+ * Whether a table was built from exactly these inputs with the current interpolation
+ *
+ * @param table Table to check
+ * @param H Row major homography
+ * @param roi Output region
+ * @param sourceSize Source image size
+ * @return bool
+ */
+bool Warper::matches(const RemapTable &table, const double H[9], Rect roi, Size sourceSize) const {
+    return !table.empty() && table.interpolation == this->interpolation && table.sourceSize == sourceSize &&
+           table.roi.x == roi.x && table.roi.y == roi.y && table.roi.width == roi.width &&
+           table.roi.height == roi.height && memcmp(table.H, H, 9 * sizeof(double)) == 0;
+}
+
+/**
+ * Bounding box of an image's corners projected through a homography. Corners that land behind the camera are skipped,
+ * and corners sent towards infinity by a nearly degenerate homography are clamped so the box stays representable.
+ *
+ * @param H Homography to project with
+ * @param size Size of the image being projected
+ * @return Rect
+ */
+Rect Warper::bounds(const Mat &H, Size size) {
+    Mat h;
+    H.convertTo(h, CV_64F);
+    const double *m = h.ptr<double>(0);
+    const double corners[4][2] = {{0, 0}, {(double) size.width, 0}, {0, (double) size.height},
+                                  {(double) size.width, (double) size.height}};
+    double minX = DBL_MAX, minY = DBL_MAX, maxX = -DBL_MAX, maxY = -DBL_MAX;
+
+    for (int k = 0; k < 4; k++) {
+        double x = corners[k][0], y = corners[k][1];
+        double w = m[6] * x + m[7] * y + m[8];
+        if (w <= 0) {
+            continue;
+        }
+
+        double px = (m[0] * x + m[1] * y + m[2]) / w;
+        double py = (m[3] * x + m[4] * y + m[5]) / w;
+        minX = min(minX, px);
+        minY = min(minY, py);
+        maxX = max(maxX, px);
+        maxY = max(maxY, py);
+    }
+
+    if (minX > maxX) {
+        return Rect();
+    }
+
+    const double LIMIT = 1 << 29;
+    minX = min(max(minX, -LIMIT), LIMIT);
+    minY = min(max(minY, -LIMIT), LIMIT);
+    maxX = min(max(maxX, -LIMIT), LIMIT);
+    maxY = min(max(maxY, -LIMIT), LIMIT);
+
+    int x0 = (int) floor(minX), y0 = (int) floor(minY);
+    return Rect(x0, y0, (int) ceil(maxX) - x0, (int) ceil(maxY) - y0);
+}
+
+bool Warper::RemapTable::empty() const { return map1.empty(); }
+int Warper::getInterpolation() const { return interpolation; }
+void Warper::setInterpolation(int interpolation) { Warper::interpolation = interpolation; }
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include "../Tools/ScratchArena.h"
+#include "../Tools/ThreadPool.h"
+
+/**
+ * Inverse warp through a homography. The homography maps output pixels to source pixels; it is evaluated
+ * incrementally along each scanline, so a pixel costs three additions and one division. The resulting coordinate maps
+ * are built in parallel row tiles and stored in a RemapTable that can be reused for every frame warped with the same
+ * homography. A gain, e.g. from GainCompensator, is applied to each tile as it is sampled.
+ */
+class Warper {
+public:
+    /**
+     * Source coordinates of every output pixel, in the fixed point layout cv::remap samples fastest
+     */
+    struct RemapTable {
+        cv::Mat map1;           // CV_16SC2 integer coordinates, CV_32FC2 for sources too large for short
+        cv::Mat map2;           // CV_16UC1 interpolation weights index, empty for nearest or float sampling
+        cv::Mat mask;           // CV_8U, 255 where the output pixel's kernel lies inside the source image
+        cv::Rect roi;           // Output region, in the coordinates the homography maps from
+        cv::Size sourceSize;    // Source image the table was built for
+        double H[9];            // Homography the table was built for
+        int interpolation;      // INTER_NEAREST, INTER_LINEAR or INTER_CUBIC
+        bool empty() const;
+    };
+private:
+    const static int TILE_ROWS = 64;    // Output rows built or sampled per task
+    ThreadPool *pool;
+    int interpolation;
+    RemapTable cached;                  // Table of the last warp(), reused while its inputs do not change
+    bool matches(const RemapTable &table, const double H[9], cv::Rect roi, cv::Size sourceSize) const;
+public:
+    explicit Warper(int interpolation = cv::INTER_LINEAR, ThreadPool *pool = nullptr);
+    void buildTable(const cv::Mat &H, cv::Rect roi, cv::Size sourceSize, RemapTable &table,
+                    ScratchArena *arena = nullptr) const;
+    void warp(const cv::Mat &source, const RemapTable &table, cv::Mat &output, int borderMode = cv::BORDER_CONSTANT,
+              double gain = 1.0) const;
+    const RemapTable &warp(const cv::Mat &source, const cv::Mat &H, cv::Rect roi, cv::Mat &output,
+                           double gain = 1.0);
+    static cv::Rect bounds(const cv::Mat &H, cv::Size size);
+    int getInterpolation() const;
+    void setInterpolation(int interpolation);
+};
\ No newline at end of file
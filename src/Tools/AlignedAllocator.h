@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+/**
+ * Minimal std::allocator replacement returning memory aligned to ALIGNMENT bytes so SIMD kernels can use aligned
+ * loads on contiguous descriptor rows.
+ */
+template <typename T, size_t ALIGNMENT = 32>
+class AlignedAllocator {
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef AlignedAllocator<U, ALIGNMENT> other;
+    };
+
+    AlignedAllocator() {}
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, ALIGNMENT> &) {}
+
+    T *allocate(size_t n) {
+        if (n == 0) {
+            return nullptr;
+        }
+
+        void *p = nullptr;
+#ifdef _WIN32
+        p = _aligned_malloc(n * sizeof(T), ALIGNMENT);
+#else
+        if (posix_memalign(&p, ALIGNMENT, n * sizeof(T)) != 0) {
+            p = nullptr;
+        }
+#endif
+        if (p == nullptr) {
+            throw std::bad_alloc();
+        }
+
+        return static_cast<T *>(p);
+    }
+
+    void deallocate(T *p, size_t) {
+#ifdef _WIN32
+        _aligned_free(p);
+#else
+        free(p);
+#endif
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, ALIGNMENT> &) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U, ALIGNMENT> &) const { return false; }
+};
\ No newline at end of file
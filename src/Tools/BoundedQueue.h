@@ -0,0 +1,87 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/**
+ * Blocking first-in first-out queue with a fixed capacity, linking the stages of a pipeline. A producer that gets
+ * ahead blocks in push() until the consumer catches up, which bounds the items in flight between two stages. Closing
+ * the queue lets the consumer drain what is left and then see the end of the stream.
+ */
+template <typename T>
+class BoundedQueue {
+private:
+    std::deque<T> items;
+    size_t capacity;
+    bool closed;
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+public:
+    explicit BoundedQueue(size_t capacity) : capacity((capacity > 0) ? capacity : 1), closed(false) {}
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    /**
+     * Append an item, waiting while the queue is full
+     *
+     * @param item Item to append
+     * @return bool False if the queue was closed, the item is dropped
+     */
+    bool push(const T &item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notFull.wait(guard, [this] { return closed || items.size() < capacity; });
+
+        if (closed) {
+            return false;
+        }
+
+        items.push_back(item);
+        notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * Take the oldest item, waiting while the queue is empty and open
+     *
+     * @param item Receives the item
+     * @return bool False once the queue is closed and drained
+     */
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> guard(lock);
+        notEmpty.wait(guard, [this] { return closed || !items.empty(); });
+
+        if (items.empty()) {
+            return false;
+        }
+
+        item = items.front();
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * End the stream. Waiting producers give up; consumers still get the items already queued.
+     *
+     * @return void
+     */
+    void close() {
+        std::lock_guard<std::mutex> guard(lock);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    /**
+     * Items waiting in the queue
+     *
+     * @return size_t
+     */
+    size_t size() {
+        std::lock_guard<std::mutex> guard(lock);
+        return items.size();
+    }
+};
\ No newline at end of file
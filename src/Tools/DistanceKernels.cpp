@@ -0,0 +1,557 @@
+#include "DistanceKernels.h"
+#include <atomic>
+#include <cfloat>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DISTANCE_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef void (*FloatTile)(const float *const *queries, int queryCount, const float *train, size_t begin, size_t end,
+                          TopTwoMatch *results);
+typedef void (*ByteTile)(const uint8_t *const *queries, int queryCount, const uint8_t *train, size_t begin, size_t end,
+                         TopTwoMatch *results);
+typedef void (*BinaryTile)(const uint64_t *const *queries, int queryCount, const uint64_t *train, size_t begin,
+                           size_t end, TopTwoMatch *results);
+typedef int (*BinaryDistance)(const uint64_t *a, const uint64_t *b);
+
+static const int DIMENSIONS = DistanceKernels::DIMENSIONS;
+static const int BINARY_WORDS = DistanceKernels::BINARY_WORDS;
+static atomic<int> selectedInstructionSet(-1);     // Set on first use, read by every matching thread
+
+static void floatTileScalar(const float *const *queries, int queryCount, const float *train, size_t begin, size_t end,
+                            TopTwoMatch *results) {
+    for (size_t t = begin; t < end; t++) {
+        const float *row = train + t * DIMENSIONS;
+
+        for (int q = 0; q < queryCount; q++) {
+            const float *query = queries[q];
+            float score = 0;
+
+            for (int k = 0; k < DIMENSIONS; k++) {
+                float d = query[k] - row[k];
+                score += d * d;
+            }
+
+            updateTopTwo(results[q], score, (int) t);
+        }
+    }
+}
+
+static void byteTileScalar(const uint8_t *const *queries, int queryCount, const uint8_t *train, size_t begin,
+                           size_t end, TopTwoMatch *results) {
+    for (size_t t = begin; t < end; t++) {
+        const uint8_t *row = train + t * DIMENSIONS;
+
+        for (int q = 0; q < queryCount; q++) {
+            const uint8_t *query = queries[q];
+            int score = 0;
+
+            for (int k = 0; k < DIMENSIONS; k++) {
+                int d = (int) query[k] - (int) row[k];
+                score += d * d;
+            }
+
+            updateTopTwo(results[q], (float) score, (int) t);
+        }
+    }
+}
+
+/**
+ * Set bits of a word without a popcount instruction, by summing bit counts in ever wider fields
+ *
+ * @param v Word
+ * @return int
+ */
+static inline int popcountPortable(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int) ((v * 0x0101010101010101ULL) >> 56);
+}
+
+static int hammingScalar(const uint64_t *a, const uint64_t *b) {
+    int score = 0;
+
+    for (int k = 0; k < BINARY_WORDS; k++) {
+        score += popcountPortable(a[k] ^ b[k]);
+    }
+
+    return score;
+}
+
+static void binaryTileScalar(const uint64_t *const *queries, int queryCount, const uint64_t *train, size_t begin,
+                             size_t end, TopTwoMatch *results) {
+    for (size_t t = begin; t < end; t++) {
+        const uint64_t *row = train + t * BINARY_WORDS;
+
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], (float) hammingScalar(queries[q], row), (int) t);
+        }
+    }
+}
+
+#ifdef DISTANCE_KERNELS_X86
+
+__attribute__((target("sse2")))
+static inline float horizontalSum(__m128 v) {
+    __m128 shuffled = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+__attribute__((target("sse2")))
+static inline int horizontalSum(__m128i v) {
+    __m128i hi = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    __m128i sums = _mm_add_epi32(v, hi);
+    hi = _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_cvtsi128_si32(_mm_add_epi32(sums, hi));
+}
+
+__attribute__((target("sse2")))
+static void floatTileSSE2(const float *const *queries, int queryCount, const float *train, size_t begin, size_t end,
+                          TopTwoMatch *results) {
+    const float *q0 = queries[0];
+    const float *q1 = queries[1];
+    const float *q2 = queries[2];
+    const float *q3 = queries[3];
+
+    for (size_t t = begin; t < end; t++) {
+        const float *row = train + t * DIMENSIONS;
+        __m128 a0 = _mm_setzero_ps();
+        __m128 a1 = _mm_setzero_ps();
+        __m128 a2 = _mm_setzero_ps();
+        __m128 a3 = _mm_setzero_ps();
+
+        for (int k = 0; k < DIMENSIONS; k += 4) {
+            __m128 v = _mm_loadu_ps(row + k);
+            __m128 d0 = _mm_sub_ps(_mm_loadu_ps(q0 + k), v);
+            __m128 d1 = _mm_sub_ps(_mm_loadu_ps(q1 + k), v);
+            __m128 d2 = _mm_sub_ps(_mm_loadu_ps(q2 + k), v);
+            __m128 d3 = _mm_sub_ps(_mm_loadu_ps(q3 + k), v);
+            a0 = _mm_add_ps(a0, _mm_mul_ps(d0, d0));
+            a1 = _mm_add_ps(a1, _mm_mul_ps(d1, d1));
+            a2 = _mm_add_ps(a2, _mm_mul_ps(d2, d2));
+            a3 = _mm_add_ps(a3, _mm_mul_ps(d3, d3));
+        }
+
+        float scores[4] = {horizontalSum(a0), horizontalSum(a1), horizontalSum(a2), horizontalSum(a3)};
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], scores[q], (int) t);
+        }
+    }
+}
+
+__attribute__((target("sse2")))
+static void byteTileSSE2(const uint8_t *const *queries, int queryCount, const uint8_t *train, size_t begin,
+                         size_t end, TopTwoMatch *results) {
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t t = begin; t < end; t++) {
+        const uint8_t *row = train + t * DIMENSIONS;
+        int scores[4] = {0, 0, 0, 0};
+
+        for (int q = 0; q < 4; q++) {
+            const uint8_t *query = queries[q];
+            __m128i acc = _mm_setzero_si128();
+
+            for (int k = 0; k < DIMENSIONS; k += 16) {
+                __m128i a = _mm_loadu_si128((const __m128i *) (query + k));
+                __m128i b = _mm_loadu_si128((const __m128i *) (row + k));
+                __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(lo, lo));
+                acc = _mm_add_epi32(acc, _mm_madd_epi16(hi, hi));
+            }
+
+            scores[q] = horizontalSum(acc);
+        }
+
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], (float) scores[q], (int) t);
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static inline float horizontalSum256(__m256 v) {
+    __m128 sums = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    __m128 shuffled = _mm_movehdup_ps(sums);
+    sums = _mm_add_ps(sums, shuffled);
+    shuffled = _mm_movehl_ps(shuffled, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuffled));
+}
+
+__attribute__((target("avx2,fma")))
+static inline int horizontalSum256(__m256i v) {
+    __m128i sums = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+    sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sums);
+}
+
+__attribute__((target("avx2,fma")))
+static void floatTileAVX2(const float *const *queries, int queryCount, const float *train, size_t begin, size_t end,
+                          TopTwoMatch *results) {
+    const float *q0 = queries[0];
+    const float *q1 = queries[1];
+    const float *q2 = queries[2];
+    const float *q3 = queries[3];
+
+    for (size_t t = begin; t < end; t++) {
+        const float *row = train + t * DIMENSIONS;
+        __m256 a0 = _mm256_setzero_ps();
+        __m256 a1 = _mm256_setzero_ps();
+        __m256 a2 = _mm256_setzero_ps();
+        __m256 a3 = _mm256_setzero_ps();
+
+        for (int k = 0; k < DIMENSIONS; k += 8) {
+            __m256 v = _mm256_loadu_ps(row + k);
+            __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(q0 + k), v);
+            __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(q1 + k), v);
+            __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(q2 + k), v);
+            __m256 d3 = _mm256_sub_ps(_mm256_loadu_ps(q3 + k), v);
+            a0 = _mm256_fmadd_ps(d0, d0, a0);
+            a1 = _mm256_fmadd_ps(d1, d1, a1);
+            a2 = _mm256_fmadd_ps(d2, d2, a2);
+            a3 = _mm256_fmadd_ps(d3, d3, a3);
+        }
+
+        float scores[4] = {horizontalSum256(a0), horizontalSum256(a1), horizontalSum256(a2), horizontalSum256(a3)};
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], scores[q], (int) t);
+        }
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void byteTileAVX2(const uint8_t *const *queries, int queryCount, const uint8_t *train, size_t begin,
+                         size_t end, TopTwoMatch *results) {
+    for (size_t t = begin; t < end; t++) {
+        const uint8_t *row = train + t * DIMENSIONS;
+        int scores[4] = {0, 0, 0, 0};
+
+        for (int q = 0; q < 4; q++) {
+            const uint8_t *query = queries[q];
+            __m256i acc = _mm256_setzero_si256();
+
+            for (int k = 0; k < DIMENSIONS; k += 16) {
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (query + k)));
+                __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (row + k)));
+                __m256i d = _mm256_sub_epi16(a, b);
+                acc = _mm256_add_epi32(acc, _mm256_madd_epi16(d, d));
+            }
+
+            scores[q] = horizontalSum256(acc);
+        }
+
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], (float) scores[q], (int) t);
+        }
+    }
+}
+
+__attribute__((target("popcnt")))
+static int hammingPopcount(const uint64_t *a, const uint64_t *b) {
+    int score = 0;
+
+    for (int k = 0; k < BINARY_WORDS; k++) {
+        score += __builtin_popcountll(a[k] ^ b[k]);
+    }
+
+    return score;
+}
+
+__attribute__((target("popcnt")))
+static void binaryTilePopcount(const uint64_t *const *queries, int queryCount, const uint64_t *train, size_t begin,
+                               size_t end, TopTwoMatch *results) {
+    const uint64_t *q0 = queries[0];
+    const uint64_t *q1 = queries[1];
+    const uint64_t *q2 = queries[2];
+    const uint64_t *q3 = queries[3];
+
+    for (size_t t = begin; t < end; t++) {
+        const uint64_t *row = train + t * BINARY_WORDS;
+        int scores[4] = {0, 0, 0, 0};
+
+        for (int k = 0; k < BINARY_WORDS; k++) {
+            uint64_t v = row[k];
+            scores[0] += __builtin_popcountll(q0[k] ^ v);
+            scores[1] += __builtin_popcountll(q1[k] ^ v);
+            scores[2] += __builtin_popcountll(q2[k] ^ v);
+            scores[3] += __builtin_popcountll(q3[k] ^ v);
+        }
+
+        for (int q = 0; q < queryCount; q++) {
+            updateTopTwo(results[q], (float) scores[q], (int) t);
+        }
+    }
+}
+
+#endif
+
+/**
+ * What the running CPU supports, probed once
+ */
+struct CpuFeatures {
+    DistanceKernels::InstructionSet best;
+    bool popcount;
+};
+
+/**
+ * Features of the running CPU. The probe runs once, under the thread safe initialisation of a local static, however
+ * many threads ask first.
+ *
+ * @return CpuFeatures
+ */
+static const CpuFeatures &cpuFeatures() {
+    static const CpuFeatures features = [] {
+        CpuFeatures probed = {DistanceKernels::SCALAR, false};
+#ifdef DISTANCE_KERNELS_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            probed.best = DistanceKernels::AVX2;
+        }
+        else if (__builtin_cpu_supports("sse2")) {
+            probed.best = DistanceKernels::SSE2;
+        }
+        probed.popcount = __builtin_cpu_supports("popcnt") != 0;
+#endif
+        return probed;
+    }();
+
+    return features;
+}
+
+/**
+ * Widest instruction set the running CPU supports
+ *
+ * @return InstructionSet
+ */
+DistanceKernels::InstructionSet DistanceKernels::getBestSupported() {
+    return cpuFeatures().best;
+}
+
+/**
+ * Whether the running CPU has a popcount instruction. Binary matching uses it unless the SCALAR set is forced.
+ *
+ * @return bool
+ */
+bool DistanceKernels::hasPopcount() {
+    return cpuFeatures().popcount;
+}
+
+/**
+ * Hamming distance function for the selected instruction set
+ *
+ * @return BinaryDistance
+ */
+static BinaryDistance selectedHamming() {
+#ifdef DISTANCE_KERNELS_X86
+    if (DistanceKernels::getInstructionSet() != DistanceKernels::SCALAR && DistanceKernels::hasPopcount()) {
+        return hammingPopcount;
+    }
+#endif
+    return hammingScalar;
+}
+
+/**
+ * Instruction set used by matchTopTwo, chosen on first use
+ *
+ * @return InstructionSet
+ */
+DistanceKernels::InstructionSet DistanceKernels::getInstructionSet() {
+    int set = selectedInstructionSet.load(memory_order_relaxed);
+
+    if (set < 0) {
+        int unset = -1;
+        selectedInstructionSet.compare_exchange_strong(unset, getBestSupported(), memory_order_relaxed);
+        set = selectedInstructionSet.load(memory_order_relaxed);
+    }
+
+    return (InstructionSet) set;
+}
+
+/**
+ * Force a narrower instruction set, mainly for benchmarking. Requests above what the CPU supports are refused. A match
+ * already running keeps the set it started with.
+ *
+ * @param set Instruction set to use
+ * @return bool
+ */
+bool DistanceKernels::setInstructionSet(InstructionSet set) {
+    if (set > getBestSupported()) {
+        return false;
+    }
+
+    selectedInstructionSet.store(set, memory_order_relaxed);
+    return true;
+}
+
+const char *DistanceKernels::getInstructionSetName(InstructionSet set) {
+    switch (set) {
+        case AVX2:
+            return "avx2";
+        case SSE2:
+            return "sse2";
+        default:
+            return "scalar";
+    }
+}
+
+/**
+ * Blocked driver shared by all element types, stride is the length of a descriptor row in elements. Train rows are
+ * visited in TRAIN_BLOCK tiles so a tile stays in cache while every query block is scored against it. Tiles are visited
+ * in train order, so ties resolve to the lowest index.
+ */
+template <typename T, typename Tile>
+static void matchBlocked(Tile tile, const T *query, size_t queryCount, const T *train, size_t trainCount,
+                         TopTwoMatch *results, size_t stride = DistanceKernels::DIMENSIONS) {
+    const int QUERY_BLOCK = DistanceKernels::QUERY_BLOCK;
+    const size_t TRAIN_BLOCK = DistanceKernels::TRAIN_BLOCK;
+
+    for (size_t q = 0; q < queryCount; q++) {
+        results[q].bestIndex = -1;
+        results[q].secondIndex = -1;
+        results[q].bestDistance = FLT_MAX;
+        results[q].secondDistance = FLT_MAX;
+    }
+
+    for (size_t t = 0; t < trainCount; t += TRAIN_BLOCK) {
+        size_t tEnd = (t + TRAIN_BLOCK < trainCount) ? t + TRAIN_BLOCK : trainCount;
+
+        for (size_t q = 0; q < queryCount; q += QUERY_BLOCK) {
+            int count = (q + QUERY_BLOCK <= queryCount) ? QUERY_BLOCK : (int) (queryCount - q);
+            const T *rows[4];
+
+            // Pad a partial block by repeating its last query; the padded scores are discarded
+            for (int i = 0; i < QUERY_BLOCK; i++) {
+                rows[i] = query + (q + (i < count ? i : count - 1)) * stride;
+            }
+
+            tile(rows, count, train, t, tEnd, results + q);
+        }
+    }
+}
+
+/**
+ * Find the two nearest train descriptors of every query descriptor
+ *
+ * @param query queryCount x DIMENSIONS descriptors
+ * @param queryCount Number of query descriptors
+ * @param train trainCount x DIMENSIONS descriptors
+ * @param trainCount Number of train descriptors
+ * @param results queryCount entries, filled in query order
+ * @return void
+ */
+void DistanceKernels::matchTopTwo(const float *query, size_t queryCount, const float *train, size_t trainCount,
+                                  TopTwoMatch *results) {
+    FloatTile tile = floatTileScalar;
+#ifdef DISTANCE_KERNELS_X86
+    InstructionSet set = getInstructionSet();
+    if (set == AVX2) {
+        tile = floatTileAVX2;
+    }
+    else if (set == SSE2) {
+        tile = floatTileSSE2;
+    }
+#endif
+    matchBlocked(tile, query, queryCount, train, trainCount, results);
+}
+
+/**
+ * Find the two nearest train descriptors of every query descriptor, using quantized descriptors
+ *
+ * @param query queryCount x DIMENSIONS descriptors
+ * @param queryCount Number of query descriptors
+ * @param train trainCount x DIMENSIONS descriptors
+ * @param trainCount Number of train descriptors
+ * @param results queryCount entries, filled in query order
+ * @return void
+ */
+void DistanceKernels::matchTopTwo(const uint8_t *query, size_t queryCount, const uint8_t *train, size_t trainCount,
+                                  TopTwoMatch *results) {
+    ByteTile tile = byteTileScalar;
+#ifdef DISTANCE_KERNELS_X86
+    InstructionSet set = getInstructionSet();
+    if (set == AVX2) {
+        tile = byteTileAVX2;
+    }
+    else if (set == SSE2) {
+        tile = byteTileSSE2;
+    }
+#endif
+    matchBlocked(tile, query, queryCount, train, trainCount, results);
+}
+
+/**
+ * Find the two nearest train descriptors of every query descriptor by Hamming distance, using the popcount
+ * instruction when the CPU has one. Distances are returned in bits.
+ *
+ * @param query queryCount x BINARY_WORDS packed descriptors
+ * @param queryCount Number of query descriptors
+ * @param train trainCount x BINARY_WORDS packed descriptors
+ * @param trainCount Number of train descriptors
+ * @param results queryCount entries, filled in query order
+ * @return void
+ */
+void DistanceKernels::matchTopTwo(const uint64_t *query, size_t queryCount, const uint64_t *train, size_t trainCount,
+                                  TopTwoMatch *results) {
+    BinaryTile tile = binaryTileScalar;
+#ifdef DISTANCE_KERNELS_X86
+    if (selectedHamming() == hammingPopcount) {
+        tile = binaryTilePopcount;
+    }
+#endif
+    matchBlocked(tile, query, queryCount, train, trainCount, results, BINARY_WORDS);
+}
+
+/**
+ * SSD between a single pair of descriptors
+ *
+ * @param a Descriptor of DIMENSIONS components
+ * @param b Descriptor of DIMENSIONS components
+ * @return float
+ */
+float DistanceKernels::squaredDistance(const float *a, const float *b) {
+    float score = 0;
+
+    for (int k = 0; k < DIMENSIONS; k++) {
+        float d = a[k] - b[k];
+        score += d * d;
+    }
+
+    return score;
+}
+
+/**
+ * SSD between a single pair of quantized descriptors
+ *
+ * @param a Descriptor of DIMENSIONS components
+ * @param b Descriptor of DIMENSIONS components
+ * @return float
+ */
+float DistanceKernels::squaredDistance(const uint8_t *a, const uint8_t *b) {
+    int score = 0;
+
+    for (int k = 0; k < DIMENSIONS; k++) {
+        int d = (int) a[k] - (int) b[k];
+        score += d * d;
+    }
+
+    return (float) score;
+}
+
+/**
+ * Hamming distance between a single pair of binary descriptors
+ *
+ * @param a Descriptor of BINARY_WORDS words
+ * @param b Descriptor of BINARY_WORDS words
+ * @return float Differing bits
+ */
+float DistanceKernels::hammingDistance(const uint64_t *a, const uint64_t *b) {
+    return (float) selectedHamming()(a, b);
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Two nearest neighbours of one query descriptor. Index -1 means no candidate was seen.
+ */
+struct TopTwoMatch {
+    int bestIndex;
+    int secondIndex;
+    float bestDistance;
+    float secondDistance;
+};
+
+/**
+ * Insert a candidate into a top-2 list. Strict comparisons keep the first candidate seen on ties.
+ *
+ * @param r Top-2 list of a query
+ * @param distance Candidate distance
+ * @param index Candidate train index
+ * @return void
+ */
+inline void updateTopTwo(TopTwoMatch &r, float distance, int index) {
+    if (distance < r.bestDistance) {
+        r.secondDistance = r.bestDistance;
+        r.secondIndex = r.bestIndex;
+        r.bestDistance = distance;
+        r.bestIndex = index;
+    }
+    else if (distance < r.secondDistance) {
+        r.secondDistance = distance;
+        r.secondIndex = index;
+    }
+}
+
+/**
+ * Brute-force SSD kernels between two row-major descriptor arrays of DIMENSIONS components, and Hamming kernels
+ * between packed binary descriptors of BINARY_WORDS words. The widest instruction set supported by the running CPU is
+ * picked on first use; uint8 distances are returned in quantized units and binary distances in bits.
+ */
+class DistanceKernels {
+public:
+    enum InstructionSet { SCALAR = 0, SSE2 = 1, AVX2 = 2 };
+    const static int DIMENSIONS = 128;
+    const static int BINARY_WORDS = 4;      // 256 bit binary descriptors
+    const static int QUERY_BLOCK = 4;       // Queries scored against each train row while it is in registers
+    const static int TRAIN_BLOCK = 256;     // Train rows per tile, 128 KB of float descriptors
+    static InstructionSet getBestSupported();
+    static bool hasPopcount();
+    static InstructionSet getInstructionSet();
+    static bool setInstructionSet(InstructionSet set);
+    static const char *getInstructionSetName(InstructionSet set);
+    static void matchTopTwo(const float *query, size_t queryCount, const float *train, size_t trainCount,
+                            TopTwoMatch *results);
+    static void matchTopTwo(const uint8_t *query, size_t queryCount, const uint8_t *train, size_t trainCount,
+                            TopTwoMatch *results);
+    static void matchTopTwo(const uint64_t *query, size_t queryCount, const uint64_t *train, size_t trainCount,
+                            TopTwoMatch *results);
+    static float squaredDistance(const float *a, const float *b);
+    static float squaredDistance(const uint8_t *a, const uint8_t *b);
+    static float hammingDistance(const uint64_t *a, const uint64_t *b);
+};
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "KDForest.h"
+#include <algorithm>
+#include <cfloat>
+#include <numeric>
+
+using namespace std;
+
+static const int DIMENSIONS = DescriptorSet::DESCRIPTOR_SIZE;
+
+/**
+ * Constructor
+ *
+ * @param treeCount Number of randomized trees, more trees raise recall for the same number of checks
+ * @param maxChecks Leaf descriptors compared per query before the search stops
+ * @param leafSize Largest number of descriptors stored in a leaf
+ * @param seed Seed for the split dimension choice, fixed so builds are reproducible
+ */
+KDForest::KDForest(int treeCount, int maxChecks, int leafSize, unsigned int seed) {
+    this->train = nullptr;
+    this->treeCount = (treeCount > 0) ? treeCount : 1;
+    this->maxChecks = maxChecks;
+    this->leafSize = (leafSize > 0) ? leafSize : 1;
+    this->seed = seed;
+}
+
+/**
+ * Build the trees over a descriptor set. Splits are made on float components, so a BRIEF set is refused and leaves the
+ * forest empty: every search then finds nothing.
+ *
+ * @param train Descriptors to index, must outlive the index
+ * @return void
+ */
+void KDForest::build(const DescriptorSet &train) {
+    if (train.isBinary()) {
+        this->train = nullptr;
+        this->trees.clear();
+        this->indices.clear();
+        return;
+    }
+
+    this->train = &train;
+    this->trees.assign(treeCount, vector<Node>());
+    this->indices.assign(treeCount, vector<int>(train.size()));
+
+    mt19937 rng(seed);
+
+    for (int t = 0; t < treeCount; t++) {
+        iota(indices[t].begin(), indices[t].end(), 0);
+        shuffle(indices[t].begin(), indices[t].end(), rng);
+
+        if (!train.empty()) {
+            trees[t].reserve(2 * train.size() / leafSize + 1);
+            buildNode(t, 0, (int) train.size(), rng);
+        }
+    }
+}
+
+/**
+ * Recursively split a range of a tree's index array at the mean of one of its highest variance dimensions
+ *
+ * @param tree Tree being built
+ * @param begin First position in the tree's index array
+ * @param end One past the last position
+ * @param rng Random source for the split dimension
+ * @return int Index of the created node
+ */
+int KDForest::buildNode(int tree, int begin, int end, mt19937 &rng) {
+    vector<int> &idx = indices[tree];
+    int id = (int) trees[tree].size();
+    Node node;
+
+    node.dimension = -1;
+    node.value = 0;
+    node.children[0] = -1;
+    node.children[1] = -1;
+    node.begin = begin;
+    node.end = end;
+    trees[tree].push_back(node);
+
+    if (end - begin <= leafSize) {
+        return id;
+    }
+
+    // Estimate per dimension variance from a sample, the index array is shuffled so its head is random
+    int count = min(end - begin, (int) SAMPLE_SIZE);
+    float mean[DIMENSIONS];
+    float variance[DIMENSIONS];
+    fill(mean, mean + DIMENSIONS, 0.0f);
+    fill(variance, variance + DIMENSIONS, 0.0f);
+
+    for (int i = begin; i < begin + count; i++) {
+        const float *d = train->getDescriptor(idx[i]);
+        for (int k = 0; k < DIMENSIONS; k++) {
+            mean[k] += d[k];
+        }
+    }
+    for (int k = 0; k < DIMENSIONS; k++) {
+        mean[k] /= count;
+    }
+    for (int i = begin; i < begin + count; i++) {
+        const float *d = train->getDescriptor(idx[i]);
+        for (int k = 0; k < DIMENSIONS; k++) {
+            float diff = d[k] - mean[k];
+            variance[k] += diff * diff;
+        }
+    }
+
+    // Pick randomly among the highest variance dimensions so the trees differ
+    int order[DIMENSIONS];
+    iota(order, order + DIMENSIONS, 0);
+    partial_sort(order, order + RANDOM_DIMENSIONS, order + DIMENSIONS,
+                 [&variance](int a, int b) { return variance[a] > variance[b]; });
+
+    int dimension = order[rng() % RANDOM_DIMENSIONS];
+    float value = mean[dimension];
+
+    // Partition around the split value
+    int lo = begin;
+    int hi = end - 1;
+    while (lo <= hi) {
+        if (train->getDescriptor(idx[lo])[dimension] < value) {
+            lo++;
+        }
+        else {
+            swap(idx[lo], idx[hi--]);
+        }
+    }
+
+    int split = lo;
+    if (split == begin || split == end) {
+        split = (begin + end) / 2;
+    }
+
+    int below = buildNode(tree, begin, split, rng);
+    int above = buildNode(tree, split, end, rng);
+
+    Node &created = trees[tree][id];
+    created.dimension = dimension;
+    created.value = value;
+    created.children[0] = below;
+    created.children[1] = above;
+
+    return id;
+}
+
+/**
+ * Walk from a node down to a leaf, queueing the branches not taken, and score the unvisited descriptors of the leaf
+ *
+ * @param query Query descriptor
+ * @param tree Tree to walk
+ * @param node Starting node
+ * @param distance Lower bound estimate accumulated on the way to node
+ * @param result Top-2 list being filled
+ * @param heap Branches still to explore
+ * @param visited Stamp per train descriptor, shared by all trees
+ * @param stamp Value marking descriptors seen by this query
+ * @param checks Descriptors compared so far
+ * @return void
+ */
+void KDForest::descend(const float *query, int tree, int node, float distance, TopTwoMatch &result,
+                       vector<Branch> &heap, vector<uint32_t> &visited, uint32_t stamp, int &checks) const {
+    const vector<Node> &nodes = trees[tree];
+
+    while (nodes[node].dimension >= 0) {
+        const Node &n = nodes[node];
+        float diff = query[n.dimension] - n.value;
+        int nearChild = (diff < 0) ? n.children[0] : n.children[1];
+        int farChild = (diff < 0) ? n.children[1] : n.children[0];
+        float farDistance = distance + diff * diff;
+
+        if (farDistance < result.secondDistance) {
+            Branch b;
+            b.distance = farDistance;
+            b.tree = tree;
+            b.node = farChild;
+            heap.push_back(b);
+            push_heap(heap.begin(), heap.end());
+        }
+
+        node = nearChild;
+    }
+
+    const vector<int> &idx = indices[tree];
+    for (int i = nodes[node].begin; i < nodes[node].end; i++) {
+        int id = idx[i];
+
+        if (visited[id] == stamp) {
+            continue;
+        }
+
+        visited[id] = stamp;
+        checks++;
+        updateTopTwo(result, DistanceKernels::squaredDistance(query, train->getDescriptor(id)), id);
+    }
+}
+
+/**
+ * Best-bin-first search of all trees for the two nearest neighbours of one query
+ *
+ * @param query Query descriptor
+ * @param result Receives the neighbours
+ * @param heap Scratch branch queue
+ * @param visited Scratch stamps, one per train descriptor
+ * @param stamp Value not yet used in visited
+ * @return void
+ */
+void KDForest::knnSearch(const float *query, TopTwoMatch &result, vector<Branch> &heap, vector<uint32_t> &visited,
+                         uint32_t stamp) const {
+    int checks = 0;
+
+    result.bestIndex = -1;
+    result.secondIndex = -1;
+    result.bestDistance = FLT_MAX;
+    result.secondDistance = FLT_MAX;
+    heap.clear();
+
+    if (train == nullptr || train->empty()) {
+        return;
+    }
+
+    for (int t = 0; t < treeCount; t++) {
+        descend(query, t, 0, 0.0f, result, heap, visited, stamp, checks);
+    }
+
+    while (!heap.empty() && checks < maxChecks) {
+        pop_heap(heap.begin(), heap.end());
+        Branch b = heap.back();
+        heap.pop_back();
+
+        // The heap is ordered, nothing left can beat the current second neighbour
+        if (b.distance >= result.secondDistance) {
+            break;
+        }
+
+        descend(query, b.tree, b.node, b.distance, result, heap, visited, stamp, checks);
+    }
+}
+
+/**
+ * Two approximate nearest neighbours of a single descriptor
+ *
+ * @param query Query descriptor
+ * @return TopTwoMatch
+ */
+TopTwoMatch KDForest::search(const float *query) const {
+    TopTwoMatch result;
+    vector<Branch> heap;
+    vector<uint32_t> visited((train != nullptr) ? train->size() : 0, 0);
+
+    knnSearch(query, result, heap, visited, 1);
+    return result;
+}
+
+/**
+ * Two approximate nearest neighbours of every descriptor in a set, split across a thread pool
+ *
+ * @param query Descriptors to find neighbours for
+ * @param pool Threads to search on, the shared pool if null
+ * @return vector<TopTwoMatch> One entry per query, in query order
+ */
+vector<TopTwoMatch> KDForest::search(const DescriptorSet &query, ThreadPool *pool) const {
+    const size_t QUERY_CHUNK = 64;
+    vector<TopTwoMatch> results(query.size());
+    size_t trainSize = (train != nullptr) ? train->size() : 0;
+
+    // Binary queries have no float components to compare
+    if (query.isBinary()) {
+        TopTwoMatch none = {-1, -1, FLT_MAX, FLT_MAX};
+        results.assign(query.size(), none);
+        return results;
+    }
+
+    if (pool == nullptr) {
+        pool = &ThreadPool::getShared();
+    }
+
+    pool->parallelFor(0, query.size(), QUERY_CHUNK, [&](size_t begin, size_t end) {
+        vector<Branch> heap;
+        vector<uint32_t> visited(trainSize, 0);
+
+        for (size_t q = begin; q < end; q++) {
+            knnSearch(query.getDescriptor(q), results[q], heap, visited, (uint32_t) (q - begin + 1));
+        }
+    });
+
+    return results;
+}
+
+const DescriptorSet *KDForest::getTrain() const { return train; }
+int KDForest::getTreeCount() const { return treeCount; }
+int KDForest::getMaxChecks() const { return maxChecks; }
+void KDForest::setMaxChecks(int maxChecks) { KDForest::maxChecks = maxChecks; }
+int KDForest::getLeafSize() const { return leafSize; }
\ No newline at end of file
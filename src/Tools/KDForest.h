@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "DistanceKernels.h"
+#include "ThreadPool.h"
+#include "../FeatureMatching/DescriptorSet.h"
+
+/**
+ * Approximate nearest neighbour index over a DescriptorSet: randomized k-d trees searched together best-bin-first.
+ * Recall and speed are traded through the tree count and the number of leaf descriptors checked per query. The index
+ * keeps a pointer to the set it was built on, which must outlive it. Only float descriptor sets can be indexed.
+ */
+class KDForest {
+private:
+    const static int SAMPLE_SIZE = 100;    // Descriptors used to estimate split variance
+    const static int RANDOM_DIMENSIONS = 5; // Highest variance dimensions a split is drawn from
+    struct Node {
+        int dimension;      // Split dimension, -1 for a leaf
+        float value;        // Split value
+        int children[2];    // Below and above the split
+        int begin;          // Leaf range into the tree's index array
+        int end;
+    };
+    struct Branch {
+        float distance;     // Lower bound estimate of the branch
+        int tree;
+        int node;
+        bool operator<(const Branch &other) const { return distance > other.distance; }
+    };
+    const DescriptorSet *train;
+    int treeCount;
+    int maxChecks;
+    int leafSize;
+    unsigned int seed;
+    std::vector<std::vector<Node> > trees;
+    std::vector<std::vector<int> > indices;
+    int buildNode(int tree, int begin, int end, std::mt19937 &rng);
+    void descend(const float *query, int tree, int node, float distance, TopTwoMatch &result,
+                 std::vector<Branch> &heap, std::vector<uint32_t> &visited, uint32_t stamp, int &checks) const;
+    void knnSearch(const float *query, TopTwoMatch &result, std::vector<Branch> &heap,
+                   std::vector<uint32_t> &visited, uint32_t stamp) const;
+public:
+    KDForest(int treeCount = 4, int maxChecks = 128, int leafSize = 8, unsigned int seed = 498);
+    void build(const DescriptorSet &train);
+    TopTwoMatch search(const float *query) const;
+    std::vector<TopTwoMatch> search(const DescriptorSet &query, ThreadPool *pool = nullptr) const;
+    const DescriptorSet *getTrain() const;
+    int getTreeCount() const;
+    int getMaxChecks() const;
+    void setMaxChecks(int maxChecks);
+    int getLeafSize() const;
+};
\ No newline at end of file
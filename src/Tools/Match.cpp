@@ -1,22 +1,32 @@
 #include "Match.h"
 
-Match::Match(const SIFTDescriptor &point1, const SIFTDescriptor &point2) : point1(point1), point2(point2) {
-    this->point1 = point1;
-    this->point2 = point2;
+Match::Match(int index1, int index2) : index1(index1), index2(index2), distance(0), ratio(0) {
 }
 
-const SIFTDescriptor &Match::getPoint1() const {
-    return point1;
+Match::Match(int index1, int index2, float distance, float ratio)
+        : index1(index1), index2(index2), distance(distance), ratio(ratio) {
 }
 
-void Match::setPoint1(const SIFTDescriptor &point1) {
-    Match::point1 = point1;
+int Match::getIndex1() const {
+    return index1;
 }
 
-const SIFTDescriptor &Match::getPoint2() const {
-    return point2;
+void Match::setIndex1(int index1) {
+    Match::index1 = index1;
 }
 
-void Match::setPoint2(const SIFTDescriptor &point2) {
-    Match::point2 = point2;
+int Match::getIndex2() const {
+    return index2;
+}
+
+void Match::setIndex2(int index2) {
+    Match::index2 = index2;
+}
+
+float Match::getDistance() const {
+    return distance;
+}
+
+float Match::getRatio() const {
+    return ratio;
 }
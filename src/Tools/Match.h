@@ -1,19 +1,25 @@
 #pragma once
 
-#include "../FeatureMatching/SIFT/SIFTDescriptor.h"
-
 class Match {
 private:
-    SIFTDescriptor point1;
-    SIFTDescriptor point2;
+    int index1;         // Keypoint index in the first image's DescriptorSet
+    int index2;         // Keypoint index in the second image's DescriptorSet
+    float distance;     // Descriptor SSD of the pair
+    float ratio;        // Best to second best distance ratio, lower is less ambiguous
 public:
-    Match(const SIFTDescriptor &point1, const SIFTDescriptor &point2);
+    Match(int index1, int index2);
+
+    Match(int index1, int index2, float distance, float ratio);
+
+    int getIndex1() const;
+
+    void setIndex1(int index1);
 
-    const SIFTDescriptor &getPoint1() const;
+    int getIndex2() const;
 
-    void setPoint1(const SIFTDescriptor &point1);
+    void setIndex2(int index2);
 
-    const SIFTDescriptor &getPoint2() const;
+    float getDistance() const;
 
-    void setPoint2(const SIFTDescriptor &point2);
+    float getRatio() const;
 };
\ No newline at end of file
@@ -0,0 +1,303 @@
+#include "Matcher.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <numeric>
+#include "Profiler.h"
+
+using namespace std;
+
+/**
+ * Constructor
+ *
+ * @param distanceThreshold Largest SSD a match may have, in normalized descriptor units, see distanceScale
+ * @param ratioThreshold Largest best/second best SSD ratio a match may have
+ * @param crossCheck Keep a match only if it is also the best match in the reverse direction
+ * @param pool Threads to match on, the shared pool if null
+ */
+Matcher::Matcher(float distanceThreshold, float ratioThreshold, bool crossCheck, ThreadPool *pool) {
+    this->distanceThreshold = distanceThreshold;
+    this->ratioThreshold = ratioThreshold;
+    this->crossCheck = crossCheck;
+    this->quantized = false;
+    this->pool = (pool != nullptr) ? pool : &ThreadPool::getShared();
+}
+
+/**
+ * Units of the distances between two sets relative to normalized float descriptors. Quantized distances are in
+ * QUANTIZATION_SCALE^2 units. Hamming distance is the SSD between the bit vectors, and BINARY_BITS / 4 bits count as
+ * one unit, so the range of both lies in [0, 4] and the same thresholds serve either descriptor.
+ *
+ * @param features1 Query set
+ * @param features2 Train set
+ * @return float
+ */
+float Matcher::distanceScale(const DescriptorSet &features1, const DescriptorSet &features2) const {
+    if (features1.isBinary()) {
+        return (float) DescriptorSet::BINARY_BITS / 4.0f;
+    }
+    if (quantized && features1.isQuantized() && features2.isQuantized()) {
+        return (float) DescriptorSet::QUANTIZATION_SCALE * DescriptorSet::QUANTIZATION_SCALE;
+    }
+
+    return 1.0f;
+}
+
+/**
+ * Two nearest train descriptors of every query descriptor. Each task writes only its own slice of the output.
+ *
+ * @param query Descriptors to find neighbours for
+ * @param train Descriptors to search
+ * @return vector<TopTwoMatch> One entry per query, in query order
+ */
+vector<TopTwoMatch> Matcher::nearestNeighbours(const DescriptorSet &query, const DescriptorSet &train) const {
+    vector<TopTwoMatch> neighbours(query.size());
+    bool useQuantized = quantized && query.isQuantized() && train.isQuantized();
+    TopTwoMatch *out = neighbours.data();
+
+    pool->parallelFor(0, query.size(), QUERY_CHUNK, [&](size_t begin, size_t end) {
+        if (query.isBinary()) {
+            DistanceKernels::matchTopTwo(query.getBinaryDescriptor(begin), end - begin,
+                                         train.getBinaryDescriptors(), train.size(), out + begin);
+        }
+        else if (useQuantized) {
+            DistanceKernels::matchTopTwo(query.getQuantizedDescriptor(begin), end - begin,
+                                         train.getQuantizedDescriptors(), train.size(), out + begin);
+        }
+        else {
+            DistanceKernels::matchTopTwo(query.getDescriptor(begin), end - begin,
+                                         train.getDescriptors(), train.size(), out + begin);
+        }
+    });
+
+    return neighbours;
+}
+
+/**
+ * Match every keypoint of features1 against features2
+ *
+ * @param features1 Keypoints of the first image
+ * @param features2 Keypoints of the second image
+ * @return vector<Match> Accepted matches ordered by index1
+ */
+vector<Match> Matcher::match(const DescriptorSet &features1, const DescriptorSet &features2) const {
+    static Profiler::Timer &timer = Profiler::timer("match");
+    Profiler::Scope scope(timer);
+
+    if (features1.empty() || features2.empty() || features1.getType() != features2.getType()) {
+        return vector<Match>();
+    }
+
+    float scale = distanceScale(features1, features2);
+    vector<TopTwoMatch> forward = nearestNeighbours(features1, features2);
+    vector<TopTwoMatch> backward;
+
+    if (crossCheck) {
+        backward = nearestNeighbours(features2, features1);
+    }
+
+    return filter(forward, backward, scale);
+}
+
+/**
+ * Match every keypoint of features1 against a prebuilt approximate index of the second image. Cross-checking needs an
+ * exact reverse search and is not applied on this path. The index only holds float descriptors.
+ *
+ * @param features1 Keypoints of the first image
+ * @param index Index built over the keypoints of the second image
+ * @return vector<Match> Accepted matches ordered by index1
+ */
+vector<Match> Matcher::match(const DescriptorSet &features1, const KDForest &index) const {
+    static Profiler::Timer &timer = Profiler::timer("match.approximate");
+    Profiler::Scope scope(timer);
+
+    const DescriptorSet *train = index.getTrain();
+    if (features1.empty() || features1.isBinary() || train == nullptr || train->isBinary() || train->empty()) {
+        return vector<Match>();
+    }
+
+    return filter(index.search(features1, pool), vector<TopTwoMatch>(), 1.0f);
+}
+
+/**
+ * Match every keypoint of features1 against only the keypoints of features2 within radius of where a homography puts
+ * it. The ratio test then compares neighbours inside that radius, which keeps repeated structure elsewhere in the
+ * image from rejecting a match. The second image's keypoints are bucketed on a grid of radius sized cells, so each
+ * query looks at the 3x3 cells around its prediction. Cross-checking is not applied on this path.
+ *
+ * @param features1 Keypoints of the first image
+ * @param features2 Keypoints of the second image
+ * @param H Row-major homography from features1 positions (col, row) to features2 positions
+ * @param radius Largest distance in pixels between a predicted and a matched position
+ * @return vector<Match> Accepted matches ordered by index1
+ */
+vector<Match> Matcher::matchGuided(const DescriptorSet &features1, const DescriptorSet &features2, const double H[9],
+                                   float radius) const {
+    static Profiler::Timer &timer = Profiler::timer("match.guided");
+    Profiler::Scope scope(timer);
+
+    if (features1.empty() || features2.empty() || features1.getType() != features2.getType() || radius <= 0) {
+        return vector<Match>();
+    }
+
+    const bool binary = features1.isBinary();
+
+    const int count2 = (int) features2.size();
+    float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for (int j = 0; j < count2; j++) {
+        minX = min(minX, features2.getCol(j));
+        maxX = max(maxX, features2.getCol(j));
+        minY = min(minY, features2.getRow(j));
+        maxY = max(maxY, features2.getRow(j));
+    }
+
+    // Counting sort of the train keypoints into grid cells
+    const int gridCols = (int) ((maxX - minX) / radius) + 1;
+    const int gridRows = (int) ((maxY - minY) / radius) + 1;
+    vector<int> cellStart(gridCols * gridRows + 1, 0);
+    vector<int> cellItems(count2);
+    vector<int> cellOf(count2);
+
+    for (int j = 0; j < count2; j++) {
+        int cx = (int) ((features2.getCol(j) - minX) / radius);
+        int cy = (int) ((features2.getRow(j) - minY) / radius);
+        cellOf[j] = cy * gridCols + cx;
+        cellStart[cellOf[j] + 1]++;
+    }
+    partial_sum(cellStart.begin(), cellStart.end(), cellStart.begin());
+    vector<int> next(cellStart.begin(), cellStart.end() - 1);
+    for (int j = 0; j < count2; j++) {
+        cellItems[next[cellOf[j]]++] = j;
+    }
+
+    vector<TopTwoMatch> forward(features1.size());
+    const float radiusSquared = radius * radius;
+
+    pool->parallelFor(0, features1.size(), QUERY_CHUNK, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            TopTwoMatch &n = forward[i];
+            n.bestIndex = -1;
+            n.secondIndex = -1;
+            n.bestDistance = FLT_MAX;
+            n.secondDistance = FLT_MAX;
+
+            double x = features1.getCol(i), y = features1.getRow(i);
+            double w = H[6] * x + H[7] * y + H[8];
+            if (fabs(w) < 1e-12) {
+                continue;
+            }
+
+            float px = (float) ((H[0] * x + H[1] * y + H[2]) / w);
+            float py = (float) ((H[3] * x + H[4] * y + H[5]) / w);
+            if (!(px >= minX - radius && px <= maxX + radius && py >= minY - radius && py <= maxY + radius)) {
+                continue;
+            }
+
+            int cx = (int) floor((px - minX) / radius);
+            int cy = (int) floor((py - minY) / radius);
+
+            for (int gy = max(cy - 1, 0); gy <= min(cy + 1, gridRows - 1); gy++) {
+                for (int gx = max(cx - 1, 0); gx <= min(cx + 1, gridCols - 1); gx++) {
+                    int cell = gy * gridCols + gx;
+
+                    for (int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                        int j = cellItems[k];
+                        float dx = features2.getCol(j) - px;
+                        float dy = features2.getRow(j) - py;
+
+                        if (dx * dx + dy * dy > radiusSquared) {
+                            continue;
+                        }
+
+                        if (binary) {
+                            updateTopTwo(n, DistanceKernels::hammingDistance(features1.getBinaryDescriptor(i),
+                                                                             features2.getBinaryDescriptor(j)), j);
+                        }
+                        else {
+                            updateTopTwo(n, DistanceKernels::squaredDistance(features1.getDescriptor(i),
+                                                                             features2.getDescriptor(j)), j);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    return filter(forward, vector<TopTwoMatch>(), binary ? distanceScale(features1, features2) : 1.0f);
+}
+
+/**
+ * Apply the distance threshold, the ratio test and, when backward neighbours are given, the cross-check
+ *
+ * @param forward Neighbours of every keypoint of the first image
+ * @param backward Neighbours of every keypoint of the second image, empty to skip the cross-check
+ * @param scale Units of the distances relative to normalized descriptors
+ * @return vector<Match>
+ */
+vector<Match> Matcher::filter(const vector<TopTwoMatch> &forward, const vector<TopTwoMatch> &backward,
+                              float scale) const {
+    static Profiler::Counter &queries = Profiler::counter("match.queries");
+    static Profiler::Counter &candidates = Profiler::counter("match.candidates");
+    vector<Match> matches = vector<Match>();
+    float threshold = distanceThreshold * scale;
+
+    for (size_t i = 0; i < forward.size(); i++) {
+        const TopTwoMatch &n = forward[i];
+
+        if (n.bestIndex < 0 || n.bestDistance >= threshold) {
+            continue;
+        }
+
+        // Candidates beyond the distance threshold do not compete in the ratio test
+        float second = (n.secondDistance < threshold) ? n.secondDistance : FLT_MAX;
+        float ratio = (second < FLT_MAX) ? n.bestDistance / second : 0.0f;
+
+        if (ratio >= ratioThreshold) {
+            continue;
+        }
+
+        if (!backward.empty() && backward[n.bestIndex].bestIndex != (int) i) {
+            continue;
+        }
+
+        matches.push_back(Match((int) i, n.bestIndex, n.bestDistance / scale, ratio));
+    }
+
+    queries.add((long long) forward.size());
+    candidates.add((long long) matches.size());
+    return matches;
+}
+
+/**
+ * Positions of matches from most to least distinctive: by ratio test score, then distance, then position, so the
+ * order is deterministic. This is the quality ordering PROSAC samples from.
+ *
+ * @param matches Matches to order
+ * @return vector<int> Positions into matches
+ */
+vector<int> Matcher::qualityOrder(const vector<Match> &matches) {
+    vector<int> order(matches.size());
+    iota(order.begin(), order.end(), 0);
+
+    sort(order.begin(), order.end(), [&matches](int a, int b) {
+        const Match &ma = matches[a], &mb = matches[b];
+        if (ma.getRatio() != mb.getRatio()) {
+            return ma.getRatio() < mb.getRatio();
+        }
+        if (ma.getDistance() != mb.getDistance()) {
+            return ma.getDistance() < mb.getDistance();
+        }
+        return a < b;
+    });
+
+    return order;
+}
+
+float Matcher::getDistanceThreshold() const { return distanceThreshold; }
+void Matcher::setDistanceThreshold(float distanceThreshold) { Matcher::distanceThreshold = distanceThreshold; }
+float Matcher::getRatioThreshold() const { return ratioThreshold; }
+void Matcher::setRatioThreshold(float ratioThreshold) { Matcher::ratioThreshold = ratioThreshold; }
+bool Matcher::isCrossCheck() const { return crossCheck; }
+void Matcher::setCrossCheck(bool crossCheck) { Matcher::crossCheck = crossCheck; }
+bool Matcher::isQuantized() const { return quantized; }
+void Matcher::setQuantized(bool quantized) { Matcher::quantized = quantized; }
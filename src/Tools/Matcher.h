@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+#include "Match.h"
+#include "DistanceKernels.h"
+#include "ThreadPool.h"
+#include "KDForest.h"
+#include "../FeatureMatching/DescriptorSet.h"
+
+/**
+ * Nearest neighbour matching between two DescriptorSets with a distance threshold, Lowe's ratio test and optional
+ * symmetric cross-checking. Float sets are compared by SSD and binary sets by Hamming distance, with the same
+ * thresholds. Queries are split across a ThreadPool; results do not depend on the thread count.
+ */
+class Matcher {
+private:
+    const static int QUERY_CHUNK = 64;     // Queries per parallel task
+    float distanceThreshold;
+    float ratioThreshold;
+    bool crossCheck;
+    bool quantized;
+    ThreadPool *pool;
+    float distanceScale(const DescriptorSet &features1, const DescriptorSet &features2) const;
+    std::vector<Match> filter(const std::vector<TopTwoMatch> &forward, const std::vector<TopTwoMatch> &backward,
+                              float scale) const;
+public:
+    Matcher(float distanceThreshold, float ratioThreshold, bool crossCheck = false, ThreadPool *pool = nullptr);
+    std::vector<TopTwoMatch> nearestNeighbours(const DescriptorSet &query, const DescriptorSet &train) const;
+    std::vector<Match> match(const DescriptorSet &features1, const DescriptorSet &features2) const;
+    std::vector<Match> match(const DescriptorSet &features1, const KDForest &index) const;
+    std::vector<Match> matchGuided(const DescriptorSet &features1, const DescriptorSet &features2, const double H[9],
+                                   float radius) const;
+    static std::vector<int> qualityOrder(const std::vector<Match> &matches);
+    float getDistanceThreshold() const;
+    void setDistanceThreshold(float distanceThreshold);
+    float getRatioThreshold() const;
+    void setRatioThreshold(float ratioThreshold);
+    bool isCrossCheck() const;
+    void setCrossCheck(bool crossCheck);
+    bool isQuantized() const;
+    void setQuantized(bool quantized);
+};
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "Profiler.h"
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+atomic<bool> Profiler::enabled(false);
+
+/**
+ * Every metric created so far, by name. Held in unique_ptrs so references handed out stay valid as the maps grow.
+ */
+struct ProfilerRegistry {
+    mutex lock;
+    map<string, unique_ptr<Profiler::Timer> > timers;
+    map<string, unique_ptr<Profiler::Counter> > counters;
+    map<string, unique_ptr<Profiler::Peak> > peaks;
+};
+
+/**
+ * The registry, created on first use so metrics can be looked up from static initialisers
+ *
+ * @return ProfilerRegistry&
+ */
+static ProfilerRegistry &registry() {
+    static ProfilerRegistry instance;
+    return instance;
+}
+
+/**
+ * Metric with a name, created empty on first use
+ *
+ * @param metrics Map of one kind of metric
+ * @param name Name of the metric
+ * @return T&
+ */
+template <typename T>
+static T &lookup(map<string, unique_ptr<T> > &metrics, const string &name) {
+    lock_guard<mutex> guard(registry().lock);
+    unique_ptr<T> &metric = metrics[name];
+
+    if (!metric) {
+        metric.reset(new T());
+    }
+
+    return *metric;
+}
+
+/**
+ * Timer with a name, created on first use
+ *
+ * @param name Dotted name, e.g. "panorama.align"
+ * @return Timer&
+ */
+Profiler::Timer &Profiler::timer(const string &name) {
+    return lookup(registry().timers, name);
+}
+
+/**
+ * Counter with a name, created on first use
+ *
+ * @param name Dotted name, e.g. "detect.keypoints"
+ * @return Counter&
+ */
+Profiler::Counter &Profiler::counter(const string &name) {
+    return lookup(registry().counters, name);
+}
+
+/**
+ * Peak with a name, created on first use
+ *
+ * @param name Dotted name, e.g. "blend.peak_bytes"
+ * @return Peak&
+ */
+Profiler::Peak &Profiler::peak(const string &name) {
+    return lookup(registry().peaks, name);
+}
+
+/**
+ * Zero every metric, e.g. between the runs of a benchmark. The peak resident set size is kept by the operating system
+ * and cannot be reset.
+ *
+ * @return void
+ */
+void Profiler::reset() {
+    ProfilerRegistry &metrics = registry();
+    lock_guard<mutex> guard(metrics.lock);
+
+    for (const pair<const string, unique_ptr<Timer> > &entry : metrics.timers) {
+        entry.second->reset();
+    }
+    for (const pair<const string, unique_ptr<Counter> > &entry : metrics.counters) {
+        entry.second->reset();
+    }
+    for (const pair<const string, unique_ptr<Peak> > &entry : metrics.peaks) {
+        entry.second->reset();
+    }
+}
+
+/**
+ * Write every metric as one JSON object, names in order:
+ *
+ *     {"timers":{"match":{"calls":12,"ms":40.25}},"counters":{"match.candidates":5210},
+ *      "peaks":{"blend.peak_bytes":7340032},"peak_rss_bytes":212336640}
+ *
+ * @param out Stream to write to
+ * @return void
+ */
+void Profiler::report(ostream &out) {
+    ProfilerRegistry &metrics = registry();
+    lock_guard<mutex> guard(metrics.lock);
+    ios::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    const char *separator = "";
+
+    out << fixed << setprecision(3) << "{\"timers\":{";
+    for (const pair<const string, unique_ptr<Timer> > &entry : metrics.timers) {
+        out << separator << "\"" << entry.first << "\":{\"calls\":" << entry.second->getCalls() << ",\"ms\":"
+            << entry.second->getMilliseconds() << "}";
+        separator = ",";
+    }
+
+    separator = "";
+    out << "},\"counters\":{";
+    for (const pair<const string, unique_ptr<Counter> > &entry : metrics.counters) {
+        out << separator << "\"" << entry.first << "\":" << entry.second->getTotal();
+        separator = ",";
+    }
+
+    separator = "";
+    out << "},\"peaks\":{";
+    for (const pair<const string, unique_ptr<Peak> > &entry : metrics.peaks) {
+        out << separator << "\"" << entry.first << "\":" << entry.second->getValue();
+        separator = ",";
+    }
+
+    out << "},\"peak_rss_bytes\":" << peakResidentBytes() << "}";
+    out.flags(flags);
+    out.precision(precision);
+}
+
+/**
+ * Largest resident set size of the process so far
+ *
+ * @return long long Bytes, 0 where the platform does not report it
+ */
+long long Profiler::peakResidentBytes() {
+#ifdef _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (long long) usage.ru_maxrss;
+#else
+    return (long long) usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/**
+ * Turn metric collection on or off. Scopes already open when it is turned on are not timed.
+ *
+ * @param enabled Whether to collect
+ * @return void
+ */
+void Profiler::setEnabled(bool enabled) {
+    Profiler::enabled.store(enabled, memory_order_relaxed);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+/**
+ * Process-wide timers, counters and peaks showing where time and memory go. Instrumented code looks a named metric up
+ * once, into a function-local static, and updates it with relaxed atomics; while the profiler is disabled, the
+ * default, an update costs one load and a branch. Metrics are created on first use and live until the process ends.
+ *
+ *     static Profiler::Timer &timer = Profiler::timer("match");
+ *     Profiler::Scope scope(timer);
+ */
+class Profiler {
+public:
+    /**
+     * Calls of one named scope and the time spent in them
+     */
+    class Timer {
+    private:
+        std::atomic<long long> nanoseconds;
+        std::atomic<long long> calls;
+    public:
+        Timer() : nanoseconds(0), calls(0) {}
+        void add(long long elapsed) {
+            nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+            calls.fetch_add(1, std::memory_order_relaxed);
+        }
+        void reset() {
+            nanoseconds.store(0, std::memory_order_relaxed);
+            calls.store(0, std::memory_order_relaxed);
+        }
+        double getMilliseconds() const { return nanoseconds.load(std::memory_order_relaxed) / 1e6; }
+        long long getCalls() const { return calls.load(std::memory_order_relaxed); }
+    };
+
+    /**
+     * Running total of events, e.g. keypoints found
+     */
+    class Counter {
+    private:
+        std::atomic<long long> total;
+    public:
+        Counter() : total(0) {}
+        void add(long long amount) {
+            if (Profiler::isEnabled()) {
+                total.fetch_add(amount, std::memory_order_relaxed);
+            }
+        }
+        void reset() { total.store(0, std::memory_order_relaxed); }
+        long long getTotal() const { return total.load(std::memory_order_relaxed); }
+    };
+
+    /**
+     * Largest value seen, e.g. the bytes of a working set
+     */
+    class Peak {
+    private:
+        std::atomic<long long> value;
+    public:
+        Peak() : value(0) {}
+        void update(long long candidate) {
+            if (!Profiler::isEnabled()) {
+                return;
+            }
+            long long current = value.load(std::memory_order_relaxed);
+            while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+            }
+        }
+        void reset() { value.store(0, std::memory_order_relaxed); }
+        long long getValue() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    /**
+     * Adds the time until it goes out of scope to a timer, if the profiler was enabled when it was created
+     */
+    class Scope {
+    private:
+        Timer *timer;
+        std::chrono::steady_clock::time_point start;
+    public:
+        explicit Scope(Timer &timer) : timer(Profiler::isEnabled() ? &timer : nullptr) {
+            if (this->timer != nullptr) {
+                start = std::chrono::steady_clock::now();
+            }
+        }
+        ~Scope() {
+            if (timer != nullptr) {
+                timer->add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                                 start).count());
+            }
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+private:
+    static std::atomic<bool> enabled;
+public:
+    static Timer &timer(const std::string &name);
+    static Counter &counter(const std::string &name);
+    static Peak &peak(const std::string &name);
+    static void reset();
+    static void report(std::ostream &out);
+    static long long peakResidentBytes();
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+};
\ No newline at end of file
@@ -0,0 +1,191 @@
+#include "ScratchArena.h"
+#include <algorithm>
+#include "Profiler.h"
+
+using namespace cv;
+using namespace std;
+
+atomic<bool> ScratchArena::enabled(true);
+
+/**
+ * Open a scope on an arena
+ *
+ * @param arena Arena of the calling thread
+ */
+ScratchArena::Scope::Scope(ScratchArena &arena) : arena(arena) {
+    this->block = arena.current;
+    this->offset = arena.offset;
+    this->loose = arena.loose.size();
+    arena.depth++;
+}
+
+/**
+ * Give back everything carved since the scope opened, and reset the arena if this was the outermost scope
+ */
+ScratchArena::Scope::~Scope() {
+    arena.rewind(block, offset, loose);
+    if (--arena.depth == 0) {
+        arena.reset();
+    }
+}
+
+ScratchArena::ScratchArena() {
+    this->current = 0;
+    this->offset = 0;
+    this->base = 0;
+    this->highWater = 0;
+    this->depth = 0;
+}
+
+ScratchArena::~ScratchArena() {
+    for (const Block &block : blocks) {
+        delete[] block.raw;
+    }
+    for (const Block &block : loose) {
+        delete[] block.raw;
+    }
+}
+
+/**
+ * Aligned heap allocation
+ *
+ * @param size Usable bytes
+ * @return Block
+ */
+ScratchArena::Block ScratchArena::heapBlock(size_t size) {
+    static Profiler::Counter &heap = Profiler::counter("arena.heap_allocations");
+    Block block;
+
+    block.raw = new char[size + ALIGNMENT - 1];
+    block.data = block.raw + (ALIGNMENT - 1 - ((size_t) block.raw + ALIGNMENT - 1) % ALIGNMENT);
+    block.size = size;
+    heap.add(1);
+    return block;
+}
+
+/**
+ * Carve bytes from the arena, ALIGNMENT aligned and uninitialised. They stay valid until the innermost open Scope
+ * closes.
+ *
+ * @param bytes Size of the request
+ * @return void*
+ */
+void *ScratchArena::allocate(size_t bytes) {
+    static Profiler::Counter &requests = Profiler::counter("arena.requests");
+    static Profiler::Peak &peak = Profiler::peak("arena.peak_bytes");
+
+    bytes = max((bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT, (size_t) ALIGNMENT);
+    requests.add(1);
+
+    if (!enabled.load(memory_order_relaxed)) {
+        loose.push_back(heapBlock(bytes));
+        return loose.back().data;
+    }
+
+    // Blocks too small for the request are skipped until the scope that skipped them closes
+    while (current < blocks.size() && offset + bytes > blocks[current].size) {
+        base += blocks[current].size;
+        current++;
+        offset = 0;
+    }
+    if (current == blocks.size()) {
+        blocks.push_back(heapBlock(max(bytes, (size_t) BLOCK_SIZE)));
+    }
+
+    void *carved = blocks[current].data + offset;
+    offset += bytes;
+    highWater = max(highWater, base + offset);
+    peak.update((long long) (base + offset));
+    return carved;
+}
+
+/**
+ * Uninitialised matrix carved from the arena. Its header does not own the memory, so copies of it are valid only
+ * while the scope it was carved in is open.
+ *
+ * @param rows Rows
+ * @param cols Columns
+ * @param type OpenCV type, e.g. CV_32F
+ * @return Mat
+ */
+Mat ScratchArena::mat(int rows, int cols, int type) {
+    return Mat(rows, cols, type, allocate((size_t) rows * cols * CV_ELEM_SIZE(type)));
+}
+
+/**
+ * Return to an earlier mark
+ *
+ * @param block Block being carved at the mark
+ * @param offset Bytes carved from it at the mark
+ * @param looseCount Heap requests alive at the mark
+ * @return void
+ */
+void ScratchArena::rewind(size_t block, size_t offset, size_t looseCount) {
+    for (size_t k = looseCount; k < loose.size(); k++) {
+        delete[] loose[k].raw;
+    }
+    loose.resize(looseCount);
+
+    this->current = block;
+    this->offset = offset;
+    this->base = 0;
+    for (size_t k = 0; k < block && k < blocks.size(); k++) {
+        this->base += blocks[k].size;
+    }
+}
+
+/**
+ * Rewind to empty, merging the blocks into one that fits the most held since the last reset, up to MAX_RETAINED
+ *
+ * @return void
+ */
+void ScratchArena::reset() {
+    size_t fit = min(max(highWater, (size_t) BLOCK_SIZE), (size_t) MAX_RETAINED);
+
+    rewind(0, 0, 0);
+    highWater = 0;
+
+    if (blocks.size() > 1 || (blocks.size() == 1 && blocks[0].size > MAX_RETAINED)) {
+        for (const Block &block : blocks) {
+            delete[] block.raw;
+        }
+        blocks.assign(1, heapBlock(fit));
+    }
+}
+
+/**
+ * Bytes the arena holds in blocks
+ *
+ * @return size_t
+ */
+size_t ScratchArena::getCapacity() const {
+    size_t capacity = 0;
+
+    for (const Block &block : blocks) {
+        capacity += block.size;
+    }
+
+    return capacity;
+}
+
+/**
+ * Arena of the calling thread, created on first use and freed when the thread ends
+ *
+ * @return ScratchArena&
+ */
+ScratchArena &ScratchArena::local() {
+    static thread_local ScratchArena arena;
+    return arena;
+}
+
+/**
+ * Serve requests from the arenas, or from the heap one allocation per request. Switch only while no scope is open.
+ *
+ * @param enabled Whether to use the arenas
+ * @return void
+ */
+void ScratchArena::setEnabled(bool enabled) {
+    ScratchArena::enabled.store(enabled, memory_order_relaxed);
+}
+
+bool ScratchArena::isEnabled() { return enabled.load(memory_order_relaxed); }
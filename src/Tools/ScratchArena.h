@@ -0,0 +1,86 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/**
+ * Per thread bump allocator for short lived scratch planes and arrays. Memory is carved from a few large blocks and
+ * given back all at once when the Scope open at the time closes, so work repeated per keypoint, tile or strip reuses
+ * the same blocks instead of going to the heap every time. Every thread, pool workers included, has its own arena from
+ * local(), so nothing is locked. A Scope must close on the thread that opened it, and nothing carved inside a Scope may
+ * be used after it closes.
+ *
+ * When the outermost Scope of a thread closes, at the end of a job, the arena is reset: the blocks it grew by are
+ * merged into one that fits the most it held, up to MAX_RETAINED bytes, so one large job does not pin memory for good.
+ *
+ * Disabled, every request is its own heap allocation freed when its Scope closes, the behaviour the arena replaces, so
+ * the two can be compared.
+ */
+class ScratchArena {
+public:
+    /**
+     * Marks the arena when opened and gives back everything carved since when closed
+     */
+    class Scope {
+    private:
+        ScratchArena &arena;
+        size_t block;
+        size_t offset;
+        size_t loose;
+    public:
+        explicit Scope(ScratchArena &arena = ScratchArena::local());
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+private:
+    const static size_t BLOCK_SIZE = 1 << 20;       // Smallest block taken from the heap
+    const static size_t MAX_RETAINED = 64 << 20;    // Most bytes an arena keeps over a reset
+    const static size_t ALIGNMENT = 64;             // Cache line, enough for any vector load
+
+    /**
+     * Heap allocation carved from, data is raw rounded up to ALIGNMENT
+     */
+    struct Block {
+        char *raw;
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    std::vector<Block> loose;                       // Requests served from the heap while disabled
+    size_t current;                                 // Block being carved
+    size_t offset;                                  // Bytes carved from it
+    size_t base;                                    // Bytes of the blocks before it
+    size_t highWater;                               // Most bytes in use since the last reset
+    int depth;                                      // Open scopes
+    static std::atomic<bool> enabled;
+    ScratchArena();
+    static Block heapBlock(size_t size);
+    void rewind(size_t block, size_t offset, size_t looseCount);
+    void reset();
+public:
+    ~ScratchArena();
+    ScratchArena(const ScratchArena &) = delete;
+    ScratchArena &operator=(const ScratchArena &) = delete;
+    void *allocate(size_t bytes);
+    cv::Mat mat(int rows, int cols, int type);
+
+    /**
+     * Uninitialised array of count elements of a trivially constructible type
+     *
+     * @param count Number of elements
+     * @return T*
+     */
+    template <typename T>
+    T *allocate(size_t count) {
+        return static_cast<T *>(allocate(count * sizeof(T)));
+    }
+
+    size_t getCapacity() const;
+    static ScratchArena &local();
+    static bool isEnabled();
+    static void setEnabled(bool enabled);
+};
\ No newline at end of file
@@ -0,0 +1,165 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+
+using namespace std;
+
+/**
+ * Bookkeeping for one parallelFor call. Held through a shared_ptr so helper tasks that start after the call returned
+ * only see an exhausted chunk counter.
+ */
+struct ParallelForState {
+    atomic<size_t> nextChunk;
+    size_t chunkCount;
+    size_t completed;
+    mutex lock;
+    condition_variable done;
+    exception_ptr error;
+};
+
+/**
+ * Constructor
+ *
+ * @param threadCount Threads doing work including the caller of parallelFor, 0 for one per hardware thread
+ */
+ThreadPool::ThreadPool(int threadCount) {
+    if (threadCount <= 0) {
+        threadCount = (int) thread::hardware_concurrency();
+    }
+
+    this->stopping = false;
+
+    for (int i = 1; i < threadCount; i++) {
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> guard(queueLock);
+        stopping = true;
+    }
+    available.notify_all();
+
+    for (thread &worker : workers) {
+        worker.join();
+    }
+}
+
+/**
+ * Run queued tasks until the pool is destroyed
+ *
+ * @return void
+ */
+void ThreadPool::workerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<std::mutex> guard(queueLock);
+            available.wait(guard, [this] { return stopping || !tasks.empty(); });
+
+            if (tasks.empty()) {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::enqueue(const function<void()> &task) {
+    {
+        lock_guard<std::mutex> guard(queueLock);
+        tasks.push_back(task);
+    }
+    available.notify_one();
+}
+
+int ThreadPool::getThreadCount() const {
+    return (int) workers.size() + 1;
+}
+
+/**
+ * Call body(chunkBegin, chunkEnd) over [begin, end) in chunks of grain elements and wait for all of them. Which thread
+ * runs a chunk varies between calls, so bodies should write only to their own slice of the output.
+ *
+ * @param begin First index
+ * @param end One past the last index
+ * @param grain Indices per chunk
+ * @param body Work for one chunk
+ * @return void
+ */
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain,
+                             const function<void(size_t, size_t)> &body) {
+    if (end <= begin) {
+        return;
+    }
+
+    grain = (grain > 0) ? grain : 1;
+    size_t chunkCount = (end - begin + grain - 1) / grain;
+
+    if (chunkCount == 1 || workers.empty()) {
+        for (size_t c = begin; c < end; c += grain) {
+            body(c, (c + grain < end) ? c + grain : end);
+        }
+        return;
+    }
+
+    shared_ptr<ParallelForState> state = make_shared<ParallelForState>();
+    state->nextChunk = 0;
+    state->chunkCount = chunkCount;
+    state->completed = 0;
+
+    const function<void(size_t, size_t)> *work = &body;
+    function<void()> claim = [state, work, begin, end, grain]() {
+        size_t chunk;
+
+        while ((chunk = state->nextChunk++) < state->chunkCount) {
+            size_t chunkBegin = begin + chunk * grain;
+            size_t chunkEnd = (chunkBegin + grain < end) ? chunkBegin + grain : end;
+
+            try {
+                (*work)(chunkBegin, chunkEnd);
+            }
+            catch (...) {
+                lock_guard<mutex> guard(state->lock);
+                if (!state->error) {
+                    state->error = current_exception();
+                }
+            }
+
+            lock_guard<mutex> guard(state->lock);
+            if (++state->completed == state->chunkCount) {
+                state->done.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = (chunkCount - 1 < workers.size()) ? chunkCount - 1 : workers.size();
+    for (size_t i = 0; i < helpers; i++) {
+        enqueue(claim);
+    }
+
+    // The caller works too, then waits for chunks still running elsewhere
+    claim();
+
+    unique_lock<mutex> guard(state->lock);
+    state->done.wait(guard, [&state] { return state->completed == state->chunkCount; });
+
+    if (state->error) {
+        rethrow_exception(state->error);
+    }
+}
+
+/**
+ * Process-wide pool sized to the hardware
+ *
+ * @return ThreadPool&
+ */
+ThreadPool &ThreadPool::getShared() {
+    static ThreadPool shared;
+    return shared;
+}
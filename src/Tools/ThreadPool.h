@@ -0,0 +1,31 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads. parallelFor splits a range into chunks that workers and the calling thread claim in
+ * order, so nested calls from inside a chunk cannot deadlock.
+ */
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex queueLock;
+    std::condition_variable available;
+    bool stopping;
+    void workerLoop();
+    void enqueue(const std::function<void()> &task);
+public:
+    explicit ThreadPool(int threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    int getThreadCount() const;
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)> &body);
+    static ThreadPool &getShared();
+};
\ No newline at end of file
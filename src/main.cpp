@@ -3,16 +3,76 @@
 #include <opencv2/opencv.hpp>
 #include "FeatureMatching/SIFT/SIFTDescriptor.h"
 #include "FeatureMatching/FeatureDetector_498.h"
+#include "FeatureMatching/DescriptorSet.h"
+#include "FeatureMatching/FeatureCache.h"
 #include "Tools/Match.h"
+#include "Tools/Matcher.h"
 #include "ImageStitching/Stitching.h"
+#include "ImageStitching/Panorama.h"
+#include "ImageStitching/BatchPipeline.h"
+#include "ImageStitching/StreamingStitcher.h"
 
 using namespace cv;
 using namespace std;
 
-vector<Match> matchFeatures(string img1, string img2, string writeTo);
+vector<Match> matchFeatures(string img1, string img2, DescriptorSet &features1, DescriptorSet &features2, string writeTo);
 
-int main() {
-    const int numIterations = 50;
+int main(int argc, char **argv) {
+    // Panoramas listed in a manifest are stitched without any window, logging progress to stdout as JSON lines
+    if (argc > 2 && string(argv[1]) == "--batch") {
+        vector<BatchPipeline::Job> jobs;
+        string error;
+        if (!BatchPipeline::readManifest(argv[2], jobs, error)) {
+            cerr << error << endl;
+            return 1;
+        }
+
+        FeatureCache cache = FeatureCache();
+        BatchPipeline pipeline = BatchPipeline();
+        pipeline.setCache(&cache);
+        return (pipeline.run(jobs, cout) == 0) ? 0 : 1;
+    }
+
+    // Frames after --stream are taken as one continuous sequence and added to a mosaic one at a time
+    if (argc > 2 && string(argv[1]) == "--stream") {
+        StreamingStitcher stream = StreamingStitcher();
+        for (int i = 2; i < argc; i++) {
+            StreamingStitcher::FrameResult r = stream.addFrame(imread(argv[i], IMREAD_COLOR));
+            cout << argv[i] << ": " << (r.tracked ? "tracked" : "skipped") << ", " << r.inliers << "/" << r.matches
+                 << " inliers, " << r.milliseconds << " ms" << endl;
+        }
+        stream.write("results/Stitched/stream.bmp");
+        return 0;
+    }
+
+    // Images after --tiles <directory> are stitched into a disk backed canvas and saved as tiles, for panoramas too
+    // large for memory
+    if (argc > 3 && string(argv[1]) == "--tiles") {
+        string directory = argv[2];
+        FeatureCache cache = FeatureCache();
+        Panorama panorama = Panorama(vector<string>(argv + 3, argv + argc));
+        panorama.setCache(&cache);
+        panorama.setOctaves(3);
+        panorama.setCoarseToFine(true);
+        bool written = panorama.stitchTiles(directory, directory + ".canvas");
+        cout << (written ? "wrote " : "failed to write ") << directory << "/index.txt" << endl;
+        return written ? 0 : 1;
+    }
+
+    // Any images given on the command line are stitched into one panorama
+    if (argc > 1) {
+        FeatureCache cache = FeatureCache();
+        Panorama panorama = Panorama(vector<string>(argv + 1, argv + argc));
+        panorama.setCache(&cache);
+        panorama.setOctaves(3);
+        panorama.setCoarseToFine(true);
+        Mat stitched = panorama.stitch("results/Stitched/panorama.bmp");
+        cout << "stitched " << panorama.getEdges().size() << " verified pairs into " << stitched.cols << "x"
+             << stitched.rows << endl;
+        return 0;
+    }
+
+    const int numIterations = 2000;     // Upper bound, RANSAC stops adaptively
     const int threshold = 15;
     string img1 = "images/rainier/Rainier1.png";
     string img2 = "images/rainier/Rainier2.png";
@@ -26,8 +86,11 @@ int main() {
     matchFeatures(img4, img5, "results/4.png");
     matchFeatures(img5, img6, "results/5.png");*/
 
-    vector<Match> m1 = matchFeatures(img1, img2, "results/1.png");
-    Stitching s1 = Stitching(img1, img2, m1);
+    DescriptorSet f1, f2;
+    vector<Match> m1 = matchFeatures(img1, img2, f1, f2, "results/1.png");
+    Stitching s1 = Stitching(img1, img2, f1, f2, m1);
+    s1.setSampling(RansacEngine::PROSAC);
+    s1.setPreemption(RansacEngine::SPRT);
     Mat r1 = s1.RANSAC(m1.size(), numIterations, threshold, "results/RANSAC/1.bmp");
     imshow("RANSAC", r1);
     waitKey(0);
@@ -35,8 +98,10 @@ int main() {
     imshow("Stitched", o1);
     waitKey(0);
 
-    vector<Match> m2 = matchFeatures(img3, img4, "results/2.png");
-    s1 = Stitching(img3, img4, m2);
+    vector<Match> m2 = matchFeatures(img3, img4, f1, f2, "results/2.png");
+    s1 = Stitching(img3, img4, f1, f2, m2);
+    s1.setSampling(RansacEngine::PROSAC);
+    s1.setPreemption(RansacEngine::SPRT);
     Mat r2 = s1.RANSAC(m2.size(), numIterations, threshold, "results/RANSAC/2.bmp");
     imshow("RANSAC", r2);
     waitKey(0);
@@ -44,6 +109,14 @@ int main() {
     imshow("Stitched", o2);
     waitKey(0);
 
+    // Whole sequence at once, features are detected once per image
+    FeatureCache cache = FeatureCache();
+    Panorama rainier = Panorama({img1, img2, img3, img4, img5, img6});
+    rainier.setCache(&cache);
+    Mat o3 = rainier.stitch("results/Stitched/rainier.bmp");
+    imshow("Panorama", o3);
+    waitKey(0);
+
     return 0;
 }
 
@@ -52,63 +125,42 @@ int main() {
  *
  * @param img1 Starting image to detect interest points
  * @param img2 Corresponding image to detect matching interest points
- * @return Mat containing both inputs with highlighted interest points and matches
+ * @param features1 Receives the keypoints of img1
+ * @param features2 Receives the keypoints of img2
+ * @return vector<Match> index pairs into features1 and features2
  */
-vector<Match> matchFeatures(string img1, string img2, string writeTo) {
-    const double DISTANCE_THRESHOLD = 3.0;
+vector<Match> matchFeatures(string img1, string img2, DescriptorSet &features1, DescriptorSet &features2, string writeTo) {
+    // Descriptors are unit length, so SSD lies in [0, 4]
+    const float DISTANCE_THRESHOLD = 1.0;
+    const float RATIO_THRESHOLD = 0.36;
     vector<Match> matchesList = vector<Match>();
 
-    // Image 1
-    FeatureDetector_498 fd = FeatureDetector_498(img1);
-    Mat h = fd.detectFeatures();
-    vector<SIFTDescriptor> descriptions = fd.describeFeatures();
+    // Features come from the on-disk cache when an image was seen before with the same detector parameters
+    FeatureCache cache = FeatureCache();
+    cache.detect(img1, features1);
+    cache.detect(img2, features2);
+    Mat h = imread(img1, IMREAD_COLOR);
+    Mat h2 = imread(img2, IMREAD_COLOR);
 
-    // Image 2
-    FeatureDetector_498 fd2 = FeatureDetector_498(img2);
-    Mat h2 = fd2.detectFeatures();
-    vector<SIFTDescriptor> descriptions2 = fd2.describeFeatures();
+    for (size_t i = 0; i < features1.size(); i++) {
+        circle(h, Point((int) features1.getCol(i), (int) features1.getRow(i)), 4, Scalar(0, 0, 0, 255));
+    }
+    for (size_t i = 0; i < features2.size(); i++) {
+        circle(h2, Point((int) features2.getCol(i), (int) features2.getRow(i)), 4, Scalar(0, 0, 0, 255));
+    }
 
     // Concatenate two images for final display
     Mat matches = Mat::zeros(h.rows, h.cols+h2.cols, h.type());
     hconcat(h, h2, matches);
 
     // Match
-    for (size_t i = 0; i < descriptions.size(); i++) {
-        SIFTDescriptor *bestDescriptor, *secondBestDescriptor;
-        double bestMatch = DBL_MAX;
-        double secondBestMatch = DBL_MAX;
-
-        for (size_t j = 0; j < descriptions2.size(); j++) {
-            double ssd = descriptions2.at(j).SSD(descriptions.at(i));
-            if (ssd < DISTANCE_THRESHOLD) {
-                if (ssd < bestMatch) {
-                    secondBestMatch = bestMatch;
-                    bestMatch = ssd;
-                    secondBestDescriptor = bestDescriptor;
-                    bestDescriptor = &descriptions2.at(j);
-                }
-                else if (ssd < secondBestMatch) {
-                    secondBestMatch = ssd;
-                    secondBestDescriptor = &descriptions2.at(j);
-                }
-            }
-        }
-
-        // Found a match
-        if (bestMatch > 0) {
-            // Calculate ratio of two best matches
-            double ratioScore = bestMatch/secondBestMatch;
+    Matcher matcher = Matcher(DISTANCE_THRESHOLD, RATIO_THRESHOLD);
+    matchesList = matcher.match(features1, features2);
 
-            // Match is unambiguous
-            if (ratioScore < 0.005) {
-                Match m = Match(descriptions.at(i), *bestDescriptor);
-                matchesList.push_back(m);
-
-                line(matches, Point(descriptions.at(i).getFeatureCol(), descriptions.at(i).getFeatureRow()),
-                     Point(bestDescriptor->getFeatureCol()+h.cols, bestDescriptor->getFeatureRow()),
-                     Scalar(0, 175, 0, 255), 1);
-            }
-        }
+    for (const Match &m : matchesList) {
+        line(matches, Point((int) features1.getCol(m.getIndex1()), (int) features1.getRow(m.getIndex1())),
+             Point((int) features2.getCol(m.getIndex2())+h.cols, (int) features2.getRow(m.getIndex2())),
+             Scalar(0, 175, 0, 255), 1);
     }
 
     imshow("Matching Points", matches);